@@ -4,16 +4,53 @@
 #include <stdlib.h>
 #include <limits.h>
 #include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <assert.h>
+#include <pthread.h>
 #ifdef WIN64
 	#include <windows.h>
+	#include <process.h>
 #else
 	#include <sys/time.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <sys/wait.h>
+	#include <poll.h>
+	#include <signal.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <time.h>
 #endif
+#if defined(__x86_64__) || defined(__i386__)
+	#include <x86intrin.h>
+#endif
+#if defined(__AVX2__) || defined(__SSE4_1__)
+	#include <immintrin.h>
+#endif
+
+// library API, exported by the library build
+#ifdef LIBRARY
+	#define BBCHESS_BUILD
+#endif
+#include "bbchess.h"
 
 #pragma region Type Definitions
 
 #define u64 unsigned long long
 
+// state owned by each search/worker thread (board, search stack, histories, per-thread caches)
+#ifndef thread_local
+	#define thread_local _Thread_local
+#endif
+
+// pack a middlegame and an endgame score into a single integer (endgame in the upper half)
+#define make_score(mg, eg) ((int)((unsigned int)(eg) << 16) + (mg))
+
+// unpack the middlegame and endgame halves of a packed score
+#define mg_score(score) ((short)(unsigned short)(unsigned int)(score))
+#define eg_score(score) ((short)(unsigned short)((unsigned int)((score) + 0x8000) >> 16))
+
 #pragma endregion
 
 #pragma region Constants & Enumerations
@@ -86,8 +123,8 @@ int char_pieces[] = {
 
 #pragma region Random Number Generation
 
-/** Seed for random number generation. */
-unsigned int seed = 1804289383;
+/** Seed for random number generation (worker threads reseed their own copy). */
+thread_local unsigned int seed = 1804289383;
 
 /**
  * Generates a 32-bit random unsigned integer.
@@ -127,6 +164,24 @@ u64 psrandom_u64() {
 	return n1 | (n2 << 16) | (n3 << 32) | (n4 << 48);
 }
 
+/** Seed of the hash key generator. */
+u64 key_seed = 0x9E3779B97F4A7C15ULL;
+
+/**
+ * Generates a 64-bit random unsigned integer for hash keys (splitmix64). Every bit
+ * depends on the whole 64-bit state, unlike psrandom_u64 whose outputs all come
+ * from the 32-bit xorshift state and would make the keys linearly dependent.
+ * @returns A random 64-bit unsigned integer.
+ */
+u64 psrandom_key() {
+	u64 num = (key_seed += 0x9E3779B97F4A7C15ULL);
+
+	num = (num ^ (num >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	num = (num ^ (num >> 27)) * 0x94D049BB133111EBULL;
+
+	return num ^ (num >> 31);
+}
+
 #pragma endregion
 
 #pragma region Bit Manipulations
@@ -141,6 +196,10 @@ u64 psrandom_u64() {
  * @return The number of bits set in the bitboard.
  */
 static inline int count_bits(u64 bitboard) {
+#if defined(__GNUC__)
+	// a single popcnt instruction when the target ISA has it (-march=x86-64-v2 and up)
+	return __builtin_popcountll(bitboard);
+#else
 	int count = 0;
 
 	// Continuously shift the bitboard to the right until it is zero
@@ -149,6 +208,7 @@ static inline int count_bits(u64 bitboard) {
 		count++;
 	}
 	return count;
+#endif
 }
 
 /**
@@ -158,7 +218,11 @@ static inline int count_bits(u64 bitboard) {
  */
 static inline int lsb_index(u64 bitboard) {
 	if (bitboard) {
+#if defined(__GNUC__)
+		return __builtin_ctzll(bitboard);
+#else
 		return count_bits((bitboard & -bitboard) - 1);
+#endif
 	} else {
 		return -1;
 	}
@@ -209,25 +273,67 @@ void print_bitboard(u64 bitboard) {
 
 #pragma endregion
 
+#pragma region Zobrist Hashing
+
+/** Random keys for every piece on every square [piece][square]. */
+u64 piece_keys[12][64];
+
+/** Random keys for every possible en-passant square. */
+u64 enpassant_keys[64];
+
+/** Random keys for every combination of castling rights. */
+u64 castle_keys[16];
+
+/** Random key toggled whenever Black is the side to move. */
+u64 side_key;
+
+/**
+ * Initialize the random keys used to hash positions. Each position is
+ * identified by the XOR of the keys of all its features, so moves can
+ * update the hash key incrementally.
+ */
+void init_random_keys() {
+	// reset random seed
+	key_seed = 0x9E3779B97F4A7C15ULL;
+
+	// loop over pieces and squares
+	for (int piece = P; piece <= k; piece++)
+		for (int square = 0; square < 64; square++)
+			piece_keys[piece][square] = psrandom_key();
+
+	// loop over en-passant squares
+	for (int square = 0; square < 64; square++)
+		enpassant_keys[square] = psrandom_key();
+
+	// loop over castling rights combinations
+	for (int castle = 0; castle < 16; castle++)
+		castle_keys[castle] = psrandom_key();
+
+	// init side key
+	side_key = psrandom_key();
+}
+
+#pragma endregion
+
 #pragma region Chess Board Representation
 
 /**
  * Array of bitboards containing each piece's bitboard. There are 12 bitboards,
  * one for each piece and color combination.
 */
-u64 bitboards[12];
+thread_local u64 bitboards[12];
 
 /**
  * Array of bitboards containing the occupancies of the White, Black and Both color pieces, in that order.
  * Access to each occupancy by the enum { white, black, both }.
  */
-u64 occupancies[3];
+thread_local u64 occupancies[3];
 
 /** Defines who plays next (White or Black) */
-int side;
+thread_local int side;
 
 /** Stores the possible en-passant move for the next turn. */
-int open_enpassant = none;
+thread_local int open_enpassant = none;
 
 /** 
  * Castling rights. They are defined by the macros [wk = 1, wq = 2, bq = 4, bq = 8].
@@ -240,7 +346,190 @@ int open_enpassant = none;
  * 
  * This way, toggling their values can be simply done by applying logic operations with them.
  */
-int available_castlings;
+thread_local int available_castlings;
+
+/** Zobrist hash key of the current position. */
+thread_local u64 hash_key;
+
+/** Zobrist hash key of the pawns of the current position (keys the pawn structure cache). */
+thread_local u64 pawn_key;
+
+/** Unit of a piece in a material key: every piece is counted in 4 bits, P first. */
+#define material_unit(piece) (1ULL << (4 * (piece)))
+
+/** Number of pieces of a kind in a material key. */
+#define material_count(key, piece) ((int)((key) >> (4 * (piece)) & 15))
+
+/** Material key of the current position: the number of pieces of every kind (see material_unit). */
+thread_local u64 material_key;
+
+/** Halfmove clock: plies since the last capture or pawn move (fifty-move rule). */
+thread_local int fifty;
+
+/** Fullmove number, incremented after every Black move. */
+thread_local int fullmove = 1;
+
+/** Maximum number of plies of game history kept for repetition detection. */
+#define MAX_GAME_PLY 1024
+
+/**
+ * Hash keys of the positions that led to the current one, both from the game
+ * (replayed by the "position" command) and from the current search line.
+ * The key of the position reached `i` plies ago is at [repetition_index - i].
+ */
+thread_local u64 repetition_table[MAX_GAME_PLY];
+
+/** Number of keys stored in the repetition table. */
+thread_local int repetition_index;
+
+/**
+ * Material and piece-square scores merged into a single table [piece][square] of packed
+ * middlegame/endgame scores, signed from White's point of view. Initialized by init_piece_square_scores().
+ */
+int piece_square_scores[12][64];
+
+/** Index of the NNUE accumulator of the current position in the accumulator stack, -1 when not computed. */
+thread_local int accumulator_index = -1;
+
+/** Packed material and piece-square score of the current position from White's point of view, updated incrementally by make_move. */
+thread_local int psqt_score;
+
+/** Game phase contribution of every piece: minor = 1, rook = 2, queen = 4. */
+const int phase_weights[12] = { 0, 1, 1, 2, 4, 0, 0, 1, 1, 2, 4, 0 };
+
+/** Game phase of the starting position (middlegame), tapering down to 0 (endgame). */
+#define MAX_PHASE 24
+
+/** Game phase of the current position, derived from the remaining material and updated incrementally by make_move. */
+thread_local int game_phase;
+
+/**
+ * Generates the hash key of the current position from scratch.
+ * @return The Zobrist hash key of the current position.
+ */
+u64 generate_hash_key() {
+	// final hash key
+	u64 key = 0ULL;
+
+	// loop over all piece bitboards
+	for (int piece = P; piece <= k; piece++) {
+		u64 bitboard = bitboards[piece];
+
+		// hash every piece on its square
+		while (bitboard) {
+			int square = lsb_index(bitboard);
+			key ^= piece_keys[piece][square];
+			pop_bit(bitboard, square);
+		}
+	}
+
+	// hash en-passant square
+	if (open_enpassant != none)
+		key ^= enpassant_keys[open_enpassant];
+
+	// hash castling rights
+	key ^= castle_keys[available_castlings];
+
+	// hash side to move
+	if (side == black)
+		key ^= side_key;
+
+	return key;
+}
+
+/**
+ * Computes the material and piece-square score of the current position from scratch.
+ * @return The material and piece-square score from White's point of view.
+ */
+int generate_psqt_score() {
+	int score = 0;
+
+	// loop over all piece bitboards
+	for (int piece = P; piece <= k; piece++) {
+		u64 bitboard = bitboards[piece];
+
+		// score every piece on its square
+		while (bitboard) {
+			int square = lsb_index(bitboard);
+			score += piece_square_scores[piece][square];
+			pop_bit(bitboard, square);
+		}
+	}
+
+	return score;
+}
+
+/**
+ * Computes the game phase of the current position from scratch.
+ * @return The game phase (MAX_PHASE with all pieces on board, 0 with pawns and kings only).
+ */
+int generate_game_phase() {
+	int phase = 0;
+
+	// loop over all piece bitboards
+	for (int piece = P; piece <= k; piece++)
+		phase += phase_weights[piece] * count_bits(bitboards[piece]);
+
+	return phase;
+}
+
+/**
+ * Generates the pawn hash key of the current position from scratch.
+ * @return The Zobrist hash key of the pawns only.
+ */
+u64 generate_pawn_key() {
+	u64 key = 0ULL;
+
+	// loop over both pawn bitboards
+	for (int piece = P; piece <= p; piece += p - P) {
+		u64 bitboard = bitboards[piece];
+
+		while (bitboard) {
+			int square = lsb_index(bitboard);
+			key ^= piece_keys[piece][square];
+			pop_bit(bitboard, square);
+		}
+	}
+
+	return key;
+}
+
+/**
+ * Generates the material key of the current position from scratch.
+ * @return The material key.
+ */
+u64 generate_material_key() {
+	u64 key = 0ULL;
+
+	for (int piece = P; piece <= k; piece++)
+		key += count_bits(bitboards[piece]) * material_unit(piece);
+
+	return key;
+}
+
+/**
+ * Packs the pieces of the current position, in square order (a8 first) of the
+ * occupancy bitboard, as 4 bit piece codes, two per byte. parse_fen rejects
+ * positions with more than the 32 pieces that fit.
+ * @param pieces The 16 bytes to fill.
+ */
+void pack_pieces(unsigned char pieces[16]) {
+	u64 occupancy = occupancies[both];
+
+	assert(count_bits(occupancy) <= 32);
+	memset(pieces, 0, 16);
+
+	for (int count = 0; occupancy; count++) {
+		int square = lsb_index(occupancy);
+		int piece = P;
+
+		while (!get_bit(bitboards[piece], square))
+			piece++;
+
+		pieces[count / 2] |= piece << ((count & 1) * 4);
+		pop_bit(occupancy, square);
+	}
+}
 
 /** 
  * Print the chess board 
@@ -291,126 +580,11 @@ void print_board() {
 		(available_castlings & bk) ? 'k' : '-',
 		(available_castlings & bq) ? 'q' : '-'
 	);
-	printf("\n");
-}
-
-/**
- * Parses a given FEN string and initializes the board from it.
- */
-void parse_fen(char* fen) {
-	// reset board position (bitboards)
-	memset(bitboards, 0ULL, sizeof(bitboards));
-
-	// reset occupancies (bitboards)
-	memset(occupancies, 0ULL, sizeof(occupancies));
 
-	// reset game state variables
-	side = 0;
-	open_enpassant = none;
-	available_castlings = 0;
-
-	// loop over board ranks
-	for (int rank = 0; rank < 8; rank++) {
-		for (int file = 0; file < 8; file++) {
-			// initialize current square
-			int square = rank * 8 + file;
-
-			// match ascii pieces within FEN string
-			if ((*fen >= 'a' && *fen <= 'z') || (*fen >= 'A' && *fen <= 'Z')) {
-				// initialize piece type
-				int piece = char_pieces[*fen];
-
-				// set piece on corresponding bitboard
-				set_bit(bitboards[piece], square);
-
-				// increment pointer of FEN string
-				fen++;
-			}
-
-			// match empty square numbers within FEN string
-			if (*fen >= '0' && *fen <= '9') {
-				// init offset variable (convert digit char to int)
-				int offset = *fen - '0';
-
-				//define piece
-				int piece = -1;
-
-				// loop over all piece bitboards
-				for (int bb = P; bb <= k; bb++) {
-					// if there is a piece on current square
-					if (get_bit(bitboards[bb], square))
-						// get piece code
-						piece = bb;
-				}
-				
-				// on empty current square, decrement file
-				if (piece == -1)
-					file--;
-
-				// adjust file counter
-				file += offset;
-
-				// increment pointer of FEN string
-				fen++;
-			}
-
-			// match rank separator
-			if (*fen == '/') 
-				fen++;
-		}
-	}
-
-	// skip empty space in FEN string
-	fen++;
-
-	// parse side to move
-	side = (*fen == 'w') ? white : black;
-
-	// skip empty space
-	fen += 2;
-
-	// parse castling righs
-	while (*fen != ' ') {
-		switch(*fen) {
-			case 'K': available_castlings |= wk; break;
-			case 'Q': available_castlings |= wq; break;
-			case 'k': available_castlings |= bk; break;
-			case 'q': available_castlings |= bq; break;
-			case '-': break;
-		}
-		fen++;
-	}
-
-	// skip blank space
-	fen++;
-
-	// parse en-passant square
-	if (*fen != '-') {
-		// parse en-passan file and rank
-		int file = fen[0] - 'a';
-		int rank = 8 - (fen[1] - '0');
-
-		// initialize en-passant square
-		open_enpassant = rank * 8 + file;
-	}
-	else {
-		open_enpassant = none;
-	}
-
-	// initialize white occupancies
-	for (int piece = P; piece <= K; piece++) {
-		// populate white occupancy bitboard
-		occupancies[white] |= bitboards[piece];
-	}
-
-	// initialize black occupancies
-	for (int piece = p; piece <= k; piece++) {
-		// populate white occupancy bitboard
-		occupancies[black] |= bitboards[piece];
-	}
-
-	// initialize all occupancy
-	occupancies[both] = occupancies[white] | occupancies[black];
+	// print hash key and move counters
+	printf(" > Hash key: %llx\n", hash_key);
+	printf(" > Halfmove clock: %d, fullmove: %d\n", fifty, fullmove);
+	printf("\n");
 }
 
 #pragma endregion
@@ -1059,964 +1233,3762 @@ void print_attacked_squares(int side) {
 
 #pragma endregion
 
-#pragma region Board State Preservation
-
-// TODO: take thiese macros to inline funcitons
-#define save_board() 																					\
-	u64 bitboards_copy[12], occupancies_copy[3]; 														\
-	int side_copy, enpassant_copy, available_castlings_copy;											\
-	memcpy(bitboards_copy, bitboards, sizeof(bitboards)); 												\
-	memcpy(occupancies_copy, occupancies, sizeof(occupancies)); 										\
-	side_copy = side, enpassant_copy = open_enpassant, available_castlings_copy = available_castlings; 	\
-
-#define restore_board() 																				\
-	memcpy(bitboards, bitboards_copy, sizeof(bitboards_copy)); 											\
-	memcpy(occupancies, occupancies_copy, sizeof(occupancies_copy)); 									\
-	side = side_copy, open_enpassant = enpassant_copy, available_castlings = available_castlings_copy; 	\
+#pragma region FEN & EPD
 
-#pragma endregion
+/** A position as described by a FEN string, independent of the engine state. */
+typedef struct {
+	u64 bitboards[12];
+	int side;
+	int enpassant;
+	int castlings;
+	int fifty;
+	int fullmove;
+} board_position;
+
+/** Errors of the FEN and EPD parsers. */
+enum {
+	fen_ok, fen_bad_placement, fen_bad_side, fen_bad_castling, fen_bad_enpassant,
+	fen_bad_counters, fen_bad_kings, fen_bad_pawns, fen_too_many_pieces, fen_bad_check, fen_too_long
+};
 
-#pragma region Move Generation
+/** Descriptions of the FEN and EPD parser errors, by error code. */
+const char* fen_errors[] = {
+	"ok",
+	"bad piece placement",
+	"bad side to move",
+	"bad castling rights",
+	"bad en-passant square",
+	"bad move counters",
+	"each side needs exactly one king",
+	"pawns on the first or last rank",
+	"more than 32 pieces",
+	"the side not to move is in check",
+	"line too long"
+};
 
-/* Move encoding
-	Binary move representation											Hexadecimal constants
+/** Piece code + 1 of every FEN piece letter, 0 for other characters. */
+const signed char fen_pieces[256] = {
+	['P'] = P + 1, ['N'] = N + 1, ['B'] = B + 1, ['R'] = R + 1, ['Q'] = Q + 1, ['K'] = K + 1,
+	['p'] = p + 1, ['n'] = n + 1, ['b'] = b + 1, ['r'] = r + 1, ['q'] = q + 1, ['k'] = k + 1
+};
 
-	0000 0000 0000 0000 0011 1111 	source square			6 bits		0x00003F
-	0000 0000 0000 1111 1100 0000 	target square			6 bits		0x000FC0
-	0000 0000 1111 0000 0000 0000 	piece					4 bits		0x00F000
-	0000 1111 0000 0000 0000 0000 	promoted piece			4 bits		0x0F0000
-	0001 0000 0000 0000 0000 0000 	capture flag			1 bit		0x100000
-	0010 0000 0000 0000 0000 0000 	double pawn push flag	1 bit		0x200000
-	0100 0000 0000 0000 0000 0000 	enpassant flag			1 bit		0x400000
-	1000 0000 0000 0000 0000 0000 	castling flag			1 bit		0x800000
+/** Room for any FEN string written by write_fen, including the terminator. */
+#define FEN_BUFFER_SIZE 128
 
-*/
+/**
+ * Reads a non-negative decimal number.
+ * @param text The text, advanced past the digits.
+ * @param value The number.
+ * @return Whether there was a number (of at most 9 digits).
+ */
+static inline int read_number(const char** text, int* value) {
+	const char* digits = *text;
+	int number = 0;
 
-// encode move macro
-#define encode_move(source, target, piece, promoted, capture, double_pawn, enpassant, castle) \
-	(source) | 				\
-	(target << 6) | 		\
-	(piece << 12) | 		\
-	(promoted << 16) | 		\
-	(capture << 20) | 		\
-	(double_pawn << 21) |	\
-	(enpassant << 22) |		\
-	(castle << 23)
+	while (**text >= '0' && **text <= '9' && *text - digits < 9)
+		number = number * 10 + (*(*text)++ - '0');
 
-// decode move macros
-#define decode_move_source_square(move) 		((move) & 0x3F)
-#define decode_move_target_square(move) 		(((move) & 0xFC0) >> 6)
-#define decode_move_piece(move) 				(((move) & 0xF000) >> 12)
-#define decode_move_promoted_piece(move) 		(((move) & 0xF0000) >> 16)
-#define decode_move_capture(move) 				(((move) & 0x100000) >> 20)
-#define decode_move_double_pawn_push(move) 		(((move) & 0x200000) >> 21)
-#define decode_move_enpassant(move) 			(((move) & 0x400000) >> 22)
-#define decode_move_castle(move) 				(((move) & 0x800000) >> 23)
+	*value = number;
+	return *text > digits && !(**text >= '0' && **text <= '9');
+}
 
 /**
- * Move list holding all the generated moves.
+ * Determines whether a square is attacked by a side in a position (not the engine state).
+ * @param position The position.
+ * @param square The square.
+ * @param color The attacking side.
+ * @return Whether the square is attacked.
  */
-typedef struct {
-	int arr[256];
-	int last;
-} move_list;
+int position_square_attacked(const board_position* position, int square, int color) {
+	const u64* pieces = position->bitboards + ((color == white) ? P : p);
+	u64 occupancy = 0ULL;
+
+	for (int piece = P; piece <= k; piece++)
+		occupancy |= position->bitboards[piece];
+
+	return (pawn_attacks[color ^ 1][square] & pieces[P]) ||
+		(knight_attacks[square] & pieces[N]) ||
+		(get_bishop_attacks(square, occupancy) & (pieces[B] | pieces[Q])) ||
+		(get_rook_attacks(square, occupancy) & (pieces[R] | pieces[Q])) ||
+		(king_attacks[square] & pieces[K]);
+}
 
 /**
- * Adds a move to the move list.
- * @param move_list The move list to add the move to.
- * @param move The move to add.
+ * Parses and validates a FEN string (the move counters are optional, as in EPD).
+ * Nothing is printed and no engine state is changed.
+ * @param fen The FEN string.
+ * @param position The parsed position.
+ * @param end Set past the last parsed field (may be NULL).
+ * @return fen_ok or the error code (see fen_errors).
  */
-static inline void add_move(move_list* move_list, int move) {
-	move_list->arr[move_list->last++] = move;
-}
+int read_fen(const char* fen, board_position* position, const char** end) {
+	memset(position->bitboards, 0, sizeof(position->bitboards));
+	position->side = white;
+	position->enpassant = none;
+	position->castlings = 0;
+	position->fifty = 0;
+	position->fullmove = 1;
+
+	// skip leading blanks
+	while (*fen == ' ' || *fen == '\t')
+		fen++;
 
-/** Map to retrieve the promoted piece character from the promoted piece enum. */
-char promoted_pieces[] = {
-	[Q] = 'q',
-	[R] = 'r',
-	[B] = 'b',
-	[N] = 'n',
-	[q] = 'q',
-	[r] = 'r',
-	[b] = 'b',
-	[n] = 'n',
-};
+	// piece placement, from a8 to h1 (a rank ends on a "/" after exactly 8 files)
+	int square = 0, file = 0;
 
-/** 
- * Print the UCI move representation of a move.
- * @param move The move to print.
- */
-void print_uci_move(int move) {
-	printf("%s%s%c", 
-		square_to_coordinates[decode_move_source_square(move)],
-		square_to_coordinates[decode_move_target_square(move)],
-		promoted_pieces[decode_move_promoted_piece(move)]);
-}
+	while (1) {
+		unsigned char character = *fen;
 
-/**
- * Print all the moves from the move list
- * @param move_list The move list to print.
- */
-void print_move_list(move_list* move_list) {
-	// do nothing on empty move list
-	if (!move_list->last) {
-		printf("\nNo moves found in the move list.\n");
-		return;
+		if (fen_pieces[character]) {
+			if (file++ == 8)
+				return fen_bad_placement;
+
+			set_bit(position->bitboards[fen_pieces[character] - 1], square++);
+		} else if (character >= '1' && character <= '8') {
+			file += character - '0';
+			square += character - '0';
+
+			if (file > 8)
+				return fen_bad_placement;
+		} else if (character == '/') {
+			if (file != 8 || square == 64)
+				return fen_bad_placement;
+
+			file = 0;
+		} else
+			break;
+
+		fen++;
 	}
 
+	if (square != 64 || file != 8)
+		return fen_bad_placement;
 
-	printf("\nmove\tpiece\tcapture\tdouble\tenpass\tcastling\n\n");
+	// side to move
+	if (fen[0] != ' ' || (fen[1] != 'w' && fen[1] != 'b'))
+		return fen_bad_side;
 
-	//loop over the moves in the move list
-	for (int move_count = 0; move_count < move_list->last; move_count++) {
-		int move = move_list->arr[move_count];
-		#ifdef WIN64
-			printf("%s%s%c\t%c\t%d\t%d\t%d\t\t%d\n", 
-				square_to_coordinates[decode_move_source_square(move)],
-				square_to_coordinates[decode_move_target_square(move)],
-				promoted_pieces[decode_move_promoted_piece(move)],
-				ascii_pieces[decode_move_piece(move)],
-				decode_move_capture(move),
-				decode_move_double_pawn_push(move),
-				decode_move_enpassant(move),
-				decode_move_castle(move));
-		#else
-			printf("%s%s%c\t%s\t%d\t%d\t%d\t%d\n", 
-				square_to_coordinates[decode_move_source_square(move)],
-				square_to_coordinates[decode_move_target_square(move)],
-				promoted_pieces[decode_move_promoted_piece(move)],
-				unicode_pieces[decode_move_piece(move)],
-				decode_move_capture(move),
-				decode_move_double_pawn_push(move),
-				decode_move_enpassant(move),
-				decode_move_castle(move));
-		#endif
+	position->side = (fen[1] == 'w') ? white : black;
+	fen += 2;
+
+	if (*fen++ != ' ')
+		return fen_bad_castling;
+
+	// castling rights, each at most once
+	if (*fen == '-')
+		fen++;
+	else {
+		while (*fen && *fen != ' ') {
+			int right;
+
+			switch (*fen++) {
+				case 'K': right = wk; break;
+				case 'Q': right = wq; break;
+				case 'k': right = bk; break;
+				case 'q': right = bq; break;
+				default: return fen_bad_castling;
+			}
+
+			if (position->castlings & right)
+				return fen_bad_castling;
+
+			position->castlings |= right;
+		}
 
+		if (!position->castlings)
+			return fen_bad_castling;
 	}
 
-	// print the move count in the move list
-	printf("\nMove count: %d\n", move_list->last);
-}
+	if (*fen++ != ' ')
+		return fen_bad_enpassant;
 
-/**
- * Returns a bitboard containing all the squares attacked by a piece on a given square.
- * @param piece The piece to check.
- * @param square The square to check.
- * @return The bitboard containing all the attacked squares.
- */
-static inline u64 attacks_for_piece(int piece, int source_square) {
-	u64 attacks;
-	switch (piece) {
-		case N: case n:
-			attacks = knight_attacks[source_square] & ((side == white) ? ~occupancies[white] : ~occupancies[black]);
-			break;
-		case B: case b:
-			attacks = get_bishop_attacks(source_square, occupancies[both]) & ((side == white) ? ~occupancies[white] : ~occupancies[black]);
-			break;
-		case R: case r:
-			attacks = get_rook_attacks(source_square, occupancies[both]) & ((side == white) ? ~occupancies[white] : ~occupancies[black]);
-			break;
-		case Q: case q:
-			attacks = get_queen_attacks(source_square, occupancies[both]) & ((side == white) ? ~occupancies[white] : ~occupancies[black]);
-			break;
-		case K: case k:
-			attacks = king_attacks[source_square] & ((side == white) ? ~occupancies[white] : ~occupancies[black]);
-			break;
+	// en-passant square, on the 6th rank with White to move, on the 3rd with Black to move
+	if (*fen == '-')
+		fen++;
+	else {
+		if (fen[0] < 'a' || fen[0] > 'h' || fen[1] != ((position->side == white) ? '6' : '3'))
+			return fen_bad_enpassant;
+
+		position->enpassant = (8 - (fen[1] - '0')) * 8 + (fen[0] - 'a');
+		fen += 2;
+
+		// the pawn that just made the double push must be there
+		int pawn_square = position->enpassant + ((position->side == white) ? 8 : -8);
+
+		if (!get_bit(position->bitboards[(position->side == white) ? p : P], pawn_square))
+			return fen_bad_enpassant;
 	}
 
-	return attacks;
+	if (*fen && *fen != ' ' && *fen != ';' && *fen != '\r' && *fen != '\n')
+		return fen_bad_enpassant;
+
+	// optional halfmove clock and fullmove number
+	if (fen[0] == ' ' && fen[1] >= '0' && fen[1] <= '9') {
+		fen++;
+
+		if (!read_number(&fen, &position->fifty))
+			return fen_bad_counters;
+
+		if (fen[0] == ' ' && fen[1] >= '0' && fen[1] <= '9') {
+			fen++;
+
+			if (!read_number(&fen, &position->fullmove))
+				return fen_bad_counters;
+
+			if (position->fullmove < 1)
+				position->fullmove = 1;
+		}
+	}
+
+	if (end)
+		*end = fen;
+
+	// exactly one king per side
+	if (count_bits(position->bitboards[K]) != 1 || count_bits(position->bitboards[k]) != 1)
+		return fen_bad_kings;
+
+	// no pawns on the first or the last rank
+	if ((position->bitboards[P] | position->bitboards[p]) & 0xFF000000000000FFULL)
+		return fen_bad_pawns;
+
+	// at most 32 pieces (training records pack that many)
+	int piece_count = 0;
+
+	for (int piece = P; piece <= k; piece++)
+		piece_count += count_bits(position->bitboards[piece]);
+
+	if (piece_count > 32)
+		return fen_too_many_pieces;
+
+	// castling rights need the king and the rook on their original squares
+	const u64* pieces = position->bitboards;
+
+	if (((position->castlings & wk) && !(get_bit(pieces[K], e1) && get_bit(pieces[R], h1))) ||
+			((position->castlings & wq) && !(get_bit(pieces[K], e1) && get_bit(pieces[R], a1))) ||
+			((position->castlings & bk) && !(get_bit(pieces[k], e8) && get_bit(pieces[r], h8))) ||
+			((position->castlings & bq) && !(get_bit(pieces[k], e8) && get_bit(pieces[r], a8))))
+		return fen_bad_castling;
+
+	// the king of the side not to move can not be in check
+	int king_square = lsb_index(pieces[(position->side == white) ? k : K]);
+
+	if (position_square_attacked(position, king_square, position->side))
+		return fen_bad_check;
+
+	return fen_ok;
 }
 
 /**
- * Generates all the moves for a given piece given a bitboard of said piece, and adds them to the move list.
- * @param move_list Move list to add the moves to, if any.
- * @param piece The piece to generate the moves for.
- * @param bitboard The bitboard of the given piece.
+ * Writes a position as a FEN string.
+ * @param position The position.
+ * @param buffer The output, at least FEN_BUFFER_SIZE characters.
+ * @return The length of the FEN string.
  */
-static inline void generate_moves_for_piece(move_list* _move_list, int piece, u64 bitboard) {
-	// initialize source and target squares
-	int source_square, target_square;
+int write_fen(const board_position* position, char* buffer) {
+	char* output = buffer;
 
-	// loop over bitboard for source squares
-	while (bitboard) {
-		source_square = lsb_index(bitboard);
+	// piece placement, from the 8th rank to the 1st
+	for (int rank = 0; rank < 8; rank++) {
+		int empty = 0;
 
-		// initialize piece attacks
-		u64 attacks = attacks_for_piece(piece, source_square);
+		for (int file = 0; file < 8; file++) {
+			int square = rank * 8 + file;
+			int piece = -1;
 
-		// loop over attacks bitboard for target squares
-		while (attacks) {
-			// initialize target square
-			target_square = lsb_index(attacks);
+			for (int candidate = P; candidate <= k; candidate++)
+				if (get_bit(position->bitboards[candidate], square))
+					piece = candidate;
 
-			// quiet move
-			if (!get_bit(((side == white) ? occupancies[black] : occupancies[white]), target_square)) {
-				add_move(_move_list, encode_move(source_square, target_square, piece, 0, 0, 0, 0, 0));
-			} 
-			// capture
-			else {
-				add_move(_move_list, encode_move(source_square, target_square, piece, 0, 1, 0, 0, 0));
+			if (piece == -1) {
+				empty++;
+				continue;
 			}
 
-			// pop last target square (attacks lsb)
-			pop_bit(attacks, target_square);
+			if (empty)
+				*output++ = '0' + empty;
+
+			*output++ = ascii_pieces[piece];
+			empty = 0;
 		}
 
-		// pop last source square (bitboards lsb)
-		pop_bit(bitboard, source_square);
+		if (empty)
+			*output++ = '0' + empty;
+
+		if (rank < 7)
+			*output++ = '/';
 	}
+
+	// side to move
+	*output++ = ' ';
+	*output++ = (position->side == white) ? 'w' : 'b';
+	*output++ = ' ';
+
+	// castling rights
+	if (!position->castlings)
+		*output++ = '-';
+
+	if (position->castlings & wk) *output++ = 'K';
+	if (position->castlings & wq) *output++ = 'Q';
+	if (position->castlings & bk) *output++ = 'k';
+	if (position->castlings & bq) *output++ = 'q';
+
+	// en-passant square and move counters
+	output += sprintf(output, " %s %d %d",
+		(position->enpassant != none) ? square_to_coordinates[position->enpassant] : "-",
+		position->fifty, position->fullmove);
+
+	return (int)(output - buffer);
 }
 
 /**
- * Generates all pawn specific moves given the pawn bitboard, and adds them to the move list.
- * @param move_list Move list to add the moves to, if any.
- * @param pawn The pawn to generate the moves for.
- * @param bitboard The pawn bitboard.
+ * Sets the engine state (of the calling thread) to a position, clearing the game history.
+ * @param position The position.
  */
-static inline void generate_pawn_moves(move_list* _move_list, int pawn, u64 bitboard) {
-	int queen 		= (side == white) ? Q : q;
-	int rook 		= (side == white) ? R : r;
-	int bishop 		= (side == white) ? B : b;
-	int knight 		= (side == white) ? N : n;
-	int opponent 	= (side == white) ? black : white;
-	
-	while (bitboard) {
-		int source_square = lsb_index(bitboard);
-		int target_square = (side == white) ? 
-			source_square - 8 : 
-			source_square + 8 ;
+void load_position(const board_position* position) {
+	memcpy(bitboards, position->bitboards, sizeof(bitboards));
+	side = position->side;
+	open_enpassant = position->enpassant;
+	available_castlings = position->castlings;
+	fifty = position->fifty;
+	fullmove = position->fullmove;
 
-		// quiet pawn moves
-		if ((side == white) ? 
-				!(target_square < a8) && !get_bit(occupancies[both], target_square) :
-				!(target_square > h1) && !get_bit(occupancies[both], target_square)) {
-			// handle promotions
-			if ((side == white) ?
-					(source_square >= a7 && source_square <= h7) :
-					(source_square >= a2 && source_square <= h2)) {
-				add_move(_move_list, encode_move(source_square, target_square, pawn, queen,  0, 0, 0, 0));
-				add_move(_move_list, encode_move(source_square, target_square, pawn, rook,   0, 0, 0, 0));
-				add_move(_move_list, encode_move(source_square, target_square, pawn, bishop, 0, 0, 0, 0));
-				add_move(_move_list, encode_move(source_square, target_square, pawn, knight, 0, 0, 0, 0));
-			} else {
-				// handle single pawn move
-				add_move(_move_list, encode_move(source_square, target_square, pawn, 0, 0, 0, 0, 0));
-
-				//handle double pawn push
-				if ((side == white) ?
-						(source_square >= a2 && source_square <= h2) && !get_bit(occupancies[both], target_square -= 8) :
-						(source_square >= a7 && source_square <= h7) && !get_bit(occupancies[both], target_square += 8) ) {
-					add_move(_move_list, encode_move(source_square, target_square, pawn, 0, 0, 1, 0, 0));
-				}
-			}
-		}
-
-		// pawn captures
-		u64 attacks = pawn_attacks[side][source_square] & occupancies[opponent];
+	// initialize occupancies
+	memset(occupancies, 0ULL, sizeof(occupancies));
 
-		while (attacks) {
-			target_square = lsb_index(attacks);
+	for (int piece = P; piece <= K; piece++)
+		occupancies[white] |= bitboards[piece];
 
-			// handle promotion captures
-			if ((side == white) ?
-					(source_square >= a7 && source_square <= h7) :
-					(source_square >= a2 && source_square <= h2)) {
-				add_move(_move_list, encode_move(source_square, target_square, pawn, queen,  1, 0, 0, 0));
-				add_move(_move_list, encode_move(source_square, target_square, pawn, rook,   1, 0, 0, 0));
-				add_move(_move_list, encode_move(source_square, target_square, pawn, bishop, 1, 0, 0, 0));
-				add_move(_move_list, encode_move(source_square, target_square, pawn, knight, 1, 0, 0, 0));
-			} 
-			// handle regular pawn captures
-			else {
-				add_move(_move_list, encode_move(source_square, target_square, pawn, 0, 1, 0, 0, 0));
-			}
+	for (int piece = p; piece <= k; piece++)
+		occupancies[black] |= bitboards[piece];
 
-			// pop last tried attack
-			pop_bit(attacks, target_square);
-		}
+	occupancies[both] = occupancies[white] | occupancies[black];
 
-		// handle en-passant capture
-		if (open_enpassant != none) {
-			u64 open_enpassant_attack = pawn_attacks[side][source_square] & (1ULL << open_enpassant);
+	// initialize hash key and clear game history
+	hash_key = generate_hash_key();
+	pawn_key = generate_pawn_key();
+	material_key = generate_material_key();
+	repetition_index = 0;
 
-			// make sure en-passant is available
-			if (open_enpassant_attack) {
-				target_square = lsb_index(open_enpassant_attack);
-				add_move(_move_list, encode_move(source_square, target_square, pawn, 0, 1, 0, 1, 0));
-			}
-		}
+	// initialize incremental evaluation
+	psqt_score = generate_psqt_score();
+	game_phase = generate_game_phase();
 
-		// pop last tried initial position from bitboard
-		pop_bit(bitboard, source_square);
-	}
+	// the NNUE accumulator is refreshed when a search starts
+	accumulator_index = -1;
 }
 
 /**
- * Generates all caslting moves for the given king.
- * @param move_list Move list to add the moves to, if any.
- * @param pawn The king to generate the castlings for.
- * @param bitboard The king bitboard.
+ * Gets the position of the engine state (of the calling thread).
+ * @param position The position.
  */
-static inline void genreate_castling_moves(move_list* _move_list, int king, u64 bitboard) {
-	int king_side_castle	 	= available_castlings & ((side == white) ? wk : bk);
-	int queen_side_castle	 	= available_castlings & ((side == white) ? wq : bq);
-	int king_side_connected  	= (side == white) ?
-		!get_bit(occupancies[both], f1) && !get_bit(occupancies[both], g1) :
-		!get_bit(occupancies[both], f8) && !get_bit(occupancies[both], g8);
-	int queen_side_connected 	= (side == white) ?
-		!get_bit(occupancies[both], d1) && !get_bit(occupancies[both], c1) && !get_bit(occupancies[both], b1) :
-		!get_bit(occupancies[both], d8) && !get_bit(occupancies[both], c8) && !get_bit(occupancies[both], b8);
-	int no_king_side_checks  	= (side == white) ?
-		!is_square_attacked(e1, black) && !is_square_attacked(f1, black) :
-		!is_square_attacked(e8, white) && !is_square_attacked(f8, white);
-	int no_queen_side_checks 	= (side == white) ?
-		!is_square_attacked(e1, black) && !is_square_attacked(d1, black) :
-		!is_square_attacked(e8, white) && !is_square_attacked(d8, white);
-	int source_square 			= (side == white) ? e1 : e8;
-	int ks_target_square 		= (side == white) ? g1 : g8;
-	int qs_target_square		= (side == white) ? c1 : c8;
-
-	// handle king-side castling
-	if (king_side_castle && king_side_connected && no_king_side_checks) {
-		add_move(_move_list, encode_move(source_square, ks_target_square, king, 0, 0, 0, 0, 1));
-	}
-	//handle queen-side castling
-	if (queen_side_castle && queen_side_connected && no_queen_side_checks) {
-		add_move(_move_list, encode_move(source_square, qs_target_square, king, 0, 0, 0, 0, 1));
-	}
+void save_position(board_position* position) {
+	memcpy(position->bitboards, bitboards, sizeof(bitboards));
+	position->side = side;
+	position->enpassant = open_enpassant;
+	position->castlings = available_castlings;
+	position->fifty = fifty;
+	position->fullmove = fullmove;
 }
 
 /**
- * Generate all pseudo legal moves for the given side.
- * @param _move_list Move list to add the generated moves to, if any.
+ * Parses a given FEN string and initializes the board from it. An invalid
+ * FEN string leaves the board unchanged.
+ * @param fen The FEN string.
+ * @return fen_ok or the error code (see fen_errors).
  */
-static inline void generate_moves(move_list* _move_list) {
-	// init move count
-	_move_list->last = 0;
-
-	int source_square, target_square;
-	u64 attacks;
-
-	// loop over all bitboards
-	for (int piece = P; piece <= k; piece++) {
-		// initialize piece bitboard copy
-		u64 bitboard = bitboards[piece];
-
-		// generate pawn moves
-		if ((side == white) ? piece == P : piece == p)
-			generate_pawn_moves(_move_list, piece, bitboard);
+int parse_fen(const char* fen) {
+	board_position position;
+	int error = read_fen(fen, &position, NULL);
 
-		// generate knight moves
-		if ((side == white) ? piece == N : piece == n)
-			generate_moves_for_piece(_move_list, piece, bitboard);
+	if (error == fen_ok)
+		load_position(&position);
 
-		// generate bishop moves
-		if ((side == white) ? piece == B : piece == b)
-			generate_moves_for_piece(_move_list, piece, bitboard);
+	return error;
+}
 
-		// generate rook moves
-		if ((side == white) ? piece == R : piece == r)
-			generate_moves_for_piece(_move_list, piece, bitboard);
+/** Maximum depth of the perft results ("D<n>" operations) of an EPD record. */
+#define EPD_MAX_PERFT 15
 
-		// generate queen moves
-		if ((side == white) ? piece == Q : piece == q)
-			generate_moves_for_piece(_move_list, piece, bitboard);
+/** Maximum number of operations of an EPD record. */
+#define EPD_MAX_OPERATIONS 16
 
-		// generate king moves
-		if ((side == white) ? piece == K : piece == k) {
-			generate_moves_for_piece(_move_list, piece, bitboard);
-			genreate_castling_moves(_move_list, piece, bitboard);
-		}
-	}
-}
+/** Size of the line buffer of the EPD reader, which bounds the length of a line. */
+#define EPD_LINE_SIZE (1 << 20)
 
-// enum to determine if the search will be done by all moves or only the captures
-enum { all_moves, only_captures };
+/** A piece of text inside a buffer or a mapped file (not terminated). */
+typedef struct {
+	const char* text;
+	int length;
+} text_span;
 
-// caslting rights
-const int castling_rights[64] = {
-	 7, 15, 15, 15,  3, 15, 15, 11,
-	15, 15, 15, 15, 15, 15, 15, 15,
-	15, 15, 15, 15, 15, 15, 15, 15,
-	15, 15, 15, 15, 15, 15, 15, 15,
-	15, 15, 15, 15, 15, 15, 15, 15,
-	15, 15, 15, 15, 15, 15, 15, 15,
-	15, 15, 15, 15, 15, 15, 15, 15,
-	13, 15, 15, 15, 12, 15, 15, 14
-};
+/** An operation of an EPD record: opcode and operands. */
+typedef struct {
+	text_span opcode;
+	text_span operands;
+} epd_operation;
 
 /**
- * Performs a move on the board, if legal.
- * @param move The move to perform.
- * @param move_flag Whether to perform all moves or only captures.
- * @return Whether the move was legal.
+ * A record of an EPD file. The texts point into the line buffer of the reader and
+ * remain valid until the next record is read.
  */
-static inline int make_move(int move, int moves_flag) {
-	// quiet moves
-	if (moves_flag == all_moves) {
-		// preserve the board state
-		save_board();
+typedef struct {
+	int error;									// fen_ok or the error code of the line
+	long line;									// line number in the file
+	board_position position;
+	text_span id;								// "id" operand, without quotes
+	text_span best_moves;						// "bm" operands (SAN moves separated by spaces)
+	text_span avoid_moves;						// "am" operands (SAN moves separated by spaces)
+	long long perft[EPD_MAX_PERFT + 1];			// node count of "D<n>" at index n, -1 if absent
+	int perft_depth;							// deepest "D<n>" operation, 0 for none
+	int operation_count;
+	epd_operation operations[EPD_MAX_OPERATIONS];	// all operations, in order
+} epd_record;
 
-		// decode move
-		int source_square = decode_move_source_square(move);
-		int target_square = decode_move_target_square(move);
-		int piece = decode_move_piece(move);
-		int promoted_piece = decode_move_promoted_piece(move);
-		int capture_flag = decode_move_capture(move);
-		int double_pawn_push_flag = decode_move_double_pawn_push(move);
-		int enpassant_flag = decode_move_enpassant(move);
-		int castling_flag = decode_move_castle(move);
+/**
+ * Parses the operations of an EPD line (";"-terminated "opcode operands" pairs).
+ * @param text The operations, terminated.
+ * @param record The record.
+ */
+void parse_epd_operations(const char* text, epd_record* record) {
+	while (*text) {
+		// skip separators
+		if (*text == ' ' || *text == '\t' || *text == ';') {
+			text++;
+			continue;
+		}
 
-		// move piece
-		pop_bit(bitboards[piece], source_square);
-		set_bit(bitboards[piece], target_square);
+		// opcode
+		const char* opcode = text;
 
-		// handle captures
-		if (capture_flag) {
-			// pick bitboards ranges depending on side
-			// int start_piece = (side == white) ? p : P;
-			// int end_piece = (side == white) ? k : K;
-			int start_piece, end_piece;
+		while (*text && *text != ' ' && *text != '\t' && *text != ';')
+			text++;
 
-			if (side == white) {
-				start_piece = p;
-				end_piece = k;
-			} else {
-				start_piece = P;
-				end_piece = K;
-			}
+		int opcode_length = (int)(text - opcode);
 
-			// loop over bitboards opposite to the side to move
-			for (int opp_piece = start_piece; opp_piece <= end_piece; opp_piece++) {
-				// if there´s a piece on the target square, pop that bit and break
-				if (get_bit(bitboards[opp_piece], target_square)) {
-					pop_bit(bitboards[opp_piece], target_square);
-					break;
-				}
-			}
-		}
+		while (*text == ' ' || *text == '\t')
+			text++;
 
-		// handle pawn promotions
-		if (promoted_piece) {
-			// pop the pawn and set the piece into the appropriate bitboards
-			pop_bit(bitboards[(side == white) ? P : p], target_square);
-			set_bit(bitboards[promoted_piece], target_square);
-		}
+		// operands, up to the ";" outside of quotes
+		const char* operands = text;
+		int quoted = 0;
 
-		// hanld en-passant captures
-		if (enpassant_flag) {
-			(side == white) ? 
-				pop_bit(bitboards[p], target_square + 8) : 
-				pop_bit(bitboards[P], target_square - 8);
+		while (*text && (quoted || *text != ';')) {
+			quoted ^= (*text == '"');
+			text++;
 		}
 
-		// clear open en-passant
-		open_enpassant = none;
+		int operands_length = (int)(text - operands);
 
-		// handle double pawn pushes
-		if (double_pawn_push_flag) {
-			open_enpassant = (side == white) ? 
-				target_square + 8 : 
-				target_square - 8;
-		}
+		while (operands_length && (operands[operands_length - 1] == ' ' || operands[operands_length - 1] == '\t'))
+			operands_length--;
 
-		// handle castlings
-		if (castling_flag) {
-			switch (target_square) {
-				case g1:
-					pop_bit(bitboards[R], h1);
-					set_bit(bitboards[R], f1);
-					break;
-				case c1:
-					pop_bit(bitboards[R], a1);
-					set_bit(bitboards[R], d1);
-					break;
-				case g8:
-					pop_bit(bitboards[r], h8);
-					set_bit(bitboards[r], f8);
-					break;
-				case c8:
-					pop_bit(bitboards[r], a8);
-					set_bit(bitboards[r], d8);
-					break;
-			}
-		}
+		text_span value = { operands, operands_length };
 
-		// update castling rights
-		available_castlings &= castling_rights[source_square];
-		available_castlings &= castling_rights[target_square];
+		// strip the quotes of string operands
+		if (value.length >= 2 && value.text[0] == '"' && value.text[value.length - 1] == '"')
+			value = (text_span){ value.text + 1, value.length - 2 };
 
-		// reset occupancies
-		memset(occupancies, 0ULL, sizeof(occupancies));
+		if (record->operation_count < EPD_MAX_OPERATIONS)
+			record->operations[record->operation_count++] = (epd_operation){ { opcode, opcode_length }, value };
 
-		// loop over pieces to set occupancies and update afterwards
-		for (int piece = P; piece <= K; piece++)
-			occupancies[white] |= bitboards[piece];
+		// well known opcodes
+		if (opcode_length == 2 && strncmp(opcode, "id", 2) == 0)
+			record->id = value;
+		else if (opcode_length == 2 && strncmp(opcode, "bm", 2) == 0)
+			record->best_moves = value;
+		else if (opcode_length == 2 && strncmp(opcode, "am", 2) == 0)
+			record->avoid_moves = value;
+		else if (opcode[0] == 'D' && opcode_length >= 2 && opcode[1] >= '1' && opcode[1] <= '9') {
+			// perft result, "D<depth> <nodes>"
+			const char* digits = opcode + 1;
+			int depth;
 
-		for (int piece = p; piece <= k; piece++)
-			occupancies[black] |= bitboards[piece];
-			
-		occupancies[both] |= occupancies[white];
-		occupancies[both] |= occupancies[black];
+			if (read_number(&digits, &depth) && digits == opcode + opcode_length && depth <= EPD_MAX_PERFT) {
+				long long count = 0;
 
-		// change side (this is done with an XOR with 1 because white = 00 and black = 01 in binary)
-		side ^= 1;
+				for (int i = 0; i < value.length && value.text[i] >= '0' && value.text[i] <= '9'; i++)
+					count = count * 10 + (value.text[i] - '0');
 
-		// check if the king is not being exposed into check
-		if (is_square_attacked(
-				((side == white) ? 
-					lsb_index(bitboards[k]) : 
-					lsb_index(bitboards[K])),
-				side)) {
-			// move is illegal
-			restore_board();
+				record->perft[depth] = count;
 
-			// return illegal move
-			return 0;
-		} else {
-			// return legal move
-			return 1;
-		}
-	}
-	// capture moves
-	else {
-		// check if the move is a capture
-		if (decode_move_capture(move)) {
-			make_move(move, all_moves);
+				if (depth > record->perft_depth)
+					record->perft_depth = depth;
+			}
 		}
-		// If the move is not a capture, don´t make the move
-		else
-			return 0;
 	}
 }
 
-#pragma endregion
-
-#pragma region Magic Numbers
-
 /**
- * Generates a magic number candidate.
- * @returns A magic number candidate.
+ * Parses a line of an EPD file: the position, then the operations. Empty lines and
+ * "#" comments hold no record.
+ * @param text The line, terminated (without the new line).
+ * @param line The line number.
+ * @param record The record; check its error, invalid lines are returned too.
+ * @return Whether the line holds a record.
  */
-u64 generate_magic_number() {
-	return psrandom_u64() & psrandom_u64() & psrandom_u64();
-}
+int parse_epd_line(const char* text, long line, epd_record* record) {
+	while (*text == ' ' || *text == '\t')
+		text++;
 
-/** 
- * Find an appropriate magic number for either a bishop or a rook, given its square
- * and the relevant bits of the occupancy bitboard.
- * @param square The square of the piece.
- * @param relevant_bits The relevant bits of the occupancy bitboard.
- * @param bishop Whether the piece is a bishop or a rook. On usage, use the macro value bishop or rook.
- * @returns The generated magic number.
- */
-u64 find_magic_number(int square, int relevant_bits, int bishop) {
-	// initialize occupancies
-	u64 occupancies[4096];
+	if (!*text || *text == '#')
+		return 0;
 
-	// initialize attack tables
-	u64 attacks[4096];
+	record->line = line;
+	record->id = record->best_moves = record->avoid_moves = (text_span){ NULL, 0 };
+	record->perft_depth = 0;
+	record->operation_count = 0;
 
-	// initialize used attacks
-	u64 used_attacks[4096];
+	for (int depth = 0; depth <= EPD_MAX_PERFT; depth++)
+		record->perft[depth] = -1;
 
-	// initialize attack mask for current piece
-	u64 attack_mask = bishop ? mask_bishop_attacks(square) : mask_rook_attacks(square);
+	record->error = read_fen(text, &record->position, &text);
 
-	// init occupancy indices
-	int occupancy_indices = 1 << relevant_bits;
+	if (record->error == fen_ok)
+		parse_epd_operations(text, record);
 
-	// loop over occupancy indices
-	for (int index = 0; index < occupancy_indices; index++) {
-		// initialize occupancies
-		occupancies[index] = set_occupancy(index, relevant_bits, attack_mask);
+	return 1;
+}
 
-		// initialize attacks
-		attacks[index] = bishop ? bishop_attacks_on_the_go(square, occupancies[index]) : 
-									rook_attacks_on_the_go(square, occupancies[index]);
-	}
+#pragma endregion
 
-	// test magic numbers
-	for (int random_count = 0; random_count < 100000000; random_count++) {
-		// generate magic number candidate
-		u64 magic_number = generate_magic_number();
+#pragma region Move Encoding
 
-		// skip inappropriate magic numbers
-		if (count_bits((attack_mask * magic_number) & 0xFF00000000000000) < 6) continue;
+/* Move encoding
+	Binary move representation											Hexadecimal constants
 
-		// init used attacks
-		memset(used_attacks, 0ULL, sizeof(used_attacks));
+	0000 0000 0000 0000 0011 1111 	source square			6 bits		0x00003F
+	0000 0000 0000 1111 1100 0000 	target square			6 bits		0x000FC0
+	0000 0000 1111 0000 0000 0000 	piece					4 bits		0x00F000
+	0000 1111 0000 0000 0000 0000 	promoted piece			4 bits		0x0F0000
+	0001 0000 0000 0000 0000 0000 	capture flag			1 bit		0x100000
+	0010 0000 0000 0000 0000 0000 	double pawn push flag	1 bit		0x200000
+	0100 0000 0000 0000 0000 0000 	enpassant flag			1 bit		0x400000
+	1000 0000 0000 0000 0000 0000 	castling flag			1 bit		0x800000
 
-		// init index and fail flag
-		int index, fail;
+*/
 
-		// text magic index loop
-        for (index = 0, fail = 0; !fail && index < occupancy_indices; index++)
-        {
-            // init magic index
-            int magic_index = (int)((occupancies[index] * magic_number) >> (64 - relevant_bits));
-            
-            // if magic index works
-            if (used_attacks[magic_index] == 0ULL)
-                // init used attacks
-                used_attacks[magic_index] = attacks[index];
-            
-            // otherwise
-            else if (used_attacks[magic_index] != attacks[index])
-                // magic index doesn't work
-                fail = 1;
-        }
+// encode move macro
+#define encode_move(source, target, piece, promoted, capture, double_pawn, enpassant, castle) \
+	(source) | 				\
+	(target << 6) | 		\
+	(piece << 12) | 		\
+	(promoted << 16) | 		\
+	(capture << 20) | 		\
+	(double_pawn << 21) |	\
+	(enpassant << 22) |		\
+	(castle << 23)
 
-		// if magic number works return it
-		if (!fail) return magic_number;
-	}
-
-	printf("MAGIC NUMBERS NOT FOUND!\n");
-	return 0ULL;
-}
-
-/** 
- * Initialize magic numbers for bishops and rooks.
- */
-void init_magic_numbers() {
-	for (int square = 0; square < 64; square++) {
-		// init bishop magic numbers
-		bishop_magic_numbers[square] = find_magic_number(square, bishop_relevant_bits[square], bishop);
-	}
-	for (int square = 0; square < 64; square++) {
-		// init rook magic numbers
-		rook_magic_numbers[square] = find_magic_number(square, rook_relevant_bits[square], rook);
-	}
-}
+// decode move macros
+#define decode_move_source_square(move) 		((move) & 0x3F)
+#define decode_move_target_square(move) 		(((move) & 0xFC0) >> 6)
+#define decode_move_piece(move) 				(((move) & 0xF000) >> 12)
+#define decode_move_promoted_piece(move) 		(((move) & 0xF0000) >> 16)
+#define decode_move_capture(move) 				(((move) & 0x100000) >> 20)
+#define decode_move_double_pawn_push(move) 		(((move) & 0x200000) >> 21)
+#define decode_move_enpassant(move) 			(((move) & 0x400000) >> 22)
+#define decode_move_castle(move) 				(((move) & 0x800000) >> 23)
 
 #pragma endregion
 
-#pragma region Initialize All
+#pragma region File Mapping
 
 /**
- * Itialize all necessary data structures.
+ * Memory maps a whole file, read only.
+ * @param path The path of the file.
+ * @param size Set to the size of the file.
+ * @return The mapping, NULL if the file could not be mapped (or is empty).
  */
-void init_all() {
-	// initialize leaper pieces attacks table
-	init_leapers_attacks();
+void* map_file(const char* path, size_t* size) {
+	void* data;
 
-	// initialize slider pieces attacks
-	init_sliders_attacks(bishop);
-	init_sliders_attacks(rook);
+	*size = 0;
 
-	/// NOTE: this initialization was made in order to get the values for the magic numbers,
-	/// it is nor needed anymore as now the magic numbers are precomputed and hardcoded
-	/// for intantaneous initialization of the magic numbers.
+#ifdef WIN64
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
 
-	// magic number initialization
-	// init_magic_numbers();
-}
+	if (file == INVALID_HANDLE_VALUE)
+		return NULL;
 
-#pragma endregion
+	LARGE_INTEGER file_size;
+	GetFileSizeEx(file, &file_size);
 
-#pragma region Performace Testing
+	HANDLE mapping = (file_size.QuadPart > 0) ? CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+	CloseHandle(file);
 
-/**
- * Returns the current time in milliseconds.
- */
-int get_time_millis() {
-#ifdef WIN64
-	return GetTickCount();
+	if (mapping == NULL)
+		return NULL;
+
+	data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping);
+
+	if (data == NULL)
+		return NULL;
+
+	*size = (size_t)file_size.QuadPart;
 #else
-	struct timeval time_val;
-	gettimeofday(&time_val, NULL);
-	return time_val.tv_sec * 1000 + time_val.tv_usec / 1000;
-#endif
-}
+	int file = open(path, O_RDONLY);
 
-/** Leaf nodes (number of positions reached during the last test of te move generator for a given depth) */
-long nodes;
+	if (file < 0)
+		return NULL;
 
-/**
- * Perft debugging function to walk the move generation tree
- * of strictly legal moves to count all the leaf nodes at a
- * certain depth, which can be compared to predetermined
- * values and used to isolate bugs.
- * @param depth Maximum depth of the tree to count the leafs from.
- */
-static inline void perft_driver(int depth) {
-	// recursion escape condition
-	if (depth == 0) {
-		// increment nodes count (count reached positions)
-		nodes++;
-		return;
-	}
+	struct stat file_stat;
 
-	// create move list and populate it
-	move_list _move_list[1];
-	generate_moves(_move_list);
+	if (fstat(file, &file_stat) < 0 || file_stat.st_size <= 0) {
+		close(file);
+		return NULL;
+	}
 
-	// loop over generated moves
-	for (int i = 0; i < _move_list->last; i++) {
-		// preserve board state
-		save_board();
+	data = mmap(NULL, (size_t)file_stat.st_size, PROT_READ, MAP_SHARED, file, 0);
+	close(file);
 
-		// make move
-		if (!make_move(_move_list->arr[i], all_moves)) 
-			continue;
+	if (data == MAP_FAILED)
+		return NULL;
 
-		// call perft driver recursively
-		perft_driver(depth - 1);
+	*size = (size_t)file_stat.st_size;
+#endif
 
-		// restore board state
-		restore_board();
-	}
+	return data;
 }
 
 /**
- * Performance test function to test the efficiency and 
- * accuracy of the engine.
- * @param depth Maximum depth of search to perform the test.
+ * Unmaps a file mapped with map_file.
+ * @param data The mapping.
+ * @param size The size of the file.
  */
-void perft_test(int depth) {
-	printf("\n - Performance test - \n");
+void unmap_file(void* data, size_t size) {
+#ifdef WIN64
+	UnmapViewOfFile(data);
+#else
+	munmap(data, size);
+#endif
+}
 
+#pragma endregion
 
-	// create move list and populate it
-	move_list _move_list[1];
-	generate_moves(_move_list);
+#pragma region NNUE
 
-	int start_time = get_time_millis();
+/*
+	NNUE (efficiently updatable neural network) evaluation, HalfKA layout
+
+	inputs			every (own king square, piece, square) triple seen from each side's
+					perspective: 64 x 12 x 64 = 49152 binary features per perspective
+	hidden layer	256 int16 neurons per perspective (the accumulator), updated
+					incrementally by make_move from the features a move adds and removes
+	output layer	both perspectives' neurons (side to move first) clipped to [0, 127],
+					dot int8 weights plus an int32 bias, scaled to centipawns
+
+	Network file (little endian, memory mapped)
+
+	header			64 bytes: "BBNN", version, input count, hidden size (uint32), zero padding
+	hidden biases	int16[256]
+	hidden weights	int16[49152][256]
+	output weights	int8[512]
+	output bias		int32
+*/
 
-	// loop over generated moves
-	for (int i = 0; i < _move_list->last; i++) {
-		// preserve board state
-		save_board();
+#define NNUE_INPUTS 49152
+#define NNUE_HIDDEN 256
+#define NNUE_VERSION 1
+#define NNUE_HEADER_SIZE 64
 
-		int move = _move_list->arr[i];
+// clipped ReLU upper bound, output weights scale and centipawn scale of the network output
+#define NNUE_CLIP 127
+#define NNUE_WEIGHT_SCALE 64
+#define NNUE_OUTPUT_SCALE 400
 
-		// make move
-		if (!make_move(move, all_moves)) 
-			continue;
+/** Number of accumulators in the (circular) accumulator stack, larger than MAX_PLY. */
+#define ACCUMULATOR_STACK_SIZE 256
 
-		// cummulative nodes
-		long prev_nodes = nodes;
+/** Hidden layer values of both perspectives [perspective][neuron]. */
+typedef struct {
+	_Alignas(64) int16_t values[2][NNUE_HIDDEN];
+} accumulator;
 
-		// call perft driver recursively
-		perft_driver(depth - 1);
+/** Accumulators of the positions along the current line, indexed by accumulator_index. */
+thread_local accumulator accumulator_stack[ACCUMULATOR_STACK_SIZE];
 
-		long curr_nodes = nodes - prev_nodes;
+/** Network parameters, pointing into the memory mapped network file. */
+const int16_t* nnue_hidden_biases;
+const int16_t* nnue_hidden_weights;
+const int8_t* nnue_output_weights;
+int32_t nnue_output_bias;
 
-		// restore board state
-		restore_board();
+/** Memory mapping of the network file. */
+void* nnue_mapping = NULL;
+size_t nnue_mapping_size = 0;
 
-		// print the move
-		printf(" move: ");
-		print_uci_move(move);
-		printf("     node: %ld\n", curr_nodes);
-	}
+/** Whether a network is loaded. */
+int nnue_loaded = 0;
 
-	int elapsed = get_time_millis() - start_time;
+/** Whether the search evaluates with the network instead of the classic evaluation. */
+int use_nnue = 0;
 
-	// print results
-	printf("\n   - Stats - \n");
-	printf(  "   depth:      %d\n", depth);
-	printf(  "   nodes:      %ld\n", nodes);
-	printf(  "   elapsed t:  %d\n", elapsed);
+/**
+ * Unmaps the currently loaded network, if any.
+ */
+void unload_nnue() {
+	if (nnue_mapping)
+		unmap_file(nnue_mapping, nnue_mapping_size);
+
+	nnue_mapping = NULL;
+	nnue_mapping_size = 0;
+	nnue_loaded = 0;
+	use_nnue = 0;
 }
 
-#pragma endregion
+/**
+ * Memory maps a network file and validates its header and size.
+ * @param path The path of the network file.
+ * @return Whether the network was loaded.
+ */
+int load_nnue(const char* path) {
+	unload_nnue();
 
-#pragma region Evaluation
+	size_t size;
+	void* data = map_file(path, &size);
 
-int material_score[12] = {
-	   100,	// white pawn
-	   300,	// white knight
-	   350,	// white bishop
-	   500,	// white rook
-	  1000,	// white queen
-	 10000, // white king
-	  -100, // black pawn
-	  -300,	// black knight
-	  -350,	// black bishop
-	  -500,	// black rook
-	 -1000,	// black queen
-	-10000,	// black king
-};
+	if (data == NULL)
+		return 0;
 
-const int pawn_scores[64] = {
-	90, 90, 90, 90, 90, 90, 90, 90,
-	30, 30, 30, 40, 40, 30, 30, 30,
-	20, 20, 20, 30, 30, 30, 20, 20,
-	10, 10, 10, 20, 20, 10, 10, 10,
-	 5,  5, 10, 20, 20,  5,  5,  5,
-	 0,  0,  0,  5,  5,  0,  0,  0,
-	 0,  0,  0,-10,-10,  0,  0,  0,
-	 0,  0,  0,  0,  0,  0,  0,  0
-};
+	nnue_mapping = data;
+	nnue_mapping_size = size;
 
-const int knight_scores[64] = {
-	-5,  0,  0,  0,  0,  0,  0, -5,
-	-5,  0,  0, 10, 10,  0,  0, -5,
-	-5,  5, 20, 20, 20, 20,  5, -5,
-	-5, 10, 20, 30, 30, 20, 10, -5,
-	-5, 10, 20, 30, 30, 20, 10, -5,
-	-5,  5, 20, 10, 10, 20,  5, -5,
-	-5,  0,  0,  0,  0,  0,  0, -5,
-	-5,-10,  0,  0,  0,  0,-10, -5
-};
+	// validate header and size
+	const unsigned char* bytes = data;
+	uint32_t header[4];
 
-const int bishop_scores[64] = {
-	 0,  0,  0,  0,  0,  0,  0,  0,
-	 0,  0,  0,  0,  0,  0,  0,  0,
-	 0,  0,  0, 10, 10,  0,  0,  0,
-	 0,  0, 10, 20, 20, 10,  0,  0,
-	 0,  0, 10, 20, 20, 10,  0,  0,
-	 0, 10,  0,  0,  0,  0, 10,  0,
-	 0, 30,  0,  0,  0,  0, 30,  0,
-	 0,  0,-10,  0,  0,-10,  0,  0,
-};
+	size_t expected_size = NNUE_HEADER_SIZE
+		+ NNUE_HIDDEN * sizeof(int16_t)
+		+ (size_t)NNUE_INPUTS * NNUE_HIDDEN * sizeof(int16_t)
+		+ 2 * NNUE_HIDDEN * sizeof(int8_t)
+		+ sizeof(int32_t);
 
-const int rook_scores[64] = {
-	50, 50, 50, 50, 50, 50, 50, 50,
-	50, 50, 50, 50, 50, 50, 50, 50,
-	 0,  0, 10, 20, 20, 10,  0,  0,
-	 0,  0, 10, 20, 20, 10,  0,  0,
-	 0,  0, 10, 20, 20, 10,  0,  0,
-	 0,  0, 10, 20, 20, 10,  0,  0,
-	 0,  0, 10, 20, 20, 10,  0,  0,
-	 0,  0,  0, 20, 20,  0,  0,  0,
-};
+	if (size != expected_size) {
+		unload_nnue();
+		return 0;
+	}
 
-const int king_scores[64] = {
-	 0,  0,  0,  0,  0,  0,  0,  0,
-	 0,  0,  5,  5,  5,  5,  0,  0,
-	 0,  5,  5, 10, 10,  5,  5,  0,
-	 0,  5, 10, 20, 20, 10,  5,  0,
-	 0,  5, 10, 20, 20, 10,  5,  0,
-	 0,  0,  5, 10, 10,  5,  0,  0,
-	 0,  5,  5, -5, -5,  0,  5,  0,
-	 0,  0,  5,  0,-15,  0, 10,  0,
-};
+	memcpy(header, bytes, sizeof(header));
 
-const int mirror_square[128] = {
-	a1, b1, c1, d1, e1, f1, g1, h1,
-	a2, b2, c2, d2, e2, f2, g2, h2,
-	a3, b3, c3, d3, e3, f3, g3, h3,
-	a4, b4, c4, d4, e4, f4, g4, h4,
-	a5, b5, c5, d5, e5, f5, g5, h5,
-	a6, b6, c6, d6, e6, f6, g6, h6,
-	a7, b7, c7, d7, e7, f7, g7, h7,
-	a8, b8, c8, d8, e8, f8, g8, h8
-};
+	if (memcmp(bytes, "BBNN", 4) || header[1] != NNUE_VERSION || header[2] != NNUE_INPUTS || header[3] != NNUE_HIDDEN) {
+		unload_nnue();
+		return 0;
+	}
+
+	// point parameters into the mapping
+	bytes += NNUE_HEADER_SIZE;
+	nnue_hidden_biases = (const int16_t*)bytes;
+	bytes += NNUE_HIDDEN * sizeof(int16_t);
+	nnue_hidden_weights = (const int16_t*)bytes;
+	bytes += (size_t)NNUE_INPUTS * NNUE_HIDDEN * sizeof(int16_t);
+	nnue_output_weights = (const int8_t*)bytes;
+	bytes += 2 * NNUE_HIDDEN * sizeof(int8_t);
+	memcpy(&nnue_output_bias, bytes, sizeof(int32_t));
+
+	nnue_loaded = 1;
+	return 1;
+}
 
 /**
- * Evaluate the position of the board.
- * @return The score of the position.
+ * Computes the index of an input feature.
+ * @param perspective The side whose point of view the feature is seen from.
+ * @param king_square The square of that side's king.
+ * @param piece The piece.
+ * @param square The square of the piece.
+ * @return The feature index.
  */
-static inline int evaluate() {
-	// static evaluation score
-	int score = 0;
+static inline int nnue_feature(int perspective, int king_square, int piece, int square) {
+	// Black sees the board flipped vertically and with colors swapped
+	if (perspective == black) {
+		king_square ^= 56;
+		square ^= 56;
+		piece = (piece < p) ? piece + p : piece - p;
+	}
 
-	// current pieces bitboard copy
-	u64 bitboard;
+	return (king_square * 12 + piece) * 64 + square;
+}
 
-	int piece, square;
+/**
+ * Adds the weights of an input feature to a perspective of an accumulator.
+ * @param values The accumulator values of one perspective.
+ * @param feature The feature to add.
+ */
+static inline void nnue_add_feature(int16_t* values, int feature) {
+	const int16_t* weights = &nnue_hidden_weights[(size_t)feature * NNUE_HIDDEN];
 
-	// loop over all piece bitboards
-	for (int bb_piece = P; bb_piece <= k; bb_piece++) {
-		// initialize piece bitboard copy
-		bitboard = bitboards[bb_piece];
+#if defined(__AVX2__)
+	for (int i = 0; i < NNUE_HIDDEN; i += 16) {
+		__m256i sum = _mm256_add_epi16(_mm256_load_si256((__m256i*)&values[i]), _mm256_loadu_si256((const __m256i*)&weights[i]));
+		_mm256_store_si256((__m256i*)&values[i], sum);
+	}
+#elif defined(__SSE4_1__)
+	for (int i = 0; i < NNUE_HIDDEN; i += 8) {
+		__m128i sum = _mm_add_epi16(_mm_load_si128((__m128i*)&values[i]), _mm_loadu_si128((const __m128i*)&weights[i]));
+		_mm_store_si128((__m128i*)&values[i], sum);
+	}
+#else
+	for (int i = 0; i < NNUE_HIDDEN; i++)
+		values[i] += weights[i];
+#endif
+}
 
-		// loop over all pieces within a bitboard
-		while (bitboard) {
-			piece = bb_piece;
-			square = lsb_index(bitboard);
-
-			// evaluate material weight
-			score += material_score[piece];
-
-			// score positional piece scores
-			switch (piece) {
-				case P: score += pawn_scores[square]; 					break;
-				case N: score += knight_scores[square]; 				break;
-				case B: score += bishop_scores[square]; 				break;
-				case R: score += rook_scores[square]; 					break;
-				case K: score += king_scores[square]; 					break;
-
-				case p: score -= pawn_scores[mirror_square[square]]; 	break;
-				case n: score -= knight_scores[mirror_square[square]]; 	break;
-				case b: score -= bishop_scores[mirror_square[square]]; 	break;
-				case r: score -= rook_scores[mirror_square[square]]; 	break;
-				case k: score -= king_scores[mirror_square[square]]; 	break;
-			}
+/**
+ * Subtracts the weights of an input feature from a perspective of an accumulator.
+ * @param values The accumulator values of one perspective.
+ * @param feature The feature to subtract.
+ */
+static inline void nnue_sub_feature(int16_t* values, int feature) {
+	const int16_t* weights = &nnue_hidden_weights[(size_t)feature * NNUE_HIDDEN];
 
-			// pop lsb
+#if defined(__AVX2__)
+	for (int i = 0; i < NNUE_HIDDEN; i += 16) {
+		__m256i difference = _mm256_sub_epi16(_mm256_load_si256((__m256i*)&values[i]), _mm256_loadu_si256((const __m256i*)&weights[i]));
+		_mm256_store_si256((__m256i*)&values[i], difference);
+	}
+#elif defined(__SSE4_1__)
+	for (int i = 0; i < NNUE_HIDDEN; i += 8) {
+		__m128i difference = _mm_sub_epi16(_mm_load_si128((__m128i*)&values[i]), _mm_loadu_si128((const __m128i*)&weights[i]));
+		_mm_store_si128((__m128i*)&values[i], difference);
+	}
+#else
+	for (int i = 0; i < NNUE_HIDDEN; i++)
+		values[i] -= weights[i];
+#endif
+}
+
+/**
+ * Computes one perspective of an accumulator from scratch.
+ * @param acc The accumulator to compute.
+ * @param perspective The perspective to compute.
+ */
+void nnue_refresh_perspective(accumulator* acc, int perspective) {
+	int king_square = lsb_index(bitboards[(perspective == white) ? K : k]);
+
+	// start from the biases
+	memcpy(acc->values[perspective], nnue_hidden_biases, NNUE_HIDDEN * sizeof(int16_t));
+
+	// add every piece on board
+	for (int piece = P; piece <= k; piece++) {
+		u64 bitboard = bitboards[piece];
+
+		while (bitboard) {
+			int square = lsb_index(bitboard);
+			nnue_add_feature(acc->values[perspective], nnue_feature(perspective, king_square, piece, square));
 			pop_bit(bitboard, square);
 		}
 	}
+}
 
-	// return the final evaluation based on side
-	return (side == white) ? score : -score;
+/**
+ * Computes the accumulator of the current position from scratch and makes it
+ * the bottom of the accumulator stack.
+ */
+void nnue_refresh_accumulator() {
+	accumulator_index = 0;
+	nnue_refresh_perspective(&accumulator_stack[0], white);
+	nnue_refresh_perspective(&accumulator_stack[0], black);
 }
 
-#pragma endregion
+/**
+ * Pushes the accumulator of the position after a move onto the accumulator stack,
+ * updated from the parent accumulator with the features the move adds and removes.
+ * A perspective whose king moved is recomputed, since all its features change.
+ * The board must already reflect the move.
+ * @param move The move that was made.
+ * @param captured_piece The piece captured on the target square, or -1.
+ */
+static inline void nnue_update_accumulator(int move, int captured_piece) {
+	accumulator* parent = &accumulator_stack[accumulator_index];
+	accumulator_index = (accumulator_index + 1) & (ACCUMULATOR_STACK_SIZE - 1);
+	accumulator* acc = &accumulator_stack[accumulator_index];
+
+	int source_square = decode_move_source_square(move);
+	int target_square = decode_move_target_square(move);
+	int piece = decode_move_piece(move);
+	int promoted_piece = decode_move_promoted_piece(move);
+	int color = (piece < p) ? white : black;
+
+	// loop over both perspectives
+	for (int perspective = white; perspective <= black; perspective++) {
+		// own king moved: every feature of this perspective changes
+		if (piece == ((perspective == white) ? K : k)) {
+			nnue_refresh_perspective(acc, perspective);
+			continue;
+		}
 
-#pragma region Search
+		int king_square = lsb_index(bitboards[(perspective == white) ? K : k]);
+		int16_t* values = acc->values[perspective];
 
-// most valuable victim & less valuable attacker
+		memcpy(values, parent->values[perspective], NNUE_HIDDEN * sizeof(int16_t));
 
-/*
-                          
-    (Victims) Pawn Knight Bishop   Rook  Queen   King
-  (Attackers)
-        Pawn   105    205    305    405    505    605
-      Knight   104    204    304    404    504    604
-      Bishop   103    203    303    403    503    603
-        Rook   102    202    302    402    502    602
-       Queen   101    201    301    401    501    601
-        King   100    200    300    400    500    600
-*/
-static int mvv_lva[12][12] = {
- 	105, 205, 305, 405, 505, 605,  105, 205, 305, 405, 505, 605,
-	104, 204, 304, 404, 504, 604,  104, 204, 304, 404, 504, 604,
-	103, 203, 303, 403, 503, 603,  103, 203, 303, 403, 503, 603,
-	102, 202, 302, 402, 502, 602,  102, 202, 302, 402, 502, 602,
-	101, 201, 301, 401, 501, 601,  101, 201, 301, 401, 501, 601,
-	100, 200, 300, 400, 500, 600,  100, 200, 300, 400, 500, 600,
+		// moving piece leaves the source square and lands (maybe promoted) on the target square
+		nnue_sub_feature(values, nnue_feature(perspective, king_square, piece, source_square));
+		nnue_add_feature(values, nnue_feature(perspective, king_square, promoted_piece ? promoted_piece : piece, target_square));
 
-	105, 205, 305, 405, 505, 605,  105, 205, 305, 405, 505, 605,
-	104, 204, 304, 404, 504, 604,  104, 204, 304, 404, 504, 604,
-	103, 203, 303, 403, 503, 603,  103, 203, 303, 403, 503, 603,
-	102, 202, 302, 402, 502, 602,  102, 202, 302, 402, 502, 602,
-	101, 201, 301, 401, 501, 601,  101, 201, 301, 401, 501, 601,
-	100, 200, 300, 400, 500, 600,  100, 200, 300, 400, 500, 600
-};
+		// captured piece
+		if (captured_piece >= 0)
+			nnue_sub_feature(values, nnue_feature(perspective, king_square, captured_piece, target_square));
 
-// killer moves [id][ply]
-int killer_moves[2][64];
+		// en-passant captured pawn
+		if (decode_move_enpassant(move))
+			nnue_sub_feature(values, nnue_feature(perspective, king_square,
+				(color == white) ? p : P, (color == white) ? target_square + 8 : target_square - 8));
+	}
 
-// history moves [piece][square]
-int history_moves[12][64];
+	// castling moves the rook too (the king moved, so only the opponent's perspective is incremental)
+	if (decode_move_castle(move)) {
+		int rook = (color == white) ? R : r;
+		int rook_source = (target_square == g1) ? h1 : (target_square == c1) ? a1 : (target_square == g8) ? h8 : a8;
+		int rook_target = (target_square == g1) ? f1 : (target_square == c1) ? d1 : (target_square == g8) ? f8 : d8;
+		int perspective = color ^ 1;
+		int king_square = lsb_index(bitboards[(perspective == white) ? K : k]);
 
-// half move counter
-int ply;
+		nnue_sub_feature(acc->values[perspective], nnue_feature(perspective, king_square, rook, rook_source));
+		nnue_add_feature(acc->values[perspective], nnue_feature(perspective, king_square, rook, rook_target));
+	}
+}
 
-// best move. This will be replace for the PV (Principal Variation)
-int best_move;
+/**
+ * Computes the output of the network from the clipped hidden neurons of both perspectives.
+ * @param us The hidden neurons of the side to move.
+ * @param them The hidden neurons of the other side.
+ * @return The raw network output.
+ */
+static inline int nnue_output(const int16_t* us, const int16_t* them) {
+	int sum = 0;
+
+#if defined(__AVX2__)
+	__m256i sums = _mm256_setzero_si256();
+	const __m256i clip = _mm256_set1_epi16(NNUE_CLIP);
+	const __m256i ones = _mm256_set1_epi16(1);
+
+	for (int perspective = 0; perspective < 2; perspective++) {
+		const int16_t* input = perspective ? them : us;
+		const int8_t* weights = &nnue_output_weights[perspective * NNUE_HIDDEN];
+
+		for (int i = 0; i < NNUE_HIDDEN; i += 32) {
+			// clip to [0, 127] (the lower bound comes from the unsigned saturating pack)
+			__m256i low = _mm256_min_epi16(_mm256_load_si256((const __m256i*)&input[i]), clip);
+			__m256i high = _mm256_min_epi16(_mm256_load_si256((const __m256i*)&input[i + 16]), clip);
+			__m256i activations = _mm256_permute4x64_epi64(_mm256_packus_epi16(low, high), 0xD8);
+
+			// uint8 x int8 products, summed in pairs and then widened to int32
+			__m256i products = _mm256_maddubs_epi16(activations, _mm256_loadu_si256((const __m256i*)&weights[i]));
+			sums = _mm256_add_epi32(sums, _mm256_madd_epi16(products, ones));
+		}
+	}
 
-static inline int score_move(int move) {
-	// score capture move
-	if (decode_move_capture(move)) {
-        // init target piece
-        int target_piece = P;
+	__m128i half = _mm_add_epi32(_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1));
+	half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0x4E));
+	half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0xB1));
+	sum = _mm_cvtsi128_si32(half);
+#elif defined(__SSE4_1__)
+	__m128i sums = _mm_setzero_si128();
+	const __m128i clip = _mm_set1_epi16(NNUE_CLIP);
+	const __m128i ones = _mm_set1_epi16(1);
+
+	for (int perspective = 0; perspective < 2; perspective++) {
+		const int16_t* input = perspective ? them : us;
+		const int8_t* weights = &nnue_output_weights[perspective * NNUE_HIDDEN];
+
+		for (int i = 0; i < NNUE_HIDDEN; i += 16) {
+			// clip to [0, 127] (the lower bound comes from the unsigned saturating pack)
+			__m128i low = _mm_min_epi16(_mm_load_si128((const __m128i*)&input[i]), clip);
+			__m128i high = _mm_min_epi16(_mm_load_si128((const __m128i*)&input[i + 8]), clip);
+			__m128i activations = _mm_packus_epi16(low, high);
+
+			// uint8 x int8 products, summed in pairs and then widened to int32
+			__m128i products = _mm_maddubs_epi16(activations, _mm_loadu_si128((const __m128i*)&weights[i]));
+			sums = _mm_add_epi32(sums, _mm_madd_epi16(products, ones));
+		}
+	}
 
-        // pick up bitboard piece index ranges depending on side
-        int start_piece, end_piece;
+	sums = _mm_add_epi32(sums, _mm_shuffle_epi32(sums, 0x4E));
+	sums = _mm_add_epi32(sums, _mm_shuffle_epi32(sums, 0xB1));
+	sum = _mm_cvtsi128_si32(sums);
+#else
+	for (int perspective = 0; perspective < 2; perspective++) {
+		const int16_t* input = perspective ? them : us;
+		const int8_t* weights = &nnue_output_weights[perspective * NNUE_HIDDEN];
 
-        // pick up side to move
-        if (side == white) { start_piece = p; end_piece = k; }
-        else { start_piece = P; end_piece = K; }
+		for (int i = 0; i < NNUE_HIDDEN; i++) {
+			int activation = (input[i] < 0) ? 0 : (input[i] > NNUE_CLIP) ? NNUE_CLIP : input[i];
+			sum += activation * weights[i];
+		}
+	}
+#endif
 
-        // loop over bitboards opposite to the current side to move
-        for (int bb_piece = start_piece; bb_piece <= end_piece; bb_piece++)
-        {
-            // if there's a piece on the target square
+	return sum;
+}
+
+/**
+ * Checks the incremental accumulator of the current position against a full recompute.
+ * @return Whether the accumulator is up to date.
+ */
+int nnue_accumulator_is_valid() {
+	static thread_local accumulator fresh;
+
+	nnue_refresh_perspective(&fresh, white);
+	nnue_refresh_perspective(&fresh, black);
+
+	return memcmp(fresh.values, accumulator_stack[accumulator_index].values, sizeof(fresh.values)) == 0;
+}
+
+/**
+ * Evaluate the current position with the network.
+ * @return The score of the position from the side to move point of view.
+ */
+static inline int evaluate_nnue() {
+	// the incremental accumulator must always match a full recompute
+	assert(nnue_accumulator_is_valid());
+
+	accumulator* acc = &accumulator_stack[accumulator_index];
+	int output = nnue_output(acc->values[side], acc->values[side ^ 1]);
+
+	return (output + nnue_output_bias) * NNUE_OUTPUT_SCALE / (NNUE_CLIP * NNUE_WEIGHT_SCALE);
+}
+
+#pragma endregion
+
+#pragma region Search Statistics
+
+/*
+ * Hot path counters of the search. They only exist in builds with SEARCH_STATS
+ * defined (make stats), otherwise the macros below compile to nothing.
+ */
+
+/** Maximum number of iterative deepening iterations with recorded node counts. */
+#define STATS_ITERATIONS 128
+
+#ifdef SEARCH_STATS
+
+/** Counters of one search (per thread). */
+typedef struct {
+	long main_nodes;						// nodes of the main search
+	long quiescence_nodes;					// nodes of the quiescence search
+	long moves_made;						// pseudo legal moves given to make_move
+	long illegal_moves;						// pseudo legal moves rejected by make_move
+	long beta_cutoffs;						// beta cutoffs in the main search
+	long first_move_cutoffs;				// beta cutoffs caused by the first legal move
+	long futile_nodes;						// frontier nodes where futility pruning applies
+	long futility_prunes;					// quiet moves skipped by futility pruning
+	long check_extensions;					// nodes extended because the side to move is in check
+	long pawn_hash_probes, pawn_hash_hits;	// pawn structure cache
+	long eval_cache_probes, eval_cache_hits;// evaluation cache
+	int iterations;							// completed iterative deepening iterations
+	long iteration_nodes[STATS_ITERATIONS];	// nodes searched by every iteration
+	u64 search_cycles;						// cycles of the whole search
+	u64 movegen_cycles;						// cycles generating moves and attack maps
+	u64 ordering_cycles;					// cycles sorting moves
+	u64 eval_cycles;						// cycles computing static evaluations
+} search_statistics;
+
+/** Statistics of the current (or last) search of this thread. */
+thread_local search_statistics stats;
+
+#define stats_add(counter, value) (stats.counter += (value))
+#define stats_start_timer(timer) u64 timer = read_cycle_counter()
+#define stats_stop_timer(counter, timer) (stats.counter += read_cycle_counter() - (timer))
+#define stats_clear() memset(&stats, 0, sizeof(stats))
+
+#else
+
+#define stats_add(counter, value) ((void)0)
+#define stats_start_timer(timer) ((void)0)
+#define stats_stop_timer(counter, timer) ((void)0)
+#define stats_clear() ((void)0)
+
+#endif
+
+#pragma endregion
+
+#pragma region Board State Preservation
+
+// TODO: take thiese macros to inline funcitons
+#define save_board() 																					\
+	u64 bitboards_copy[12], occupancies_copy[3], hash_key_copy;											\
+	int side_copy, enpassant_copy, available_castlings_copy, fifty_copy, fullmove_copy;				\
+	memcpy(bitboards_copy, bitboards, sizeof(bitboards)); 												\
+	memcpy(occupancies_copy, occupancies, sizeof(occupancies)); 										\
+	side_copy = side, enpassant_copy = open_enpassant, available_castlings_copy = available_castlings; 	\
+	hash_key_copy = hash_key, fifty_copy = fifty, fullmove_copy = fullmove;								\
+	int psqt_score_copy = psqt_score, game_phase_copy = game_phase;										\
+	u64 pawn_key_copy = pawn_key, material_key_copy = material_key;									\
+	int accumulator_index_copy = accumulator_index;														\
+
+#define restore_board() 																				\
+	memcpy(bitboards, bitboards_copy, sizeof(bitboards_copy)); 											\
+	memcpy(occupancies, occupancies_copy, sizeof(occupancies_copy)); 									\
+	side = side_copy, open_enpassant = enpassant_copy, available_castlings = available_castlings_copy; 	\
+	hash_key = hash_key_copy, fifty = fifty_copy, fullmove = fullmove_copy;								\
+	psqt_score = psqt_score_copy, game_phase = game_phase_copy;											\
+	pawn_key = pawn_key_copy, material_key = material_key_copy;										\
+	accumulator_index = accumulator_index_copy;															\
+
+#pragma endregion
+
+#pragma region Move Generation
+
+/**
+ * Move list holding all the generated moves.
+ */
+typedef struct {
+	int arr[256];
+	int last;
+} move_list;
+
+/**
+ * Adds a move to the move list.
+ * @param move_list The move list to add the move to.
+ * @param move The move to add.
+ */
+static inline void add_move(move_list* move_list, int move) {
+	move_list->arr[move_list->last++] = move;
+}
+
+/** Map to retrieve the promoted piece character from the promoted piece enum. */
+char promoted_pieces[] = {
+	[Q] = 'q',
+	[R] = 'r',
+	[B] = 'b',
+	[N] = 'n',
+	[q] = 'q',
+	[r] = 'r',
+	[b] = 'b',
+	[n] = 'n',
+};
+
+/** 
+ * Print the UCI move representation of a move.
+ * @param move The move to print.
+ */
+void print_uci_move(int move) {
+	printf("%s%s%c", 
+		square_to_coordinates[decode_move_source_square(move)],
+		square_to_coordinates[decode_move_target_square(move)],
+		promoted_pieces[decode_move_promoted_piece(move)]);
+}
+
+/**
+ * Print all the moves from the move list
+ * @param move_list The move list to print.
+ */
+void print_move_list(move_list* move_list) {
+	// do nothing on empty move list
+	if (!move_list->last) {
+		printf("\nNo moves found in the move list.\n");
+		return;
+	}
+
+
+	printf("\nmove\tpiece\tcapture\tdouble\tenpass\tcastling\n\n");
+
+	//loop over the moves in the move list
+	for (int move_count = 0; move_count < move_list->last; move_count++) {
+		int move = move_list->arr[move_count];
+		#ifdef WIN64
+			printf("%s%s%c\t%c\t%d\t%d\t%d\t\t%d\n", 
+				square_to_coordinates[decode_move_source_square(move)],
+				square_to_coordinates[decode_move_target_square(move)],
+				promoted_pieces[decode_move_promoted_piece(move)],
+				ascii_pieces[decode_move_piece(move)],
+				decode_move_capture(move),
+				decode_move_double_pawn_push(move),
+				decode_move_enpassant(move),
+				decode_move_castle(move));
+		#else
+			printf("%s%s%c\t%s\t%d\t%d\t%d\t%d\n", 
+				square_to_coordinates[decode_move_source_square(move)],
+				square_to_coordinates[decode_move_target_square(move)],
+				promoted_pieces[decode_move_promoted_piece(move)],
+				unicode_pieces[decode_move_piece(move)],
+				decode_move_capture(move),
+				decode_move_double_pawn_push(move),
+				decode_move_enpassant(move),
+				decode_move_castle(move));
+		#endif
+
+	}
+
+	// print the move count in the move list
+	printf("\nMove count: %d\n", move_list->last);
+}
+
+/**
+ * Returns a bitboard containing all the squares attacked by a piece on a given square.
+ * @param piece The piece to check.
+ * @param square The square to check.
+ * @return The bitboard containing all the attacked squares.
+ */
+static inline u64 attacks_for_piece(int piece, int source_square) {
+	u64 attacks;
+	switch (piece) {
+		case N: case n:
+			attacks = knight_attacks[source_square] & ((side == white) ? ~occupancies[white] : ~occupancies[black]);
+			break;
+		case B: case b:
+			attacks = get_bishop_attacks(source_square, occupancies[both]) & ((side == white) ? ~occupancies[white] : ~occupancies[black]);
+			break;
+		case R: case r:
+			attacks = get_rook_attacks(source_square, occupancies[both]) & ((side == white) ? ~occupancies[white] : ~occupancies[black]);
+			break;
+		case Q: case q:
+			attacks = get_queen_attacks(source_square, occupancies[both]) & ((side == white) ? ~occupancies[white] : ~occupancies[black]);
+			break;
+		case K: case k:
+			attacks = king_attacks[source_square] & ((side == white) ? ~occupancies[white] : ~occupancies[black]);
+			break;
+	}
+
+	return attacks;
+}
+
+/**
+ * Generates all the moves for a given piece given a bitboard of said piece, and adds them to the move list.
+ * @param move_list Move list to add the moves to, if any.
+ * @param piece The piece to generate the moves for.
+ * @param bitboard The bitboard of the given piece.
+ */
+static inline void generate_moves_for_piece(move_list* _move_list, int piece, u64 bitboard) {
+	// initialize source and target squares
+	int source_square, target_square;
+
+	// loop over bitboard for source squares
+	while (bitboard) {
+		source_square = lsb_index(bitboard);
+
+		// initialize piece attacks
+		u64 attacks = attacks_for_piece(piece, source_square);
+
+		// loop over attacks bitboard for target squares
+		while (attacks) {
+			// initialize target square
+			target_square = lsb_index(attacks);
+
+			// quiet move
+			if (!get_bit(((side == white) ? occupancies[black] : occupancies[white]), target_square)) {
+				add_move(_move_list, encode_move(source_square, target_square, piece, 0, 0, 0, 0, 0));
+			} 
+			// capture
+			else {
+				add_move(_move_list, encode_move(source_square, target_square, piece, 0, 1, 0, 0, 0));
+			}
+
+			// pop last target square (attacks lsb)
+			pop_bit(attacks, target_square);
+		}
+
+		// pop last source square (bitboards lsb)
+		pop_bit(bitboard, source_square);
+	}
+}
+
+/**
+ * Generates all pawn specific moves given the pawn bitboard, and adds them to the move list.
+ * @param move_list Move list to add the moves to, if any.
+ * @param pawn The pawn to generate the moves for.
+ * @param bitboard The pawn bitboard.
+ */
+static inline void generate_pawn_moves(move_list* _move_list, int pawn, u64 bitboard) {
+	int queen 		= (side == white) ? Q : q;
+	int rook 		= (side == white) ? R : r;
+	int bishop 		= (side == white) ? B : b;
+	int knight 		= (side == white) ? N : n;
+	int opponent 	= (side == white) ? black : white;
+	
+	while (bitboard) {
+		int source_square = lsb_index(bitboard);
+		int target_square = (side == white) ? 
+			source_square - 8 : 
+			source_square + 8 ;
+
+		// quiet pawn moves
+		if ((side == white) ? 
+				!(target_square < a8) && !get_bit(occupancies[both], target_square) :
+				!(target_square > h1) && !get_bit(occupancies[both], target_square)) {
+			// handle promotions
+			if ((side == white) ?
+					(source_square >= a7 && source_square <= h7) :
+					(source_square >= a2 && source_square <= h2)) {
+				add_move(_move_list, encode_move(source_square, target_square, pawn, queen,  0, 0, 0, 0));
+				add_move(_move_list, encode_move(source_square, target_square, pawn, rook,   0, 0, 0, 0));
+				add_move(_move_list, encode_move(source_square, target_square, pawn, bishop, 0, 0, 0, 0));
+				add_move(_move_list, encode_move(source_square, target_square, pawn, knight, 0, 0, 0, 0));
+			} else {
+				// handle single pawn move
+				add_move(_move_list, encode_move(source_square, target_square, pawn, 0, 0, 0, 0, 0));
+
+				//handle double pawn push
+				if ((side == white) ?
+						(source_square >= a2 && source_square <= h2) && !get_bit(occupancies[both], target_square -= 8) :
+						(source_square >= a7 && source_square <= h7) && !get_bit(occupancies[both], target_square += 8) ) {
+					add_move(_move_list, encode_move(source_square, target_square, pawn, 0, 0, 1, 0, 0));
+				}
+			}
+		}
+
+		// pawn captures
+		u64 attacks = pawn_attacks[side][source_square] & occupancies[opponent];
+
+		while (attacks) {
+			target_square = lsb_index(attacks);
+
+			// handle promotion captures
+			if ((side == white) ?
+					(source_square >= a7 && source_square <= h7) :
+					(source_square >= a2 && source_square <= h2)) {
+				add_move(_move_list, encode_move(source_square, target_square, pawn, queen,  1, 0, 0, 0));
+				add_move(_move_list, encode_move(source_square, target_square, pawn, rook,   1, 0, 0, 0));
+				add_move(_move_list, encode_move(source_square, target_square, pawn, bishop, 1, 0, 0, 0));
+				add_move(_move_list, encode_move(source_square, target_square, pawn, knight, 1, 0, 0, 0));
+			} 
+			// handle regular pawn captures
+			else {
+				add_move(_move_list, encode_move(source_square, target_square, pawn, 0, 1, 0, 0, 0));
+			}
+
+			// pop last tried attack
+			pop_bit(attacks, target_square);
+		}
+
+		// handle en-passant capture
+		if (open_enpassant != none) {
+			u64 open_enpassant_attack = pawn_attacks[side][source_square] & (1ULL << open_enpassant);
+
+			// make sure en-passant is available
+			if (open_enpassant_attack) {
+				target_square = lsb_index(open_enpassant_attack);
+				add_move(_move_list, encode_move(source_square, target_square, pawn, 0, 1, 0, 1, 0));
+			}
+		}
+
+		// pop last tried initial position from bitboard
+		pop_bit(bitboard, source_square);
+	}
+}
+
+/**
+ * Generates all caslting moves for the given king.
+ * @param move_list Move list to add the moves to, if any.
+ * @param pawn The king to generate the castlings for.
+ * @param bitboard The king bitboard.
+ */
+static inline void genreate_castling_moves(move_list* _move_list, int king, u64 bitboard) {
+	int king_side_castle	 	= available_castlings & ((side == white) ? wk : bk);
+	int queen_side_castle	 	= available_castlings & ((side == white) ? wq : bq);
+	int king_side_connected  	= (side == white) ?
+		!get_bit(occupancies[both], f1) && !get_bit(occupancies[both], g1) :
+		!get_bit(occupancies[both], f8) && !get_bit(occupancies[both], g8);
+	int queen_side_connected 	= (side == white) ?
+		!get_bit(occupancies[both], d1) && !get_bit(occupancies[both], c1) && !get_bit(occupancies[both], b1) :
+		!get_bit(occupancies[both], d8) && !get_bit(occupancies[both], c8) && !get_bit(occupancies[both], b8);
+	int no_king_side_checks  	= (side == white) ?
+		!is_square_attacked(e1, black) && !is_square_attacked(f1, black) :
+		!is_square_attacked(e8, white) && !is_square_attacked(f8, white);
+	int no_queen_side_checks 	= (side == white) ?
+		!is_square_attacked(e1, black) && !is_square_attacked(d1, black) :
+		!is_square_attacked(e8, white) && !is_square_attacked(d8, white);
+	int source_square 			= (side == white) ? e1 : e8;
+	int ks_target_square 		= (side == white) ? g1 : g8;
+	int qs_target_square		= (side == white) ? c1 : c8;
+
+	// handle king-side castling
+	if (king_side_castle && king_side_connected && no_king_side_checks) {
+		add_move(_move_list, encode_move(source_square, ks_target_square, king, 0, 0, 0, 0, 1));
+	}
+	//handle queen-side castling
+	if (queen_side_castle && queen_side_connected && no_queen_side_checks) {
+		add_move(_move_list, encode_move(source_square, qs_target_square, king, 0, 0, 0, 0, 1));
+	}
+}
+
+/**
+ * Generate all pseudo legal moves for the given side.
+ * @param _move_list Move list to add the generated moves to, if any.
+ */
+static inline void generate_moves(move_list* _move_list) {
+	// init move count
+	_move_list->last = 0;
+
+	int source_square, target_square;
+	u64 attacks;
+
+	// loop over all bitboards
+	for (int piece = P; piece <= k; piece++) {
+		// initialize piece bitboard copy
+		u64 bitboard = bitboards[piece];
+
+		// generate pawn moves
+		if ((side == white) ? piece == P : piece == p)
+			generate_pawn_moves(_move_list, piece, bitboard);
+
+		// generate knight moves
+		if ((side == white) ? piece == N : piece == n)
+			generate_moves_for_piece(_move_list, piece, bitboard);
+
+		// generate bishop moves
+		if ((side == white) ? piece == B : piece == b)
+			generate_moves_for_piece(_move_list, piece, bitboard);
+
+		// generate rook moves
+		if ((side == white) ? piece == R : piece == r)
+			generate_moves_for_piece(_move_list, piece, bitboard);
+
+		// generate queen moves
+		if ((side == white) ? piece == Q : piece == q)
+			generate_moves_for_piece(_move_list, piece, bitboard);
+
+		// generate king moves
+		if ((side == white) ? piece == K : piece == k) {
+			generate_moves_for_piece(_move_list, piece, bitboard);
+			genreate_castling_moves(_move_list, piece, bitboard);
+		}
+	}
+}
+
+// enum to determine if the search will be done by all moves or only the captures
+enum { all_moves, only_captures };
+
+// caslting rights
+const int castling_rights[64] = {
+	 7, 15, 15, 15,  3, 15, 15, 11,
+	15, 15, 15, 15, 15, 15, 15, 15,
+	15, 15, 15, 15, 15, 15, 15, 15,
+	15, 15, 15, 15, 15, 15, 15, 15,
+	15, 15, 15, 15, 15, 15, 15, 15,
+	15, 15, 15, 15, 15, 15, 15, 15,
+	15, 15, 15, 15, 15, 15, 15, 15,
+	13, 15, 15, 15, 12, 15, 15, 14
+};
+
+/**
+ * Performs a move on the board, if legal.
+ * @param move The move to perform.
+ * @param move_flag Whether to perform all moves or only captures.
+ * @return Whether the move was legal.
+ */
+static inline int make_move(int move, int moves_flag) {
+	// quiet moves
+	if (moves_flag == all_moves) {
+		stats_add(moves_made, 1);
+
+		// preserve the board state
+		save_board();
+
+		// decode move
+		int source_square = decode_move_source_square(move);
+		int target_square = decode_move_target_square(move);
+		int piece = decode_move_piece(move);
+		int promoted_piece = decode_move_promoted_piece(move);
+		int capture_flag = decode_move_capture(move);
+		int double_pawn_push_flag = decode_move_double_pawn_push(move);
+		int enpassant_flag = decode_move_enpassant(move);
+		int castling_flag = decode_move_castle(move);
+
+		// captured piece, if any (en-passant captures are handled by the NNUE update itself)
+		int captured_piece = -1;
+
+		// move piece
+		pop_bit(bitboards[piece], source_square);
+		set_bit(bitboards[piece], target_square);
+
+		// hash piece (remove from source square and put on target square)
+		hash_key ^= piece_keys[piece][source_square];
+		hash_key ^= piece_keys[piece][target_square];
+
+		// update material and piece-square score
+		psqt_score += piece_square_scores[piece][target_square] - piece_square_scores[piece][source_square];
+
+		// increment halfmove clock (reset below on pawn moves and captures)
+		fifty++;
+
+		// pawn moves reset the halfmove clock and change the pawn structure
+		if (piece == P || piece == p) {
+			fifty = 0;
+			pawn_key ^= piece_keys[piece][source_square] ^ piece_keys[piece][target_square];
+		}
+
+		// handle captures
+		if (capture_flag) {
+			// captures reset the halfmove clock
+			fifty = 0;
+
+			// pick bitboards ranges depending on side
+			// int start_piece = (side == white) ? p : P;
+			// int end_piece = (side == white) ? k : K;
+			int start_piece, end_piece;
+
+			if (side == white) {
+				start_piece = p;
+				end_piece = k;
+			} else {
+				start_piece = P;
+				end_piece = K;
+			}
+
+			// loop over bitboards opposite to the side to move
+			for (int opp_piece = start_piece; opp_piece <= end_piece; opp_piece++) {
+				// if there´s a piece on the target square, pop that bit and break
+				if (get_bit(bitboards[opp_piece], target_square)) {
+					pop_bit(bitboards[opp_piece], target_square);
+
+					// remove the captured piece from the hash key and the score
+					hash_key ^= piece_keys[opp_piece][target_square];
+					psqt_score -= piece_square_scores[opp_piece][target_square];
+					game_phase -= phase_weights[opp_piece];
+					material_key -= material_unit(opp_piece);
+					captured_piece = opp_piece;
+
+					if (opp_piece == P || opp_piece == p)
+						pawn_key ^= piece_keys[opp_piece][target_square];
+					break;
+				}
+			}
+		}
+
+		// handle pawn promotions
+		if (promoted_piece) {
+			// pop the pawn and set the piece into the appropriate bitboards
+			pop_bit(bitboards[(side == white) ? P : p], target_square);
+			set_bit(bitboards[promoted_piece], target_square);
+
+			// hash the pawn out and the promoted piece in
+			hash_key ^= piece_keys[(side == white) ? P : p][target_square];
+			hash_key ^= piece_keys[promoted_piece][target_square];
+
+			// swap the pawn score for the promoted piece score
+			psqt_score += piece_square_scores[promoted_piece][target_square] - piece_square_scores[(side == white) ? P : p][target_square];
+			game_phase += phase_weights[promoted_piece];
+			pawn_key ^= piece_keys[(side == white) ? P : p][target_square];
+			material_key += material_unit(promoted_piece) - material_unit((side == white) ? P : p);
+		}
+
+		// hanld en-passant captures
+		if (enpassant_flag) {
+			if (side == white) {
+				pop_bit(bitboards[p], target_square + 8);
+				hash_key ^= piece_keys[p][target_square + 8];
+				psqt_score -= piece_square_scores[p][target_square + 8];
+				pawn_key ^= piece_keys[p][target_square + 8];
+				material_key -= material_unit(p);
+			} else {
+				pop_bit(bitboards[P], target_square - 8);
+				hash_key ^= piece_keys[P][target_square - 8];
+				psqt_score -= piece_square_scores[P][target_square - 8];
+				pawn_key ^= piece_keys[P][target_square - 8];
+				material_key -= material_unit(P);
+			}
+		}
+
+		// hash out and clear open en-passant
+		if (open_enpassant != none)
+			hash_key ^= enpassant_keys[open_enpassant];
+
+		open_enpassant = none;
+
+		// handle double pawn pushes
+		if (double_pawn_push_flag) {
+			open_enpassant = (side == white) ? 
+				target_square + 8 : 
+				target_square - 8;
+
+			hash_key ^= enpassant_keys[open_enpassant];
+		}
+
+		// handle castlings
+		if (castling_flag) {
+			switch (target_square) {
+				case g1:
+					pop_bit(bitboards[R], h1);
+					set_bit(bitboards[R], f1);
+					hash_key ^= piece_keys[R][h1] ^ piece_keys[R][f1];
+					psqt_score += piece_square_scores[R][f1] - piece_square_scores[R][h1];
+					break;
+				case c1:
+					pop_bit(bitboards[R], a1);
+					set_bit(bitboards[R], d1);
+					hash_key ^= piece_keys[R][a1] ^ piece_keys[R][d1];
+					psqt_score += piece_square_scores[R][d1] - piece_square_scores[R][a1];
+					break;
+				case g8:
+					pop_bit(bitboards[r], h8);
+					set_bit(bitboards[r], f8);
+					hash_key ^= piece_keys[r][h8] ^ piece_keys[r][f8];
+					psqt_score += piece_square_scores[r][f8] - piece_square_scores[r][h8];
+					break;
+				case c8:
+					pop_bit(bitboards[r], a8);
+					set_bit(bitboards[r], d8);
+					hash_key ^= piece_keys[r][a8] ^ piece_keys[r][d8];
+					psqt_score += piece_square_scores[r][d8] - piece_square_scores[r][a8];
+					break;
+			}
+		}
+
+		// update castling rights (hash out the old rights, hash in the new ones)
+		hash_key ^= castle_keys[available_castlings];
+		available_castlings &= castling_rights[source_square];
+		available_castlings &= castling_rights[target_square];
+		hash_key ^= castle_keys[available_castlings];
+
+		// reset occupancies
+		memset(occupancies, 0ULL, sizeof(occupancies));
+
+		// loop over pieces to set occupancies and update afterwards
+		for (int piece = P; piece <= K; piece++)
+			occupancies[white] |= bitboards[piece];
+
+		for (int piece = p; piece <= k; piece++)
+			occupancies[black] |= bitboards[piece];
+			
+		occupancies[both] |= occupancies[white];
+		occupancies[both] |= occupancies[black];
+
+		// increment fullmove number after Black's move
+		if (side == black)
+			fullmove++;
+
+		// change side (this is done with an XOR with 1 because white = 00 and black = 01 in binary)
+		side ^= 1;
+		hash_key ^= side_key;
+
+		// check if the king is not being exposed into check
+		if (is_square_attacked(
+				((side == white) ? 
+					lsb_index(bitboards[k]) : 
+					lsb_index(bitboards[K])),
+				side)) {
+			// move is illegal
+			restore_board();
+			stats_add(illegal_moves, 1);
+
+			// return illegal move
+			return 0;
+		} else {
+			// update the NNUE accumulator, if in use
+			if (accumulator_index >= 0)
+				nnue_update_accumulator(move, captured_piece);
+
+			// return legal move
+			return 1;
+		}
+	}
+	// capture moves
+	else {
+		// check if the move is a capture
+		if (decode_move_capture(move)) {
+			return make_move(move, all_moves);
+		}
+		// If the move is not a capture, don´t make the move
+		else
+			return 0;
+	}
+}
+
+/**
+ * Collects the legal moves of the current position.
+ * @param moves The legal moves (room for 256).
+ * @return The number of legal moves.
+ */
+int generate_legal_moves(int* moves) {
+	move_list _move_list[1];
+	int count = 0;
+
+	generate_moves(_move_list);
+
+	for (int index = 0; index < _move_list->last; index++) {
+		save_board();
+
+		if (make_move(_move_list->arr[index], all_moves))
+			moves[count++] = _move_list->arr[index];
+
+		restore_board();
+	}
+
+	return count;
+}
+
+#pragma endregion
+
+#pragma region Repetition Detection
+
+/** Number of slots in the cuckoo tables of reversible moves. */
+#define CUCKOO_SIZE 8192
+
+// cuckoo table hash functions (two independent slices of the move key)
+#define cuckoo_h1(key) ((int)((key) & 0x1FFF))
+#define cuckoo_h2(key) ((int)(((key) >> 16) & 0x1FFF))
+
+/** Hash key differences of every reversible (non-pawn, non-capture) move. */
+u64 cuckoo_keys[CUCKOO_SIZE];
+
+/** Moves matching each entry of the cuckoo keys table. */
+int cuckoo_moves[CUCKOO_SIZE];
+
+/**
+ * Returns the squares strictly between two squares on the same rank, file or diagonal.
+ * @param source_square The first square.
+ * @param target_square The second square.
+ * @return The bitboard of squares in between, or empty if they are not aligned.
+ */
+static inline u64 squares_between(int source_square, int target_square) {
+	u64 source = 1ULL << source_square;
+	u64 target = 1ULL << target_square;
+
+	// diagonal alignment
+	if (get_bishop_attacks(source_square, 0ULL) & target)
+		return get_bishop_attacks(source_square, target) & get_bishop_attacks(target_square, source);
+
+	// orthogonal alignment
+	if (get_rook_attacks(source_square, 0ULL) & target)
+		return get_rook_attacks(source_square, target) & get_rook_attacks(target_square, source);
+
+	return 0ULL;
+}
+
+/**
+ * Initialize the cuckoo tables used by the upcoming repetition detection. Every
+ * reversible piece move is stored under the key difference it makes to a position,
+ * so the move that would close a cycle can be found with just two lookups.
+ */
+void init_cuckoo_tables() {
+	memset(cuckoo_keys, 0ULL, sizeof(cuckoo_keys));
+	memset(cuckoo_moves, 0, sizeof(cuckoo_moves));
+
+	// loop over non-pawn pieces
+	for (int piece = P; piece <= k; piece++) {
+		if (piece == P || piece == p)
+			continue;
+
+		// loop over all source and target square pairs
+		for (int source_square = 0; source_square < 64; source_square++) {
+			for (int target_square = source_square + 1; target_square < 64; target_square++) {
+				// piece attacks on an empty board
+				u64 attacks;
+
+				switch (piece) {
+					case N: case n: attacks = knight_attacks[source_square]; break;
+					case B: case b: attacks = get_bishop_attacks(source_square, 0ULL); break;
+					case R: case r: attacks = get_rook_attacks(source_square, 0ULL); break;
+					case Q: case q: attacks = get_queen_attacks(source_square, 0ULL); break;
+					default: 		attacks = king_attacks[source_square]; break;
+				}
+
+				if (!get_bit(attacks, target_square))
+					continue;
+
+				// insert move, kicking out any previous occupant to its alternative slot
+				int move = encode_move(source_square, target_square, piece, 0, 0, 0, 0, 0);
+				u64 key = piece_keys[piece][source_square] ^ piece_keys[piece][target_square] ^ side_key;
+				int slot = cuckoo_h1(key);
+
+				while (1) {
+					u64 kicked_key = cuckoo_keys[slot];
+					int kicked_move = cuckoo_moves[slot];
+
+					cuckoo_keys[slot] = key;
+					cuckoo_moves[slot] = move;
+
+					// stop on empty slot
+					if (!kicked_move)
+						break;
+
+					// move the kicked out entry to its other slot
+					key = kicked_key;
+					move = kicked_move;
+					slot = (slot == cuckoo_h1(key)) ? cuckoo_h2(key) : cuckoo_h1(key);
+				}
+			}
+		}
+	}
+}
+
+/**
+ * Plays a legal move of a game (self-play or PGN), keeping the game history for repetitions.
+ * @param move The move.
+ */
+void play_game_move(int move) {
+	repetition_table[repetition_index++] = hash_key;
+	make_move(move, all_moves);
+
+	// positions before an irreversible move can never repeat, drop them
+	if (fifty == 0 || repetition_index >= MAX_GAME_PLY / 2)
+		repetition_index = 0;
+}
+
+/**
+ * Determines whether the current position already occurred since the last
+ * irreversible move, either in the game or along the current search line.
+ * Only positions with the same side to move and within the halfmove clock are scanned.
+ * @return Whether the current position is a repetition.
+ */
+static inline int is_repetition() {
+	// bound the backward scan by the halfmove clock
+	int end = (fifty < repetition_index) ? fifty : repetition_index;
+
+	for (int distance = 2; distance <= end; distance += 2)
+		if (repetition_table[repetition_index - distance] == hash_key)
+			return 1;
+
+	return 0;
+}
+
+/**
+ * Determines whether the side to move can reach a position of the current search
+ * line with a single reversible move, i.e. a repetition can be forced next move.
+ * Only cycles that lie completely inside the search tree are reported.
+ * @param ply Distance from the root of the search.
+ * @return Whether there is an upcoming repetition.
+ */
+static inline int has_upcoming_repetition(int ply) {
+	// bound the backward scan by the halfmove clock
+	int end = (fifty < repetition_index) ? fifty : repetition_index;
+
+	if (end < 3)
+		return 0;
+
+	// key difference between the current position and one ply ago, with side toggled
+	u64 other = hash_key ^ repetition_table[repetition_index - 1] ^ side_key;
+
+	for (int distance = 3; distance <= end; distance += 2) {
+		// accumulate the opponent's reversible moves
+		other ^= repetition_table[repetition_index - distance + 1] ^ repetition_table[repetition_index - distance] ^ side_key;
+
+		// opponent's pieces are not back on their original squares
+		if (other)
+			continue;
+
+		// cycles reaching before the root are left to the regular repetition check
+		if (ply <= distance)
+			break;
+
+		// look up a single move that transforms the current position into the old one
+		u64 move_key = hash_key ^ repetition_table[repetition_index - distance];
+		int slot = cuckoo_h1(move_key);
+
+		if (cuckoo_keys[slot] != move_key)
+			slot = cuckoo_h2(move_key);
+
+		if (cuckoo_keys[slot] != move_key)
+			continue;
+
+		// the move must not be blocked
+		int move = cuckoo_moves[slot];
+
+		if (!(squares_between(decode_move_source_square(move), decode_move_target_square(move)) & occupancies[both]))
+			return 1;
+	}
+
+	return 0;
+}
+
+#pragma endregion
+
+#pragma region Magic Numbers
+
+/**
+ * Generates a magic number candidate.
+ * @returns A magic number candidate.
+ */
+u64 generate_magic_number() {
+	return psrandom_u64() & psrandom_u64() & psrandom_u64();
+}
+
+/** 
+ * Find an appropriate magic number for either a bishop or a rook, given its square
+ * and the relevant bits of the occupancy bitboard.
+ * @param square The square of the piece.
+ * @param relevant_bits The relevant bits of the occupancy bitboard.
+ * @param bishop Whether the piece is a bishop or a rook. On usage, use the macro value bishop or rook.
+ * @returns The generated magic number.
+ */
+u64 find_magic_number(int square, int relevant_bits, int bishop) {
+	// initialize occupancies
+	u64 occupancies[4096];
+
+	// initialize attack tables
+	u64 attacks[4096];
+
+	// initialize used attacks
+	u64 used_attacks[4096];
+
+	// initialize attack mask for current piece
+	u64 attack_mask = bishop ? mask_bishop_attacks(square) : mask_rook_attacks(square);
+
+	// init occupancy indices
+	int occupancy_indices = 1 << relevant_bits;
+
+	// loop over occupancy indices
+	for (int index = 0; index < occupancy_indices; index++) {
+		// initialize occupancies
+		occupancies[index] = set_occupancy(index, relevant_bits, attack_mask);
+
+		// initialize attacks
+		attacks[index] = bishop ? bishop_attacks_on_the_go(square, occupancies[index]) : 
+									rook_attacks_on_the_go(square, occupancies[index]);
+	}
+
+	// test magic numbers
+	for (int random_count = 0; random_count < 100000000; random_count++) {
+		// generate magic number candidate
+		u64 magic_number = generate_magic_number();
+
+		// skip inappropriate magic numbers
+		if (count_bits((attack_mask * magic_number) & 0xFF00000000000000) < 6) continue;
+
+		// init used attacks
+		memset(used_attacks, 0ULL, sizeof(used_attacks));
+
+		// init index and fail flag
+		int index, fail;
+
+		// text magic index loop
+        for (index = 0, fail = 0; !fail && index < occupancy_indices; index++)
+        {
+            // init magic index
+            int magic_index = (int)((occupancies[index] * magic_number) >> (64 - relevant_bits));
+            
+            // if magic index works
+            if (used_attacks[magic_index] == 0ULL)
+                // init used attacks
+                used_attacks[magic_index] = attacks[index];
+            
+            // otherwise
+            else if (used_attacks[magic_index] != attacks[index])
+                // magic index doesn't work
+                fail = 1;
+        }
+
+		// if magic number works return it
+		if (!fail) return magic_number;
+	}
+
+	printf("MAGIC NUMBERS NOT FOUND!\n");
+	return 0ULL;
+}
+
+/** 
+ * Initialize magic numbers for bishops and rooks.
+ */
+void init_magic_numbers() {
+	for (int square = 0; square < 64; square++) {
+		// init bishop magic numbers
+		bishop_magic_numbers[square] = find_magic_number(square, bishop_relevant_bits[square], bishop);
+	}
+	for (int square = 0; square < 64; square++) {
+		// init rook magic numbers
+		rook_magic_numbers[square] = find_magic_number(square, rook_relevant_bits[square], rook);
+	}
+}
+
+#pragma endregion
+
+#pragma region Performace Testing
+
+/**
+ * Returns the current time in milliseconds.
+ */
+int get_time_millis() {
+#ifdef WIN64
+	return GetTickCount();
+#else
+	struct timeval time_val;
+	gettimeofday(&time_val, NULL);
+	return time_val.tv_sec * 1000 + time_val.tv_usec / 1000;
+#endif
+}
+
+/**
+ * Reads a high resolution cycle counter, used to measure where the search spends its time.
+ * On x86 this is the time stamp counter, elsewhere a nanosecond clock.
+ * @return The current value of the counter.
+ */
+static inline u64 read_cycle_counter() {
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	struct timespec time_spec;
+	clock_gettime(CLOCK_MONOTONIC, &time_spec);
+	return (u64)time_spec.tv_sec * 1000000000ULL + time_spec.tv_nsec;
+#endif
+}
+
+/** Leaf nodes (number of positions reached during the last test of te move generator for a given depth) */
+thread_local long long nodes;
+
+/**
+ * Perft debugging function to walk the move generation tree
+ * of strictly legal moves to count all the leaf nodes at a
+ * certain depth, which can be compared to predetermined
+ * values and used to isolate bugs.
+ * @param depth Maximum depth of the tree to count the leafs from.
+ */
+static inline void perft_driver(int depth) {
+	// recursion escape condition
+	if (depth == 0) {
+		// increment nodes count (count reached positions)
+		nodes++;
+		return;
+	}
+
+	// create move list and populate it
+	move_list _move_list[1];
+	generate_moves(_move_list);
+
+	// loop over generated moves
+	for (int i = 0; i < _move_list->last; i++) {
+		// preserve board state
+		save_board();
+
+		// make move
+		if (!make_move(_move_list->arr[i], all_moves)) 
+			continue;
+
+		// call perft driver recursively
+		perft_driver(depth - 1);
+
+		// restore board state
+		restore_board();
+	}
+}
+
+/**
+ * Performance test function to test the efficiency and 
+ * accuracy of the engine.
+ * @param depth Maximum depth of search to perform the test.
+ */
+void perft_test(int depth) {
+	printf("\n - Performance test - \n");
+
+
+	// create move list and populate it
+	move_list _move_list[1];
+	generate_moves(_move_list);
+
+	int start_time = get_time_millis();
+
+	// loop over generated moves
+	for (int i = 0; i < _move_list->last; i++) {
+		// preserve board state
+		save_board();
+
+		int move = _move_list->arr[i];
+
+		// make move
+		if (!make_move(move, all_moves)) 
+			continue;
+
+		// cummulative nodes
+		long long prev_nodes = nodes;
+
+		// call perft driver recursively
+		perft_driver(depth - 1);
+
+		long long curr_nodes = nodes - prev_nodes;
+
+		// restore board state
+		restore_board();
+
+		// print the move
+		printf(" move: ");
+		print_uci_move(move);
+		printf("     node: %lld\n", curr_nodes);
+	}
+
+	int elapsed = get_time_millis() - start_time;
+
+	// print results
+	printf("\n   - Stats - \n");
+	printf(  "   depth:      %d\n", depth);
+	printf(  "   nodes:      %lld\n", nodes);
+	printf(  "   elapsed t:  %d\n", elapsed);
+}
+
+#pragma endregion
+
+#pragma region Endgames
+
+/*
+	Specialised evaluation of endgames, selected by the material key of the position
+
+	Every known material has an evaluation function, registered for both colors in a
+	small open-addressing table, so the lookup costs one multiplication per node. A
+	function either scores the position (exactly for draws, as an estimate otherwise) or
+	gives a scale factor for the regular evaluation of drawish materials. King and pawn
+	against king is probed in a bitbase built at startup by retrograde iteration.
+*/
+
+#define ENDGAME_MAX_PIECES 5
+#define ENDGAME_TABLE_SIZE 64
+
+// score of a won endgame, far below mate scores but above any regular evaluation
+#define KNOWN_WIN 10000
+
+// scale factor of the regular evaluation that leaves it unchanged
+#define ENDGAME_SCALE_NORMAL 64
+
+// results of an endgame lookup
+enum { endgame_unknown, endgame_estimate, endgame_exact, endgame_scale };
+
+/**
+ * Evaluates an endgame.
+ * @param strong_side The side with more material.
+ * @param exact Set to 1 for exact scores, left unchanged for estimates and by scaling functions.
+ * @return The score from the strong side point of view, or the scale factor of a scaling function.
+ */
+typedef int (*endgame_function)(int strong_side, int* exact);
+
+/** An entry of the endgame table. */
+typedef struct {
+	u64 key;					// material key, 0 for empty entries
+	endgame_function evaluate;
+	int strong_side;
+	int scaling;				// whether the function gives a scale factor instead of a score
+} endgame;
+
+endgame endgames[ENDGAME_TABLE_SIZE];
+
+// piece values of the endgame scores (P, N, B, R, Q, K)
+static const int endgame_piece_values[6] = { 100, 300, 300, 500, 900, 0 };
+
+// bitbase of king and pawn against king, White with the pawn on files a-d: bit set if White wins
+#define KPK_SIZE (2 * 24 * 64 * 64)
+unsigned int kpk_bitbase[KPK_SIZE / 32];
+
+/**
+ * Gets the material key of a material name: White's pieces, "v", Black's pieces (e.g. "KRPvKR").
+ * @param name The material name, both sides starting with their king.
+ * @return The material key, 0 if the name is invalid.
+ */
+u64 parse_material(const char* name) {
+	u64 key = 0;
+	int color = -1;
+
+	for (; *name; name++) {
+		const char* piece = memchr(ascii_pieces, *name, 6);
+
+		// every side starts with its king
+		if (*name == 'K')
+			color++;
+
+		if (*name == 'v')
+			continue;
+
+		if (piece == NULL || color < 0 || color > black)
+			return 0;
+
+		key += material_unit((piece - ascii_pieces) + 6 * color);
+	}
+
+	return (color == black) ? key : 0;
+}
+
+/**
+ * Gets the king distance (moves of a king) between two squares.
+ * @param first The first square.
+ * @param second The second square.
+ * @return The distance.
+ */
+static inline int square_distance(int first, int second) {
+	int files = abs(first % 8 - second % 8);
+	int rows = abs(first / 8 - second / 8);
+
+	return (files > rows) ? files : rows;
+}
+
+/**
+ * Gets the distance of a square from the four center squares.
+ * @param square The square.
+ * @return The distance, 0 in the center to 6 in the corners.
+ */
+static inline int center_distance(int square) {
+	int file = square % 8, row = square / 8;
+
+	return ((file < 4) ? 3 - file : file - 4) + ((row < 4) ? 3 - row : row - 4);
+}
+
+/**
+ * Gets the index of a position in the KPK bitbase.
+ * @param side_to_move The side to move (White has the pawn).
+ * @param white_king The square of the white king.
+ * @param black_king The square of the black king.
+ * @param pawn The square of the pawn, on files a-d and ranks 2-7.
+ * @return The index.
+ */
+static inline int kpk_index(int side_to_move, int white_king, int black_king, int pawn) {
+	return white_king | black_king << 6 | side_to_move << 12 | ((pawn / 8 - 1) * 4 + pawn % 8) << 13;
+}
+
+// classifications of the positions while building the KPK bitbase
+enum { kpk_invalid = 0, kpk_unknown = 1, kpk_draw = 2, kpk_win = 4 };
+
+/**
+ * Classifies a KPK position by the results of its moves.
+ * @param results The classification of all positions.
+ * @param index The index of the position.
+ * @return The classification.
+ */
+static int kpk_classify(const unsigned char* results, int index) {
+	int white_king = index & 63, black_king = index >> 6 & 63, side_to_move = index >> 12 & 1;
+	int pawn_index = index >> 13;
+	int pawn = (pawn_index / 4 + 1) * 8 + pawn_index % 4;
+
+	// White looks for a win, Black for a draw
+	int good = (side_to_move == white) ? kpk_win : kpk_draw;
+	int bad = (side_to_move == white) ? kpk_draw : kpk_win;
+	int result = kpk_invalid;
+
+	// king moves (positions with the kings adjacent or on the pawn are invalid)
+	u64 targets = king_attacks[(side_to_move == white) ? white_king : black_king];
+
+	while (targets) {
+		int target = lsb_index(targets);
+		pop_bit(targets, target);
+
+		result |= (side_to_move == white)
+			? results[kpk_index(black, target, black_king, pawn)]
+			: results[kpk_index(white, white_king, target, pawn)];
+	}
+
+	// pawn pushes (a push onto a king gives an invalid position)
+	if (side_to_move == white) {
+		if (pawn / 8 > 1)
+			result |= results[kpk_index(black, white_king, black_king, pawn - 8)];
+
+		if (pawn / 8 == 6 && pawn - 8 != white_king && pawn - 8 != black_king)
+			result |= results[kpk_index(black, white_king, black_king, pawn - 16)];
+	}
+
+	return (result & good) ? good : (result & kpk_unknown) ? kpk_unknown : bad;
+}
+
+/**
+ * Builds the KPK bitbase: positions are classified from the immediate wins (safe
+ * promotions) and draws (stalemates, captures of the pawn), then by their moves until
+ * nothing changes; the positions left unknown are draws.
+ */
+void init_kpk_bitbase() {
+	unsigned char* results = malloc(KPK_SIZE);
+
+	for (int index = 0; index < KPK_SIZE; index++) {
+		int white_king = index & 63, black_king = index >> 6 & 63, side_to_move = index >> 12 & 1;
+		int pawn_index = index >> 13;
+		int pawn = (pawn_index / 4 + 1) * 8 + pawn_index % 4;
+		int promotion = pawn - 8;
+
+		if (square_distance(white_king, black_king) <= 1 || white_king == pawn || black_king == pawn
+			|| (side_to_move == white && get_bit(pawn_attacks[white][pawn], black_king)))
+			results[index] = kpk_invalid;
+
+		// the pawn promotes and the queen cannot be captured
+		else if (side_to_move == white && pawn / 8 == 1 && white_king != promotion
+			&& (square_distance(black_king, promotion) > 1 || square_distance(white_king, promotion) == 1))
+			results[index] = kpk_win;
+
+		// the black king is stalemated or takes the undefended pawn
+		else if (side_to_move == black
+			&& (!(king_attacks[black_king] & ~(king_attacks[white_king] | pawn_attacks[white][pawn]))
+				|| (get_bit(king_attacks[black_king], pawn) && !get_bit(king_attacks[white_king], pawn))))
+			results[index] = kpk_draw;
+
+		else
+			results[index] = kpk_unknown;
+	}
+
+	// iterate until no position changes
+	for (int changed = 1; changed; ) {
+		changed = 0;
+
+		for (int index = 0; index < KPK_SIZE; index++)
+			if (results[index] == kpk_unknown && (results[index] = kpk_classify(results, index)) != kpk_unknown)
+				changed = 1;
+	}
+
+	memset(kpk_bitbase, 0, sizeof(kpk_bitbase));
+
+	for (int index = 0; index < KPK_SIZE; index++)
+		if (results[index] == kpk_win)
+			kpk_bitbase[index / 32] |= 1U << (index % 32);
+
+	free(results);
+}
+
+/**
+ * Draw that no play can change (insufficient material to mate).
+ * @param strong_side Unused, the draw is the same for both sides.
+ * @param exact Set, the draw is exact.
+ * @return The score.
+ */
+int evaluate_insufficient_material(int strong_side, int* exact) {
+	(void)strong_side;
+
+	*exact = 1;
+	return 0;
+}
+
+/**
+ * Drawn material where mate can only be helped by the losing side.
+ * @param strong_side Unused, the draw is the same for both sides.
+ * @param exact Unused, the draw is an estimate.
+ * @return The score.
+ */
+int evaluate_drawish_material(int strong_side, int* exact) {
+	(void)strong_side, (void)exact;
+
+	return 0;
+}
+
+/**
+ * King and a major piece against king: drive the lone king to the edge with the king close.
+ * @param strong_side The side with more material.
+ * @param exact Unused, the score is an estimate.
+ * @return The score.
+ */
+int evaluate_kxk(int strong_side, int* exact) {
+	(void)exact;
+
+	int strong_king = lsb_index(bitboards[(strong_side == white) ? K : k]);
+	int weak_king = lsb_index(bitboards[(strong_side == white) ? k : K]);
+	int piece = (bitboards[(strong_side == white) ? Q : q]) ? Q : R;
+
+	return KNOWN_WIN + endgame_piece_values[piece] + 20 * center_distance(weak_king)
+		+ 10 * (7 - square_distance(strong_king, weak_king));
+}
+
+/**
+ * King, bishop and knight against king: drive the lone king to a corner of the color of
+ * the bishop with the king close.
+ * @param strong_side The side with more material.
+ * @param exact Unused, the score is an estimate.
+ * @return The score.
+ */
+int evaluate_kbnk(int strong_side, int* exact) {
+	(void)exact;
+
+	int strong_king = lsb_index(bitboards[(strong_side == white) ? K : k]);
+	int weak_king = lsb_index(bitboards[(strong_side == white) ? k : K]);
+	int bishop = lsb_index(bitboards[(strong_side == white) ? B : b]);
+
+	// a8 and h1 are light squares, h8 and a1 dark squares
+	int light = ((bishop % 8 + bishop / 8) & 1) == 0;
+	int first = light ? a8 : h8, second = light ? h1 : a1;
+	int first_distance = abs(weak_king % 8 - first % 8) + abs(weak_king / 8 - first / 8);
+	int second_distance = abs(weak_king % 8 - second % 8) + abs(weak_king / 8 - second / 8);
+	int corner_distance = (first_distance < second_distance) ? first_distance : second_distance;
+
+	return KNOWN_WIN + endgame_piece_values[B] + endgame_piece_values[N] + 20 * (14 - corner_distance)
+		+ 10 * (7 - square_distance(strong_king, weak_king));
+}
+
+/**
+ * King and pawn against king, probed in the bitbase: exact draws, estimated wins that
+ * grow as the pawn advances.
+ * @param strong_side The side with more material.
+ * @param exact Set for draws, left unchanged for wins.
+ * @return The score.
+ */
+int evaluate_kpk(int strong_side, int* exact) {
+	int strong_king = lsb_index(bitboards[(strong_side == white) ? K : k]);
+	int weak_king = lsb_index(bitboards[(strong_side == white) ? k : K]);
+	int pawn = lsb_index(bitboards[(strong_side == white) ? P : p]);
+
+	// bring the pawn to White and to files a-d
+	if (strong_side == black)
+		strong_king ^= 56, weak_king ^= 56, pawn ^= 56;
+
+	if (pawn % 8 > 3)
+		strong_king ^= 7, weak_king ^= 7, pawn ^= 7;
+
+	int index = kpk_index((side == strong_side) ? white : black, strong_king, weak_king, pawn);
+
+	if (!(kpk_bitbase[index / 32] >> (index % 32) & 1)) {
+		*exact = 1;
+		return 0;
+	}
+
+	return KNOWN_WIN + endgame_piece_values[P] + 20 * (6 - pawn / 8);
+}
+
+/**
+ * Rook against a minor piece: usually a draw, the regular evaluation is scaled down.
+ * @param strong_side Unused, the factor is the same for both sides.
+ * @param exact Unused by scaling functions.
+ * @return The scale factor.
+ */
+int scale_rook_against_minor(int strong_side, int* exact) {
+	(void)strong_side, (void)exact;
+
+	return ENDGAME_SCALE_NORMAL / 4;
+}
+
+/**
+ * Bishop and pawn against bishop: with bishops of opposite colors the defending bishop
+ * blocks the pawn, the regular evaluation is scaled down.
+ * @param strong_side The side with more material.
+ * @param exact Unused by scaling functions.
+ * @return The scale factor.
+ */
+int scale_kbpkb(int strong_side, int* exact) {
+	(void)exact;
+
+	int strong_bishop = lsb_index(bitboards[(strong_side == white) ? B : b]);
+	int weak_bishop = lsb_index(bitboards[(strong_side == white) ? b : B]);
+	int opposite = ((strong_bishop % 8 + strong_bishop / 8) & 1) != ((weak_bishop % 8 + weak_bishop / 8) & 1);
+
+	return opposite ? ENDGAME_SCALE_NORMAL / 8 : ENDGAME_SCALE_NORMAL;
+}
+
+/**
+ * Gets the endgame table entry of a material key.
+ * @param key The material key.
+ * @return The entry, the empty entry ending the probe sequence if the material is unknown.
+ */
+static inline endgame* find_endgame(u64 key) {
+	int slot = (int)((key * 0x9E3779B97F4A7C15ULL) >> 58);
+
+	while (endgames[slot].key && endgames[slot].key != key)
+		slot = (slot + 1) & (ENDGAME_TABLE_SIZE - 1);
+
+	return &endgames[slot];
+}
+
+/**
+ * Registers an endgame for both colors.
+ * @param name The material with the strong side as White (e.g. "KBNvK").
+ * @param function The evaluation function.
+ * @param scaling Whether the function gives a scale factor.
+ */
+void add_endgame(const char* name, endgame_function function, int scaling) {
+	u64 key = parse_material(name);
+
+	for (int strong_side = white; strong_side <= black; strong_side++) {
+		endgame* entry = find_endgame(key);
+
+		// symmetric materials are registered once
+		if (entry->key == 0)
+			*entry = (endgame){ key, function, strong_side, scaling };
+
+		// swap the colors
+		key = key >> 24 | (key & 0xFFFFFF) << 24;
+	}
+}
+
+/**
+ * Fills the endgame table and builds the KPK bitbase.
+ */
+void init_endgames() {
+	memset(endgames, 0, sizeof(endgames));
+
+	add_endgame("KvK", evaluate_insufficient_material, 0);
+	add_endgame("KNvK", evaluate_insufficient_material, 0);
+	add_endgame("KBvK", evaluate_insufficient_material, 0);
+	add_endgame("KNNvK", evaluate_drawish_material, 0);
+	add_endgame("KNvKN", evaluate_drawish_material, 0);
+	add_endgame("KBvKN", evaluate_drawish_material, 0);
+	add_endgame("KBvKB", evaluate_drawish_material, 0);
+	add_endgame("KQvK", evaluate_kxk, 0);
+	add_endgame("KRvK", evaluate_kxk, 0);
+	add_endgame("KBNvK", evaluate_kbnk, 0);
+	add_endgame("KPvK", evaluate_kpk, 0);
+	add_endgame("KRvKN", scale_rook_against_minor, 1);
+	add_endgame("KRvKB", scale_rook_against_minor, 1);
+	add_endgame("KBPvKB", scale_kbpkb, 1);
+
+	init_kpk_bitbase();
+}
+
+/**
+ * Looks up the specialised evaluation of the material of the current position.
+ * @param value Set to the score from the side to move point of view, or to the scale factor.
+ * @return endgame_unknown, endgame_estimate, endgame_exact or endgame_scale.
+ */
+static inline int evaluate_endgame(int* value) {
+	const endgame* entry = find_endgame(material_key);
+
+	if (entry->key == 0)
+		return endgame_unknown;
+
+	int exact = 0;
+	int score = entry->evaluate(entry->strong_side, &exact);
+
+	if (entry->scaling) {
+		*value = score;
+		return endgame_scale;
+	}
+
+	*value = (side == entry->strong_side) ? score : -score;
+	return exact ? endgame_exact : endgame_estimate;
+}
+
+#pragma endregion
+
+#pragma region Evaluation
+
+// material and piece-square tables (regenerated by the tuner, see make tuner)
+#include "eval_tables.h"
+
+const int mirror_square[128] = {
+	a1, b1, c1, d1, e1, f1, g1, h1,
+	a2, b2, c2, d2, e2, f2, g2, h2,
+	a3, b3, c3, d3, e3, f3, g3, h3,
+	a4, b4, c4, d4, e4, f4, g4, h4,
+	a5, b5, c5, d5, e5, f5, g5, h5,
+	a6, b6, c6, d6, e6, f6, g6, h6,
+	a7, b7, c7, d7, e7, f7, g7, h7,
+	a8, b8, c8, d8, e8, f8, g8, h8
+};
+
+/**
+ * Merge the material and positional tables into the single piece-square table of
+ * packed middlegame/endgame scores used by the incremental evaluation. Knights,
+ * bishops and rooks share their positional table between both phases, queens have none.
+ * Black entries are mirrored and negated.
+ */
+void init_piece_square_scores() {
+	// loop over all squares
+	for (int square = 0; square < 64; square++) {
+		// white pieces
+		piece_square_scores[P][square] = make_score(material_score[P] + pawn_scores[square], endgame_material_score[P] + pawn_endgame_scores[square]);
+		piece_square_scores[N][square] = make_score(material_score[N] + knight_scores[square], endgame_material_score[N] + knight_scores[square]);
+		piece_square_scores[B][square] = make_score(material_score[B] + bishop_scores[square], endgame_material_score[B] + bishop_scores[square]);
+		piece_square_scores[R][square] = make_score(material_score[R] + rook_scores[square], endgame_material_score[R] + rook_scores[square]);
+		piece_square_scores[Q][square] = make_score(material_score[Q], endgame_material_score[Q]);
+		piece_square_scores[K][square] = make_score(material_score[K] + king_scores[square], endgame_material_score[K] + king_endgame_scores[square]);
+	}
+
+	// black pieces, mirrored
+	for (int piece = p; piece <= k; piece++)
+		for (int square = 0; square < 64; square++)
+			piece_square_scores[piece][square] = -piece_square_scores[piece - p][mirror_square[square]];
+}
+
+/** File masks [square]: every square on the same file as the given square. */
+u64 file_masks[64];
+
+/** Isolated pawn masks [square]: every square on the files adjacent to the given square. */
+u64 isolated_masks[64];
+
+/** Passed pawn masks [color][square]: squares in front of the given square on its own and adjacent files. */
+u64 passed_masks[2][64];
+
+/** Backward pawn masks [color][square]: squares on adjacent files level with or behind the given square. */
+u64 backward_masks[2][64];
+
+/** Penalty for every extra pawn on a file. */
+const int doubled_pawn_penalty = make_score(-10, -20);
+
+/** Penalty for pawns with no friendly pawns on adjacent files. */
+const int isolated_pawn_penalty = make_score(-10, -15);
+
+/** Penalty for pawns that cannot be supported by friendly pawns and whose stop square is controlled by an enemy pawn. */
+const int backward_pawn_penalty = make_score(-8, -10);
+
+/** Passed pawn bonus by rank, relative to the pawn's color. */
+const int passed_pawn_bonus[8] = {
+	make_score(0, 0), make_score(5, 10), make_score(10, 20), make_score(15, 35),
+	make_score(25, 60), make_score(40, 100), make_score(60, 150), make_score(0, 0)
+};
+
+/**
+ * Initialize the file, isolated, passed and backward pawn masks.
+ */
+void init_evaluation_masks() {
+	// loop over all squares
+	for (int square = 0; square < 64; square++) {
+		int rank = square / 8;
+
+		// own file and the two adjacent files (clipped at the board edges)
+		file_masks[square] = 0x0101010101010101ULL << (square % 8);
+		isolated_masks[square] = ((file_masks[square] << 1) & not_a_file) | ((file_masks[square] >> 1) & not_h_file);
+
+		// loop over all other ranks
+		passed_masks[white][square] = passed_masks[black][square] = 0ULL;
+		backward_masks[white][square] = backward_masks[black][square] = 0ULL;
+
+		for (int r = 0; r < 8; r++) {
+			u64 rank_mask = 0xFFULL << (r * 8);
+
+			// White pawns move towards rank index 0, Black pawns towards rank index 7
+			if (r < rank) passed_masks[white][square] |= (file_masks[square] | isolated_masks[square]) & rank_mask;
+			if (r > rank) passed_masks[black][square] |= (file_masks[square] | isolated_masks[square]) & rank_mask;
+			if (r >= rank) backward_masks[white][square] |= isolated_masks[square] & rank_mask;
+			if (r <= rank) backward_masks[black][square] |= isolated_masks[square] & rank_mask;
+		}
+	}
+}
+
+/** Pawn structure cache entry. */
+typedef struct {
+	u64 key;	// pawn hash key
+	int score;	// packed pawn structure score from White's point of view
+} pawn_entry;
+
+/** Number of entries of the pawn structure cache (power of two). */
+#define PAWN_HASH_SIZE 16384
+
+/** Pawn structure cache, indexed by the pawn hash key. */
+thread_local pawn_entry pawn_hash_table[PAWN_HASH_SIZE];
+
+/**
+ * Evaluate the pawn structure of one side.
+ * @param color The color of the pawns.
+ * @return The packed pawn structure score for the given color.
+ */
+static inline int evaluate_pawn_structure(int color) {
+	u64 own_pawns = bitboards[(color == white) ? P : p];
+	u64 enemy_pawns = bitboards[(color == white) ? p : P];
+	u64 bitboard = own_pawns;
+	int score = 0;
+
+	while (bitboard) {
+		int square = lsb_index(bitboard);
+
+		// doubled pawns (penalize every pawn that has another friendly pawn in front)
+		if (own_pawns & file_masks[square] & passed_masks[color][square])
+			score += doubled_pawn_penalty;
+
+		// isolated pawns
+		if (!(own_pawns & isolated_masks[square]))
+			score += isolated_pawn_penalty;
+
+		// backward pawns (stop square attacked by an enemy pawn and no possible support)
+		else if (!(own_pawns & backward_masks[color][square]) &&
+				(pawn_attacks[color][(color == white) ? square - 8 : square + 8] & enemy_pawns))
+			score += backward_pawn_penalty;
+
+		// passed pawns
+		if (!(enemy_pawns & passed_masks[color][square]))
+			score += passed_pawn_bonus[(color == white) ? 7 - square / 8 : square / 8];
+
+		pop_bit(bitboard, square);
+	}
+
+	return score;
+}
+
+/**
+ * Evaluate the pawn structure of the current position, probing the pawn
+ * structure cache first. Pawn structures change rarely during the search,
+ * so the vast majority of calls are answered by the cache.
+ * @return The packed pawn structure score from White's point of view.
+ */
+static inline int evaluate_pawns() {
+	pawn_entry* entry = &pawn_hash_table[pawn_key & (PAWN_HASH_SIZE - 1)];
+	stats_add(pawn_hash_probes, 1);
+
+	// cache hit
+	if (entry->key == pawn_key) {
+		stats_add(pawn_hash_hits, 1);
+		return entry->score;
+	}
+
+	// evaluate and store the pawn structure
+	entry->key = pawn_key;
+	entry->score = evaluate_pawn_structure(white) - evaluate_pawn_structure(black);
+
+	return entry->score;
+}
+
+/** Mobility bonus for every safe square a piece attacks, beyond its baseline [piece]. */
+const int mobility_bonus[6] = { 0, make_score(4, 4), make_score(5, 5), make_score(2, 4), make_score(1, 2), 0 };
+
+/** Number of safe squares considered neutral for every piece [piece]. */
+const int mobility_baseline[6] = { 0, 4, 6, 7, 13, 0 };
+
+/** Weight of every attack on the enemy king zone [piece]. */
+const int king_attack_weight[6] = { 0, 2, 2, 3, 5, 0 };
+
+/**
+ * Attack map of a position: the squares attacked by each piece type and by each
+ * side, plus the mobility and king zone attack counts gathered while building it.
+ * It is generated once per node and shared by the evaluation and the search.
+ */
+typedef struct {
+	u64 attacked_by[12];		// squares attacked by every piece type
+	u64 attacks[2];				// squares attacked by each side
+	int mobility;				// packed mobility score from White's point of view
+	int king_attackers[2];		// number of pieces of each side attacking the enemy king zone
+	int king_attack_units[2];	// weighted attacks of each side on the enemy king zone
+} attack_map;
+
+/**
+ * Generates the attack map of the current position.
+ * @param map The attack map to fill.
+ */
+static inline void generate_attack_map(attack_map* map) {
+	// pawn attacks by shifting whole bitboards
+	map->attacked_by[P] = ((bitboards[P] >> 7) & not_a_file) | ((bitboards[P] >> 9) & not_h_file);
+	map->attacked_by[p] = ((bitboards[p] << 7) & not_h_file) | ((bitboards[p] << 9) & not_a_file);
+
+	map->mobility = 0;
+
+	// loop over both sides
+	for (int color = white; color <= black; color++) {
+		int offset = (color == white) ? P : p;
+		int enemy_king = lsb_index(bitboards[(color == white) ? k : K]);
+
+		// mobility counts squares not occupied by own pieces nor attacked by enemy pawns
+		u64 safe = ~occupancies[color] & ~map->attacked_by[(color == white) ? p : P];
+
+		// enemy king zone: the king square and its surroundings
+		u64 king_zone = king_attacks[enemy_king] | (1ULL << enemy_king);
+
+		map->king_attackers[color] = 0;
+		map->king_attack_units[color] = 0;
+
+		// loop over knights, bishops, rooks, queens and the king
+		for (int type = N; type <= K; type++) {
+			u64 bitboard = bitboards[offset + type];
+			u64 all_attacks = 0ULL;
+
+			while (bitboard) {
+				int square = lsb_index(bitboard);
+				u64 attacks;
+
+				switch (type) {
+					case N: attacks = knight_attacks[square]; break;
+					case B: attacks = get_bishop_attacks(square, occupancies[both]); break;
+					case R: attacks = get_rook_attacks(square, occupancies[both]); break;
+					case Q: attacks = get_queen_attacks(square, occupancies[both]); break;
+					default: attacks = king_attacks[square]; break;
+				}
+
+				all_attacks |= attacks;
+
+				// mobility over safe squares
+				int mobility = (count_bits(attacks & safe) - mobility_baseline[type]) * mobility_bonus[type];
+				map->mobility += (color == white) ? mobility : -mobility;
+
+				// attacks on the enemy king zone
+				if (type != K && (attacks & king_zone)) {
+					map->king_attackers[color]++;
+					map->king_attack_units[color] += king_attack_weight[type] * count_bits(attacks & king_zone);
+				}
+
+				pop_bit(bitboard, square);
+			}
+
+			map->attacked_by[offset + type] = all_attacks;
+		}
+
+		// all squares attacked by the side
+		map->attacks[color] = 0ULL;
+
+		for (int type = P; type <= K; type++)
+			map->attacks[color] |= map->attacked_by[offset + type];
+	}
+}
+
+/**
+ * Evaluate the king safety of one side from the attacks gathered in the attack map.
+ * A single attacker is harmless, beyond that the danger grows quadratically.
+ * @param map The attack map of the position.
+ * @param color The color of the attacking side.
+ * @return The packed king attack score for the given side.
+ */
+static inline int evaluate_king_attack(const attack_map* map, int color) {
+	int units = map->king_attack_units[color];
+
+	return (map->king_attackers[color] >= 2) ? make_score(units * units / 4, 0) : 0;
+}
+
+/**
+ * Evaluate the position of the board. Material and piece-square scores are
+ * kept up to date by make_move as packed middlegame/endgame scores. Pawn structure
+ * comes from its cache, mobility and king safety from the attack map of the node,
+ * and the sum is interpolated by the game phase.
+ * @param map The attack map of the current position.
+ * @return The score of the position.
+ */
+static inline int evaluate(const attack_map* map) {
+	// the incremental state must always match a full recompute
+	assert(psqt_score == generate_psqt_score());
+	assert(game_phase == generate_game_phase());
+	assert(pawn_key == generate_pawn_key());
+	assert(material_key == generate_material_key());
+
+	// add the cached pawn structure score to the material and piece-square score
+	int packed_score = psqt_score + evaluate_pawns();
+
+	// add mobility and king safety from the attack map
+	packed_score += map->mobility;
+	packed_score += evaluate_king_attack(map, white) - evaluate_king_attack(map, black);
+
+	// clamp the phase (early promotions may push it above the maximum)
+	int phase = (game_phase < MAX_PHASE) ? game_phase : MAX_PHASE;
+
+	// interpolate between the middlegame and endgame scores
+	int score = (mg_score(packed_score) * phase + eg_score(packed_score) * (MAX_PHASE - phase)) / MAX_PHASE;
+
+	// return the final evaluation based on side
+	return (side == white) ? score : -score;
+}
+
+/**
+ * Evaluation cache entry. The key is stored XORed with the data, so a torn
+ * entry written concurrently by another thread simply fails validation and
+ * the cache can be shared without locks.
+ */
+typedef struct {
+	u64 key;	// position hash key XOR data
+	u64 data;	// static evaluation of the position (side to move point of view)
+} eval_entry;
+
+/** Default size of the evaluation cache in megabytes. */
+#define DEFAULT_EVAL_CACHE_MB 16
+
+/** Direct-mapped evaluation cache, holding static evaluations only (never search scores). */
+eval_entry* eval_cache = NULL;
+
+/** Number of entries of the evaluation cache (power of two, 0 when disabled). */
+u64 eval_cache_entries = 0;
+
+/** Requested size of the evaluation cache in megabytes. */
+int eval_cache_megabytes = 0;
+
+/**
+ * Allocates (or resizes) and clears the evaluation cache.
+ * @param megabytes The size of the cache in megabytes, 0 disables it.
+ */
+void init_eval_cache(int megabytes) {
+	// free previous cache
+	free(eval_cache);
+	eval_cache = NULL;
+	eval_cache_entries = 0;
+	eval_cache_megabytes = megabytes;
+
+	if (megabytes <= 0)
+		return;
+
+	// largest power of two number of entries that fits in the given size
+	u64 entries = 1;
+
+	while (entries * 2 * sizeof(eval_entry) <= (u64)megabytes * 1024 * 1024)
+		entries *= 2;
+
+	eval_cache = calloc(entries, sizeof(eval_entry));
+
+	if (eval_cache)
+		eval_cache_entries = entries;
+	else
+		printf("info string could not allocate %d MB of evaluation cache\n", megabytes);
+}
+
+/**
+ * Static evaluation of the current position from scratch: known endgames by their own
+ * function, anything else with the network or with the classic evaluation, scaled for
+ * drawish endgames. Shared by the search and the library.
+ * @param map The attack map to fill for the classic evaluation.
+ * @param map_ready Set to whether the attack map was generated.
+ * @return The static evaluation from the side to move point of view.
+ */
+static inline int evaluate_position(attack_map* map, int* map_ready) {
+	int scale = ENDGAME_SCALE_NORMAL, evaluation;
+
+	*map_ready = 0;
+
+	// known endgames are scored by their own function, or scale the regular evaluation
+	if (count_bits(occupancies[both]) <= ENDGAME_MAX_PIECES) {
+		int value;
+		int result = evaluate_endgame(&value);
+
+		if (result == endgame_scale)
+			scale = value;
+		else if (result != endgame_unknown)
+			return value;
+	}
+
+	if (use_nnue)
+		evaluation = evaluate_nnue();
+	else {
+		generate_attack_map(map);
+		*map_ready = 1;
+		evaluation = evaluate(map);
+	}
+
+	return evaluation * scale / ENDGAME_SCALE_NORMAL;
+}
+
+/**
+ * Static evaluation of the current position, probing the evaluation cache first.
+ * On a miss the attack map is generated, the position evaluated and the cache updated.
+ * @param map The attack map to fill on a cache miss.
+ * @param map_ready Set to whether the attack map was generated.
+ * @return The static evaluation from the side to move point of view.
+ */
+static inline int cached_evaluate(attack_map* map, int* map_ready) {
+	stats_start_timer(start);
+	eval_entry* entry = NULL;
+
+	// probe the cache
+	if (eval_cache_entries) {
+		entry = &eval_cache[hash_key & (eval_cache_entries - 1)];
+		stats_add(eval_cache_probes, 1);
+
+		u64 data = entry->data;
+
+		if ((entry->key ^ data) == hash_key) {
+			stats_add(eval_cache_hits, 1);
+			*map_ready = 0;
+			stats_stop_timer(eval_cycles, start);
+			return (int)data;
+		}
+	}
+
+	int evaluation = evaluate_position(map, map_ready);
+
+	// store in the cache
+	if (entry) {
+		u64 data = (u64)(unsigned int)evaluation;
+		entry->key = hash_key ^ data;
+		entry->data = data;
+	}
+
+	stats_stop_timer(eval_cycles, start);
+	return evaluation;
+}
+
+#pragma endregion
+
+#pragma region Endgame Tablebases
+
+/*
+	Endgame tablebases of up to 5 pieces (kings included), two files per material
+
+	name			White's pieces, "v", Black's pieces, in KQRBNP order (e.g. "KRPvKR.bbt" and
+					"KRPvKR.bbw"); White is the side with more material, positions with the colors
+					swapped are probed on the mirrored board
+	.bbt			distance to mate, played from at the root and probed while generating
+		header		16 bytes: "BBTB", version, number of pieces, king placements (uint32)
+		values		uint8[2][size], White to move first: 0 draw, 255 impossible position,
+					otherwise 1 + plies to mate: odd plies if the side to move mates, even
+					plies if it is mated
+	.bbw			win, draw or loss, probed by the search (a quarter of the .bbt size)
+		header		16 bytes: "BBTW", version, number of pieces, king placements (uint32)
+		values		2 bits per position in the order of the .bbt values, from the lowest bits
+					of each byte: 0 draw, 1 win, 2 loss, 3 impossible position
+	index			the placement of the two kings, then the squares of each group of identical
+					pieces (White's then Black's, in KQRBNP order) as one combination, ranked in
+					the combinatorial number system (pawns on 48 squares)
+	kings			the board is mirrored to bring the white king to files a-d and, without
+					pawns, into the a1-d1-d4 triangle, mirroring on the a1-h8 diagonal when the
+					white king is above it, or on it with the black king above it: 1806 king
+					placements with pawns, 462 without
+
+	A position with both kings on the diagonal takes the smaller index of its two
+	orientations, the other index holds an impossible position. Tables are built by
+	retrograde analysis (see Tablebase Generation) and assume no castling rights and no
+	en passant square.
+*/
+
+#define TB_MAX_PIECES 5
+#define TB_VERSION 2
+#define TB_HEADER_SIZE 16
+
+// special values
+#define TB_DRAW 0
+#define TB_INVALID 255
+
+// win, draw or loss values of the side to move
+#define TB_WDL_DRAW 0
+#define TB_WDL_WIN 1
+#define TB_WDL_LOSS 2
+#define TB_WDL_INVALID 3
+
+/** Score of a tablebase win without a known distance, below the mate scores. */
+#define TB_WIN_SCORE 48000
+
+// king placements without and with pawns
+#define TB_KING_PLACEMENTS 462
+#define TB_PAWN_KING_PLACEMENTS 1806
+
+/** King placement of kings that are not mirrored into the index (or touch each other). */
+#define TB_NO_KINGS 0xFFFF
+
+/** Index of a position whose kings touch each other. */
+#define TB_NO_INDEX (~0ULL)
+
+/** Slots of the table of loaded tablebases (a power of two). */
+#define TB_HASH_SIZE 1024
+
+/** A tablebase: the positions of one material. */
+typedef struct {
+	u64 material;						// material key (see material_unit)
+	int piece_count;
+	int pieces[TB_MAX_PIECES];			// piece of every square of the index
+	int pawns;							// whether there are pawns (no rank or diagonal mirroring)
+	int groups;							// groups of identical pieces after the kings
+	int group_first[TB_MAX_PIECES];		// first square of the index of every group
+	int group_count[TB_MAX_PIECES];		// pieces of every group
+	u64 group_size[TB_MAX_PIECES];		// placements of every group
+	u64 size;							// positions per side to move
+	const unsigned char* dtm;			// [2][size] distances to mate, White to move first, NULL if not loaded
+	const unsigned char* wdl;			// [2 * size / 4] wins, draws and losses, NULL if not loaded
+	void* dtm_mapping;					// memory mappings of the files, NULL if not loaded
+	void* wdl_mapping;
+	size_t dtm_mapping_size;
+	size_t wdl_mapping_size;
+} tablebase;
+
+/** Loaded tablebases by material key (open addressing). */
+tablebase* tablebases[TB_HASH_SIZE];
+
+/** Largest number of pieces of the loaded tablebases, 0 if none is loaded. */
+int tb_max_pieces = 0;
+
+/** Index of every king placement by [pawns][white king][black king], TB_NO_KINGS if not in the index. */
+static unsigned short tb_king_index[2][64][64];
+
+/** Squares of the white and the black king of every king placement by [pawns][index]. */
+static unsigned char tb_king_squares[2][TB_PAWN_KING_PLACEMENTS][2];
+
+/** Binomial coefficients by [n][k], ranking the squares of identical pieces. */
+static u64 tb_binomial[65][TB_MAX_PIECES];
+
+// piece values deciding which side is White in a tablebase (P, N, B, R, Q, K)
+static const int tb_piece_values[6] = { 1, 3, 3, 5, 9, 0 };
+
+/**
+ * Gets the side of the a1-h8 diagonal a square is on.
+ * @param square The square.
+ * @return Positive above the diagonal (towards a8), 0 on it, negative below it.
+ */
+static inline int tb_diagonal_side(int square) {
+	return 7 - square / 8 - square % 8;
+}
+
+/**
+ * Mirrors a square on the a1-h8 diagonal.
+ * @param square The square.
+ * @return The mirrored square.
+ */
+static inline int tb_transpose(int square) {
+	return (7 - square % 8) * 8 + 7 - square / 8;
+}
+
+/**
+ * Initializes the king placements and the binomial coefficients of the tablebase index.
+ */
+void init_tablebase_index() {
+	for (int n = 0; n <= 64; n++)
+		for (int k = 0; k < TB_MAX_PIECES; k++)
+			tb_binomial[n][k] = (k == 0) ? 1 : (n == 0) ? 0 : tb_binomial[n - 1][k - 1] + tb_binomial[n - 1][k];
+
+	for (int pawns = 0; pawns <= 1; pawns++) {
+		int count = 0;
+
+		for (int white_king = 0; white_king < 64; white_king++)
+			for (int black_king = 0; black_king < 64; black_king++) {
+				int placed = white_king % 8 < 4 && black_king != white_king && !get_bit(king_attacks[white_king], black_king);
+
+				// without pawns: the a1-d1-d4 triangle, the black king not above the diagonal if the white king is on it
+				if (!pawns)
+					placed &= white_king / 8 >= 4 && tb_diagonal_side(white_king) <= 0 &&
+						(tb_diagonal_side(white_king) < 0 || tb_diagonal_side(black_king) <= 0);
+
+				tb_king_index[pawns][white_king][black_king] = placed ? count : TB_NO_KINGS;
+
+				if (placed) {
+					tb_king_squares[pawns][count][white] = white_king;
+					tb_king_squares[pawns][count++][black] = black_king;
+				}
+			}
+
+		assert(count == (pawns ? TB_PAWN_KING_PLACEMENTS : TB_KING_PLACEMENTS));
+	}
+}
+
+/**
+ * Swaps the colors of a material key.
+ * @param material The material key.
+ * @return The material key with the colors swapped.
+ */
+static inline u64 tb_mirror_material(u64 material) {
+	return (material >> 24) | ((material & 0xFFFFFF) << 24);
+}
+
+/**
+ * Determines whether White is the stronger side of a material key, as tablebases store it.
+ * @param material The material key.
+ * @return Whether White is the stronger side (or both sides are equal).
+ */
+static inline int tb_white_is_stronger(u64 material) {
+	int strength[2] = { 0, 0 };
+
+	for (int piece = P; piece <= k; piece++)
+		strength[piece / 6] += material_count(material, piece) * tb_piece_values[piece % 6];
+
+	if (strength[white] != strength[black])
+		return strength[white] > strength[black];
+
+	return (material & 0xFFFFFF) >= (material >> 24);
+}
+
+/**
+ * Writes the name of the tablebase of a material key (e.g. "KRPvKR").
+ * @param material The material key.
+ * @param name The output, at least 16 characters.
+ */
+void tb_name(u64 material, char* name) {
+	// KQRBNP order
+	static const int order[6] = { K, Q, R, B, N, P };
+
+	for (int color = white; color <= black; color++) {
+		for (int index = 0; index < 6; index++) {
+			int piece = order[index] + 6 * color;
+			int count = (index == 0) ? 1 : material_count(material, piece);
+
+			while (count--)
+				*name++ = ascii_pieces[order[index]];
+		}
+
+		if (color == white)
+			*name++ = 'v';
+	}
+
+	*name = '\0';
+}
+
+/**
+ * Describes the index of a tablebase: the piece of every square of the index, the groups
+ * of identical pieces and the size.
+ * @param table The tablebase, with its material key set.
+ */
+void tb_init_layout(tablebase* table) {
+	static const int order[6] = { K, Q, R, B, N, P };
+
+	table->piece_count = 0;
+	table->pieces[table->piece_count++] = K;
+	table->pieces[table->piece_count++] = k;
+	table->groups = 0;
+
+	for (int color = white; color <= black; color++)
+		for (int index = 1; index < 6; index++) {
+			int piece = order[index] + 6 * color;
+			int count = material_count(table->material, piece);
+
+			if (count == 0)
+				continue;
+
+			table->group_first[table->groups] = table->piece_count;
+			table->group_count[table->groups++] = count;
+
+			while (count--)
+				table->pieces[table->piece_count++] = piece;
+		}
+
+	table->pawns = (table->material & (15ULL | 15ULL << (4 * p))) != 0;
+	table->size = table->pawns ? TB_PAWN_KING_PLACEMENTS : TB_KING_PLACEMENTS;
+
+	for (int group = 0; group < table->groups; group++) {
+		int squares = (table->pieces[table->group_first[group]] % 6 == P) ? 48 : 64;
+
+		table->group_size[group] = tb_binomial[squares][table->group_count[group]];
+		table->size *= table->group_size[group];
+	}
+}
+
+/**
+ * Finds a loaded tablebase.
+ * @param material The material key, as stored (White the stronger side).
+ * @return The tablebase, NULL if it is not loaded.
+ */
+tablebase* tb_find(u64 material) {
+	for (u64 slot = (material * 0x9E3779B97F4A7C15ULL) >> 54; tablebases[slot]; slot = (slot + 1) & (TB_HASH_SIZE - 1))
+		if (tablebases[slot]->material == material)
+			return tablebases[slot];
+
+	return NULL;
+}
+
+/**
+ * Adds a tablebase to the loaded ones.
+ * @param table The tablebase.
+ */
+void tb_add(tablebase* table) {
+	u64 slot = (table->material * 0x9E3779B97F4A7C15ULL) >> 54;
+
+	while (tablebases[slot])
+		slot = (slot + 1) & (TB_HASH_SIZE - 1);
+
+	tablebases[slot] = table;
+
+	if (table->piece_count > tb_max_pieces)
+		tb_max_pieces = table->piece_count;
+}
+
+/**
+ * Computes the index of a position in a tablebase, its kings already placed as the index
+ * expects.
+ * @param table The tablebase.
+ * @param squares The square of every piece of the index.
+ * @return The index (within the positions of one side to move), TB_NO_INDEX if the kings
+ * are not in the index.
+ */
+static inline u64 tb_placement_index(const tablebase* table, const int* squares) {
+	u64 index = tb_king_index[table->pawns][squares[0]][squares[1]];
+
+	if (index == TB_NO_KINGS)
+		return TB_NO_INDEX;
+
+	for (int group = 0; group < table->groups; group++) {
+		int first = table->group_first[group], count = table->group_count[group];
+		int offset = (table->pieces[first] % 6 == P) ? 8 : 0;
+		int sorted[TB_MAX_PIECES];
+		u64 rank = 0;
+
+		// identical pieces are one combination: their squares in increasing order
+		for (int piece = 0; piece < count; piece++) {
+			int square = squares[first + piece] - offset, slot = piece;
+
+			for (; slot > 0 && sorted[slot - 1] > square; slot--)
+				sorted[slot] = sorted[slot - 1];
+
+			sorted[slot] = square;
+		}
+
+		for (int piece = 0; piece < count; piece++)
+			rank += tb_binomial[sorted[piece]][piece + 1];
+
+		index = index * table->group_size[group] + rank;
+	}
+
+	return index;
+}
+
+/**
+ * Computes the index of a position in a tablebase.
+ * @param table The tablebase.
+ * @param squares The square of every piece of the index.
+ * @return The index (within the positions of one side to move), TB_NO_INDEX if the kings
+ * touch each other.
+ */
+static inline u64 tb_index(const tablebase* table, const int* squares) {
+	int mirrored[TB_MAX_PIECES];
+	int king = squares[white];
+
+	// mirror the white king to files a-d and, without pawns, to ranks 1-4
+	int mirror = ((king % 8 > 3) ? 7 : 0) | ((!table->pawns && king / 8 < 4) ? 56 : 0);
+
+	for (int slot = 0; slot < table->piece_count; slot++)
+		mirrored[slot] = squares[slot] ^ mirror;
+
+	if (table->pawns)
+		return tb_placement_index(table, mirrored);
+
+	// then below the a1-h8 diagonal, with the black king if the white king is on it
+	int white_side = tb_diagonal_side(squares[white] ^ mirror), black_side = tb_diagonal_side(squares[black] ^ mirror);
+
+	if (white_side > 0 || (white_side == 0 && black_side > 0))
+		for (int slot = 0; slot < table->piece_count; slot++)
+			mirrored[slot] = tb_transpose(mirrored[slot]);
+
+	u64 index = tb_placement_index(table, mirrored);
+
+	// both kings on the diagonal: the orientation of the other pieces with the smaller index
+	if (white_side == 0 && black_side == 0) {
+		for (int slot = 0; slot < table->piece_count; slot++)
+			mirrored[slot] = tb_transpose(mirrored[slot]);
+
+		u64 transposed = tb_placement_index(table, mirrored);
+
+		index = (transposed < index) ? transposed : index;
+	}
+
+	return index;
+}
+
+/**
+ * Finds the tablebase of the current position and the index of the position in it.
+ * @param index Set to the index of the position, side to move included.
+ * @return The tablebase, NULL if the position is not in a loaded tablebase.
+ */
+static inline const tablebase* tb_locate(u64* index) {
+	u64 material = material_key;
+
+	// positions of the weaker White are probed with the colors swapped and the board mirrored
+	int swap = !tb_white_is_stronger(material);
+	const tablebase* table = tb_find(swap ? tb_mirror_material(material) : material);
+
+	if (table == NULL || available_castlings || open_enpassant != none)
+		return NULL;
+
+	u64 pieces[12];
+	int squares[TB_MAX_PIECES];
+
+	memcpy(pieces, bitboards, sizeof(pieces));
+
+	for (int slot = 0; slot < table->piece_count; slot++) {
+		int piece = swap ? (table->pieces[slot] + 6) % 12 : table->pieces[slot];
+		int square = lsb_index(pieces[piece]);
+
+		pop_bit(pieces[piece], square);
+		squares[slot] = swap ? square ^ 56 : square;
+	}
+
+	*index = (side ^ swap) * table->size + tb_index(table, squares);
+
+	return table;
+}
+
+/**
+ * Gets the win, draw or loss of a distance to mate value.
+ * @param value The distance to mate value.
+ * @return The win, draw or loss value.
+ */
+static inline int tb_wdl_of(int value) {
+	if (value == TB_DRAW || value == TB_INVALID)
+		return (value == TB_DRAW) ? TB_WDL_DRAW : TB_WDL_INVALID;
+
+	// odd distances are won by the side to move
+	return ((value - 1) & 1) ? TB_WDL_WIN : TB_WDL_LOSS;
+}
+
+/**
+ * Probes the distance to mate tablebases for the current position.
+ * @return The tablebase value for the side to move, -1 if the position is not in a loaded
+ * distance to mate tablebase.
+ */
+int tb_probe_dtm() {
+	u64 index;
+
+	// kings only
+	if (material_key == (material_unit(K) | material_unit(k)))
+		return TB_DRAW;
+
+	const tablebase* table = tb_locate(&index);
+
+	return (table && table->dtm) ? table->dtm[index] : -1;
+}
+
+/**
+ * Probes the win, draw or loss tablebases for the current position, or the distance to
+ * mate ones of the materials without them.
+ * @return The win, draw or loss value for the side to move, -1 if the position is not in
+ * a loaded tablebase.
+ */
+int tb_probe_wdl() {
+	u64 index;
+
+	// kings only
+	if (material_key == (material_unit(K) | material_unit(k)))
+		return TB_WDL_DRAW;
+
+	const tablebase* table = tb_locate(&index);
+
+	if (table == NULL)
+		return -1;
+
+	return table->wdl ? (table->wdl[index / 4] >> (2 * (index % 4))) & 3 : tb_wdl_of(table->dtm[index]);
+}
+
+/**
+ * Converts a distance to mate value to a search score.
+ * @param value The tablebase value for the side to move.
+ * @param ply The distance to the root.
+ * @return The score, a mate score unless the position is a draw.
+ */
+static inline int tb_score(int value, int ply) {
+	if (value == TB_DRAW)
+		return 0;
+
+	// odd distances are won by the side to move
+	return ((value - 1) & 1) ? 49000 - ply - (value - 1) : -49000 + ply + (value - 1);
+}
+
+/**
+ * Converts a win, draw or loss value to a search score.
+ * @param wdl The win, draw or loss value for the side to move.
+ * @param ply The distance to the root.
+ * @return The score: below the mate scores for a win, preferring the nearest one.
+ */
+static inline int tb_wdl_score(int wdl, int ply) {
+	if (wdl == TB_WDL_WIN || wdl == TB_WDL_LOSS)
+		return (wdl == TB_WDL_WIN) ? TB_WIN_SCORE - ply : -TB_WIN_SCORE + ply;
+
+	return 0;
+}
+
+/**
+ * Picks the root move from the distance to mate tablebases: the quickest mate, the
+ * slowest one when mated, or else a draw.
+ * @param score Set to the score of the move.
+ * @return The move, 0 if the position after some legal move is not in a loaded distance
+ * to mate tablebase.
+ */
+int tb_root_move(int* score) {
+	int moves[256], count = generate_legal_moves(moves), best_move = 0, best_score = -50000;
+
+	for (int index = 0; index < count; index++) {
+		save_board();
+		make_move(moves[index], all_moves);
+
+		int value = tb_probe_dtm();
+
+		restore_board();
+
+		if (value < 0 || value == TB_INVALID)
+			return 0;
+
+		// the score of the opponent one ply from the root
+		int move_score = -tb_score(value, 1);
+
+		if (move_score > best_score) {
+			best_score = move_score;
+			best_move = moves[index];
+		}
+	}
+
+	*score = best_score;
+
+	return best_move;
+}
+
+/**
+ * Unloads all tablebases.
+ */
+void tb_close() {
+	for (int slot = 0; slot < TB_HASH_SIZE; slot++) {
+		if (tablebases[slot] && tablebases[slot]->dtm_mapping)
+			unmap_file(tablebases[slot]->dtm_mapping, tablebases[slot]->dtm_mapping_size);
+
+		if (tablebases[slot] && tablebases[slot]->wdl_mapping)
+			unmap_file(tablebases[slot]->wdl_mapping, tablebases[slot]->wdl_mapping_size);
+
+		free(tablebases[slot]);
+		tablebases[slot] = NULL;
+	}
+
+	tb_max_pieces = 0;
+}
+
+/**
+ * Memory maps a file of a tablebase and validates it.
+ * @param path The path of the file.
+ * @param magic The first 4 bytes of the file ("BBTB" or "BBTW").
+ * @param table The tablebase, with its layout set.
+ * @param values_size The size of the values of the file.
+ * @param size Set to the size of the mapping.
+ * @return The mapping, NULL if the file is missing or invalid.
+ */
+void* tb_map_file(const char* path, const char* magic, const tablebase* table, u64 values_size, size_t* size) {
+	unsigned char* data = map_file(path, size);
+	uint32_t header[4] = { 0 };
+
+	if (data == NULL)
+		return NULL;
+
+	if (*size >= TB_HEADER_SIZE)
+		memcpy(header, data, sizeof(header));
+
+	if (*size != TB_HEADER_SIZE + values_size || memcmp(data, magic, 4) || header[1] != TB_VERSION ||
+			header[2] != (uint32_t)table->piece_count ||
+			header[3] != (uint32_t)(table->pawns ? TB_PAWN_KING_PLACEMENTS : TB_KING_PLACEMENTS)) {
+		unmap_file(data, *size);
+		return NULL;
+	}
+
+	return data;
+}
+
+/**
+ * Memory maps the files of a tablebase: the distances to mate, the wins, draws and losses,
+ * or both.
+ * @param directory The directory of the tablebase files.
+ * @param material The material key (White the stronger side).
+ * @return The tablebase, NULL if both files are missing or invalid.
+ */
+tablebase* tb_map(const char* directory, u64 material) {
+	char name[16], path[1100];
+	tablebase* table = calloc(1, sizeof(tablebase));
+
+	if (table == NULL)
+		return NULL;
+
+	table->material = material;
+	tb_init_layout(table);
+	tb_name(material, name);
+
+	snprintf(path, sizeof(path), "%s/%s.bbt", directory, name);
+	table->dtm_mapping = tb_map_file(path, "BBTB", table, 2 * table->size, &table->dtm_mapping_size);
+
+	snprintf(path, sizeof(path), "%s/%s.bbw", directory, name);
+	table->wdl_mapping = tb_map_file(path, "BBTW", table, (2 * table->size + 3) / 4, &table->wdl_mapping_size);
+
+	if (!table->dtm_mapping && !table->wdl_mapping) {
+		free(table);
+		return NULL;
+	}
+
+	table->dtm = table->dtm_mapping ? (unsigned char*)table->dtm_mapping + TB_HEADER_SIZE : NULL;
+	table->wdl = table->wdl_mapping ? (unsigned char*)table->wdl_mapping + TB_HEADER_SIZE : NULL;
+
+	return table;
+}
+
+/**
+ * Calls a function for the material keys of all tablebases up to a number of pieces,
+ * as stored (White the stronger side). Tables are visited by increasing number of pieces.
+ * @param max_pieces The maximum number of pieces (kings included).
+ * @param visit The function.
+ * @param data Passed to the function.
+ */
+void tb_for_each_material(int max_pieces, void (*visit)(u64 material, void* data), void* data) {
+	// the non-king pieces, with repetitions: (piece, count of the piece) in each digit
+	static const int pieces[10] = { Q, R, B, N, P, q, r, b, n, p };
+
+	for (int count = 1; count <= max_pieces - 2; count++) {
+		int choice[TB_MAX_PIECES] = { 0 };
+
+		// multisets of count pieces: non-decreasing choices
+		while (1) {
+			u64 material = material_unit(K) | material_unit(k);
+
+			for (int index = 0; index < count; index++)
+				material += material_unit(pieces[choice[index]]);
+
+			if (tb_white_is_stronger(material))
+				visit(material, data);
+
+			// next multiset
+			int index = count - 1;
+
+			while (index >= 0 && choice[index] == 9)
+				index--;
+
+			if (index < 0)
+				break;
+
+			choice[index]++;
+
+			for (int next = index + 1; next < count; next++)
+				choice[next] = choice[index];
+		}
+	}
+}
+
+/**
+ * Maps the tablebase of a material key if its file exists (a tb_for_each_material visitor).
+ * @param material The material key.
+ * @param directory The directory of the tablebase files.
+ */
+void tb_load_material(u64 material, void* directory) {
+	tablebase* table = tb_map(directory, material);
+
+	if (table)
+		tb_add(table);
+}
+
+/**
+ * Counts the loaded tablebases.
+ * @return The number of tablebases loaded.
+ */
+int tb_count() {
+	int count = 0;
+
+	for (int slot = 0; slot < TB_HASH_SIZE; slot++)
+		count += tablebases[slot] != NULL;
+
+	return count;
+}
+
+/**
+ * Loads all tablebases of a directory, replacing the loaded ones.
+ * @param directory The directory (empty to unload the tablebases).
+ * @return The number of tablebases loaded.
+ */
+int tb_load(const char* directory) {
+	tb_close();
+
+	if (!*directory || strcmp(directory, "<empty>") == 0)
+		return 0;
+
+	tb_for_each_material(TB_MAX_PIECES, tb_load_material, (void*)directory);
+
+	return tb_count();
+}
+
+#pragma endregion
+
+#pragma region Search
+
+// most valuable victim & less valuable attacker
+
+/*
+                          
+    (Victims) Pawn Knight Bishop   Rook  Queen   King
+  (Attackers)
+        Pawn   105    205    305    405    505    605
+      Knight   104    204    304    404    504    604
+      Bishop   103    203    303    403    503    603
+        Rook   102    202    302    402    502    602
+       Queen   101    201    301    401    501    601
+        King   100    200    300    400    500    600
+*/
+static int mvv_lva[12][12] = {
+ 	105, 205, 305, 405, 505, 605,  105, 205, 305, 405, 505, 605,
+	104, 204, 304, 404, 504, 604,  104, 204, 304, 404, 504, 604,
+	103, 203, 303, 403, 503, 603,  103, 203, 303, 403, 503, 603,
+	102, 202, 302, 402, 502, 602,  102, 202, 302, 402, 502, 602,
+	101, 201, 301, 401, 501, 601,  101, 201, 301, 401, 501, 601,
+	100, 200, 300, 400, 500, 600,  100, 200, 300, 400, 500, 600,
+
+	105, 205, 305, 405, 505, 605,  105, 205, 305, 405, 505, 605,
+	104, 204, 304, 404, 504, 604,  104, 204, 304, 404, 504, 604,
+	103, 203, 303, 403, 503, 603,  103, 203, 303, 403, 503, 603,
+	102, 202, 302, 402, 502, 602,  102, 202, 302, 402, 502, 602,
+	101, 201, 301, 401, 501, 601,  101, 201, 301, 401, 501, 601,
+	100, 200, 300, 400, 500, 600,  100, 200, 300, 400, 500, 600
+};
+
+/** Maximum depth of the search tree in plies, including extensions and quiescence. */
+#define MAX_PLY 128
+
+/**
+ * Search frame holding everything the search keeps per ply.
+ */
+typedef struct {
+	int killers[2];		// killer moves (quiet moves that caused a beta cutoff at this ply)
+	attack_map map;		// attack map of the node
+	int static_eval;	// static evaluation of the node
+	int move;			// move being searched from the node
+	int reduction;		// depth adjustment applied to the node (negative for extensions)
+	int pv_length;		// length of the principal variation starting at this ply
+	int pv[MAX_PLY];	// principal variation starting at this ply
+} search_frame;
+
+/**
+ * Search stack. The frame of ply N lives at index N + 2, so that the frames of
+ * the two plies before the root exist (empty) and can always be looked back at.
+ */
+thread_local search_frame search_stack[MAX_PLY + 3];
+
+// get the search frame of a given ply
+#define frame_at(ply) (&search_stack[(ply) + 2])
+
+/** Upper bound of the absolute value of any history score. */
+#define MAX_HISTORY 16384
+
+// history moves [piece][square]
+thread_local int history_moves[12][64];
+
+// counter moves [previous piece][previous target square]
+thread_local int counter_moves[12][64];
+
+// continuation history [plies back - 1][previous piece][previous target square][piece][target square]
+thread_local short continuation_history[2][12][64][12][64];
+
+// half move counter
+thread_local int ply;
+
+/** Node budget (0 for none) and deadline in milliseconds (0 for none) of the current search. */
+thread_local long long node_limit;
+thread_local int stop_time;
+
+/** Whether the current search ran out of nodes or time. */
+thread_local int stop_search;
+
+/** Called after every completed iteration of the current search (library API), NULL for none. */
+thread_local bbchess_info_callback search_info_callback;
+thread_local void* search_info_data;
+
+/** Whether the current search listens to the GUI for "stop" (UCI searches only). */
+thread_local int search_listens;
+
+/** Whether the GUI sent "quit" during the last search. */
+int quit_requested = 0;
+
+/** A command the GUI sent during the last search, run by the UCI loop once the search is over. */
+char pending_input[2000];
+
+/**
+ * Checks whether the GUI sent input, without blocking (stdin is unbuffered in the UCI loop).
+ * @return Whether input is waiting.
+ */
+int input_waiting() {
+#ifdef WIN64
+	DWORD available = 0;
+
+	return PeekNamedPipe(GetStdHandle(STD_INPUT_HANDLE), NULL, 0, NULL, &available, NULL) && available;
+#else
+	struct pollfd descriptor = { STDIN_FILENO, POLLIN, 0 };
+
+	return poll(&descriptor, 1, 0) > 0;
+#endif
+}
+
+/**
+ * Reads a command the GUI sent during a search: "stop" and "quit" stop the search,
+ * "isready" is answered right away and anything else waits for the end of the search.
+ */
+void read_search_input() {
+	char input[sizeof(pending_input)];
+
+	// the input is closed: nothing more can come, the search runs to its limits
+	if (!fgets(input, sizeof(input), stdin)) {
+		search_listens = 0;
+		return;
+	}
+
+	if (strncmp(input, "quit", 4) == 0) {
+		quit_requested = 1;
+		stop_search = 1;
+	}
+	else if (strncmp(input, "stop", 4) == 0)
+		stop_search = 1;
+	else if (strncmp(input, "isready", 7) == 0)
+		printf("readyok\n");
+	else {
+		// keep the first command for later (the search stops listening until it ends)
+		strcpy(pending_input, input);
+		search_listens = 0;
+	}
+}
+
+/**
+ * Stops the search once its node budget or its time is spent, or when the GUI says so
+ * (the clock and the input are only checked every 2048 nodes).
+ */
+static inline void check_search_limits() {
+	if (node_limit && nodes >= node_limit)
+		stop_search = 1;
+
+	if ((nodes & 2047) == 0) {
+		if (stop_time && get_time_millis() >= stop_time)
+			stop_search = 1;
+
+		if (search_listens && input_waiting())
+			read_search_input();
+	}
+}
+
+/**
+ * Determines whether the static evaluation of the side to move got better over
+ * its last move, comparing the current frame with the one two plies earlier.
+ * @param ply The ply of the node.
+ * @return Whether the position is improving.
+ */
+static inline int is_improving(int ply) {
+	return ply >= 2 && frame_at(ply)->static_eval > frame_at(ply - 2)->static_eval;
+}
+
+static inline int score_move(int move) {
+	// score capture move
+	if (decode_move_capture(move)) {
+        // init target piece
+        int target_piece = P;
+
+        // pick up bitboard piece index ranges depending on side
+        int start_piece, end_piece;
+
+        // pick up side to move
+        if (side == white) { start_piece = p; end_piece = k; }
+        else { start_piece = P; end_piece = K; }
+
+        // loop over bitboards opposite to the current side to move
+        for (int bb_piece = start_piece; bb_piece <= end_piece; bb_piece++)
+        {
+            // if there's a piece on the target square
             if (get_bit(bitboards[bb_piece], decode_move_target_square(move)))
             {
                 // remove it from corresponding bitboard
@@ -2025,536 +4997,6758 @@ static inline int score_move(int move) {
             }
         }
 
-		return mvv_lva[decode_move_piece(move)][target_piece] + 10000;
-	}
+		return mvv_lva[decode_move_piece(move)][target_piece] + 1000000;
+	}
+
+	// socre quiet move
+	else {
+		search_frame* ss = frame_at(ply);
+
+		// score first killer move
+		if (ss->killers[0] == move)
+			return 900000;
+
+		// score second killer move
+		else if (ss->killers[1] == move)
+			return 800000;
+
+		int piece = decode_move_piece(move);
+		int target_square = decode_move_target_square(move);
+		int previous_move = (ss - 1)->move;
+
+		// score the refutation of the previous move
+		if (previous_move && counter_moves[decode_move_piece(previous_move)][decode_move_target_square(previous_move)] == move)
+			return 700000;
+
+		// score history moves
+		int score = history_moves[piece][target_square];
+
+		// score continuation histories of the last two moves
+		if (previous_move)
+			score += continuation_history[0][decode_move_piece(previous_move)][decode_move_target_square(previous_move)][piece][target_square];
+
+		if ((ss - 2)->move)
+			score += continuation_history[1][decode_move_piece((ss - 2)->move)][decode_move_target_square((ss - 2)->move)][piece][target_square];
+
+		return score;
+	}
+
+	return 0;
+}
+
+/**
+ * Applies a bonus (or a malus, when negative) to a history score. The gravity term
+ * pulls the score back as it grows, keeping it within [-MAX_HISTORY, MAX_HISTORY].
+ * @param score The current history score.
+ * @param bonus The bonus to apply.
+ * @return The updated history score.
+ */
+static inline int history_gravity(int score, int bonus) {
+	return score + bonus - score * abs(bonus) / MAX_HISTORY;
+}
+
+/**
+ * Updates the history, continuation history and counter move tables for a quiet move.
+ * @param move The quiet move to update.
+ * @param bonus The bonus (or malus, when negative) to apply.
+ */
+static inline void update_quiet_histories(int move, int bonus) {
+	int piece = decode_move_piece(move);
+	int target_square = decode_move_target_square(move);
+
+	// update butterfly history
+	history_moves[piece][target_square] = history_gravity(history_moves[piece][target_square], bonus);
+
+	// update continuation histories of the moves made one and two plies ago
+	for (int back = 1; back <= 2; back++) {
+		int previous_move = frame_at(ply - back)->move;
+
+		if (!previous_move)
+			continue;
+
+		short* entry = &continuation_history[back - 1][decode_move_piece(previous_move)][decode_move_target_square(previous_move)][piece][target_square];
+		*entry = history_gravity(*entry, bonus);
+	}
+}
+
+/**
+ * Ages the move ordering history between searches, so that statistics gathered
+ * in earlier positions fade out instead of dominating the new search.
+ */
+void age_history() {
+	for (int piece = P; piece <= k; piece++)
+		for (int square = 0; square < 64; square++)
+			history_moves[piece][square] /= 2;
+
+	short* entry = &continuation_history[0][0][0][0][0];
+
+	for (int i = 0; i < (int)(sizeof(continuation_history) / sizeof(short)); i++)
+		entry[i] /= 2;
+}
+
+static inline void sort_moves(move_list *_move_list)
+{
+    // move scores
+    int move_scores[_move_list->last];
+
+    // score all the moves within a move list
+    for (int count = 0; count < _move_list->last; count++)
+        // score move
+        move_scores[count] = score_move(_move_list->arr[count]);
+
+    // loop over current move within a move list
+    for (int current_move = 0; current_move < _move_list->last; current_move++)
+    {
+        // loop over next move within a move list
+        for (int next_move = current_move + 1; next_move < _move_list->last; next_move++)
+        {
+            // compare current and next move scores
+            if (move_scores[current_move] < move_scores[next_move])
+            {
+                // swap scores
+                int temp_score = move_scores[current_move];
+                move_scores[current_move] = move_scores[next_move];
+                move_scores[next_move] = temp_score;
+
+                // swap moves
+                int temp_move = _move_list->arr[current_move];
+                _move_list->arr[current_move] = _move_list->arr[next_move];
+                _move_list->arr[next_move] = temp_move;
+            }
+        }
+    }
+}
+
+// print move (for UCI purposes)
+/**
+ * Writes a move in UCI notation (e.g. "e7e8q").
+ * @param move The move.
+ * @param buffer The output, at least 6 characters.
+ * @return The output.
+ */
+char* format_move(int move, char* buffer)
+{
+    if (decode_move_promoted_piece(move))
+        sprintf(buffer, "%s%s%c", square_to_coordinates[decode_move_source_square(move)],
+                           square_to_coordinates[decode_move_target_square(move)],
+                           promoted_pieces[decode_move_promoted_piece(move)]);
+    else
+        sprintf(buffer, "%s%s", square_to_coordinates[decode_move_source_square(move)],
+                           square_to_coordinates[decode_move_target_square(move)]);
+
+    return buffer;
+}
+
+void print_move(int move)
+{
+    char buffer[6];
+
+    printf("%s", format_move(move, buffer));
+}
+
+void print_move_scores(move_list *_move_list)
+{
+    printf("     Move scores:\n\n");
+
+    // loop over moves within a move list
+    for (int count = 0; count <= _move_list->last; count++)
+    {
+        printf("     move: ");
+        print_move(_move_list->arr[count]);
+        printf(" score: %d\n", score_move(_move_list->arr[count]));
+    }
+}
+
+/**
+ * Cheap static exchange estimate from the attack map of the node: a capture is
+ * considered losing when a more valuable piece takes a defended, cheaper piece.
+ * @param move The capture move.
+ * @param map The attack map of the position before the move.
+ * @return Whether the capture is likely to lose material.
+ */
+static inline int is_losing_capture(int move, const attack_map* map) {
+	int target_square = decode_move_target_square(move);
+
+	// promotions and en-passant captures never lose material on the spot
+	if (decode_move_promoted_piece(move) || decode_move_enpassant(move))
+		return 0;
+
+	// find the captured piece
+	int start_piece = (side == white) ? p : P;
+	int victim = start_piece;
+
+	for (int piece = start_piece; piece < start_piece + 6; piece++)
+		if (get_bit(bitboards[piece], target_square)) {
+			victim = piece;
+			break;
+		}
+
+	// winning or equal trades are never losing
+	if (abs(material_score[victim]) >= abs(material_score[decode_move_piece(move)]))
+		return 0;
+
+	// a cheaper piece is only lost if the square is defended
+	return get_bit(map->attacks[side ^ 1], target_square) != 0;
+}
+
+static inline int quiescence(int alpha, int beta) {
+	nodes++;
+	stats_add(quiescence_nodes, 1);
+
+	// stop once the node budget or the time is spent
+	check_search_limits();
+
+	if (stop_search)
+		return 0;
+
+	// get the search frame of this ply
+	search_frame* ss = frame_at(ply);
+
+	// quiescence nodes never extend the principal variation
+	ss->pv_length = 0;
+
+	// evaluate the node, generating its attack map on cache misses
+	int map_ready;
+	int evaluation = cached_evaluate(&ss->map, &map_ready);
+
+	// never search beyond the end of the search stack
+	if (ply >= MAX_PLY - 1)
+		return evaluation;
+
+	// fail-hard beta cutoff
+	if (evaluation >= beta)
+	{
+		// node (move) fails high
+		return beta;
+	}
+	
+	// found a better move
+	if (evaluation > alpha)
+	{
+		// PV node (move)
+		alpha = evaluation;
+	}
+	
+	stats_start_timer(movegen_start);
+
+	// the attack map is needed to estimate exchanges
+	if (!map_ready)
+		generate_attack_map(&ss->map);
+
+	// create move list instance
+    move_list _move_list[1];
+    
+    // generate moves
+	generate_moves(_move_list);
+
+	stats_stop_timer(movegen_cycles, movegen_start);
+	stats_start_timer(ordering_start);
+
+	sort_moves(_move_list);
+
+	stats_stop_timer(ordering_cycles, ordering_start);
+    
+    // loop over moves within a movelist
+    for (int count = 0; count < _move_list->last; count++)
+    {
+        // skip captures that are likely to lose material
+        if (decode_move_capture(_move_list->arr[count]) && is_losing_capture(_move_list->arr[count], &ss->map))
+            continue;
+
+        // preserve board state
+        save_board();
+
+        // remember the move made at this ply
+        ss->move = _move_list->arr[count];
+        
+        // increment ply
+        ply++;
+        
+        // make sure to make only legal moves
+        if (make_move(_move_list->arr[count], only_captures) == 0)
+        {
+            // decrement ply
+            ply--;
+            
+            // skip to next move
+            continue;
+        }
+
+        // score current move
+        int score = -quiescence(-beta, -alpha);
+        
+        // decrement ply
+        ply--;
+
+        // take move back
+        restore_board();
+
+        // the score of an interrupted search is meaningless
+        if (stop_search)
+            return 0;
+        
+        // fail-hard beta cutoff
+        if (score >= beta)
+        {
+            // node (move) fails high
+            return beta;
+        }
+        
+        // found a better move
+        if (score > alpha)
+        {
+            // PV node (move)
+            alpha = score;
+        }
+    }
+
+	// return the node that fails low
+	return alpha;
+}
+
+/**
+ * Negamax search with alpha-beta pruning. This is the main search function.
+ * This searches the tree from the root to the leaf and return the best move.
+ * @param alpha The lower bound of the search.
+ * @param beta The upper bound of the search.
+ * @param depth The depth of the search.
+ * @return The best move.
+ */
+static inline int negamax(int alpha, int beta, int depth)
+{
+	// get the search frame of this ply
+	search_frame* ss = frame_at(ply);
+
+	// reset the principal variation of this ply
+	ss->pv_length = 0;
+
+	// unwind an interrupted search
+	check_search_limits();
+
+	if (stop_search)
+		return 0;
+
+	// draw by repetition or by the fifty-move rule (never at the root)
+	if (ply && (is_repetition() || fifty >= 100))
+		return 0;
+
+	// the side to move can force a repetition, so the node is worth at least a draw
+	if (ply && alpha < 0 && has_upcoming_repetition(ply)) {
+		alpha = 0;
+
+		if (alpha >= beta)
+			return alpha;
+	}
+
+	// the result of endgames in the tablebases (never at the root)
+	if (ply && tb_max_pieces && count_bits(occupancies[both]) <= tb_max_pieces) {
+		int wdl = tb_probe_wdl();
+
+		if (wdl >= 0)
+			return tb_wdl_score(wdl, ply);
+	}
+
+	// the exact result of known endgames, draws by insufficient material or by the KPK bitbase
+	if (ply && count_bits(occupancies[both]) <= ENDGAME_MAX_PIECES) {
+		int value;
+
+		if (evaluate_endgame(&value) == endgame_exact)
+			return value;
+	}
+
+    // recurrsion escape condition
+    if (depth == 0)
+        // ru quiescence search
+        return quiescence(alpha, beta);
+
+    // store the static evaluation for pruning decisions at this and later plies
+    int map_ready;
+    ss->static_eval = cached_evaluate(&ss->map, &map_ready);
+
+    // the attack map of the node is shared by evaluation, check detection and pruning
+    if (!map_ready) {
+        stats_start_timer(map_start);
+        generate_attack_map(&ss->map);
+        stats_stop_timer(movegen_cycles, map_start);
+    }
+
+    // never search beyond the end of the search stack
+    if (ply >= MAX_PLY - 1)
+        return ss->static_eval;
+    
+    // increment nodes count
+    nodes++;
+    stats_add(main_nodes, 1);
+
+	// check if king is in check
+	int in_check = (ss->map.attacks[side ^ 1] & bitboards[(side == white) ? K : k]) != 0;
+
+	// extend the search when in check
+	ss->reduction = in_check ? -1 : 0;
+	depth -= ss->reduction;
+	stats_add(check_extensions, in_check);
+
+	// frontier node whose static evaluation is too low for a quiet move to reach alpha
+	int futile = (depth == 1 && ply && !in_check && ss->static_eval + (is_improving(ply) ? 200 : 120) <= alpha);
+	stats_add(futile_nodes, futile);
+
+	// legal moves counter
+	int legal_moves = 0;
+
+    // quiet moves searched so far, penalized if a later move fails high
+    int quiets_searched[256];
+    int quiet_count = 0;
+    
+    // create move list instance
+    move_list _move_list[1];
+    
+    // generate moves
+	stats_start_timer(movegen_start);
+	generate_moves(_move_list);
+	stats_stop_timer(movegen_cycles, movegen_start);
+
+	stats_start_timer(ordering_start);
+	sort_moves(_move_list);
+	stats_stop_timer(ordering_cycles, ordering_start);
+    
+    // loop over moves within a movelist
+    for (int count = 0; count < _move_list->last; count++)
+    {
+        // preserve board state
+        save_board();
+
+        // remember the move made at this ply
+        ss->move = _move_list->arr[count];
+        
+        // increment ply
+        ply++;
+
+        // store the position in the repetition table
+        repetition_table[repetition_index++] = hash_key;
+        
+        // make sure to make only legal moves
+        if (make_move(_move_list->arr[count], all_moves) == 0)
+        {
+            // decrement ply
+            ply--;
+
+            // drop the position from the repetition table
+            repetition_index--;
+            
+            // skip to next move
+            continue;
+        }
+
+		// increment legal moves
+		legal_moves++;
+
+		// futility pruning: skip quiet moves that do not give check (always search one move)
+		if (futile && legal_moves > 1 &&
+				!decode_move_capture(_move_list->arr[count]) && !decode_move_promoted_piece(_move_list->arr[count]) &&
+				!is_square_attacked(lsb_index(bitboards[(side == white) ? K : k]), side ^ 1)) {
+			ply--;
+			repetition_index--;
+			restore_board();
+			stats_add(futility_prunes, 1);
+			continue;
+		}
+        
+        // score current move
+        int score = -negamax(-beta, -alpha, depth - 1);
+        
+        // decrement ply
+        ply--;
+
+        // drop the position from the repetition table
+        repetition_index--;
+
+        // take move back
+        restore_board();
+
+        // the score of an interrupted search is meaningless
+        if (stop_search)
+            return 0;
+        
+        // fail-hard beta cutoff
+        if (score >= beta)
+        {
+			int move = _move_list->arr[count];
+
+			// track how often the first move searched is good enough
+			stats_add(beta_cutoffs, 1);
+
+			if (legal_moves == 1)
+				stats_add(first_move_cutoffs, 1);
+
+			// update quiet move ordering tables
+			if (!decode_move_capture(move)) {
+				int bonus = (depth * depth * 16 < 1600) ? depth * depth * 16 : 1600;
+
+				// store killer moves
+				if (ss->killers[0] != move) {
+					ss->killers[1] = ss->killers[0];
+					ss->killers[0] = move;
+				}
+
+				// store counter move
+				if ((ss - 1)->move)
+					counter_moves[decode_move_piece((ss - 1)->move)][decode_move_target_square((ss - 1)->move)] = move;
+
+				// reward the cutoff move and penalize the quiet moves tried before it
+				update_quiet_histories(move, bonus);
+
+				for (int i = 0; i < quiet_count; i++)
+					update_quiet_histories(quiets_searched[i], -bonus);
+			}
+
+            // node (move) fails high
+            return beta;
+        }
+
+        // remember searched quiet moves
+        if (!decode_move_capture(_move_list->arr[count]))
+            quiets_searched[quiet_count++] = _move_list->arr[count];
+        
+        // found a better move
+        if (score > alpha)
+        {
+            // PV node (move)
+            alpha = score;
+
+            // update the principal variation: this move followed by the child's line
+            ss->pv[0] = _move_list->arr[count];
+            memcpy(&ss->pv[1], (ss + 1)->pv, (ss + 1)->pv_length * sizeof(int));
+            ss->pv_length = (ss + 1)->pv_length + 1;
+        }
+    }
+
+	// there are no legal moves to make in this position
+	if (legal_moves == 0) {
+		// king is in check, return -infinity
+		if (in_check)
+			return -49000 + ply; // adding ply is necessary in order to avoid stalemate
+
+		// king is NOT in check, return stalemate score, this is a draw
+		else
+			return 0;
+	}
+    
+    // node (move) fails low
+    return alpha;
+}
+
+/**
+ * Prepares a new search: resets the search statistics and the search stack.
+ */
+void clear_search() {
+	// reset search statistics
+	nodes = 0;
+	stats_clear();
+	stop_search = 0;
+
+	// fade out move ordering statistics from previous searches
+	age_history();
+
+	// clear the search stack
+	memset(search_stack, 0, sizeof(search_stack));
+	ply = 0;
+
+	// compute the NNUE accumulator of the root, make_move keeps it updated from here
+	if (use_nnue)
+		nnue_refresh_accumulator();
+	else
+		accumulator_index = -1;
+}
+
+/**
+ * Iterative deepening: searches the current position one depth after another until
+ * the maximum depth, the node budget or the time is reached. An interrupted iteration
+ * is discarded, the last completed one gives the result. If even the first iteration
+ * is cut short, its best root move so far is kept, or else the first legal move.
+ * Endgames of the distance to mate tablebases are not searched: they give the move.
+ * @param max_depth The maximum depth.
+ * @param print_info Whether to print an "info" line after every iteration.
+ * @param pv The principal variation of the last completed iteration (at least MAX_PLY moves).
+ * @param best_score The score of the last completed iteration (side to move point of view).
+ * @return The length of the principal variation, 0 if there are no legal moves.
+ */
+int iterative_deepening(int max_depth, int print_info, int* pv, int* best_score) {
+	int pv_length = 0;
+	int start = get_time_millis();
+
+	*best_score = 0;
+
+	// endgames of the distance to mate tablebases are played from them
+	if (tb_max_pieces && count_bits(occupancies[both]) <= tb_max_pieces && (pv[0] = tb_root_move(best_score))) {
+		if (print_info) {
+			printf("info score cp %d depth 1 nodes 0 time %d pv ", *best_score, get_time_millis() - start);
+			print_move(pv[0]);
+			printf("\n");
+		}
+
+		return 1;
+	}
+
+	stats_start_timer(search_start);
+
+	for (int depth = 1; depth <= max_depth; depth++) {
+#ifdef SEARCH_STATS
+		long long iteration_start = nodes;
+#endif
+
+		int score = negamax(-50000, 50000, depth);
+
+#ifdef SEARCH_STATS
+		// nodes of every completed iteration, for the branching factor
+		if (!stop_search && stats.iterations < STATS_ITERATIONS)
+			stats.iteration_nodes[stats.iterations++] = nodes - iteration_start;
+#endif
+
+		// principal variation found from the root
+		search_frame* root = frame_at(0);
+
+		// an interrupted iteration is only used when there is nothing else
+		if (stop_search && pv_length)
+			break;
+
+		if (root->pv_length) {
+			pv_length = root->pv_length;
+			memcpy(pv, root->pv, pv_length * sizeof(int));
+			*best_score = score;
+
+			if (print_info) {
+				// print search info with the principal variation
+				printf("info score cp %d depth %d nodes %lld time %d pv", score, depth, nodes, get_time_millis() - start);
+
+				for (int i = 0; i < pv_length; i++) {
+					printf(" ");
+					print_move(pv[i]);
+				}
+
+				printf("\n");
+			}
+
+			// report completed iterations to the library user, who may stop the search
+			if (search_info_callback && !stop_search) {
+				bbchess_search_info info = { depth, score, nodes, get_time_millis() - start, pv_length, pv };
+
+				if (search_info_callback(&info, search_info_data))
+					break;
+			}
+		}
+
+		if (stop_search)
+			break;
+
+		// the next iteration would not finish in time anyway (once half the time is used)
+		if (stop_time && 2 * (get_time_millis() - start) >= stop_time - start)
+			break;
+	}
+
+	stats_stop_timer(search_cycles, search_start);
+
+	// the budget ran out before any root move was searched: any legal move will do
+	if (!pv_length) {
+		int moves[256];
+
+		if (generate_legal_moves(moves)) {
+			pv[0] = moves[0];
+			pv_length = 1;
+		}
+	}
+
+	return pv_length;
+}
+
+/**
+ * Prints the statistics of the last search of this thread as "info string" lines.
+ * Without SEARCH_STATS only a note that they are compiled out is printed.
+ */
+void print_search_stats() {
+#ifdef SEARCH_STATS
+	long total_nodes = stats.main_nodes + stats.quiescence_nodes;
+
+	// where the nodes are spent
+	printf("info string main nodes %ld quiescence nodes %ld (%.2f%%)\n",
+		stats.main_nodes, stats.quiescence_nodes,
+		total_nodes ? 100.0 * stats.quiescence_nodes / total_nodes : 0.0);
+
+	// move ordering quality
+	printf("info string beta cutoffs %ld first move cutoff rate %.2f%%\n",
+		stats.beta_cutoffs, stats.beta_cutoffs ? 100.0 * stats.first_move_cutoffs / stats.beta_cutoffs : 0.0);
+
+	// pruning and extensions
+	printf("info string futile nodes %ld futility prunes %ld check extensions %ld\n",
+		stats.futile_nodes, stats.futility_prunes, stats.check_extensions);
+
+	// wasted move generation work
+	printf("info string illegal moves %ld of %ld made (%.2f%%)\n",
+		stats.illegal_moves, stats.moves_made,
+		stats.moves_made ? 100.0 * stats.illegal_moves / stats.moves_made : 0.0);
+
+	// cache efficiency
+	printf("info string pawn hash hit rate %.2f%% eval cache hit rate %.2f%%\n",
+		stats.pawn_hash_probes ? 100.0 * stats.pawn_hash_hits / stats.pawn_hash_probes : 0.0,
+		stats.eval_cache_probes ? 100.0 * stats.eval_cache_hits / stats.eval_cache_probes : 0.0);
+
+	// effective branching factor: of the last iteration and averaged over all of them
+	if (stats.iterations > 1 && stats.iteration_nodes[0]) {
+		int last = stats.iterations - 1;
+
+		printf("info string branching factor %.2f average %.2f\n",
+			(double)stats.iteration_nodes[last] / (stats.iteration_nodes[last - 1] ? stats.iteration_nodes[last - 1] : 1),
+			pow((double)stats.iteration_nodes[last] / stats.iteration_nodes[0], 1.0 / last));
+	}
+
+	// time share of the search phases
+	u64 cycles = stats.search_cycles ? stats.search_cycles : 1;
+
+	printf("info string time share movegen %.2f%% ordering %.2f%% evaluation %.2f%%\n",
+		100.0 * stats.movegen_cycles / cycles, 100.0 * stats.ordering_cycles / cycles,
+		100.0 * stats.eval_cycles / cycles);
+#else
+	printf("info string search statistics are not compiled in (build with make stats)\n");
+#endif
+}
+
+/**
+ * Searches the best move for the current position within the limits set by
+ * node_limit and stop_time.
+ * @param depth Maximum depth of the search.
+ * @return Whether a best move was found.
+ */
+int search_position(int depth) {
+	printf("Searching (depth = %d)...\n", depth);
+
+	clear_search();
+
+	// find best move for a given position
+	int pv[MAX_PLY], score;
+	int pv_length = iterative_deepening(depth, 1, pv, &score);
+
+	// the limits only apply to this search
+	node_limit = 0;
+	stop_time = 0;
+
+#ifdef SEARCH_STATS
+	print_search_stats();
+#endif
+	printf("\n");
+
+	// the search always has a move unless the game is over, which UCI answers with a null move
+	if (!pv_length) {
+		printf("bestmove 0000\n");
+		return 0;
+	}
+
+	printf("bestmove ");
+	print_move(pv[0]);
+	printf("\n");
+	return 1;
+}
+
+/**
+ * Searches the current position without printing. Used for self-play.
+ * @param max_depth The maximum depth.
+ * @param max_nodes The node budget (0 for none).
+ * @param best_score The score of the best move (side to move point of view).
+ * @return The best move, or 0 if there are no legal moves.
+ */
+int search_best_move(int max_depth, long max_nodes, int* best_score) {
+	int pv[MAX_PLY];
+
+	clear_search();
+	node_limit = max_nodes;
+
+	int pv_length = iterative_deepening(max_depth, 0, pv, best_score);
+
+	node_limit = 0;
+
+	return pv_length ? pv[0] : 0;
+}
+
+#pragma endregion
+
+#pragma region Mate Search
+
+/*
+	Mate solver for "go mate N": depth-first proof-number search (df-pn)
+
+	The attacker (the side to move at the root) only plays checks, the defender every
+	legal move (all evasions). A node is proven when the attacker mates, disproven when
+	it cannot within the remaining plies. Proof and disproof numbers, the minimal number
+	of leaves to prove or disprove a node, are kept in a hash table of their own and the
+	search always descends into the most proving child, with thresholds that send it
+	back up as soon as another child becomes more promising.
+*/
+
+#define MATE_INFINITY 100000000
+#define MATE_HASH_BUCKETS (1 << 18)
+#define MATE_BUCKET_SIZE 4
+
+/** An entry of the mate hash table. */
+typedef struct {
+	u64 key;			// position hash key
+	int pn, dn;			// proof and disproof numbers
+	short plies;		// remaining plies of the search that stored the numbers
+	short distance;		// plies to mate of a proven node
+	unsigned int work;	// nodes searched below the node (replacement priority)
+} mate_entry;
+
+/** Mate hash table, allocated for every mate search. */
+thread_local mate_entry* mate_table;
+
+/**
+ * Looks up the proof and disproof numbers of the current position. Proofs also hold
+ * with more remaining plies, disproofs with fewer.
+ * @param key The hash key of the position.
+ * @param plies The remaining plies.
+ * @param pn Set to the proof number (left unchanged if the position is not found).
+ * @param dn Set to the disproof number (left unchanged if the position is not found).
+ * @return The entry, NULL if the position is not found.
+ */
+static inline mate_entry* mate_lookup(u64 key, int plies, int* pn, int* dn) {
+	mate_entry* bucket = &mate_table[(key >> 32) % MATE_HASH_BUCKETS * MATE_BUCKET_SIZE];
+
+	for (int index = 0; index < MATE_BUCKET_SIZE; index++) {
+		mate_entry* entry = &bucket[index];
+
+		if (entry->key != key)
+			continue;
+
+		if ((entry->pn == 0 && entry->plies <= plies) || (entry->dn == 0 && entry->plies >= plies)
+			|| entry->plies == plies) {
+			*pn = entry->pn;
+			*dn = entry->dn;
+			return entry;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Stores the proof and disproof numbers of a position, replacing the entry of the same
+ * position and plies or else the one with the least work.
+ * @param key The hash key.
+ * @param plies The remaining plies.
+ * @param pn The proof number.
+ * @param dn The disproof number.
+ * @param distance The plies to mate of a proven position.
+ * @param work The nodes searched below the position.
+ */
+static inline void mate_store(u64 key, int plies, int pn, int dn, int distance, unsigned int work) {
+	mate_entry* bucket = &mate_table[(key >> 32) % MATE_HASH_BUCKETS * MATE_BUCKET_SIZE];
+	mate_entry* replaced = &bucket[0];
+
+	for (int index = 0; index < MATE_BUCKET_SIZE; index++) {
+		mate_entry* entry = &bucket[index];
+
+		if (entry->key == key && entry->plies == plies) {
+			replaced = entry;
+			break;
+		}
+
+		if (entry->work < replaced->work)
+			replaced = entry;
+	}
+
+	*replaced = (mate_entry){ key, pn, dn, (short)plies, (short)distance, work };
+}
+
+/**
+ * Collects the moves searched by the mate solver: checks for the attacker, every legal
+ * move for the defender.
+ * @param attacker Whether the side to move is the attacker.
+ * @param moves The moves (room for 256).
+ * @param keys The hash keys of the positions after the moves.
+ * @param in_check Set to whether the side to move is in check (may be NULL).
+ * @return The number of moves.
+ */
+static int generate_mate_moves(int attacker, int* moves, u64* keys, int* in_check) {
+	move_list _move_list[1];
+	int count = 0;
+
+	generate_moves(_move_list);
+
+	if (in_check)
+		*in_check = is_square_attacked(lsb_index(bitboards[(side == white) ? K : k]), side ^ 1);
+
+	for (int index = 0; index < _move_list->last; index++) {
+		save_board();
+
+		// after the move the opponent is to move: a check attacks its king
+		if (make_move(_move_list->arr[index], all_moves)
+			&& (!attacker || is_square_attacked(lsb_index(bitboards[(side == white) ? K : k]), side ^ 1))) {
+			moves[count] = _move_list->arr[index];
+			keys[count++] = hash_key;
+		}
+
+		restore_board();
+	}
+
+	return count;
+}
+
+/**
+ * Searches a node until its proof number reaches the proof threshold or its disproof
+ * number the disproof threshold, and stores its numbers.
+ * @param attacker Whether the side to move is the attacker.
+ * @param plies The remaining plies.
+ * @param pn_threshold The proof number threshold.
+ * @param dn_threshold The disproof number threshold.
+ */
+static void mate_search_node(int attacker, int plies, int pn_threshold, int dn_threshold) {
+	int moves[256], child_pn[256], child_dn[256];
+	u64 keys[256];
+	long long start_nodes = nodes++;
+	int in_check;
+
+	check_search_limits();
+
+	int count = generate_mate_moves(attacker, moves, keys, &in_check);
+
+	// leaves: no checks or no plies left for the attacker, mate or stalemate for the defender
+	if (attacker && (count == 0 || plies <= 0)) {
+		mate_store(hash_key, plies, MATE_INFINITY, 0, 0, 1);
+		return;
+	}
+
+	if (!attacker && (count == 0 || plies <= 0)) {
+		int mated = count == 0 && in_check;
+		mate_store(hash_key, plies, mated ? 0 : MATE_INFINITY, mated ? MATE_INFINITY : 0, 0, 1);
+		return;
+	}
+
+	while (!stop_search) {
+		int pn = attacker ? MATE_INFINITY : 0, dn = attacker ? 0 : MATE_INFINITY;
+		int best = 0, best_value = MATE_INFINITY, second = MATE_INFINITY;
+		int distance = attacker ? MATE_INFINITY : 0;
+
+		// OR node: proof number of the best child, disproof numbers added (AND node the reverse)
+		for (int index = 0; index < count; index++) {
+			child_pn[index] = 1, child_dn[index] = 1;
+
+			mate_entry* entry = mate_lookup(keys[index], plies - 1, &child_pn[index], &child_dn[index]);
+			int child_distance = (entry && child_pn[index] == 0) ? entry->distance + 1 : 0;
+			int proving = attacker ? child_pn[index] : child_dn[index];
+			int other = attacker ? child_dn[index] : child_pn[index];
+
+			// the most proving child and the runner-up value
+			if (proving < best_value) {
+				second = best_value;
+				best = index, best_value = proving;
+			}
+			else if (proving < second)
+				second = proving;
+
+			if (attacker) {
+				pn = (proving < pn) ? proving : pn;
+				dn = (dn + other < MATE_INFINITY) ? dn + other : MATE_INFINITY;
+
+				if (child_pn[index] == 0 && child_distance < distance)
+					distance = child_distance;
+			} else {
+				dn = (proving < dn) ? proving : dn;
+				pn = (pn + other < MATE_INFINITY) ? pn + other : MATE_INFINITY;
+
+				if (child_distance > distance)
+					distance = child_distance;
+			}
+		}
+
+		// back to the parent once over a threshold (proven and disproven nodes always are)
+		if (pn >= pn_threshold || dn >= dn_threshold || stop_search) {
+			mate_store(hash_key, plies, pn, dn, (pn == 0) ? distance : 0, (unsigned int)(nodes - start_nodes));
+			return;
+		}
+
+		// thresholds of the best child: until it stops being the best or the node is solved
+		int pn_child_threshold, dn_child_threshold;
+
+		if (attacker) {
+			pn_child_threshold = (pn_threshold < second + 1) ? pn_threshold : second + 1;
+			dn_child_threshold = dn_threshold - dn + child_dn[best];
+		} else {
+			dn_child_threshold = (dn_threshold < second + 1) ? dn_threshold : second + 1;
+			pn_child_threshold = pn_threshold - pn + child_pn[best];
+		}
+
+		save_board();
+		make_move(moves[best], all_moves);
+		mate_search_node(!attacker, plies - 1, pn_child_threshold, dn_child_threshold);
+		restore_board();
+	}
+}
+
+/**
+ * Follows the mate hash table from the root: the quickest mating check for the
+ * attacker, the longest resistance for the defender.
+ * @param plies The remaining plies at the root.
+ * @param pv The mating line (at least plies moves).
+ * @return The length of the mating line, 0 if it is not in the table anymore.
+ */
+int extract_mate_line(int plies, int* pv) {
+	int moves[256];
+	u64 keys[256];
+	int length = 0;
+
+	save_board();
+
+	for (int attacker = 1; plies > 0; attacker = !attacker, plies--) {
+		int count = generate_mate_moves(attacker, moves, keys, NULL);
+		int best = -1, best_distance = 0;
+
+		for (int index = 0; index < count; index++) {
+			int pn = 1, dn = 1;
+			mate_entry* entry = mate_lookup(keys[index], plies - 1, &pn, &dn);
+
+			if (entry == NULL || pn != 0)
+				continue;
+
+			if (best < 0 || (attacker ? entry->distance < best_distance : entry->distance > best_distance))
+				best = index, best_distance = entry->distance;
+		}
+
+		// the line ends with mate (or where the table lost it)
+		if (best < 0)
+			break;
+
+		make_move(moves[best], all_moves);
+		pv[length++] = moves[best];
+	}
+
+	restore_board();
+
+	return length;
+}
+
+/**
+ * Searches a mate for the side to move in up to the given number of moves, one more
+ * move at a time so the quickest mate is found, and prints it as UCI "info" lines.
+ * @param moves The maximum number of moves of the attacker.
+ * @param pv The mating line (at least 2 * moves plies).
+ * @return The length of the mating line, 0 if no mate was found.
+ */
+int search_mate(int moves, int* pv) {
+	int start = get_time_millis();
+	int length = 0;
+
+	nodes = 0;
+	stop_search = 0;
+
+	// the solver never evaluates
+	accumulator_index = -1;
+
+	mate_table = calloc((size_t)MATE_HASH_BUCKETS * MATE_BUCKET_SIZE, sizeof(mate_entry));
+
+	if (mate_table == NULL) {
+		printf("info string could not allocate the mate hash table\n");
+		return 0;
+	}
+
+	for (int depth = 1; depth <= moves && !stop_search; depth++) {
+		int plies = 2 * depth - 1, pn = 1, dn = 1;
+
+		mate_search_node(1, plies, MATE_INFINITY, MATE_INFINITY);
+		mate_lookup(hash_key, plies, &pn, &dn);
+
+		if (pn == 0) {
+			length = extract_mate_line(plies, pv);
+
+			printf("info depth %d score mate %d nodes %lld time %d pv", plies, depth, nodes, get_time_millis() - start);
+
+			for (int index = 0; index < length; index++) {
+				printf(" ");
+				print_move(pv[index]);
+			}
+
+			printf("\n");
+			break;
+		}
+	}
+
+	free(mate_table);
+	mate_table = NULL;
+
+	return length;
+}
+
+#pragma endregion
+
+#pragma region Threads
+
+/** Stack size of worker threads, room for deep searches on top of the thread-local state. */
+#define THREAD_STACK_SIZE (64 * 1024 * 1024)
+
+/** Maximum number of worker threads. */
+#define MAX_THREADS 256
+
+/**
+ * Gets the number of logical processors of the machine.
+ * @return The number of logical processors.
+ */
+int get_cpu_count() {
+#ifdef WIN64
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return (int)info.dwNumberOfProcessors;
+#else
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return (count > 0) ? (int)count : 1;
+#endif
+}
+
+/**
+ * Runs a worker function on several threads and waits for all of them to finish.
+ * Every thread starts with its own, fresh copy of the thread-local engine state.
+ * @param count The number of threads (at most MAX_THREADS).
+ * @param worker The worker function.
+ * @param args Array of count worker arguments.
+ * @param arg_size The size of one worker argument.
+ */
+void run_threads(int count, void* (*worker)(void*), void* args, size_t arg_size) {
+	pthread_t threads[MAX_THREADS];
+	pthread_attr_t attributes;
+
+	if (count > MAX_THREADS)
+		count = MAX_THREADS;
+
+	pthread_attr_init(&attributes);
+	pthread_attr_setstacksize(&attributes, THREAD_STACK_SIZE);
+
+	// start the workers
+	for (int thread = 0; thread < count; thread++)
+		pthread_create(&threads[thread], &attributes, worker, (char*)args + thread * arg_size);
+
+	// wait for all of them
+	for (int thread = 0; thread < count; thread++)
+		pthread_join(threads[thread], NULL);
+
+	pthread_attr_destroy(&attributes);
+}
+
+#pragma endregion
+
+#pragma region SAN & PGN
+
+/** Piece type (P to K) of the uppercase SAN piece letters, -1 for other characters. */
+static inline int san_piece_type(char letter) {
+	switch (letter) {
+		case 'N': return N;
+		case 'B': return B;
+		case 'R': return R;
+		case 'Q': return Q;
+		case 'K': return K;
+		default: return -1;
+	}
+}
+
+/**
+ * Writes a legal move of the current position in standard algebraic notation
+ * (e.g. "Nbd7", "exd8=Q+", "O-O#").
+ * @param move The move.
+ * @param buffer The output, at least 8 characters.
+ * @return The length of the move.
+ */
+int format_san(int move, char* buffer) {
+	int source_square = decode_move_source_square(move);
+	int target_square = decode_move_target_square(move);
+	int type = decode_move_piece(move) % 6;
+	char* output = buffer;
+
+	if (decode_move_castle(move))
+		output += sprintf(output, (target_square == g1 || target_square == g8) ? "O-O" : "O-O-O");
+	else {
+		if (type == P) {
+			// pawn captures name the file they start from
+			if (decode_move_capture(move)) {
+				*output++ = 'a' + source_square % 8;
+				*output++ = 'x';
+			}
+		} else {
+			*output++ = ascii_pieces[type];
+
+			// name the file, the rank or both when another piece of the same type can go there too
+			int moves[256], count = generate_legal_moves(moves);
+			int ambiguous = 0, same_file = 0, same_rank = 0;
+
+			for (int index = 0; index < count; index++) {
+				int other = moves[index];
+				int other_source = decode_move_source_square(other);
+
+				if (other_source != source_square && decode_move_piece(other) == decode_move_piece(move) &&
+						decode_move_target_square(other) == target_square && !decode_move_castle(other)) {
+					ambiguous = 1;
+					same_file |= (other_source % 8 == source_square % 8);
+					same_rank |= (other_source / 8 == source_square / 8);
+				}
+			}
+
+			if (ambiguous && (!same_file || same_rank))
+				*output++ = 'a' + source_square % 8;
+
+			if (ambiguous && same_file)
+				*output++ = '8' - source_square / 8;
+
+			if (decode_move_capture(move))
+				*output++ = 'x';
+		}
+
+		*output++ = square_to_coordinates[target_square][0];
+		*output++ = square_to_coordinates[target_square][1];
+
+		if (decode_move_promoted_piece(move)) {
+			*output++ = '=';
+			*output++ = ascii_pieces[decode_move_promoted_piece(move) % 6];
+		}
+	}
+
+	// check or mate
+	save_board();
+
+	if (make_move(move, all_moves) &&
+			is_square_attacked(lsb_index(bitboards[(side == white) ? K : k]), side ^ 1)) {
+		int replies[256];
+		*output++ = generate_legal_moves(replies) ? '+' : '#';
+	}
+
+	restore_board();
+
+	*output = '\0';
+	return (int)(output - buffer);
+}
+
+/**
+ * Parses a move in standard algebraic notation for the current position. Check, mate
+ * and annotation suffixes are ignored, "0-0" castling and promotions without "=" accepted.
+ * @param san The move (need not be terminated).
+ * @param length The length of the move.
+ * @return The legal move, 0 if it is malformed, illegal or ambiguous.
+ */
+int parse_san(const char* san, int length) {
+	int type = P, source_file = -1, source_rank = -1, target_square = -1, promoted_type = -1, castle = 0;
+
+	// strip check, mate and annotation suffixes
+	while (length > 0 && (san[length - 1] == '+' || san[length - 1] == '#' || san[length - 1] == '!' || san[length - 1] == '?'))
+		length--;
+
+	if ((length == 3 && (strncmp(san, "O-O", 3) == 0 || strncmp(san, "0-0", 3) == 0)))
+		castle = 1;
+	else if ((length == 5 && (strncmp(san, "O-O-O", 5) == 0 || strncmp(san, "0-0-0", 5) == 0)))
+		castle = 2;
+	else {
+		int start = 0, end = length;
+
+		// promotion, with or without "="
+		if (end >= 3 && san_piece_type(san[end - 1]) >= N && san_piece_type(san[end - 1]) <= Q &&
+				(san[end - 2] == '=' || (san[end - 2] >= '1' && san[end - 2] <= '8'))) {
+			promoted_type = san_piece_type(san[end - 1]);
+			end -= (san[end - 2] == '=') ? 2 : 1;
+		}
+
+		// target square
+		if (end < 2 || san[end - 2] < 'a' || san[end - 2] > 'h' || san[end - 1] < '1' || san[end - 1] > '8')
+			return 0;
+
+		target_square = ('8' - san[end - 1]) * 8 + (san[end - 2] - 'a');
+		end -= 2;
+
+		// piece letter, pawns have none
+		if (start < end && san_piece_type(san[start]) >= 0)
+			type = san_piece_type(san[start++]);
+
+		// capture sign
+		if (end > start && (san[end - 1] == 'x' || san[end - 1] == ':'))
+			end--;
+
+		// disambiguation by file and/or rank
+		for (int index = start; index < end; index++) {
+			if (san[index] >= 'a' && san[index] <= 'h' && source_file < 0 && source_rank < 0)
+				source_file = san[index] - 'a';
+			else if (san[index] >= '1' && san[index] <= '8' && source_rank < 0)
+				source_rank = '8' - san[index];
+			else
+				return 0;
+		}
+	}
+
+	// match the pseudo legal moves, checking the legality of candidates only
+	move_list _move_list[1];
+	int found = 0;
+
+	generate_moves(_move_list);
+
+	for (int index = 0; index < _move_list->last; index++) {
+		int move = _move_list->arr[index];
+		int move_target = decode_move_target_square(move);
+
+		if (castle) {
+			if (!decode_move_castle(move) || (castle == 1) != (move_target == g1 || move_target == g8))
+				continue;
+		} else {
+			int promoted_piece = decode_move_promoted_piece(move);
+
+			if (decode_move_castle(move) || move_target != target_square ||
+					decode_move_piece(move) % 6 != type ||
+					(source_file >= 0 && decode_move_source_square(move) % 8 != source_file) ||
+					(source_rank >= 0 && decode_move_source_square(move) / 8 != source_rank) ||
+					(promoted_piece ? promoted_piece % 6 : -1) != promoted_type)
+				continue;
+		}
+
+		save_board();
+		int legal = make_move(move, all_moves);
+		restore_board();
+
+		if (!legal)
+			continue;
+
+		// two legal moves match: the move is ambiguous
+		if (found)
+			return 0;
+
+		found = move;
+	}
+
+	return found;
+}
+
+/** Maximum number of tags of a PGN game kept by the reader. */
+#define PGN_MAX_TAGS 32
+
+/** Results of PGN games, from White's point of view. */
+enum { pgn_black_wins = -1, pgn_draw = 0, pgn_white_wins = 1, pgn_unknown_result = 2 };
+
+/** A PGN tag pair. */
+typedef struct {
+	text_span name;
+	text_span value;	// without quotes, escapes are kept
+} pgn_tag;
+
+/** A game of a PGN file. Its texts point into the mapped file. */
+typedef struct {
+	int tag_count;
+	pgn_tag tags[PGN_MAX_TAGS];
+	text_span movetext;		// moves, comments and variations, without the result
+	int result;				// pgn_white_wins, pgn_draw, pgn_black_wins or pgn_unknown_result
+} pgn_game;
+
+/**
+ * Called for every position of a replayed game, with the engine state of the
+ * calling thread set to the position.
+ * @param game The game.
+ * @param ply The number of moves played before the position.
+ * @param move The move played from the position, 0 for the final position.
+ * @param user_data The data given to the reader.
+ * @return Non-zero to stop replaying the game.
+ */
+typedef int (*pgn_position_callback)(const pgn_game* game, int ply, int move, void* user_data);
+
+/**
+ * Gets the value of a tag of a PGN game.
+ * @param game The game.
+ * @param name The name of the tag.
+ * @return The value, with a NULL text if the game has no such tag.
+ */
+text_span pgn_tag_value(const pgn_game* game, const char* name) {
+	int length = (int)strlen(name);
+
+	for (int index = 0; index < game->tag_count; index++)
+		if (game->tags[index].name.length == length && strncmp(game->tags[index].name.text, name, length) == 0)
+			return game->tags[index].value;
+
+	return (text_span){ NULL, 0 };
+}
+
+/**
+ * Gets the result of a game termination marker.
+ * @param text The text, at the start of a token.
+ * @param end The end of the text.
+ * @param length Set to the length of the marker.
+ * @return The result, or -2 if the text is not a termination marker.
+ */
+static inline int pgn_termination(const char* text, const char* end, int* length) {
+	static const char* markers[] = { "1-0", "0-1", "1/2-1/2", "*" };
+	static const int results[] = { pgn_white_wins, pgn_black_wins, pgn_draw, pgn_unknown_result };
+
+	for (int index = 0; index < 4; index++) {
+		int marker_length = (int)strlen(markers[index]);
+
+		// a whole token only
+		if (end - text >= marker_length && strncmp(text, markers[index], marker_length) == 0 &&
+				(text + marker_length == end || strchr(" \t\r\n", text[marker_length]))) {
+			*length = marker_length;
+			return results[index];
+		}
+	}
+
+	return -2;
+}
+
+/**
+ * Finds the start of the first game at or after a position of a PGN file:
+ * a tag line that follows an empty line (or the start of the file).
+ * @param text The position.
+ * @param begin The start of the file.
+ * @param end The end of the file.
+ * @return The start of the game, or end if there is none.
+ */
+const char* pgn_find_game(const char* text, const char* begin, const char* end) {
+	for (; text < end; text++) {
+		if (*text != '[')
+			continue;
+
+		// the tag must start a line that follows an empty line
+		const char* line = text;
+
+		if (line == begin)
+			return text;
+
+		if (line[-1] != '\n')
+			continue;
+
+		const char* previous = line - 1;
+
+		if (previous > begin && previous[-1] == '\r')
+			previous--;
+
+		if (previous == begin || previous[-1] == '\n')
+			return text;
+	}
+
+	return end;
+}
+
+/**
+ * Reads the next game of a PGN file without copying anything.
+ * @param text Where to start reading.
+ * @param end The end of the file.
+ * @param game The game.
+ * @return Where the next game starts, or NULL if there are no more games.
+ */
+const char* pgn_next_game(const char* text, const char* end, pgn_game* game) {
+	game->tag_count = 0;
+	game->result = pgn_unknown_result;
+
+	// skip blank space and a byte order mark
+	while (text < end && (strchr(" \t\r\n", *text) || (unsigned char)*text == 0xEF || (unsigned char)*text == 0xBB || (unsigned char)*text == 0xBF))
+		text++;
+
+	if (text >= end)
+		return NULL;
+
+	// tag pairs: [Name "Value"]
+	while (text < end && *text == '[') {
+		const char* line_end = memchr(text, '\n', end - text);
+		line_end = line_end ? line_end : end;
+
+		const char* name = ++text;
+
+		while (text < line_end && *text != ' ' && *text != ']')
+			text++;
+
+		const char* quote = memchr(text, '"', line_end - text);
+
+		if (quote && game->tag_count < PGN_MAX_TAGS) {
+			const char* value = quote + 1;
+			const char* value_end = value;
+
+			while (value_end < line_end && *value_end != '"')
+				value_end += (*value_end == '\\' && value_end + 1 < line_end) ? 2 : 1;
+
+			game->tags[game->tag_count++] = (pgn_tag){
+				{ name, (int)(text - name) }, { value, (int)(value_end - value) }
+			};
+		}
+
+		text = line_end;
+
+		while (text < end && strchr(" \t\r\n", *text))
+			text++;
+	}
+
+	// movetext, up to the termination marker (or the tags of the next game)
+	game->movetext.text = text;
+	int depth = 0, at_line_start = 1;
+
+	while (text < end) {
+		char character = *text;
+
+		if (character == '\n') {
+			at_line_start = 1;
+			text++;
+			continue;
+		}
+
+		// the next game starts without a termination marker
+		if (at_line_start && character == '[' && depth == 0)
+			break;
+
+		at_line_start = 0;
+
+		// comments and escaped lines
+		if (character == '{') {
+			const char* comment_end = memchr(text, '}', end - text);
+			text = comment_end ? comment_end + 1 : end;
+		} else if (character == ';' || (character == '%' && (text == game->movetext.text || text[-1] == '\n'))) {
+			const char* line_end = memchr(text, '\n', end - text);
+			text = line_end ? line_end : end;
+		} else if (character == '(') {
+			depth++;
+			text++;
+		} else if (character == ')') {
+			depth -= (depth > 0);
+			text++;
+		} else if (strchr(" \t\r.", character)) {
+			text++;
+		} else {
+			// termination marker, outside of variations
+			int length;
+			int result = (depth == 0 && (text == game->movetext.text || strchr(" \t\r\n.", text[-1])))
+				? pgn_termination(text, end, &length) : -2;
+
+			if (result != -2) {
+				game->movetext.length = (int)(text - game->movetext.text);
+				game->result = result;
+				return text + length;
+			}
+
+			// skip the token
+			while (text < end && !strchr(" \t\r\n{}();", *text))
+				text++;
+		}
+	}
+
+	game->movetext.length = (int)(text - game->movetext.text);
+	return text;
+}
+
+/**
+ * Replays a PGN game, calling back for every position.
+ * @param game The game.
+ * @param callback Called for every position (may be NULL).
+ * @param user_data Passed to the callback.
+ * @return The number of moves played, -1 if the game has an invalid start position or move.
+ */
+int pgn_replay_game(const pgn_game* game, pgn_position_callback callback, void* user_data) {
+	text_span fen = pgn_tag_value(game, "FEN");
+
+	// start position: the FEN tag or the standard one
+	if (fen.text) {
+		char buffer[FEN_BUFFER_SIZE];
+
+		if (fen.length >= FEN_BUFFER_SIZE)
+			return -1;
+
+		memcpy(buffer, fen.text, fen.length);
+		buffer[fen.length] = '\0';
+
+		if (parse_fen(buffer) != fen_ok)
+			return -1;
+	} else
+		parse_fen(fen_starting_position);
+
+	const char* text = game->movetext.text;
+	const char* end = text + game->movetext.length;
+	int ply = 0, depth = 0;
+
+	while (text < end) {
+		char character = *text;
+
+		// comments, variations and escaped lines
+		if (character == '{') {
+			const char* comment_end = memchr(text, '}', end - text);
+			text = comment_end ? comment_end + 1 : end;
+			continue;
+		}
+
+		if (character == ';' || (character == '%' && (text == game->movetext.text || text[-1] == '\n'))) {
+			const char* line_end = memchr(text, '\n', end - text);
+			text = line_end ? line_end : end;
+			continue;
+		}
+
+		if (character == '(' || character == ')') {
+			depth += (character == '(') ? 1 : -(depth > 0);
+			text++;
+			continue;
+		}
+
+		if (strchr(" \t\r\n.", character)) {
+			text++;
+			continue;
+		}
+
+		// token
+		const char* token = text;
+
+		while (text < end && !strchr(" \t\r\n{}();", *text))
+			text++;
+
+		// moves of variations, NAGs and move numbers (possibly glued to the move, e.g. "12.e4")
+		if (depth || *token == '$')
+			continue;
+
+		if (*token >= '1' && *token <= '9') {
+			while (token < text && ((*token >= '0' && *token <= '9') || *token == '.'))
+				token++;
+
+			if (token == text)
+				continue;
+		}
+
+		int move = parse_san(token, (int)(text - token));
+
+		if (!move)
+			return -1;
+
+		if (callback && callback(game, ply, move, user_data))
+			return ply;
+
+		play_game_move(move);
+		ply++;
+	}
+
+	// the final position
+	if (callback)
+		callback(game, ply, 0, user_data);
+
+	return ply;
+}
+
+/** Totals of reading a PGN file. */
+typedef struct {
+	long games;			// games read
+	long positions;		// positions replayed, including the final ones
+	long errors;		// games with an invalid start position or move
+} pgn_totals;
+
+/** Part of a PGN file read by one thread. */
+typedef struct {
+	const char* begin;
+	const char* end;
+	pgn_position_callback callback;
+	void* user_data;
+	pgn_totals totals;
+} pgn_job;
+
+/**
+ * Reads and replays the games of one part of a PGN file.
+ * @param arg The PGN job.
+ */
+void* pgn_worker(void* arg) {
+	pgn_job* job = arg;
+	pgn_game game;
+	const char* text = job->begin;
+
+	while ((text = pgn_next_game(text, job->end, &game))) {
+		int plies = pgn_replay_game(&game, job->callback, job->user_data);
+
+		job->totals.games++;
+
+		if (plies < 0)
+			job->totals.errors++;
+		else
+			job->totals.positions += plies + 1;
+	}
+
+	return NULL;
+}
+
+/**
+ * Reads a PGN file, memory mapped, and replays all its games. The file is split
+ * at game boundaries into one part per thread; the callback is called from all
+ * of them at the same time, with the engine state of each thread.
+ * @param path The path of the file.
+ * @param threads The number of threads (1 to MAX_THREADS).
+ * @param callback Called for every position (may be NULL).
+ * @param user_data Passed to the callback: shared by all threads, or an array
+ * with one element per thread if user_data_size is not 0.
+ * @param user_data_size The size of the elements of user_data, 0 to share it.
+ * @param totals The totals.
+ * @return Whether the file could be read.
+ */
+int read_pgn(const char* path, int threads, pgn_position_callback callback, void* user_data, size_t user_data_size, pgn_totals* totals) {
+	pgn_job jobs[MAX_THREADS];
+	size_t size;
+	const char* data = map_file(path, &size);
+
+	*totals = (pgn_totals){ 0, 0, 0 };
+
+	if (!data)
+		return 0;
+
+	threads = (threads < 1) ? 1 : (threads > MAX_THREADS) ? MAX_THREADS : threads;
+
+	// split the file at game boundaries
+	const char* end = data + size;
+	const char* begin = data;
+
+	for (int thread = 0; thread < threads; thread++) {
+		const char* split = (thread == threads - 1) ? end : pgn_find_game(data + size / threads * (thread + 1), data, end);
+
+		jobs[thread] = (pgn_job){ begin, (split > begin) ? split : begin, callback,
+			user_data_size ? (char*)user_data + thread * user_data_size : user_data, { 0, 0, 0 } };
+		begin = jobs[thread].end;
+	}
+
+	run_threads(threads, pgn_worker, jobs, sizeof(pgn_job));
+
+	for (int thread = 0; thread < threads; thread++) {
+		totals->games += jobs[thread].totals.games;
+		totals->positions += jobs[thread].totals.positions;
+		totals->errors += jobs[thread].totals.errors;
+	}
+
+	unmap_file((void*)data, size);
+	return 1;
+}
+
+/**
+ * Parses and runs a "pgn" command: replays all games of a PGN file and prints the totals.
+ * @param command The input string (e.g. "pgn games.pgn threads 4").
+ */
+void parse_pgn_command(char* command) {
+	char path[1024] = "", *argument;
+	int threads = 1;
+	pgn_totals totals;
+
+	// the file is the first argument
+	sscanf(command + 3, " %1023s", path);
+
+	if ((argument = strstr(command, " threads ")))
+		threads = atoi(argument + 9);
+
+	int start = get_time_millis();
+
+	if (!read_pgn(path, threads, NULL, NULL, 0, &totals)) {
+		printf("could not read PGN file '%s'\n", path);
+		return;
+	}
+
+	int elapsed = get_time_millis() - start;
+
+	printf("Games           : %ld\n", totals.games);
+	printf("Positions       : %ld\n", totals.positions);
+	printf("Invalid games   : %ld\n", totals.errors);
+	printf("Time (ms)       : %d\n", elapsed);
+	printf("Positions/second: %ld\n", totals.positions * 1000 / (elapsed ? elapsed : 1));
+}
+
+#pragma endregion
+
+#pragma region EPD Files
+
+/**
+ * Called for every record of an EPD file, from the thread reading it.
+ * @param record The record; check its error, invalid lines are passed too.
+ * @param user_data The data given to the reader.
+ */
+typedef void (*epd_record_callback)(const epd_record* record, void* user_data);
+
+/** Totals of reading an EPD file. */
+typedef struct {
+	long records;		// records read, including invalid ones
+	long errors;		// records with an invalid position or too long
+	size_t bytes;		// size of the file
+} epd_totals;
+
+/** Part of an EPD file read by one thread. */
+typedef struct {
+	const char* begin;
+	const char* end;
+	long line;			// number of the line before the part
+	epd_record_callback callback;
+	void* user_data;
+	epd_totals totals;
+} epd_job;
+
+/**
+ * Reads the records of one part of an EPD file.
+ * @param arg The EPD job.
+ */
+void* epd_worker(void* arg) {
+	epd_job* job = arg;
+	epd_record record;
+	char line[EPD_LINE_SIZE];
+	const char* text = job->begin;
+
+	while (text < job->end) {
+		const char* newline = memchr(text, '\n', job->end - text);
+		const char* line_end = newline ? newline : job->end;
+		size_t length = line_end - text;
+
+		job->line++;
+
+		if (length >= EPD_LINE_SIZE) {
+			record.error = fen_too_long;
+			record.line = job->line;
+		} else {
+			// the mapped file is read-only: the line is copied to be terminated
+			memcpy(line, text, length);
+			line[(length && line_end[-1] == '\r') ? length - 1 : length] = '\0';
+
+			if (!parse_epd_line(line, job->line, &record)) {
+				text = line_end + 1;
+				continue;
+			}
+		}
+
+		job->totals.records++;
+
+		if (record.error != fen_ok)
+			job->totals.errors++;
+
+		if (job->callback)
+			job->callback(&record, job->user_data);
+
+		text = line_end + 1;
+	}
+
+	return NULL;
+}
+
+/**
+ * Counts the lines of one part of an EPD file, which numbers the lines of the next parts.
+ * @param arg The EPD job, whose line is set to the count.
+ */
+void* epd_line_worker(void* arg) {
+	epd_job* job = arg;
+	long count = 0;
+
+	for (const char* text = job->begin; text < job->end; text++)
+		count += *text == '\n';
+
+	job->line = count;
+	return NULL;
+}
+
+/**
+ * Reads an EPD file, memory mapped, and parses all its records. The file is split
+ * at line boundaries into one part per thread; the callback is called from all of
+ * them at the same time.
+ * @param path The path of the file.
+ * @param threads The number of threads (1 to MAX_THREADS).
+ * @param callback Called for every record (may be NULL).
+ * @param user_data Passed to the callback: shared by all threads, or an array
+ * with one element per thread if user_data_size is not 0.
+ * @param user_data_size The size of the elements of user_data, 0 to share it.
+ * @param totals The totals.
+ * @return Whether the file could be read.
+ */
+int read_epd(const char* path, int threads, epd_record_callback callback, void* user_data, size_t user_data_size, epd_totals* totals) {
+	epd_job jobs[MAX_THREADS];
+	size_t size;
+	const char* data = map_file(path, &size);
+
+	*totals = (epd_totals){ 0, 0, 0 };
+
+	if (!data)
+		return 0;
+
+	totals->bytes = size;
+
+	threads = (threads < 1) ? 1 : (threads > MAX_THREADS) ? MAX_THREADS : threads;
+
+	// split the file after new lines
+	const char* end = data + size;
+	const char* begin = data;
+
+	for (int thread = 0; thread < threads; thread++) {
+		const char* split = (thread == threads - 1) ? end : data + size / threads * (thread + 1);
+
+		if (split < begin)
+			split = begin;
+
+		while (split < end && split > data && split[-1] != '\n')
+			split++;
+
+		jobs[thread] = (epd_job){ begin, split, 0, callback,
+			user_data_size ? (char*)user_data + thread * user_data_size : user_data, { 0, 0, 0 } };
+
+		begin = split;
+	}
+
+	// number the lines: every part starts after the lines of the parts before it
+	if (threads > 1) {
+		long line = 0;
+
+		run_threads(threads, epd_line_worker, jobs, sizeof(epd_job));
+
+		for (int thread = 0; thread < threads; thread++) {
+			long count = jobs[thread].line;
+
+			jobs[thread].line = line;
+			line += count;
+		}
+	}
+
+	run_threads(threads, epd_worker, jobs, sizeof(epd_job));
+
+	for (int thread = 0; thread < threads; thread++) {
+		totals->records += jobs[thread].totals.records;
+		totals->errors += jobs[thread].totals.errors;
+	}
+
+	unmap_file((void*)data, size);
+	return 1;
+}
+
+/**
+ * Parses and runs an "epd" command: parses all records of an EPD file and prints the totals.
+ * @param command The input string (e.g. "epd positions.epd threads 4").
+ */
+void parse_epd_command(char* command) {
+	char path[1024] = "", *argument;
+	int threads = 1;
+	epd_totals totals;
+
+	// the file is the first argument
+	sscanf(command + 3, " %1023s", path);
+
+	if ((argument = strstr(command, " threads ")))
+		threads = atoi(argument + 9);
+
+	int start = get_time_millis();
+
+	if (!read_epd(path, threads, NULL, NULL, 0, &totals)) {
+		printf("could not read EPD file '%s'\n", path);
+		return;
+	}
+
+	int elapsed = get_time_millis() - start;
+
+	printf("Records         : %ld\n", totals.records);
+	printf("Invalid records : %ld\n", totals.errors);
+	printf("Time (ms)       : %d\n", elapsed);
+	printf("Megabytes/second: %ld\n", (long)(totals.bytes * 1000 / (elapsed ? elapsed : 1) >> 20));
+}
+
+/** Counts of the perft checks of one thread of a perft suite. */
+typedef struct {
+	int max_depth;
+	long positions;
+	long invalid;
+	long checks;
+	long failures;
+	long long nodes;
+} perft_suite_counts;
+
+/**
+ * Checks the perft results of an EPD record (an epd_record_callback).
+ * @param record The record.
+ * @param user_data The counts of the thread.
+ */
+void check_perft_record(const epd_record* record, void* user_data) {
+	perft_suite_counts* counts = user_data;
+
+	if (record->error != fen_ok) {
+		printf("line %ld: %s\n", record->line, fen_errors[record->error]);
+		counts->invalid++;
+		return;
+	}
+
+	counts->positions++;
+
+	for (int depth = 1; depth <= record->perft_depth && depth <= counts->max_depth; depth++) {
+		if (record->perft[depth] < 0)
+			continue;
+
+		load_position(&record->position);
+		nodes = 0;
+		perft_driver(depth);
+
+		counts->nodes += nodes;
+		counts->checks++;
+
+		if (nodes != record->perft[depth]) {
+			printf("line %ld: D%d expected %lld, got %lld\n", record->line, depth, record->perft[depth], nodes);
+			counts->failures++;
+		}
+	}
+}
+
+/**
+ * Parses and runs a "perftsuite" command: checks the perft results ("D<n>" operations)
+ * of an EPD file, printing the mismatches and invalid lines.
+ * @param command The input string (e.g. "perftsuite standard.epd depth 5 threads 4").
+ */
+void parse_perftsuite_command(char* command) {
+	char path[1024] = "", *argument;
+	int max_depth = 5, threads = 1;
+	perft_suite_counts counts[MAX_THREADS];
+	epd_totals totals;
+
+	// the file is the first argument
+	sscanf(command + 10, " %1023s", path);
+
+	if ((argument = strstr(command, " depth ")))
+		max_depth = atoi(argument + 7);
+
+	if ((argument = strstr(command, " threads ")))
+		threads = atoi(argument + 9);
+
+	threads = (threads < 1) ? 1 : (threads > MAX_THREADS) ? MAX_THREADS : threads;
+
+	for (int thread = 0; thread < threads; thread++)
+		counts[thread] = (perft_suite_counts){ max_depth, 0, 0, 0, 0, 0 };
+
+	int start = get_time_millis();
+
+	if (!path[0] || !read_epd(path, threads, check_perft_record, counts, sizeof(perft_suite_counts), &totals)) {
+		printf("could not open EPD file '%s'\n", path);
+		return;
+	}
+
+	int elapsed = get_time_millis() - start;
+
+	// add up the threads
+	for (int thread = 1; thread < threads; thread++) {
+		counts[0].positions += counts[thread].positions;
+		counts[0].invalid += counts[thread].invalid;
+		counts[0].checks += counts[thread].checks;
+		counts[0].failures += counts[thread].failures;
+		counts[0].nodes += counts[thread].nodes;
+	}
+
+	printf("Positions       : %ld\n", counts[0].positions);
+	printf("Invalid lines   : %ld\n", counts[0].invalid);
+	printf("Perft checks    : %ld\n", counts[0].checks);
+	printf("Failures        : %ld\n", counts[0].failures);
+	printf("Nodes           : %lld\n", counts[0].nodes);
+	printf("Nodes/second    : %lld\n", counts[0].nodes * 1000 / (elapsed ? elapsed : 1));
+}
+
+#pragma endregion
+
+#pragma region Opening Book
+
+/*
+	Polyglot opening books
+
+	entry			16 bytes, big endian: key (uint64), move (uint16), weight (uint16), learn (uint32)
+	order			sorted by key, entries of the same position are adjacent
+	key				XOR of the keys of every piece on its square, the castling rights, the en passant
+					file (only if a pawn of the side to move can capture en passant) and White to move
+	move			to file (bits 0-2), to row (3-5), from file (6-8), from row (9-11), promotion
+					(12-14, 1 knight to 4 queen); castling is encoded as the king taking its own rook
+
+	Rows count from White's first rank. The keys are the Random64 table of the Polyglot
+	reference, so books built by other tools match the books of the "makebook" command.
+*/
+
+#define BOOK_ENTRY_SIZE 16
+
+// offsets of the castling, en passant and side keys in polyglot_keys
+#define POLYGLOT_CASTLE_KEYS 768
+#define POLYGLOT_ENPASSANT_KEYS 772
+#define POLYGLOT_TURN_KEY 780
+
+/** Keys of pieces on squares [64 * kind + 8 * row + file], castling rights, en passant files and the turn. */
+const u64 polyglot_keys[781] = {
+	0x9D39247E33776D41ULL, 0x2AF7398005AAA5C7ULL, 0x44DB015024623547ULL, 0x9C15F73E62A76AE2ULL,
+	0x75834465489C0C89ULL, 0x3290AC3A203001BFULL, 0x0FBBAD1F61042279ULL, 0xE83A908FF2FB60CAULL,
+	0x0D7E765D58755C10ULL, 0x1A083822CEAFE02DULL, 0x9605D5F0E25EC3B0ULL, 0xD021FF5CD13A2ED5ULL,
+	0x40BDF15D4A672E32ULL, 0x011355146FD56395ULL, 0x5DB4832046F3D9E5ULL, 0x239F8B2D7FF719CCULL,
+	0x05D1A1AE85B49AA1ULL, 0x679F848F6E8FC971ULL, 0x7449BBFF801FED0BULL, 0x7D11CDB1C3B7ADF0ULL,
+	0x82C7709E781EB7CCULL, 0xF3218F1C9510786CULL, 0x331478F3AF51BBE6ULL, 0x4BB38DE5E7219443ULL,
+	0xAA649C6EBCFD50FCULL, 0x8DBD98A352AFD40BULL, 0x87D2074B81D79217ULL, 0x19F3C751D3E92AE1ULL,
+	0xB4AB30F062B19ABFULL, 0x7B0500AC42047AC4ULL, 0xC9452CA81A09D85DULL, 0x24AA6C514DA27500ULL,
+	0x4C9F34427501B447ULL, 0x14A68FD73C910841ULL, 0xA71B9B83461CBD93ULL, 0x03488B95B0F1850FULL,
+	0x637B2B34FF93C040ULL, 0x09D1BC9A3DD90A94ULL, 0x3575668334A1DD3BULL, 0x735E2B97A4C45A23ULL,
+	0x18727070F1BD400BULL, 0x1FCBACD259BF02E7ULL, 0xD310A7C2CE9B6555ULL, 0xBF983FE0FE5D8244ULL,
+	0x9F74D14F7454A824ULL, 0x51EBDC4AB9BA3035ULL, 0x5C82C505DB9AB0FAULL, 0xFCF7FE8A3430B241ULL,
+	0x3253A729B9BA3DDEULL, 0x8C74C368081B3075ULL, 0xB9BC6C87167C33E7ULL, 0x7EF48F2B83024E20ULL,
+	0x11D505D4C351BD7FULL, 0x6568FCA92C76A243ULL, 0x4DE0B0F40F32A7B8ULL, 0x96D693460CC37E5DULL,
+	0x42E240CB63689F2FULL, 0x6D2BDCDAE2919661ULL, 0x42880B0236E4D951ULL, 0x5F0F4A5898171BB6ULL,
+	0x39F890F579F92F88ULL, 0x93C5B5F47356388BULL, 0x63DC359D8D231B78ULL, 0xEC16CA8AEA98AD76ULL,
+	0x5355F900C2A82DC7ULL, 0x07FB9F855A997142ULL, 0x5093417AA8A7ED5EULL, 0x7BCBC38DA25A7F3CULL,
+	0x19FC8A768CF4B6D4ULL, 0x637A7780DECFC0D9ULL, 0x8249A47AEE0E41F7ULL, 0x79AD695501E7D1E8ULL,
+	0x14ACBAF4777D5776ULL, 0xF145B6BECCDEA195ULL, 0xDABF2AC8201752FCULL, 0x24C3C94DF9C8D3F6ULL,
+	0xBB6E2924F03912EAULL, 0x0CE26C0B95C980D9ULL, 0xA49CD132BFBF7CC4ULL, 0xE99D662AF4243939ULL,
+	0x27E6AD7891165C3FULL, 0x8535F040B9744FF1ULL, 0x54B3F4FA5F40D873ULL, 0x72B12C32127FED2BULL,
+	0xEE954D3C7B411F47ULL, 0x9A85AC909A24EAA1ULL, 0x70AC4CD9F04F21F5ULL, 0xF9B89D3E99A075C2ULL,
+	0x87B3E2B2B5C907B1ULL, 0xA366E5B8C54F48B8ULL, 0xAE4A9346CC3F7CF2ULL, 0x1920C04D47267BBDULL,
+	0x87BF02C6B49E2AE9ULL, 0x092237AC237F3859ULL, 0xFF07F64EF8ED14D0ULL, 0x8DE8DCA9F03CC54EULL,
+	0x9C1633264DB49C89ULL, 0xB3F22C3D0B0B38EDULL, 0x390E5FB44D01144BULL, 0x5BFEA5B4712768E9ULL,
+	0x1E1032911FA78984ULL, 0x9A74ACB964E78CB3ULL, 0x4F80F7A035DAFB04ULL, 0x6304D09A0B3738C4ULL,
+	0x2171E64683023A08ULL, 0x5B9B63EB9CEFF80CULL, 0x506AACF489889342ULL, 0x1881AFC9A3A701D6ULL,
+	0x6503080440750644ULL, 0xDFD395339CDBF4A7ULL, 0xEF927DBCF00C20F2ULL, 0x7B32F7D1E03680ECULL,
+	0xB9FD7620E7316243ULL, 0x05A7E8A57DB91B77ULL, 0xB5889C6E15630A75ULL, 0x4A750A09CE9573F7ULL,
+	0xCF464CEC899A2F8AULL, 0xF538639CE705B824ULL, 0x3C79A0FF5580EF7FULL, 0xEDE6C87F8477609DULL,
+	0x799E81F05BC93F31ULL, 0x86536B8CF3428A8CULL, 0x97D7374C60087B73ULL, 0xA246637CFF328532ULL,
+	0x043FCAE60CC0EBA0ULL, 0x920E449535DD359EULL, 0x70EB093B15B290CCULL, 0x73A1921916591CBDULL,
+	0x56436C9FE1A1AA8DULL, 0xEFAC4B70633B8F81ULL, 0xBB215798D45DF7AFULL, 0x45F20042F24F1768ULL,
+	0x930F80F4E8EB7462ULL, 0xFF6712FFCFD75EA1ULL, 0xAE623FD67468AA70ULL, 0xDD2C5BC84BC8D8FCULL,
+	0x7EED120D54CF2DD9ULL, 0x22FE545401165F1CULL, 0xC91800E98FB99929ULL, 0x808BD68E6AC10365ULL,
+	0xDEC468145B7605F6ULL, 0x1BEDE3A3AEF53302ULL, 0x43539603D6C55602ULL, 0xAA969B5C691CCB7AULL,
+	0xA87832D392EFEE56ULL, 0x65942C7B3C7E11AEULL, 0xDED2D633CAD004F6ULL, 0x21F08570F420E565ULL,
+	0xB415938D7DA94E3CULL, 0x91B859E59ECB6350ULL, 0x10CFF333E0ED804AULL, 0x28AED140BE0BB7DDULL,
+	0xC5CC1D89724FA456ULL, 0x5648F680F11A2741ULL, 0x2D255069F0B7DAB3ULL, 0x9BC5A38EF729ABD4ULL,
+	0xEF2F054308F6A2BCULL, 0xAF2042F5CC5C2858ULL, 0x480412BAB7F5BE2AULL, 0xAEF3AF4A563DFE43ULL,
+	0x19AFE59AE451497FULL, 0x52593803DFF1E840ULL, 0xF4F076E65F2CE6F0ULL, 0x11379625747D5AF3ULL,
+	0xBCE5D2248682C115ULL, 0x9DA4243DE836994FULL, 0x066F70B33FE09017ULL, 0x4DC4DE189B671A1CULL,
+	0x51039AB7712457C3ULL, 0xC07A3F80C31FB4B4ULL, 0xB46EE9C5E64A6E7CULL, 0xB3819A42ABE61C87ULL,
+	0x21A007933A522A20ULL, 0x2DF16F761598AA4FULL, 0x763C4A1371B368FDULL, 0xF793C46702E086A0ULL,
+	0xD7288E012AEB8D31ULL, 0xDE336A2A4BC1C44BULL, 0x0BF692B38D079F23ULL, 0x2C604A7A177326B3ULL,
+	0x4850E73E03EB6064ULL, 0xCFC447F1E53C8E1BULL, 0xB05CA3F564268D99ULL, 0x9AE182C8BC9474E8ULL,
+	0xA4FC4BD4FC5558CAULL, 0xE755178D58FC4E76ULL, 0x69B97DB1A4C03DFEULL, 0xF9B5B7C4ACC67C96ULL,
+	0xFC6A82D64B8655FBULL, 0x9C684CB6C4D24417ULL, 0x8EC97D2917456ED0ULL, 0x6703DF9D2924E97EULL,
+	0xC547F57E42A7444EULL, 0x78E37644E7CAD29EULL, 0xFE9A44E9362F05FAULL, 0x08BD35CC38336615ULL,
+	0x9315E5EB3A129ACEULL, 0x94061B871E04DF75ULL, 0xDF1D9F9D784BA010ULL, 0x3BBA57B68871B59DULL,
+	0xD2B7ADEEDED1F73FULL, 0xF7A255D83BC373F8ULL, 0xD7F4F2448C0CEB81ULL, 0xD95BE88CD210FFA7ULL,
+	0x336F52F8FF4728E7ULL, 0xA74049DAC312AC71ULL, 0xA2F61BB6E437FDB5ULL, 0x4F2A5CB07F6A35B3ULL,
+	0x87D380BDA5BF7859ULL, 0x16B9F7E06C453A21ULL, 0x7BA2484C8A0FD54EULL, 0xF3A678CAD9A2E38CULL,
+	0x39B0BF7DDE437BA2ULL, 0xFCAF55C1BF8A4424ULL, 0x18FCF680573FA594ULL, 0x4C0563B89F495AC3ULL,
+	0x40E087931A00930DULL, 0x8CFFA9412EB642C1ULL, 0x68CA39053261169FULL, 0x7A1EE967D27579E2ULL,
+	0x9D1D60E5076F5B6FULL, 0x3810E399B6F65BA2ULL, 0x32095B6D4AB5F9B1ULL, 0x35CAB62109DD038AULL,
+	0xA90B24499FCFAFB1ULL, 0x77A225A07CC2C6BDULL, 0x513E5E634C70E331ULL, 0x4361C0CA3F692F12ULL,
+	0xD941ACA44B20A45BULL, 0x528F7C8602C5807BULL, 0x52AB92BEB9613989ULL, 0x9D1DFA2EFC557F73ULL,
+	0x722FF175F572C348ULL, 0x1D1260A51107FE97ULL, 0x7A249A57EC0C9BA2ULL, 0x04208FE9E8F7F2D6ULL,
+	0x5A110C6058B920A0ULL, 0x0CD9A497658A5698ULL, 0x56FD23C8F9715A4CULL, 0x284C847B9D887AAEULL,
+	0x04FEABFBBDB619CBULL, 0x742E1E651C60BA83ULL, 0x9A9632E65904AD3CULL, 0x881B82A13B51B9E2ULL,
+	0x506E6744CD974924ULL, 0xB0183DB56FFC6A79ULL, 0x0ED9B915C66ED37EULL, 0x5E11E86D5873D484ULL,
+	0xF678647E3519AC6EULL, 0x1B85D488D0F20CC5ULL, 0xDAB9FE6525D89021ULL, 0x0D151D86ADB73615ULL,
+	0xA865A54EDCC0F019ULL, 0x93C42566AEF98FFBULL, 0x99E7AFEABE000731ULL, 0x48CBFF086DDF285AULL,
+	0x7F9B6AF1EBF78BAFULL, 0x58627E1A149BBA21ULL, 0x2CD16E2ABD791E33ULL, 0xD363EFF5F0977996ULL,
+	0x0CE2A38C344A6EEDULL, 0x1A804AADB9CFA741ULL, 0x907F30421D78C5DEULL, 0x501F65EDB3034D07ULL,
+	0x37624AE5A48FA6E9ULL, 0x957BAF61700CFF4EULL, 0x3A6C27934E31188AULL, 0xD49503536ABCA345ULL,
+	0x088E049589C432E0ULL, 0xF943AEE7FEBF21B8ULL, 0x6C3B8E3E336139D3ULL, 0x364F6FFA464EE52EULL,
+	0xD60F6DCEDC314222ULL, 0x56963B0DCA418FC0ULL, 0x16F50EDF91E513AFULL, 0xEF1955914B609F93ULL,
+	0x565601C0364E3228ULL, 0xECB53939887E8175ULL, 0xBAC7A9A18531294BULL, 0xB344C470397BBA52ULL,
+	0x65D34954DAF3CEBDULL, 0xB4B81B3FA97511E2ULL, 0xB422061193D6F6A7ULL, 0x071582401C38434DULL,
+	0x7A13F18BBEDC4FF5ULL, 0xBC4097B116C524D2ULL, 0x59B97885E2F2EA28ULL, 0x99170A5DC3115544ULL,
+	0x6F423357E7C6A9F9ULL, 0x325928EE6E6F8794ULL, 0xD0E4366228B03343ULL, 0x565C31F7DE89EA27ULL,
+	0x30F5611484119414ULL, 0xD873DB391292ED4FULL, 0x7BD94E1D8E17DEBCULL, 0xC7D9F16864A76E94ULL,
+	0x947AE053EE56E63CULL, 0xC8C93882F9475F5FULL, 0x3A9BF55BA91F81CAULL, 0xD9A11FBB3D9808E4ULL,
+	0x0FD22063EDC29FCAULL, 0xB3F256D8ACA0B0B9ULL, 0xB03031A8B4516E84ULL, 0x35DD37D5871448AFULL,
+	0xE9F6082B05542E4EULL, 0xEBFAFA33D7254B59ULL, 0x9255ABB50D532280ULL, 0xB9AB4CE57F2D34F3ULL,
+	0x693501D628297551ULL, 0xC62C58F97DD949BFULL, 0xCD454F8F19C5126AULL, 0xBBE83F4ECC2BDECBULL,
+	0xDC842B7E2819E230ULL, 0xBA89142E007503B8ULL, 0xA3BC941D0A5061CBULL, 0xE9F6760E32CD8021ULL,
+	0x09C7E552BC76492FULL, 0x852F54934DA55CC9ULL, 0x8107FCCF064FCF56ULL, 0x098954D51FFF6580ULL,
+	0x23B70EDB1955C4BFULL, 0xC330DE426430F69DULL, 0x4715ED43E8A45C0AULL, 0xA8D7E4DAB780A08DULL,
+	0x0572B974F03CE0BBULL, 0xB57D2E985E1419C7ULL, 0xE8D9ECBE2CF3D73FULL, 0x2FE4B17170E59750ULL,
+	0x11317BA87905E790ULL, 0x7FBF21EC8A1F45ECULL, 0x1725CABFCB045B00ULL, 0x964E915CD5E2B207ULL,
+	0x3E2B8BCBF016D66DULL, 0xBE7444E39328A0ACULL, 0xF85B2B4FBCDE44B7ULL, 0x49353FEA39BA63B1ULL,
+	0x1DD01AAFCD53486AULL, 0x1FCA8A92FD719F85ULL, 0xFC7C95D827357AFAULL, 0x18A6A990C8B35EBDULL,
+	0xCCCB7005C6B9C28DULL, 0x3BDBB92C43B17F26ULL, 0xAA70B5B4F89695A2ULL, 0xE94C39A54A98307FULL,
+	0xB7A0B174CFF6F36EULL, 0xD4DBA84729AF48ADULL, 0x2E18BC1AD9704A68ULL, 0x2DE0966DAF2F8B1CULL,
+	0xB9C11D5B1E43A07EULL, 0x64972D68DEE33360ULL, 0x94628D38D0C20584ULL, 0xDBC0D2B6AB90A559ULL,
+	0xD2733C4335C6A72FULL, 0x7E75D99D94A70F4DULL, 0x6CED1983376FA72BULL, 0x97FCAACBF030BC24ULL,
+	0x7B77497B32503B12ULL, 0x8547EDDFB81CCB94ULL, 0x79999CDFF70902CBULL, 0xCFFE1939438E9B24ULL,
+	0x829626E3892D95D7ULL, 0x92FAE24291F2B3F1ULL, 0x63E22C147B9C3403ULL, 0xC678B6D860284A1CULL,
+	0x5873888850659AE7ULL, 0x0981DCD296A8736DULL, 0x9F65789A6509A440ULL, 0x9FF38FED72E9052FULL,
+	0xE479EE5B9930578CULL, 0xE7F28ECD2D49EECDULL, 0x56C074A581EA17FEULL, 0x5544F7D774B14AEFULL,
+	0x7B3F0195FC6F290FULL, 0x12153635B2C0CF57ULL, 0x7F5126DBBA5E0CA7ULL, 0x7A76956C3EAFB413ULL,
+	0x3D5774A11D31AB39ULL, 0x8A1B083821F40CB4ULL, 0x7B4A38E32537DF62ULL, 0x950113646D1D6E03ULL,
+	0x4DA8979A0041E8A9ULL, 0x3BC36E078F7515D7ULL, 0x5D0A12F27AD310D1ULL, 0x7F9D1A2E1EBE1327ULL,
+	0xDA3A361B1C5157B1ULL, 0xDCDD7D20903D0C25ULL, 0x36833336D068F707ULL, 0xCE68341F79893389ULL,
+	0xAB9090168DD05F34ULL, 0x43954B3252DC25E5ULL, 0xB438C2B67F98E5E9ULL, 0x10DCD78E3851A492ULL,
+	0xDBC27AB5447822BFULL, 0x9B3CDB65F82CA382ULL, 0xB67B7896167B4C84ULL, 0xBFCED1B0048EAC50ULL,
+	0xA9119B60369FFEBDULL, 0x1FFF7AC80904BF45ULL, 0xAC12FB171817EEE7ULL, 0xAF08DA9177DDA93DULL,
+	0x1B0CAB936E65C744ULL, 0xB559EB1D04E5E932ULL, 0xC37B45B3F8D6F2BAULL, 0xC3A9DC228CAAC9E9ULL,
+	0xF3B8B6675A6507FFULL, 0x9FC477DE4ED681DAULL, 0x67378D8ECCEF96CBULL, 0x6DD856D94D259236ULL,
+	0xA319CE15B0B4DB31ULL, 0x073973751F12DD5EULL, 0x8A8E849EB32781A5ULL, 0xE1925C71285279F5ULL,
+	0x74C04BF1790C0EFEULL, 0x4DDA48153C94938AULL, 0x9D266D6A1CC0542CULL, 0x7440FB816508C4FEULL,
+	0x13328503DF48229FULL, 0xD6BF7BAEE43CAC40ULL, 0x4838D65F6EF6748FULL, 0x1E152328F3318DEAULL,
+	0x8F8419A348F296BFULL, 0x72C8834A5957B511ULL, 0xD7A023A73260B45CULL, 0x94EBC8ABCFB56DAEULL,
+	0x9FC10D0F989993E0ULL, 0xDE68A2355B93CAE6ULL, 0xA44CFE79AE538BBEULL, 0x9D1D84FCCE371425ULL,
+	0x51D2B1AB2DDFB636ULL, 0x2FD7E4B9E72CD38CULL, 0x65CA5B96B7552210ULL, 0xDD69A0D8AB3B546DULL,
+	0x604D51B25FBF70E2ULL, 0x73AA8A564FB7AC9EULL, 0x1A8C1E992B941148ULL, 0xAAC40A2703D9BEA0ULL,
+	0x764DBEAE7FA4F3A6ULL, 0x1E99B96E70A9BE8BULL, 0x2C5E9DEB57EF4743ULL, 0x3A938FEE32D29981ULL,
+	0x26E6DB8FFDF5ADFEULL, 0x469356C504EC9F9DULL, 0xC8763C5B08D1908CULL, 0x3F6C6AF859D80055ULL,
+	0x7F7CC39420A3A545ULL, 0x9BFB227EBDF4C5CEULL, 0x89039D79D6FC5C5CULL, 0x8FE88B57305E2AB6ULL,
+	0xA09E8C8C35AB96DEULL, 0xFA7E393983325753ULL, 0xD6B6D0ECC617C699ULL, 0xDFEA21EA9E7557E3ULL,
+	0xB67C1FA481680AF8ULL, 0xCA1E3785A9E724E5ULL, 0x1CFC8BED0D681639ULL, 0xD18D8549D140CAEAULL,
+	0x4ED0FE7E9DC91335ULL, 0xE4DBF0634473F5D2ULL, 0x1761F93A44D5AEFEULL, 0x53898E4C3910DA55ULL,
+	0x734DE8181F6EC39AULL, 0x2680B122BAA28D97ULL, 0x298AF231C85BAFABULL, 0x7983EED3740847D5ULL,
+	0x66C1A2A1A60CD889ULL, 0x9E17E49642A3E4C1ULL, 0xEDB454E7BADC0805ULL, 0x50B704CAB602C329ULL,
+	0x4CC317FB9CDDD023ULL, 0x66B4835D9EAFEA22ULL, 0x219B97E26FFC81BDULL, 0x261E4E4C0A333A9DULL,
+	0x1FE2CCA76517DB90ULL, 0xD7504DFA8816EDBBULL, 0xB9571FA04DC089C8ULL, 0x1DDC0325259B27DEULL,
+	0xCF3F4688801EB9AAULL, 0xF4F5D05C10CAB243ULL, 0x38B6525C21A42B0EULL, 0x36F60E2BA4FA6800ULL,
+	0xEB3593803173E0CEULL, 0x9C4CD6257C5A3603ULL, 0xAF0C317D32ADAA8AULL, 0x258E5A80C7204C4BULL,
+	0x8B889D624D44885DULL, 0xF4D14597E660F855ULL, 0xD4347F66EC8941C3ULL, 0xE699ED85B0DFB40DULL,
+	0x2472F6207C2D0484ULL, 0xC2A1E7B5B459AEB5ULL, 0xAB4F6451CC1D45ECULL, 0x63767572AE3D6174ULL,
+	0xA59E0BD101731A28ULL, 0x116D0016CB948F09ULL, 0x2CF9C8CA052F6E9FULL, 0x0B090A7560A968E3ULL,
+	0xABEEDDB2DDE06FF1ULL, 0x58EFC10B06A2068DULL, 0xC6E57A78FBD986E0ULL, 0x2EAB8CA63CE802D7ULL,
+	0x14A195640116F336ULL, 0x7C0828DD624EC390ULL, 0xD74BBE77E6116AC7ULL, 0x804456AF10F5FB53ULL,
+	0xEBE9EA2ADF4321C7ULL, 0x03219A39EE587A30ULL, 0x49787FEF17AF9924ULL, 0xA1E9300CD8520548ULL,
+	0x5B45E522E4B1B4EFULL, 0xB49C3B3995091A36ULL, 0xD4490AD526F14431ULL, 0x12A8F216AF9418C2ULL,
+	0x001F837CC7350524ULL, 0x1877B51E57A764D5ULL, 0xA2853B80F17F58EEULL, 0x993E1DE72D36D310ULL,
+	0xB3598080CE64A656ULL, 0x252F59CF0D9F04BBULL, 0xD23C8E176D113600ULL, 0x1BDA0492E7E4586EULL,
+	0x21E0BD5026C619BFULL, 0x3B097ADAF088F94EULL, 0x8D14DEDB30BE846EULL, 0xF95CFFA23AF5F6F4ULL,
+	0x3871700761B3F743ULL, 0xCA672B91E9E4FA16ULL, 0x64C8E531BFF53B55ULL, 0x241260ED4AD1E87DULL,
+	0x106C09B972D2E822ULL, 0x7FBA195410E5CA30ULL, 0x7884D9BC6CB569D8ULL, 0x0647DFEDCD894A29ULL,
+	0x63573FF03E224774ULL, 0x4FC8E9560F91B123ULL, 0x1DB956E450275779ULL, 0xB8D91274B9E9D4FBULL,
+	0xA2EBEE47E2FBFCE1ULL, 0xD9F1F30CCD97FB09ULL, 0xEFED53D75FD64E6BULL, 0x2E6D02C36017F67FULL,
+	0xA9AA4D20DB084E9BULL, 0xB64BE8D8B25396C1ULL, 0x70CB6AF7C2D5BCF0ULL, 0x98F076A4F7A2322EULL,
+	0xBF84470805E69B5FULL, 0x94C3251F06F90CF3ULL, 0x3E003E616A6591E9ULL, 0xB925A6CD0421AFF3ULL,
+	0x61BDD1307C66E300ULL, 0xBF8D5108E27E0D48ULL, 0x240AB57A8B888B20ULL, 0xFC87614BAF287E07ULL,
+	0xEF02CDD06FFDB432ULL, 0xA1082C0466DF6C0AULL, 0x8215E577001332C8ULL, 0xD39BB9C3A48DB6CFULL,
+	0x2738259634305C14ULL, 0x61CF4F94C97DF93DULL, 0x1B6BACA2AE4E125BULL, 0x758F450C88572E0BULL,
+	0x959F587D507A8359ULL, 0xB063E962E045F54DULL, 0x60E8ED72C0DFF5D1ULL, 0x7B64978555326F9FULL,
+	0xFD080D236DA814BAULL, 0x8C90FD9B083F4558ULL, 0x106F72FE81E2C590ULL, 0x7976033A39F7D952ULL,
+	0xA4EC0132764CA04BULL, 0x733EA705FAE4FA77ULL, 0xB4D8F77BC3E56167ULL, 0x9E21F4F903B33FD9ULL,
+	0x9D765E419FB69F6DULL, 0xD30C088BA61EA5EFULL, 0x5D94337FBFAF7F5BULL, 0x1A4E4822EB4D7A59ULL,
+	0x6FFE73E81B637FB3ULL, 0xDDF957BC36D8B9CAULL, 0x64D0E29EEA8838B3ULL, 0x08DD9BDFD96B9F63ULL,
+	0x087E79E5A57D1D13ULL, 0xE328E230E3E2B3FBULL, 0x1C2559E30F0946BEULL, 0x720BF5F26F4D2EAAULL,
+	0xB0774D261CC609DBULL, 0x443F64EC5A371195ULL, 0x4112CF68649A260EULL, 0xD813F2FAB7F5C5CAULL,
+	0x660D3257380841EEULL, 0x59AC2C7873F910A3ULL, 0xE846963877671A17ULL, 0x93B633ABFA3469F8ULL,
+	0xC0C0F5A60EF4CDCFULL, 0xCAF21ECD4377B28CULL, 0x57277707199B8175ULL, 0x506C11B9D90E8B1DULL,
+	0xD83CC2687A19255FULL, 0x4A29C6465A314CD1ULL, 0xED2DF21216235097ULL, 0xB5635C95FF7296E2ULL,
+	0x22AF003AB672E811ULL, 0x52E762596BF68235ULL, 0x9AEBA33AC6ECC6B0ULL, 0x944F6DE09134DFB6ULL,
+	0x6C47BEC883A7DE39ULL, 0x6AD047C430A12104ULL, 0xA5B1CFDBA0AB4067ULL, 0x7C45D833AFF07862ULL,
+	0x5092EF950A16DA0BULL, 0x9338E69C052B8E7BULL, 0x455A4B4CFE30E3F5ULL, 0x6B02E63195AD0CF8ULL,
+	0x6B17B224BAD6BF27ULL, 0xD1E0CCD25BB9C169ULL, 0xDE0C89A556B9AE70ULL, 0x50065E535A213CF6ULL,
+	0x9C1169FA2777B874ULL, 0x78EDEFD694AF1EEDULL, 0x6DC93D9526A50E68ULL, 0xEE97F453F06791EDULL,
+	0x32AB0EDB696703D3ULL, 0x3A6853C7E70757A7ULL, 0x31865CED6120F37DULL, 0x67FEF95D92607890ULL,
+	0x1F2B1D1F15F6DC9CULL, 0xB69E38A8965C6B65ULL, 0xAA9119FF184CCCF4ULL, 0xF43C732873F24C13ULL,
+	0xFB4A3D794A9A80D2ULL, 0x3550C2321FD6109CULL, 0x371F77E76BB8417EULL, 0x6BFA9AAE5EC05779ULL,
+	0xCD04F3FF001A4778ULL, 0xE3273522064480CAULL, 0x9F91508BFFCFC14AULL, 0x049A7F41061A9E60ULL,
+	0xFCB6BE43A9F2FE9BULL, 0x08DE8A1C7797DA9BULL, 0x8F9887E6078735A1ULL, 0xB5B4071DBFC73A66ULL,
+	0x230E343DFBA08D33ULL, 0x43ED7F5A0FAE657DULL, 0x3A88A0FBBCB05C63ULL, 0x21874B8B4D2DBC4FULL,
+	0x1BDEA12E35F6A8C9ULL, 0x53C065C6C8E63528ULL, 0xE34A1D250E7A8D6BULL, 0xD6B04D3B7651DD7EULL,
+	0x5E90277E7CB39E2DULL, 0x2C046F22062DC67DULL, 0xB10BB459132D0A26ULL, 0x3FA9DDFB67E2F199ULL,
+	0x0E09B88E1914F7AFULL, 0x10E8B35AF3EEAB37ULL, 0x9EEDECA8E272B933ULL, 0xD4C718BC4AE8AE5FULL,
+	0x81536D601170FC20ULL, 0x91B534F885818A06ULL, 0xEC8177F83F900978ULL, 0x190E714FADA5156EULL,
+	0xB592BF39B0364963ULL, 0x89C350C893AE7DC1ULL, 0xAC042E70F8B383F2ULL, 0xB49B52E587A1EE60ULL,
+	0xFB152FE3FF26DA89ULL, 0x3E666E6F69AE2C15ULL, 0x3B544EBE544C19F9ULL, 0xE805A1E290CF2456ULL,
+	0x24B33C9D7ED25117ULL, 0xE74733427B72F0C1ULL, 0x0A804D18B7097475ULL, 0x57E3306D881EDB4FULL,
+	0x4AE7D6A36EB5DBCBULL, 0x2D8D5432157064C8ULL, 0xD1E649DE1E7F268BULL, 0x8A328A1CEDFE552CULL,
+	0x07A3AEC79624C7DAULL, 0x84547DDC3E203C94ULL, 0x990A98FD5071D263ULL, 0x1A4FF12616EEFC89ULL,
+	0xF6F7FD1431714200ULL, 0x30C05B1BA332F41CULL, 0x8D2636B81555A786ULL, 0x46C9FEB55D120902ULL,
+	0xCCEC0A73B49C9921ULL, 0x4E9D2827355FC492ULL, 0x19EBB029435DCB0FULL, 0x4659D2B743848A2CULL,
+	0x963EF2C96B33BE31ULL, 0x74F85198B05A2E7DULL, 0x5A0F544DD2B1FB18ULL, 0x03727073C2E134B1ULL,
+	0xC7F6AA2DE59AEA61ULL, 0x352787BAA0D7C22FULL, 0x9853EAB63B5E0B35ULL, 0xABBDCDD7ED5C0860ULL,
+	0xCF05DAF5AC8D77B0ULL, 0x49CAD48CEBF4A71EULL, 0x7A4C10EC2158C4A6ULL, 0xD9E92AA246BF719EULL,
+	0x13AE978D09FE5557ULL, 0x730499AF921549FFULL, 0x4E4B705B92903BA4ULL, 0xFF577222C14F0A3AULL,
+	0x55B6344CF97AAFAEULL, 0xB862225B055B6960ULL, 0xCAC09AFBDDD2CDB4ULL, 0xDAF8E9829FE96B5FULL,
+	0xB5FDFC5D3132C498ULL, 0x310CB380DB6F7503ULL, 0xE87FBB46217A360EULL, 0x2102AE466EBB1148ULL,
+	0xF8549E1A3AA5E00DULL, 0x07A69AFDCC42261AULL, 0xC4C118BFE78FEAAEULL, 0xF9F4892ED96BD438ULL,
+	0x1AF3DBE25D8F45DAULL, 0xF5B4B0B0D2DEEEB4ULL, 0x962ACEEFA82E1C84ULL, 0x046E3ECAAF453CE9ULL,
+	0xF05D129681949A4CULL, 0x964781CE734B3C84ULL, 0x9C2ED44081CE5FBDULL, 0x522E23F3925E319EULL,
+	0x177E00F9FC32F791ULL, 0x2BC60A63A6F3B3F2ULL, 0x222BBFAE61725606ULL, 0x486289DDCC3D6780ULL,
+	0x7DC7785B8EFDFC80ULL, 0x8AF38731C02BA980ULL, 0x1FAB64EA29A2DDF7ULL, 0xE4D9429322CD065AULL,
+	0x9DA058C67844F20CULL, 0x24C0E332B70019B0ULL, 0x233003B5A6CFE6ADULL, 0xD586BD01C5C217F6ULL,
+	0x5E5637885F29BC2BULL, 0x7EBA726D8C94094BULL, 0x0A56A5F0BFE39272ULL, 0xD79476A84EE20D06ULL,
+	0x9E4C1269BAA4BF37ULL, 0x17EFEE45B0DEE640ULL, 0x1D95B0A5FCF90BC6ULL, 0x93CBE0B699C2585DULL,
+	0x65FA4F227A2B6D79ULL, 0xD5F9E858292504D5ULL, 0xC2B5A03F71471A6FULL, 0x59300222B4561E00ULL,
+	0xCE2F8642CA0712DCULL, 0x7CA9723FBB2E8988ULL, 0x2785338347F2BA08ULL, 0xC61BB3A141E50E8CULL,
+	0x150F361DAB9DEC26ULL, 0x9F6A419D382595F4ULL, 0x64A53DC924FE7AC9ULL, 0x142DE49FFF7A7C3DULL,
+	0x0C335248857FA9E7ULL, 0x0A9C32D5EAE45305ULL, 0xE6C42178C4BBB92EULL, 0x71F1CE2490D20B07ULL,
+	0xF1BCC3D275AFE51AULL, 0xE728E8C83C334074ULL, 0x96FBF83A12884624ULL, 0x81A1549FD6573DA5ULL,
+	0x5FA7867CAF35E149ULL, 0x56986E2EF3ED091BULL, 0x917F1DD5F8886C61ULL, 0xD20D8C88C8FFE65FULL,
+	0x31D71DCE64B2C310ULL, 0xF165B587DF898190ULL, 0xA57E6339DD2CF3A0ULL, 0x1EF6E6DBB1961EC9ULL,
+	0x70CC73D90BC26E24ULL, 0xE21A6B35DF0C3AD7ULL, 0x003A93D8B2806962ULL, 0x1C99DED33CB890A1ULL,
+	0xCF3145DE0ADD4289ULL, 0xD0E4427A5514FB72ULL, 0x77C621CC9FB3A483ULL, 0x67A34DAC4356550BULL,
+	0xF8D626AAAF278509ULL
+};
+
+/** Memory mapping of the book file. */
+const unsigned char* book_mapping = NULL;
+size_t book_mapping_size = 0;
+
+/** Number of entries of the book. */
+size_t book_entries = 0;
+
+/** Whether the engine plays moves from the book (UCI option OwnBook). */
+int use_book = 0;
+
+/**
+ * Computes the book key of the current position.
+ * @return The key.
+ */
+u64 polyglot_key() {
+	u64 key = 0;
+
+	// pieces: black pawn is kind 0, white pawn 1, black knight 2 and so on up to the white king
+	for (int piece = P; piece <= k; piece++) {
+		u64 bitboard = bitboards[piece];
+		int kind = 2 * (piece % 6) + (piece < p);
+
+		while (bitboard) {
+			int square = lsb_index(bitboard);
+
+			key ^= polyglot_keys[64 * kind + 8 * (7 - square / 8) + square % 8];
+			pop_bit(bitboard, square);
+		}
+	}
+
+	// castling rights
+	if (available_castlings & wk) key ^= polyglot_keys[POLYGLOT_CASTLE_KEYS + 0];
+	if (available_castlings & wq) key ^= polyglot_keys[POLYGLOT_CASTLE_KEYS + 1];
+	if (available_castlings & bk) key ^= polyglot_keys[POLYGLOT_CASTLE_KEYS + 2];
+	if (available_castlings & bq) key ^= polyglot_keys[POLYGLOT_CASTLE_KEYS + 3];
+
+	// en passant file, if a pawn of the side to move stands next to the pushed pawn
+	if (open_enpassant != none && (pawn_attacks[side ^ 1][open_enpassant] & bitboards[(side == white) ? P : p]))
+		key ^= polyglot_keys[POLYGLOT_ENPASSANT_KEYS + open_enpassant % 8];
+
+	if (side == white)
+		key ^= polyglot_keys[POLYGLOT_TURN_KEY];
+
+	return key;
+}
+
+/**
+ * Checks the book keys against the reference key of the starting position.
+ * @return Whether the keys match.
+ */
+int polyglot_keys_are_valid() {
+	// black pieces are the even kinds, White's first row and Black's last
+	int back_rank[8] = { 3, 1, 2, 4, 5, 2, 1, 3 };
+	u64 key = polyglot_keys[POLYGLOT_TURN_KEY];
+
+	for (int file = 0; file < 8; file++) {
+		key ^= polyglot_keys[64 * 1 + 8 * 1 + file] ^ polyglot_keys[64 * 0 + 8 * 6 + file];
+		key ^= polyglot_keys[64 * (2 * back_rank[file] + 1) + file] ^ polyglot_keys[64 * (2 * back_rank[file]) + 8 * 7 + file];
+	}
+
+	for (int castling = 0; castling < 4; castling++)
+		key ^= polyglot_keys[POLYGLOT_CASTLE_KEYS + castling];
+
+	return key == 0x463B96181691FC9CULL;
+}
+
+/**
+ * Encodes a move in the book format.
+ * @param move The move.
+ * @return The book move.
+ */
+int polyglot_move(int move) {
+	int source_square = decode_move_source_square(move);
+	int target_square = decode_move_target_square(move);
+	int promoted_piece = decode_move_promoted_piece(move);
+
+	// castling: the king takes its own rook
+	if (decode_move_castle(move))
+		target_square = (target_square % 8 == 6) ? target_square + 1 : target_square - 2;
+
+	return (source_square % 8) << 6 | (7 - source_square / 8) << 9 |
+		(target_square % 8) | (7 - target_square / 8) << 3 |
+		(promoted_piece ? promoted_piece % 6 : 0) << 12;
+}
+
+/**
+ * Reads a big endian number of a book entry.
+ * @param data The first byte.
+ * @param bytes The number of bytes.
+ * @return The number.
+ */
+static inline u64 read_big_endian(const unsigned char* data, int bytes) {
+	u64 number = 0;
+
+	for (int index = 0; index < bytes; index++)
+		number = number << 8 | data[index];
+
+	return number;
+}
+
+/**
+ * Writes a big endian number of a book entry.
+ * @param data The first byte.
+ * @param number The number.
+ * @param bytes The number of bytes.
+ */
+static inline void write_big_endian(unsigned char* data, u64 number, int bytes) {
+	for (int index = bytes - 1; index >= 0; index--, number >>= 8)
+		data[index] = (unsigned char)number;
+}
+
+/**
+ * Unmaps the current book, if any.
+ */
+void close_book() {
+	if (book_mapping)
+		unmap_file((void*)book_mapping, book_mapping_size);
+
+	book_mapping = NULL;
+	book_mapping_size = 0;
+	book_entries = 0;
+}
+
+/**
+ * Memory maps a book file, replacing the current book.
+ * @param path The path of the book file (empty to close the book).
+ * @return Whether the book was opened.
+ */
+int open_book(const char* path) {
+	close_book();
+
+	if (!*path || strcmp(path, "<empty>") == 0)
+		return 0;
+
+	size_t size;
+	void* data = map_file(path, &size);
+
+	// a book is a whole number of entries
+	if (data == NULL || size % BOOK_ENTRY_SIZE) {
+		if (data)
+			unmap_file(data, size);
+
+		return 0;
+	}
+
+	book_mapping = data;
+	book_mapping_size = size;
+	book_entries = size / BOOK_ENTRY_SIZE;
+
+	return 1;
+}
+
+/**
+ * Finds the book entries of the current position and their legal moves.
+ * @param moves The legal moves of the entries (room for 256).
+ * @param weights The weights of the entries (room for 256).
+ * @return The number of entries found.
+ */
+int probe_book(int* moves, int* weights) {
+	if (!book_entries)
+		return 0;
+
+	u64 key = polyglot_key();
+
+	// binary search for the first entry of the position
+	size_t low = 0, high = book_entries;
+
+	while (low < high) {
+		size_t middle = low + (high - low) / 2;
+
+		if (read_big_endian(book_mapping + middle * BOOK_ENTRY_SIZE, 8) < key)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	int legal_moves[256], legal_count = generate_legal_moves(legal_moves), count = 0;
+
+	// the entries of the position, whose moves are legal (keys can collide)
+	for (; low < book_entries && count < 256; low++) {
+		const unsigned char* entry = book_mapping + low * BOOK_ENTRY_SIZE;
+
+		if (read_big_endian(entry, 8) != key)
+			break;
+
+		int book_move = (int)read_big_endian(entry + 8, 2);
+
+		for (int index = 0; index < legal_count; index++) {
+			if (polyglot_move(legal_moves[index]) == book_move) {
+				moves[count] = legal_moves[index];
+				weights[count++] = (int)read_big_endian(entry + 10, 2);
+				break;
+			}
+		}
+	}
+
+	return count;
+}
+
+/**
+ * Picks a book move of the current position at random, in proportion to the weights.
+ * @return The move, 0 if the position is not in the book.
+ */
+int book_move() {
+	int moves[256], weights[256];
+	int count = probe_book(moves, weights);
+	long total = 0;
+
+	for (int index = 0; index < count; index++)
+		total += weights[index];
+
+	if (total == 0)
+		return 0;
+
+	long pick = (long)(psrandom_u32() % (unsigned long)total);
+
+	for (int index = 0; index < count; index++)
+		if ((pick -= weights[index]) < 0)
+			return moves[index];
+
+	return 0;
+}
+
+/**
+ * Prints the book moves of the current position with their weights, in reply to the "book" command.
+ */
+void print_book_moves() {
+	int moves[256], weights[256];
+	int count = probe_book(moves, weights);
+
+	printf("info string book key %016llx, %d moves\n", polyglot_key(), count);
+
+	for (int index = 0; index < count; index++) {
+		printf("info string book move ");
+		print_move(moves[index]);
+		printf(" weight %d\n", weights[index]);
+	}
+}
+
+#pragma endregion
+
+#pragma region Book Builder
+
+/*
+	Builds a book from the games of a PGN file (or the "bm" moves of an EPD file)
+
+	Every thread collects (key, move, score) records of the first plies of its games in a
+	buffer of its own. A full buffer is sorted and its duplicates combined; if that does
+	not free half of it, it is written to a temporary file as a sorted run. The runs are
+	finally merged into the book, so the input can be larger than the memory budget.
+
+	score			2 per game won by the side that played the move, 1 per draw (or unknown result)
+	weight			the score, scaled down per position if it does not fit in 16 bits
+*/
+
+/** Default memory budget of the book builder in megabytes, shared by its threads. */
+#define BOOK_BUILDER_MB 256
+
+/** Maximum number of sorted runs written to temporary files. */
+#define BOOK_MAX_RUNS 4096
+
+/** A move of a book position with its statistics. */
+typedef struct {
+	u64 key;
+	uint32_t score;
+	uint32_t games;
+	uint16_t move;		// book move
+} book_record;
+
+/** State shared by the threads of the book builder. */
+typedef struct {
+	int max_ply;				// plies of every game recorded
+	pthread_mutex_t lock;		// guards the runs
+	int run_count;
+	FILE* runs[BOOK_MAX_RUNS];	// sorted runs, rewound
+	int failed;					// a run could not be written
+} book_builder;
+
+/** Records collected by one thread of the book builder. */
+typedef struct {
+	book_builder* builder;
+	book_record* records;
+	size_t count;
+	size_t capacity;
+	long errors;				// EPD best moves that could not be parsed
+} book_buffer;
+
+/**
+ * Orders book records by key, then by move.
+ */
+int compare_book_records(const void* first, const void* second) {
+	const book_record* a = first;
+	const book_record* b = second;
+
+	if (a->key != b->key)
+		return (a->key < b->key) ? -1 : 1;
+
+	return (int)a->move - (int)b->move;
+}
+
+/**
+ * Sorts the records of a buffer and combines the records of the same key and move.
+ * @param buffer The buffer.
+ */
+void compact_book_buffer(book_buffer* buffer) {
+	size_t count = 0;
+
+	qsort(buffer->records, buffer->count, sizeof(book_record), compare_book_records);
+
+	for (size_t index = 0; index < buffer->count; index++) {
+		book_record* record = &buffer->records[index];
+
+		if (count && record->key == buffer->records[count - 1].key && record->move == buffer->records[count - 1].move) {
+			buffer->records[count - 1].score += record->score;
+			buffer->records[count - 1].games += record->games;
+		} else
+			buffer->records[count++] = *record;
+	}
+
+	buffer->count = count;
+}
+
+/**
+ * Writes the records of a buffer to a temporary file as a sorted run and empties the buffer.
+ * @param buffer The buffer.
+ */
+void flush_book_buffer(book_buffer* buffer) {
+	book_builder* builder = buffer->builder;
+
+	compact_book_buffer(buffer);
+
+	if (buffer->count == 0)
+		return;
+
+	FILE* run = tmpfile();
+
+	if (run && fwrite(buffer->records, sizeof(book_record), buffer->count, run) == buffer->count)
+		rewind(run);
+	else if (run) {
+		fclose(run);
+		run = NULL;
+	}
+
+	pthread_mutex_lock(&builder->lock);
+
+	if (run && builder->run_count < BOOK_MAX_RUNS)
+		builder->runs[builder->run_count++] = run;
+	else {
+		if (run)
+			fclose(run);
+
+		builder->failed = 1;
+	}
+
+	pthread_mutex_unlock(&builder->lock);
+
+	buffer->count = 0;
+}
+
+/**
+ * Adds a move of the current position to a buffer.
+ * @param buffer The buffer.
+ * @param move The move.
+ * @param score The score of the game for the side to move.
+ */
+void add_book_record(book_buffer* buffer, int move, int score) {
+	// make room: combine duplicates, spill to a run if that does not free enough
+	if (buffer->count == buffer->capacity) {
+		compact_book_buffer(buffer);
+
+		if (buffer->count > buffer->capacity / 2)
+			flush_book_buffer(buffer);
+	}
+
+	buffer->records[buffer->count++] = (book_record){ polyglot_key(), score, 1, polyglot_move(move) };
+}
+
+/**
+ * Records the moves of the first plies of a PGN game (a pgn_position_callback).
+ * @param user_data The book buffer of the thread.
+ * @return Whether the rest of the game can be skipped.
+ */
+int record_book_position(const pgn_game* game, int ply, int move, void* user_data) {
+	book_buffer* buffer = user_data;
+
+	if (ply >= buffer->builder->max_ply)
+		return 1;
+
+	if (move) {
+		int score = 1;
+
+		if (game->result == pgn_white_wins || game->result == pgn_black_wins)
+			score = ((game->result == pgn_white_wins) == (side == white)) ? 2 : 0;
+
+		add_book_record(buffer, move, score);
+	}
+
+	return 0;
+}
+
+/**
+ * Records the "bm" moves of an EPD record as won games (an epd_record_callback).
+ * @param record The record.
+ * @param user_data The book buffer of the thread.
+ */
+void record_book_epd(const epd_record* record, void* user_data) {
+	book_buffer* buffer = user_data;
+
+	if (record->error != fen_ok)
+		return;
+
+	load_position(&record->position);
+
+	// the best moves, in SAN separated by spaces
+	const char* text = record->best_moves.text;
+	const char* end = text + record->best_moves.length;
+
+	while (text < end) {
+		const char* token = text;
+
+		while (text < end && *text != ' ')
+			text++;
+
+		int move = (text > token) ? parse_san(token, (int)(text - token)) : 0;
+
+		if (move)
+			add_book_record(buffer, move, 2);
+		else if (text > token)
+			buffer->errors++;
+
+		text++;
+	}
+}
+
+/**
+ * Writes the book entries of one position: the moves played in at least min_games
+ * games and with a positive score, by decreasing weight.
+ * @param file The book file.
+ * @param records The records of the position (sorted by move).
+ * @param count The number of records.
+ * @param min_games The minimum number of games of a move.
+ * @return The number of entries written.
+ */
+int write_book_position(FILE* file, book_record* records, int count, int min_games) {
+	uint32_t max_score = 0;
+	int kept = 0;
+
+	for (int index = 0; index < count; index++)
+		if (records[index].games >= (uint32_t)min_games && records[index].score > 0) {
+			records[kept++] = records[index];
+			max_score = (records[index].score > max_score) ? records[index].score : max_score;
+		}
+
+	// insertion sort by decreasing score, positions have few moves
+	for (int index = 1; index < kept; index++) {
+		book_record record = records[index];
+		int slot = index;
+
+		for (; slot > 0 && records[slot - 1].score < record.score; slot--)
+			records[slot] = records[slot - 1];
+
+		records[slot] = record;
+	}
+
+	for (int index = 0; index < kept; index++) {
+		unsigned char entry[BOOK_ENTRY_SIZE] = { 0 };
+		u64 weight = records[index].score;
+
+		// keep the proportions when the scores do not fit in 16 bits
+		if (max_score > 0xFFFF)
+			weight = (weight * 0xFFFF / max_score) ? weight * 0xFFFF / max_score : 1;
+
+		write_big_endian(entry, records[index].key, 8);
+		write_big_endian(entry + 8, records[index].move, 2);
+		write_big_endian(entry + 10, weight, 2);
+		fwrite(entry, 1, BOOK_ENTRY_SIZE, file);
+	}
+
+	return kept;
+}
+
+/**
+ * Merges the sorted runs of a builder into a book file, closing them.
+ * @param builder The builder.
+ * @param path The path of the book file.
+ * @param min_games The minimum number of games of a move.
+ * @return The number of entries written, -1 if the book file could not be written.
+ */
+long merge_book_runs(book_builder* builder, const char* path, int min_games) {
+	FILE* file = fopen(path, "wb");
+	book_record* heads = malloc(builder->run_count * sizeof(book_record) + 1);
+	int* heap = malloc(builder->run_count * sizeof(int) + 1);
+	book_record position[256];
+	int heap_size = 0, position_count = 0;
+	long entries = 0;
+
+	if (file && heads && heap) {
+		// a min-heap of the runs, ordered by their next record
+		for (int run = 0; run < builder->run_count; run++) {
+			if (fread(&heads[run], sizeof(book_record), 1, builder->runs[run]) != 1)
+				continue;
+
+			int slot = heap_size++;
+
+			for (; slot > 0 && compare_book_records(&heads[run], &heads[heap[(slot - 1) / 2]]) < 0; slot = (slot - 1) / 2)
+				heap[slot] = heap[(slot - 1) / 2];
+
+			heap[slot] = run;
+		}
+
+		while (heap_size) {
+			int run = heap[0];
+			book_record record = heads[run];
+
+			// combine the record with the same move of other runs, flush finished positions
+			if (position_count && position[position_count - 1].key == record.key && position[position_count - 1].move == record.move) {
+				position[position_count - 1].score += record.score;
+				position[position_count - 1].games += record.games;
+			} else {
+				if (position_count && (position[0].key != record.key || position_count == 256)) {
+					entries += write_book_position(file, position, position_count, min_games);
+					position_count = 0;
+				}
+
+				position[position_count++] = record;
+			}
+
+			// next record of the run, or drop the run
+			if (fread(&heads[run], sizeof(book_record), 1, builder->runs[run]) != 1)
+				run = heap[--heap_size];
+
+			// sift the run down
+			int slot = 0;
+
+			while (heap_size) {
+				int child = 2 * slot + 1;
+
+				if (child >= heap_size)
+					break;
+
+				if (child + 1 < heap_size && compare_book_records(&heads[heap[child + 1]], &heads[heap[child]]) < 0)
+					child++;
+
+				if (compare_book_records(&heads[heap[child]], &heads[run]) >= 0)
+					break;
+
+				heap[slot] = heap[child];
+				slot = child;
+			}
+
+			if (heap_size)
+				heap[slot] = run;
+		}
+
+		if (position_count)
+			entries += write_book_position(file, position, position_count, min_games);
+	}
+
+	for (int run = 0; run < builder->run_count; run++)
+		fclose(builder->runs[run]);
+
+	builder->run_count = 0;
+	free(heads);
+	free(heap);
+
+	if (!file || fclose(file) != 0 || !heads || !heap)
+		return -1;
+
+	return entries;
+}
+
+/**
+ * Parses and runs a "makebook" command: builds a book from a PGN or EPD file.
+ * @param command The input string (e.g. "makebook games.pgn book.bin maxply 16 mingames 3 threads 4 memory 256").
+ */
+void parse_makebook_command(char* command) {
+	char input[1024] = "", output[1024] = "", *argument;
+	int max_ply = 16, min_games = 1, threads = 1, megabytes = BOOK_BUILDER_MB;
+
+	// the input and output files are the first arguments
+	sscanf(command + 8, " %1023s %1023s", input, output);
+
+	if ((argument = strstr(command, " maxply ")))
+		max_ply = atoi(argument + 8);
+
+	if ((argument = strstr(command, " mingames ")))
+		min_games = atoi(argument + 10);
+
+	if ((argument = strstr(command, " threads ")))
+		threads = atoi(argument + 9);
+
+	if ((argument = strstr(command, " memory ")))
+		megabytes = atoi(argument + 8);
+
+	if (!input[0] || !output[0]) {
+		printf("usage: makebook <input.pgn|input.epd> <output.bin> [maxply N] [mingames N] [threads N] [memory MB]\n");
+		return;
+	}
+
+	int epd = strlen(input) > 4 && strcmp(input + strlen(input) - 4, ".epd") == 0;
+
+	// one buffer per thread, sharing the memory budget
+	threads = (threads < 1) ? 1 : (threads > MAX_THREADS) ? MAX_THREADS : threads;
+
+	book_builder* builder = calloc(1, sizeof(book_builder));
+	book_buffer buffers[MAX_THREADS];
+	size_t capacity = ((size_t)((megabytes > 1) ? megabytes : 1) << 20) / sizeof(book_record) / threads;
+	int allocated = builder != NULL, readable = 0;
+	pgn_totals totals = { 0, 0, 0 };
+
+	for (int thread = 0; thread < threads; thread++) {
+		buffers[thread] = (book_buffer){ builder, malloc(capacity * sizeof(book_record)), 0, capacity, 0 };
+		allocated &= buffers[thread].records != NULL;
+	}
+
+	int start = get_time_millis();
+
+	if (allocated) {
+		builder->max_ply = max_ply;
+		pthread_mutex_init(&builder->lock, NULL);
+
+		if (epd) {
+			epd_totals records;
+
+			readable = read_epd(input, threads, record_book_epd, buffers, sizeof(book_buffer), &records);
+			totals.positions = records.records - records.errors;
+			totals.errors = records.errors;
+		}
+		else
+			readable = read_pgn(input, threads, record_book_position, buffers, sizeof(book_buffer), &totals);
+
+		for (int thread = 0; thread < threads; thread++) {
+			flush_book_buffer(&buffers[thread]);
+			totals.errors += buffers[thread].errors;
+		}
+	}
+
+	for (int thread = 0; thread < threads; thread++)
+		free(buffers[thread].records);
+
+	if (!allocated)
+		printf("not enough memory for the book builder\n");
+	else if (!readable)
+		printf("could not read '%s'\n", input);
+	else if (builder->failed)
+		printf("could not write the temporary files of the book builder\n");
+	else {
+		int runs = builder->run_count;
+		long entries = merge_book_runs(builder, output, min_games);
+		int elapsed = get_time_millis() - start;
+
+		if (entries < 0)
+			printf("could not write book '%s'\n", output);
+		else {
+			if (!epd)
+				printf("Games           : %ld\n", totals.games);
+
+			printf("Positions       : %ld\n", totals.positions);
+			printf(epd ? "Invalid entries : %ld\n" : "Invalid games   : %ld\n", totals.errors);
+			printf("Sorted runs     : %d\n", runs);
+			printf("Book entries    : %ld\n", entries);
+			printf("Time (ms)       : %d\n", elapsed);
+		}
+	}
+
+	if (allocated)
+		pthread_mutex_destroy(&builder->lock);
+
+	// runs left after a failure
+	for (int run = 0; builder && run < builder->run_count; run++)
+		fclose(builder->runs[run]);
+
+	free(builder);
+}
+
+#pragma endregion
+
+#pragma region Tablebase Generation
+
+/*
+	Retrograde analysis of a tablebase (values as in Endgame Tablebases)
+
+	init			every position is set up on the board and its legal moves generated: mates
+					are lost in 0 plies; captures and promotions lead to smaller (or other)
+					tables that are probed, quiet moves are counted per position; indexes
+					that are not the index of their position are impossible positions
+	level d			the positions at distance d are unmade move by move (without captures):
+					a predecessor of a lost position is won in d + 1 plies, and a predecessor
+					of a won position loses once all its counted moves lead to won positions
+	end				positions left unknown are draws, the wins, draws and losses are
+					written next to the distances
+
+	Levels run until no position is pending; each pass splits the positions between the
+	threads, so predecessors are updated with atomic operations. A position symmetric to a
+	diagonal of the board shares its index with its mirror, so unmade moves are weighted to
+	match the counted ones: a symmetric predecessor of a position without symmetry loses
+	two counted moves per unmade move, and a symmetric position is unmade toward only one
+	of the two mirrors of each predecessor. Tables needed for captures and promotions are generated first (or loaded if their
+	files exist). A table takes 3 bytes per position while generated: up to about 730 MB
+	for 5 pieces without pawns and 2.1 GB with pawns.
+*/
+
+/** Largest distance to mate a value can hold (254 is the largest value below TB_INVALID). */
+#define TB_MAX_DISTANCE 253
+
+/** Work of one thread in a pass of the retrograde analysis. */
+typedef struct {
+	const tablebase* table;
+	unsigned char* values;		// [2][size], 0 while unknown
+	unsigned char* counters;	// [2][size] moves not yet known to lead to a won position
+	unsigned char* externals;	// [2][size] best distance through captures and promotions: odd wins, even loses
+	u64 begin;
+	u64 end;
+	int level;					// distance of the positions to unmake
+	int highest;				// largest distance assigned or pending
+	int missing;				// a capture or promotion leads to a table that is not loaded
+	int overflow;				// a distance does not fit in a value
+} tb_job;
+
+/**
+ * Gets the squares of a position from its index in a tablebase.
+ * @param table The tablebase.
+ * @param index The index (within the positions of one side to move).
+ * @param squares The square of every piece of the index.
+ */
+static inline void tb_decode(const tablebase* table, u64 index, int* squares) {
+	for (int group = table->groups - 1; group >= 0; group--) {
+		int first = table->group_first[group];
+		int offset = (table->pieces[first] % 6 == P) ? 8 : 0;
+		u64 rank = index % table->group_size[group];
+
+		index /= table->group_size[group];
+
+		// the combinatorial number system, largest square first
+		for (int piece = table->group_count[group] - 1; piece >= 0; piece--) {
+			int square = piece;
+
+			while (tb_binomial[square + 1][piece + 1] <= rank)
+				square++;
+
+			rank -= tb_binomial[square][piece + 1];
+			squares[first + piece] = square + offset;
+		}
+	}
+
+	squares[0] = tb_king_squares[table->pawns][index][white];
+	squares[1] = tb_king_squares[table->pawns][index][black];
+}
+
+/**
+ * Compares a position without pawns with its mirror on a diagonal of the board.
+ * @param table The tablebase.
+ * @param squares The square of every piece of the index.
+ * @param anti Whether to mirror on the a8-h1 diagonal instead of the a1-h8 one.
+ * @return 0 if the mirror is the same position, otherwise the sign tells the two apart.
+ */
+static inline int tb_compare_mirror(const tablebase* table, const int* squares, int anti) {
+	u64 boards[2][12] = { { 0 } };
+
+	for (int slot = 0; slot < table->piece_count; slot++) {
+		set_bit(boards[0][table->pieces[slot]], squares[slot]);
+		set_bit(boards[1][table->pieces[slot]], tb_transpose(squares[slot]) ^ (anti ? 63 : 0));
+	}
+
+	return memcmp(boards[0], boards[1], sizeof(boards[0]));
+}
+
+/**
+ * Counts the mirrors of a position that leave it unchanged, itself included. Only the
+ * mirrors on the diagonals keep the kings in place, and only with both kings on the same
+ * diagonal.
+ * @param table The tablebase.
+ * @param squares The square of every piece of the index.
+ * @return 2 if the position is symmetric to a diagonal, otherwise 1.
+ */
+static inline int tb_symmetries(const tablebase* table, const int* squares) {
+	if (table->pawns)
+		return 1;
+
+	for (int anti = 0; anti <= 1; anti++) {
+		int on_diagonal = 1;
+
+		for (int slot = white; slot <= black; slot++)
+			on_diagonal &= anti ? squares[slot] % 8 == squares[slot] / 8 : tb_diagonal_side(squares[slot]) == 0;
+
+		if (on_diagonal && tb_compare_mirror(table, squares, anti) == 0)
+			return 2;
+	}
+
+	return 1;
+}
+
+/**
+ * Sets the engine state to a position of a tablebase.
+ * @param table The tablebase.
+ * @param squares The square of every piece of the index.
+ * @param side_to_move The side to move.
+ * @return Whether the position is possible (no shared squares, no pawns on the first or
+ * last rank, the side that just moved not in check).
+ */
+int tb_set_position(const tablebase* table, const int* squares, int side_to_move) {
+	board_position position = { { 0 }, side_to_move, none, 0, 0, 1 };
+	u64 occupancy = 0;
+
+	for (int slot = 0; slot < table->piece_count; slot++) {
+		int square = squares[slot];
+
+		if (get_bit(occupancy, square) || (table->pieces[slot] % 6 == P && (square / 8 == 0 || square / 8 == 7)))
+			return 0;
+
+		set_bit(occupancy, square);
+		set_bit(position.bitboards[table->pieces[slot]], square);
+	}
+
+	load_position(&position);
+
+	return !is_square_attacked(lsb_index(bitboards[(side == white) ? k : K]), side);
+}
+
+/**
+ * Gets the squares a piece can have come from with a quiet move.
+ * @param piece The piece.
+ * @param square The square of the piece.
+ * @param occupancy The occupied squares.
+ * @return The squares.
+ */
+static inline u64 tb_unmove_origins(int piece, int square, u64 occupancy) {
+	switch (piece % 6) {
+		case P: {
+			// pawns come from the rank behind them, never from their first rank
+			int step = (piece == P) ? 8 : -8;
+			int origin = square + step;
+
+			if (origin / 8 == 0 || origin / 8 == 7 || get_bit(occupancy, origin))
+				return 0;
+
+			// double pushes end on the fourth rank of their side
+			if (square / 8 == ((piece == P) ? 4 : 3) && !get_bit(occupancy, origin + step))
+				return 1ULL << origin | 1ULL << (origin + step);
+
+			return 1ULL << origin;
+		}
+		case N: return knight_attacks[square] & ~occupancy;
+		case B: return get_bishop_attacks(square, occupancy) & ~occupancy;
+		case R: return get_rook_attacks(square, occupancy) & ~occupancy;
+		case Q: return get_queen_attacks(square, occupancy) & ~occupancy;
+		default: return king_attacks[square] & ~occupancy;
+	}
+}
+
+/**
+ * Initializes the positions of a range: mates, moves to count and results through
+ * captures and promotions.
+ * @param arg The tablebase job.
+ */
+void* tb_init_worker(void* arg) {
+	tb_job* job = arg;
+	const tablebase* table = job->table;
+	int squares[TB_MAX_PIECES];
+
+	for (u64 position = job->begin; position < job->end; position++) {
+		tb_decode(table, position % table->size, squares);
+
+		// the other orientation of a position with both kings on the diagonal has the index
+		if (tb_index(table, squares) != position % table->size || !tb_set_position(table, squares, position >= table->size)) {
+			job->values[position] = TB_INVALID;
+			continue;
+		}
+
+		move_list _move_list[1];
+		int legal_moves = 0, counter = 0, external = 0;
+
+		generate_moves(_move_list);
+
+		for (int index = 0; index < _move_list->last; index++) {
+			int move = _move_list->arr[index];
+
+			save_board();
+
+			if (!make_move(move, all_moves))
+				continue;
+
+			legal_moves++;
+
+			// quiet moves stay in this table
+			if (!decode_move_capture(move) && !decode_move_promoted_piece(move))
+				counter++;
+			else {
+				// one ply more than the distance of the opponent (value - 1)
+				int value = tb_probe_dtm();
+				int distance = value;
+
+				if (value < 0)
+					job->missing = 1;
+				else if (value == TB_DRAW)
+					counter++;
+				else if (distance > TB_MAX_DISTANCE)
+					job->overflow = 1;
+				else if (distance & 1) {
+					// the opponent is mated: the quickest such move wins (and the position is never lost)
+					external = ((external & 1) && external < distance) ? external : distance;
+					counter++;
+				}
+				else if (!(external & 1) && distance > external)
+					// the opponent mates: the slowest such move is the best defence
+					external = distance;
+			}
+
+			restore_board();
+		}
+
+		// mated, or all moves lead to mates through captures and promotions
+		if (legal_moves == 0 && is_square_attacked(lsb_index(bitboards[(side == white) ? K : k]), side ^ 1))
+			job->values[position] = 1;
+		else if (legal_moves && counter == 0 && !(external & 1))
+			job->values[position] = external + 1;
+
+		job->counters[position] = counter;
+		job->externals[position] = external;
+		job->highest = (external > job->highest) ? external : job->highest;
+	}
+
+	return NULL;
+}
+
+/**
+ * Unmakes the moves of the positions of a range at the distance of the job, resolving
+ * their predecessors.
+ * @param arg The tablebase job.
+ */
+void* tb_level_worker(void* arg) {
+	tb_job* job = arg;
+	const tablebase* table = job->table;
+	int level = job->level;
+	int squares[TB_MAX_PIECES], origin_squares[TB_MAX_PIECES];
+
+	for (u64 position = job->begin; position < job->end; position++) {
+		int value = __atomic_load_n(&job->values[position], __ATOMIC_RELAXED);
+
+		// won through a capture or promotion at this distance
+		if (value == 0 && (level & 1) && job->externals[position] == level) {
+			value = level + 1;
+			__atomic_store_n(&job->values[position], value, __ATOMIC_RELAXED);
+		}
+
+		if (value != level + 1)
+			continue;
+
+		// the side that just moved moves back
+		int mover = (position < table->size);
+		u64 occupancy = 0;
+
+		tb_decode(table, position % table->size, squares);
+
+		for (int slot = 0; slot < table->piece_count; slot++)
+			set_bit(occupancy, squares[slot]);
+
+		// a symmetric position is reached from both mirrors of its predecessors
+		int symmetric = tb_symmetries(table, squares) == 2;
+
+		for (int slot = 0; slot < table->piece_count; slot++) {
+			if (table->pieces[slot] / 6 != mover)
+				continue;
+
+			u64 origins = tb_unmove_origins(table->pieces[slot], squares[slot], occupancy);
+
+			while (origins) {
+				int origin = lsb_index(origins);
+
+				pop_bit(origins, origin);
+				memcpy(origin_squares, squares, sizeof(squares));
+				origin_squares[slot] = origin;
+
+				u64 index = tb_index(table, origin_squares);
+
+				// kings touching each other, or the other mirror of a predecessor of a symmetric position
+				if (index == TB_NO_INDEX || (symmetric && tb_compare_mirror(table, origin_squares, 0) > 0))
+					continue;
+
+				// a symmetric predecessor counted the moves to both mirrors of a position without symmetry
+				int weight = symmetric ? 1 : tb_symmetries(table, origin_squares);
+				u64 predecessor = mover * table->size + index;
+				unsigned char* target = &job->values[predecessor];
+				unsigned char unknown = 0;
+
+				if (level + 1 > TB_MAX_DISTANCE) {
+					job->overflow = 1;
+					continue;
+				}
+
+				// the position is lost: its predecessors win one ply later
+				if (!(level & 1)) {
+					if (__atomic_compare_exchange_n(target, &unknown, level + 2, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+						job->highest = (level + 1 > job->highest) ? level + 1 : job->highest;
+				}
+
+				// the position is won: a predecessor whose last move is refuted loses
+				else if (__atomic_load_n(target, __ATOMIC_RELAXED) == 0 &&
+						__atomic_sub_fetch(&job->counters[predecessor], weight, __ATOMIC_RELAXED) == 0) {
+					int distance = (job->externals[predecessor] > level + 1) ? job->externals[predecessor] : level + 1;
+
+					__atomic_store_n(target, distance + 1, __ATOMIC_RELAXED);
+					job->highest = (distance > job->highest) ? distance : job->highest;
+				}
+			}
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Runs a pass of the retrograde analysis on several threads.
+ * @param jobs The jobs (one per thread), with the shared fields set.
+ * @param threads The number of threads.
+ * @param worker The pass.
+ * @param level The distance of the positions to unmake.
+ * @param highest Raised to the largest distance assigned or pending.
+ * @return Whether all tables needed were loaded and all distances fit.
+ */
+int tb_run_pass(tb_job* jobs, int threads, void* (*worker)(void*), int level, int* highest) {
+	u64 positions = 2 * jobs[0].table->size;
+	int complete = 1;
+
+	for (int thread = 0; thread < threads; thread++) {
+		jobs[thread].begin = positions * thread / threads;
+		jobs[thread].end = positions * (thread + 1) / threads;
+		jobs[thread].level = level;
+		jobs[thread].highest = 0;
+	}
+
+	run_threads(threads, worker, jobs, sizeof(tb_job));
+
+	for (int thread = 0; thread < threads; thread++) {
+		*highest = (jobs[thread].highest > *highest) ? jobs[thread].highest : *highest;
+		complete &= !jobs[thread].missing && !jobs[thread].overflow;
+	}
+
+	return complete;
+}
+
+/**
+ * Writes a file of a tablebase.
+ * @param path The path of the file.
+ * @param magic The first 4 bytes of the file ("BBTB" or "BBTW").
+ * @param table The tablebase.
+ * @param values The values of the file.
+ * @param size The size of the values.
+ * @return Whether the file is written.
+ */
+int tb_write_file(const char* path, const char* magic, const tablebase* table, const unsigned char* values, u64 size) {
+	uint32_t header[4] = { 0, TB_VERSION, (uint32_t)table->piece_count, table->pawns ? TB_PAWN_KING_PLACEMENTS : TB_KING_PLACEMENTS };
+	FILE* file = fopen(path, "wb");
+
+	if (file == NULL)
+		return 0;
+
+	memcpy(header, magic, 4);
+
+	int written = fwrite(header, sizeof(header), 1, file) == 1 && fwrite(values, 1, size, file) == size;
+
+	return (fclose(file) == 0) && written;
+}
+
+/**
+ * Generates a tablebase, and the tablebases it needs first, unless their distance to
+ * mate files exist. The tablebases are written to files and loaded.
+ * @param material The material key.
+ * @param directory The directory of the tablebase files.
+ * @param threads The number of threads.
+ * @return Whether the tablebase is loaded.
+ */
+int tb_generate(u64 material, const char* directory, int threads) {
+	// the stronger side is White
+	if (!tb_white_is_stronger(material))
+		material = tb_mirror_material(material);
+
+	tablebase* loaded = tb_find(material);
+
+	// kings only, or already loaded with the distances to mate that larger tables probe
+	if (material == (material_unit(K) | material_unit(k)) || (loaded && loaded->dtm))
+		return 1;
+
+	if (loaded == NULL && (loaded = tb_map(directory, material)))
+		tb_add(loaded);
+
+	if (loaded && loaded->dtm)
+		return 1;
+
+	// tables reached by captures and promotions
+	for (int piece = P; piece <= k; piece++) {
+		int count = material_count(material, piece);
+
+		if (piece % 6 == K || count == 0)
+			continue;
+
+		if (!tb_generate(material - material_unit(piece), directory, threads))
+			return 0;
+
+		for (int promoted = piece + N; piece % 6 == P && promoted <= piece + Q; promoted++)
+			if (!tb_generate(material - material_unit(piece) + material_unit(promoted), directory, threads))
+				return 0;
+	}
+
+	char name[16];
+	tb_name(material, name);
+
+	tablebase* table = calloc(1, sizeof(tablebase));
+
+	if (table == NULL)
+		return 0;
+
+	table->material = material;
+	tb_init_layout(table);
+
+	int start = get_time_millis();
+	u64 positions = 2 * table->size;
+	unsigned char* values = calloc(positions, 1);
+	unsigned char* counters = malloc(positions);
+	unsigned char* externals = malloc(positions);
+	tb_job jobs[MAX_THREADS];
+	int highest = 0, complete = values && counters && externals;
+
+	threads = (threads < 1) ? 1 : (threads > MAX_THREADS) ? MAX_THREADS : threads;
+
+	for (int thread = 0; thread < threads; thread++)
+		jobs[thread] = (tb_job){ table, values, counters, externals, 0, 0, 0, 0, 0, 0 };
+
+	// initial positions, then one level per distance
+	if (complete)
+		complete = tb_run_pass(jobs, threads, tb_init_worker, 0, &highest);
+
+	for (int level = 0; complete && level <= highest; level++)
+		complete = tb_run_pass(jobs, threads, tb_level_worker, level, &highest);
+
+	free(counters);
+	free(externals);
+
+	// the wins, draws and losses, 4 positions per byte
+	u64 wdl_size = (positions + 3) / 4;
+	unsigned char* wdl = complete ? calloc(wdl_size, 1) : NULL;
+	long wins = 0, losses = 0, draws = 0;
+
+	for (u64 position = 0; wdl && position < positions; position++) {
+		int result = tb_wdl_of(values[position]);
+
+		wdl[position / 4] |= result << (2 * (position % 4));
+
+		// statistics: wins and losses of the side to move
+		wins += result == TB_WDL_WIN;
+		losses += result == TB_WDL_LOSS;
+		draws += result == TB_WDL_DRAW;
+	}
+
+	// write the files
+	char path[1100];
+
+	snprintf(path, sizeof(path), "%s/%s.bbt", directory, name);
+	complete = wdl && tb_write_file(path, "BBTB", table, values, positions);
+
+	snprintf(path, sizeof(path), "%s/%s.bbw", directory, name);
+	complete = complete && tb_write_file(path, "BBTW", table, wdl, wdl_size);
+
+	free(wdl);
+	free(values);
+	free(table);
+
+	if (!complete) {
+		printf("could not generate %s\n", name);
+		return 0;
+	}
+
+	printf("%-8s wins %ld losses %ld draws %ld longest mate %d plies (%d ms)\n",
+		name, wins, losses, draws, highest, get_time_millis() - start);
+
+	// probe the new files, also while generating larger tables
+	table = tb_map(directory, material);
+
+	if (table && loaded) {
+		// replaces the wins, draws and losses loaded without distances
+		unmap_file(loaded->wdl_mapping, loaded->wdl_mapping_size);
+		*loaded = *table;
+		free(table);
+	}
+	else if (table)
+		tb_add(table);
+
+	return table != NULL;
+}
+
+/** Arguments of the "tbgen" command. */
+typedef struct {
+	const char* directory;
+	int threads;
+} tbgen_arguments;
+
+/**
+ * Generates a tablebase (a tb_for_each_material visitor).
+ * @param material The material key.
+ * @param data The tbgen arguments.
+ */
+void tb_generate_material(u64 material, void* data) {
+	tbgen_arguments* arguments = data;
+
+	tb_generate(material, arguments->directory, arguments->threads);
+}
+
+/**
+ * Parses and runs a "tbgen" command: generates tablebases.
+ * @param command The input string (e.g. "tbgen KQvKR threads 4 path tables" or "tbgen 4").
+ */
+void parse_tbgen_command(char* command) {
+	char target[64] = "", directory[1024] = ".", *argument;
+	int threads = get_cpu_count();
+
+	sscanf(command + 5, " %63s", target);
+
+	if ((argument = strstr(command, " threads ")))
+		threads = atoi(argument + 9);
+
+	if ((argument = strstr(command, " path ")))
+		sscanf(argument + 6, " %1023s", directory);
+
+	// all tables up to a number of pieces
+	if (target[0] >= '3' && target[0] <= '0' + TB_MAX_PIECES && !target[1]) {
+		tbgen_arguments arguments = { directory, threads };
+
+		tb_for_each_material(target[0] - '0', tb_generate_material, &arguments);
+	}
+
+	// one material, e.g. "KRPvKR"
+	else {
+		u64 material = parse_material(target);
+		int count = 0;
+
+		for (int piece = P; piece <= k; piece++)
+			count += material_count(material, piece);
+
+		if (material == 0 || count > TB_MAX_PIECES || count < 3) {
+			printf("usage: tbgen <material (e.g. KRvK)|max pieces (3-%d)> [threads N] [path DIR]\n", TB_MAX_PIECES);
+			return;
+		}
+
+		tb_generate(material, directory, threads);
+	}
+
+	printf("info string %d tablebases loaded\n", tb_count());
+}
+
+#pragma endregion
+
+#pragma region Self-Play Data Generation
+
+/*
+	Training data generation from self-play (gensfen)
+
+	Every worker thread plays its share of games against itself: a few random
+	moves from the starting position, then one fixed-node search per move. Each
+	position that is not in check is recorded with its search score and, once the
+	game is over, the game result. Records are 32 bytes and are appended to the
+	output file from per-thread buffers, so threads only meet when flushing.
+
+	gensfen file <path> games <n> nodes <n> depth <n> threads <n> random_plies <n> max_plies <n>
+*/
+
+/** Packed training position (32 bytes, little endian). */
+typedef struct {
+	u64 occupancy;				// occupied squares
+	unsigned char pieces[16];	// pieces in occupancy order (a8 first), two per byte
+	short score;				// search score, side to move point of view
+	unsigned short move;		// best move: source | target << 6 | promoted piece type << 12
+	unsigned char fifty;		// halfmove clock
+	unsigned char enpassant;	// en-passant square, 64 for none
+	signed char result;			// game result for the side to move: 1 win, 0 draw, -1 loss
+	unsigned char state;		// side to move (bit 0) and castling rights (bits 1-4)
+} training_record;
+
+/** Records buffered by each thread before appending them to the output file. */
+#define TRAINING_BUFFER_SIZE 4096
+
+/** Output file shared by all generator threads. */
+typedef struct {
+	FILE* file;
+	pthread_mutex_t lock;
+	long positions;
+	long games;
+} training_writer;
+
+/** Work of one generator thread. */
+typedef struct {
+	training_writer* writer;
+	int thread;
+	int games;
+	long nodes;
+	int depth;
+	int random_plies;
+	int max_plies;
+} gensfen_job;
+
+/**
+ * Packs the current position into a training record.
+ * @param record The record to fill (the result is set when the game is over).
+ * @param score The search score.
+ * @param move The best move.
+ */
+void pack_training_record(training_record* record, int score, int move) {
+	int promoted_piece = decode_move_promoted_piece(move);
+
+	record->occupancy = occupancies[both];
+	pack_pieces(record->pieces);
+	record->score = score;
+	record->move = decode_move_source_square(move) | (decode_move_target_square(move) << 6) |
+		((promoted_piece ? promoted_piece % 6 : 0) << 12);
+	record->fifty = (fifty < 255) ? fifty : 255;
+	record->enpassant = (open_enpassant == none) ? 64 : open_enpassant;
+	record->result = 0;
+	record->state = side | (available_castlings << 1);
+}
+
+/**
+ * Appends buffered records to the output file.
+ * @param writer The shared writer.
+ * @param records The records.
+ * @param count The number of records.
+ * @param games The number of games the records come from.
+ */
+void flush_training_records(training_writer* writer, const training_record* records, int count, int games) {
+	pthread_mutex_lock(&writer->lock);
+
+	fwrite(records, sizeof(training_record), count, writer->file);
+	writer->positions += count;
+	writer->games += games;
+
+	pthread_mutex_unlock(&writer->lock);
+}
+
+/**
+ * Counts the legal moves of the current position.
+ * @param random_move Set to one of them, picked at random.
+ * @return The number of legal moves.
+ */
+int count_legal_moves(int* random_move) {
+	move_list _move_list[1];
+	int legal_moves[256], count = 0;
+
+	generate_moves(_move_list);
+
+	for (int index = 0; index < _move_list->last; index++) {
+		save_board();
+
+		if (make_move(_move_list->arr[index], all_moves))
+			legal_moves[count++] = _move_list->arr[index];
+
+		restore_board();
+	}
+
+	*random_move = count ? legal_moves[psrandom_u32() % count] : 0;
+	return count;
+}
+
+/**
+ * Plays one self-play game and records its positions.
+ * @param job The generator job.
+ * @param records The records of the game (room for max_plies records).
+ * @return The number of records of the game.
+ */
+int play_self_play_game(const gensfen_job* job, training_record* records) {
+	int count = 0, move, result = 0, ply_count;
+
+	// random opening, restarted if it runs into the end of the game
+	do {
+		parse_fen(fen_starting_position);
+
+		for (ply_count = 0; ply_count < job->random_plies; ply_count++) {
+			if (!count_legal_moves(&move))
+				break;
+
+			play_game_move(move);
+		}
+	} while (ply_count < job->random_plies || !count_legal_moves(&move));
+
+	for (ply_count = 0; ply_count < job->max_plies; ply_count++) {
+		int in_check = is_square_attacked(lsb_index(bitboards[(side == white) ? K : k]), side ^ 1);
+
+		// checkmate (the side to move lost) or stalemate
+		if (!count_legal_moves(&move)) {
+			result = in_check ? ((side == white) ? -1 : 1) : 0;
+			break;
+		}
+
+		// draw by repetition, fifty-move rule or a lone minor piece at most
+		if (is_repetition() || fifty >= 100 || count_bits(occupancies[both]) == 2 ||
+				(count_bits(occupancies[both]) == 3 && !(bitboards[P] | bitboards[p] | bitboards[R] | bitboards[r] | bitboards[Q] | bitboards[q])))
+			break;
+
+		int score;
+		move = search_best_move(job->depth, job->nodes, &score);
+
+		// no move to play: end the game as a draw rather than record it
+		if (!move)
+			break;
+
+		// positions in check have no meaningful static score
+		if (!in_check)
+			pack_training_record(&records[count++], score, move);
+
+		play_game_move(move);
+	}
+
+	// store the result from each side to move point of view
+	for (int index = 0; index < count; index++)
+		records[index].result = (records[index].state & 1) ? -result : result;
+
+	return count;
+}
+
+/**
+ * Plays the self-play games of one thread.
+ * @param arg The generator job.
+ */
+void* gensfen_worker(void* arg) {
+	gensfen_job* job = arg;
+
+	// every thread plays different openings
+	seed = 1804289383u ^ ((unsigned int)(job->thread + 1) * 2654435761u);
+
+	if (seed == 0)
+		seed = 1;
+
+	training_record* game = malloc(job->max_plies * sizeof(training_record));
+	training_record* buffer = malloc(TRAINING_BUFFER_SIZE * sizeof(training_record));
+	int buffered = 0, buffered_games = 0;
+
+	for (int played = 0; played < job->games; played++) {
+		int count = play_self_play_game(job, game);
+
+		// make room for the whole game
+		if (buffered + count > TRAINING_BUFFER_SIZE) {
+			flush_training_records(job->writer, buffer, buffered, buffered_games);
+			buffered = buffered_games = 0;
+		}
+
+		memcpy(&buffer[buffered], game, count * sizeof(training_record));
+		buffered += count;
+		buffered_games++;
+	}
+
+	flush_training_records(job->writer, buffer, buffered, buffered_games);
+
+	free(game);
+	free(buffer);
+	return NULL;
+}
+
+/**
+ * Parses and runs a "gensfen" command, appending self-play training data to a file.
+ * @param command The input string (e.g. "gensfen file data.bin games 1000 nodes 5000 threads 8").
+ */
+void parse_gensfen_command(char* command) {
+	char path[1024] = "training_data.bin";
+	char* argument;
+	int games = 100, threads = get_cpu_count();
+
+	gensfen_job job = { .nodes = 5000, .depth = 64, .random_plies = 8, .max_plies = 400 };
+
+	// parse options
+	if ((argument = strstr(command, "file ")))
+		sscanf(argument + 5, "%1023s", path);
+
+	if ((argument = strstr(command, "games ")))
+		games = atoi(argument + 6);
+
+	if ((argument = strstr(command, "nodes ")))
+		job.nodes = atol(argument + 6);
+
+	if ((argument = strstr(command, "depth ")))
+		job.depth = atoi(argument + 6);
+
+	if ((argument = strstr(command, "threads ")))
+		threads = atoi(argument + 8);
+
+	if ((argument = strstr(command, "random_plies ")))
+		job.random_plies = atoi(argument + 13);
+
+	if ((argument = strstr(command, "max_plies ")))
+		job.max_plies = atoi(argument + 10);
+
+	// keep the options within sane bounds
+	threads = (threads < 1) ? 1 : (threads > MAX_THREADS) ? MAX_THREADS : threads;
+	job.depth = (job.depth < 1) ? 1 : (job.depth > MAX_PLY - 1) ? MAX_PLY - 1 : job.depth;
+	job.max_plies = (job.max_plies < 1) ? 1 : (job.max_plies > MAX_GAME_PLY / 2) ? MAX_GAME_PLY / 2 : job.max_plies;
+
+	training_writer writer = { .file = fopen(path, "ab") };
+
+	if (!writer.file) {
+		printf("info string could not open %s\n", path);
+		return;
+	}
+
+	pthread_mutex_init(&writer.lock, NULL);
+
+	// split the games between the threads
+	gensfen_job jobs[MAX_THREADS];
+
+	for (int thread = 0; thread < threads; thread++) {
+		jobs[thread] = job;
+		jobs[thread].writer = &writer;
+		jobs[thread].thread = thread;
+		jobs[thread].games = games / threads + (thread < games % threads);
+	}
+
+	int start = get_time_millis();
+
+	run_threads(threads, gensfen_worker, jobs, sizeof(gensfen_job));
+
+	double seconds = (get_time_millis() - start + 1) / 1000.0;
+
+	printf("info string gensfen %ld games %ld positions written to %s in %.1f s (%.0f positions/s)\n",
+		writer.games, writer.positions, path, seconds, writer.positions / seconds);
+
+	fclose(writer.file);
+	pthread_mutex_destroy(&writer.lock);
+}
+
+#pragma endregion
+
+#pragma region Benchmark
+
+/*
+	bench: searches a fixed set of positions to a fixed depth, each one from a clean
+	state (move ordering tables cleared), so the total node count is a signature of
+	the search and evaluation: it only changes when their behaviour changes. The
+	positions are spread over the requested threads, which only changes the speed.
+
+	bench depth <n> threads <n> hash <megabytes>
+
+	hash sets the evaluation cache size of the run. When a network is loaded, the positions are
+	searched with both evaluations and the speed of each one is reported.
+*/
+
+/** Benchmark positions: middlegames, endgames, mates and stalemates. */
+char* bench_positions[] = {
+	fen_starting_position,
+	fen_tricky_position,
+	fen_killer_position,
+	fen_cmk_position,
+	"r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+	"rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+	"r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+	"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 11",
+	"4rrk1/pp1n3p/3q2pQ/2p1pb2/2PP4/2P3N1/P2B2PP/4RRK1 b - - 7 19",
+	"rq3rk1/ppp2ppp/1bnpb3/3N2B1/3NP3/7P/PPPQ1PP1/2KR3R w - - 7 14",
+	"r1bq1r1k/1pp1n1pp/1p1p4/4p2Q/4Pp2/1BNP4/PPP2PPP/3R1RK1 w - - 2 14",
+	"r3r1k1/2p2ppp/p1p1bn2/8/1q2P3/2NPQN2/PPP3PP/R4RK1 b - - 2 15",
+	"r1bbk1nr/pp3p1p/2n5/1N4p1/2Np1B2/8/PPP2PPP/2KR1B1R w kq - 0 13",
+	"r1bq1rk1/ppp1nppp/4n3/3p3Q/3P4/1BP1B3/PP1N2PP/R4RK1 w - - 1 16",
+	"4r1k1/r1q2ppp/ppp2n2/4P3/5Rb1/1N1BQ3/PPP3PP/R5K1 w - - 1 17",
+	"2rqkb1r/ppp2p2/2npb1p1/1N1Nn2p/2P1PP2/8/PP2B1PP/R1BQK2R b KQ - 0 11",
+	"r1bq1r1k/b1p1npp1/p2p3p/1p6/3PP3/1B2NN2/PP3PPP/R2Q1RK1 w - - 1 16",
+	"3r1rk1/p5pp/bpp1pp2/8/q1PP1P2/b3P3/P2NQRPP/1R2B1K1 b - - 6 22",
+	"r1q2rk1/2p1bppp/2Pp4/p6b/Q1PNp3/4B3/PP1R1PPP/2K4R w - - 2 18",
+	"4k2r/1pb2ppp/1p2p3/1R1p4/3P4/2r1PN2/P4PPP/1R4K1 b - - 3 22",
+	"3q2k1/pb3p1p/4pbp1/2r5/PpN2N2/1P2P2P/5PP1/Q2R2K1 b - - 4 26",
+	"6k1/6p1/6Pp/ppp5/3pn2P/1P3K2/1PP2P2/8 b - - 0 1",
+	"3b4/5kp1/1p1p1p1p/pP1PpP1P/P1P1P3/3KN3/8/8 w - - 0 1",
+	"2K5/p7/7P/5pR1/8/5k2/r7/8 w - - 0 1",
+	"8/6pk/1p6/8/PP3p1p/5P2/4KP1q/3Q4 w - - 0 1",
+	"7k/3p2pp/4q3/8/4Q3/5Kp1/P6b/8 w - - 0 1",
+	"8/2p5/8/2kPKp1p/2p4P/2P5/3P4/8 w - - 0 1",
+	"8/1p3pp1/7p/5P1P/2k3P1/8/2K2P2/8 w - - 0 1",
+	"8/pp2r1k1/2p1p3/3pP2p/1P1P1P1P/P5KR/8/8 w - - 0 1",
+	"8/3p4/p1bk3p/Pp6/1Kp1PpPp/2P2P1P/2P5/5B2 b - - 0 1",
+	"5k2/7R/4P2p/5K2/p1r2P1p/8/8/8 b - - 0 1",
+	"6k1/6p1/P6p/r1N5/5p2/7P/1b3PP1/4R1K1 w - - 0 1",
+	"1r3k2/4q3/2Pp3b/3Bp3/2Q2p2/1p1P2P1/1P2KP2/3N4 w - - 0 1",
+	"6k1/4pp1p/3p2p1/P1pPb3/R7/1r2P1PP/3B1P2/6K1 w - - 0 1",
+	"8/3p3B/5p2/5P2/p7/PP5b/k7/6K1 w - - 0 1",
+	"5rk1/q6p/2p3bR/1pPp1rP1/1P1Pp3/P3B1Q1/1K3P2/R7 w - - 93 90",
+	"4rrk1/1p1nq3/p7/2p1P1pp/3P2bp/3Q1Bn1/PPPB4/1K2R1NR w - - 40 21",
+	"r3k2r/3nnpbp/q2pp1p1/p7/Pp1PPPP1/4BNN1/1P5P/R2Q1RK1 w kq - 0 16",
+	"3Qb1k1/1r2ppb1/pN1n2q1/Pp1Pp1Pr/4P2p/4BP2/4B1R1/1R5K b - - 11 40",
+	"4k3/3q1r2/1N2r1b1/3ppN2/2nPP3/1B1R2n1/2R1Q3/3K4 w - - 5 1",
+	"8/8/8/8/5kp1/P7/8/1K1N4 w - - 0 1",
+	"8/8/8/5N2/8/p7/8/2NK3k w - - 0 1",
+	"8/3k4/8/8/8/4B3/4KB2/2B5 w - - 0 1",
+	"8/8/1P6/5pr1/8/4R3/7k/2K5 w - - 0 1",
+	"8/2p4P/8/kr6/6R1/8/8/1K6 w - - 0 1",
+	"8/8/3P3k/8/1p6/8/1P6/1K3n2 b - - 0 1",
+	"8/R7/2q5/8/6k1/8/1P5p/K6R w - - 0 124",
+	"6k1/3b3r/1p1p4/p1n2p2/1PPNpP1q/P3Q1p1/1R1RB1P1/5K2 b - - 0 1",
+	"r2r1n2/pp2bk2/2p1p2p/3q4/3PN1QP/2P3R1/P4PP1/5RK1 w - - 0 1",
+	"8/8/8/8/8/6k1/6p1/6K1 w - - 0 1",
+	"7k/7P/6K1/8/3B4/8/8/8 b - - 0 1"
+};
+
+#define BENCH_POSITIONS (int)(sizeof(bench_positions) / sizeof(bench_positions[0]))
+
+/** Work of one benchmark thread. */
+typedef struct {
+	int thread;
+	int threads;
+	int depth;
+	long nodes;		// nodes searched by this thread
+#ifdef SEARCH_STATS
+	search_statistics stats;	// search statistics summed over the positions of this thread
+#endif
+} bench_job;
+
+#ifdef SEARCH_STATS
+/**
+ * Adds the statistics of one search to a running total.
+ * @param total The total.
+ * @param search The statistics to add.
+ */
+void merge_search_stats(search_statistics* total, const search_statistics* search) {
+	total->main_nodes += search->main_nodes;
+	total->quiescence_nodes += search->quiescence_nodes;
+	total->moves_made += search->moves_made;
+	total->illegal_moves += search->illegal_moves;
+	total->beta_cutoffs += search->beta_cutoffs;
+	total->first_move_cutoffs += search->first_move_cutoffs;
+	total->futile_nodes += search->futile_nodes;
+	total->futility_prunes += search->futility_prunes;
+	total->check_extensions += search->check_extensions;
+	total->pawn_hash_probes += search->pawn_hash_probes;
+	total->pawn_hash_hits += search->pawn_hash_hits;
+	total->eval_cache_probes += search->eval_cache_probes;
+	total->eval_cache_hits += search->eval_cache_hits;
+	total->search_cycles += search->search_cycles;
+	total->movegen_cycles += search->movegen_cycles;
+	total->ordering_cycles += search->ordering_cycles;
+	total->eval_cycles += search->eval_cycles;
+
+	// nodes per iteration are summed depth by depth
+	for (int i = 0; i < search->iterations; i++)
+		total->iteration_nodes[i] += search->iteration_nodes[i];
+
+	if (search->iterations > total->iterations)
+		total->iterations = search->iterations;
+}
+#endif
+
+/**
+ * Clears the move ordering tables, so a search does not depend on earlier ones.
+ */
+void clear_history() {
+	memset(history_moves, 0, sizeof(history_moves));
+	memset(counter_moves, 0, sizeof(counter_moves));
+	memset(continuation_history, 0, sizeof(continuation_history));
+}
+
+/**
+ * Searches the benchmark positions of one thread.
+ * @param arg The benchmark job.
+ */
+void* bench_worker(void* arg) {
+	bench_job* job = arg;
+	int pv[MAX_PLY], score;
+
+	job->nodes = 0;
+
+	for (int index = job->thread; index < BENCH_POSITIONS; index += job->threads) {
+		parse_fen(bench_positions[index]);
+		clear_history();
+		clear_search();
+		iterative_deepening(job->depth, 0, pv, &score);
+
+		job->nodes += nodes;
+#ifdef SEARCH_STATS
+		merge_search_stats(&job->stats, &stats);
+#endif
+	}
+
+	return NULL;
+}
+
+/**
+ * Searches all benchmark positions with the current evaluation.
+ * @param depth The search depth.
+ * @param threads The number of threads.
+ * @param time The elapsed time in milliseconds.
+ * @return The total number of nodes.
+ */
+long run_bench(int depth, int threads, int* time) {
+	bench_job jobs[MAX_THREADS];
+
+	for (int thread = 0; thread < threads; thread++)
+		jobs[thread] = (bench_job){ .thread = thread, .threads = threads, .depth = depth };
+
+	// the evaluation cache must not carry over from earlier searches
+	init_eval_cache(eval_cache_megabytes);
+
+	int start = get_time_millis();
+
+	run_threads(threads, bench_worker, jobs, sizeof(bench_job));
+
+	*time = get_time_millis() - start;
+
+	long total = 0;
+
+	for (int thread = 0; thread < threads; thread++)
+		total += jobs[thread].nodes;
+
+#ifdef SEARCH_STATS
+	// the totals of all threads become the statistics reported by "stats"
+	stats_clear();
+
+	for (int thread = 0; thread < threads; thread++)
+		merge_search_stats(&stats, &jobs[thread].stats);
+#endif
+
+	return total;
+}
+
+/**
+ * Parses and runs a "bench" command.
+ * @param command The input string (e.g. "bench depth 6 threads 4 hash 64").
+ */
+void parse_bench_command(char* command) {
+	char* argument;
+	int depth = 5, threads = 1, time;
+
+	// the cache size only applies to this run
+	int cache_megabytes = eval_cache_megabytes;
+
+	// parse options
+	if ((argument = strstr(command, "depth ")))
+		depth = atoi(argument + 6);
+
+	if ((argument = strstr(command, "threads ")))
+		threads = atoi(argument + 8);
+
+	if ((argument = strstr(command, "hash ")))
+		init_eval_cache(atoi(argument + 5));
+
+	depth = (depth < 1) ? 1 : (depth > MAX_PLY - 1) ? MAX_PLY - 1 : depth;
+	threads = (threads < 1) ? 1 : (threads > MAX_THREADS) ? MAX_THREADS : threads;
+
+	// the signature always comes from the classic evaluation
+	int nnue = use_nnue;
+	use_nnue = 0;
+
+	long total = run_bench(depth, threads, &time);
+
+	printf("\n===========================\n");
+	printf("Positions       : %d\n", BENCH_POSITIONS);
+	printf("Depth           : %d\n", depth);
+	printf("Threads         : %d\n", threads);
+	printf("Total time (ms) : %d\n", time);
+	printf("Nodes searched  : %ld\n", total);
+	printf("Nodes/second    : %ld\n", total * 1000 / (time ? time : 1));
+
+#ifdef SEARCH_STATS
+	print_search_stats();
+#endif
+
+	// speed of the network, on the same positions
+	if (nnue_loaded) {
+		use_nnue = 1;
+		total = run_bench(depth, threads, &time);
+
+		printf("NNUE nodes      : %ld\n", total);
+		printf("NNUE nodes/sec  : %ld\n", total * 1000 / (time ? time : 1));
+	}
+
+	use_nnue = nnue;
+
+	if (eval_cache_megabytes != cache_megabytes)
+		init_eval_cache(cache_megabytes);
+}
+
+#pragma endregion
+
+#pragma region Initialize All
+
+/**
+ * Itialize all necessary data structures.
+ */
+void init_all() {
+	// initialize leaper pieces attacks table
+	init_leapers_attacks();
+
+	// initialize slider pieces attacks
+	init_sliders_attacks(bishop);
+	init_sliders_attacks(rook);
+
+	// initialize merged piece-square tables and evaluation masks
+	init_piece_square_scores();
+	init_evaluation_masks();
+
+	// initialize hashing keys and reversible moves tables
+	init_random_keys();
+	init_cuckoo_tables();
+
+	// the book keys are the reference Polyglot table
+	assert(polyglot_keys_are_valid());
+
+	// initialize the endgame table and the KPK bitbase
+	init_endgames();
+
+	// initialize the king placements of the tablebase index
+	init_tablebase_index();
+
+	// allocate evaluation cache
+	init_eval_cache(DEFAULT_EVAL_CACHE_MB);
+
+	/// NOTE: this initialization was made in order to get the values for the magic numbers,
+	/// it is nor needed anymore as now the magic numbers are precomputed and hardcoded
+	/// for intantaneous initialization of the magic numbers.
+
+	// magic number initialization
+	// init_magic_numbers();
+}
+
+#pragma endregion
+
+#pragma region UCI
+
+/**
+ * Parses the given move from a string. (e.g. "e7e8q")
+ * @param move_str The string containing the move.
+ * @return Whether the move is legal or not
+ */
+int parse_move(char* move_str) {
+	move_list _move_list[1];
+
+	// generate_moves_cmk(_move_list);
+	generate_moves(_move_list);
+
+	// parse source and target squares
+	int source_square = (move_str[0] - 'a') + ((8 - (move_str[1] - '0')) * 8);
+	int target_square = (move_str[2] - 'a') + ((8 - (move_str[3] - '0')) * 8);
+
+	// define parse promoted piece
+	int promoted_piece = 0;
+
+	// loop over the moves within the move list
+	for (int i = 0; i < _move_list->last; i++) {
+		// init move
+		int move = _move_list->arr[i];
+
+		// make sure source and target squares are available within the generated move
+		if (decode_move_source_square(move) == source_square && decode_move_target_square(move) == target_square) {
+			// initialize promoted piece, if that's the case
+			promoted_piece = decode_move_promoted_piece(move);
+
+			// only check this if promoted piece is available
+			if (promoted_piece) {
+				// promotion to queen
+				if ((promoted_piece == Q || promoted_piece == q) && move_str[4] == 'q')
+					return move;
+
+				// promotion to rook
+				if ((promoted_piece == R || promoted_piece == r) && move_str[4] == 'r')
+					return move;
+
+				// promotion to bishop
+				if ((promoted_piece == B || promoted_piece == b) && move_str[4] == 'b')
+					return move;
+
+				// promotion to knight
+				if ((promoted_piece == N || promoted_piece == n) && move_str[4] == 'n')
+					return move;
+
+				// continue in case of bad promotion input
+				continue;
+			}
+
+			// if the move is not a promotion, return it
+			return move;
+		}
+	}
+
+	// return illegal move by default
+	return 0;
+}
+
+/**
+ * Plays moves in UCI notation from the current position, keeping the game history.
+ * @param current_char The moves separated by spaces (e.g. "e2e4 e7e5").
+ * @return The number of moves played, -1 if a move is illegal (the moves before it stay played).
+ */
+int play_moves(char* current_char) {
+	int played = 0;
+
+	// loop over all moves
+	while (*current_char) {
+		// skip separators
+		if (*current_char == ' ' || *current_char == '\n' || *current_char == '\r') {
+			current_char++;
+			continue;
+		}
+
+		// a move has at least 4 characters (e.g. "e2e4")
+		if (strcspn(current_char, " \r\n") < 4)
+			return -1;
+
+		// parse move
+		int move = parse_move(current_char);
+
+		// the move is not even pseudo legal
+		if (move == 0)
+			return -1;
+
+		// store the position in the game history
+		repetition_table[repetition_index++] = hash_key;
+
+		// make move (the board is left unchanged if it is illegal)
+		if (!make_move(move, all_moves)) {
+			repetition_index--;
+			return -1;
+		}
+
+		played++;
+
+		// positions before an irreversible move can never repeat, drop them
+		// (and always keep room for the keys pushed by the search line)
+		if (fifty == 0 || repetition_index >= MAX_GAME_PLY / 2)
+			repetition_index = 0;
+
+		// shift pointer to the right
+		while (*current_char && *current_char != ' ') {
+			current_char++;
+		}
+	}
+
+	return played;
+}
+
+/**
+ * Parse UCI "position" command from a given input string.
+ * @param input_str The input string.
+ */
+void parse_position_command(char* input_str) {
+	// shift pointer to the right where next token begins
+	input_str += 9;
+
+	// initialize the pointer to the current character in the command string
+	char* current_char = input_str;
+
+	// parse UCI "startpos" command
+	if (strncmp(input_str, "startpos", 8) == 0) {
+		// initialize the board with the starting position
+		parse_fen(fen_starting_position);
+	} else {
+		// make sure "fen" is available within command string
+		current_char = strstr(input_str, "fen");
+
+		// if no "fen" command is available, return
+		if (current_char == NULL)
+			parse_fen(fen_starting_position);
+		else {
+			// shift pointer to the right where next token begins
+			current_char += 4;
+
+			// initialize board position from given fen string (an invalid one keeps the position)
+			int error = parse_fen(current_char);
+
+			if (error != fen_ok) {
+				printf("info string invalid fen: %s\n", fen_errors[error]);
+				return;
+			}
+		}
+	}
+
+	// parse moves for position
+	current_char = strstr(input_str, "moves");
+
+	// if "moves" command is available, play them (up to the first illegal one)
+	if (current_char != NULL)
+		play_moves(current_char + 6);
+}
+
+/**
+ * Parse UCI "go" command from a given input string.
+ * @param input_str The input string.
+ */
+void parse_go_command(char *command)
+{
+    // play from the book without searching
+    int move = use_book ? book_move() : 0;
+
+    if (move) {
+        printf("bestmove ");
+        print_move(move);
+        printf("\n");
+        return;
+    }
+
+    // init depth
+    int depth = -1;
+    
+    // init character pointer to the current depth argument
+    char *current_depth = NULL;
+
+    // init character pointer to the current limit argument
+    char *argument = NULL;
+
+    // remaining time, increment and moves to go of the side to move
+    int time = -1, increment = 0, moves_to_go = 30, move_time = -1;
+
+    // handle fixed depth search
+    if ((current_depth = strstr(command, "depth")))
+        //convert string to integer and assign the result value to depth
+        depth = atoi(current_depth + 6);
+
+    // handle fixed node search
+    if ((argument = strstr(command, "nodes")))
+        node_limit = atol(argument + 6);
+
+    // handle fixed time per move
+    if ((argument = strstr(command, "movetime")))
+        move_time = atoi(argument + 9);
+
+    // handle clocks
+    if ((argument = strstr(command, (side == white) ? "wtime" : "btime")))
+        time = atoi(argument + 6);
+
+    if ((argument = strstr(command, (side == white) ? "winc" : "binc")))
+        increment = atoi(argument + 5);
+
+    if ((argument = strstr(command, "movestogo")))
+        moves_to_go = atoi(argument + 10);
+
+    // spend a share of the remaining time plus most of the increment, keeping a safety margin
+    if (time >= 0) {
+        move_time = time / ((moves_to_go > 0) ? moves_to_go : 30) + increment * 3 / 4;
+
+        if (move_time > time - 50)
+            move_time = (time > 100) ? time - 50 : time / 2;
+    }
+
+    if (move_time >= 0)
+        stop_time = get_time_millis() + ((move_time > 1) ? move_time : 1);
+
+    // the GUI can stop the search (and the mate solver) with "stop"
+    search_listens = 1;
+
+    // search a forced mate with the mate solver, the regular search plays on without one
+    if ((argument = strstr(command, "mate"))) {
+        int moves = atoi(argument + 5), pv[MAX_PLY];
+
+        if (moves > MAX_PLY / 2)
+            moves = MAX_PLY / 2;
+
+        if (moves > 0 && search_mate(moves, pv)) {
+            node_limit = 0;
+            stop_time = 0;
+            search_listens = 0;
+
+            printf("bestmove ");
+            print_move(pv[0]);
+            printf("\n");
+            return;
+        }
+
+        printf("info string no mate in %d found\n", moves);
+
+        // the solver spent the limits or was stopped: only a quick search for the move is left
+        if (stop_search)
+            depth = 1;
+    }
+
+    // searches limited by nodes or time deepen as far as they can
+    if (depth <= 0)
+        depth = (node_limit || stop_time) ? MAX_PLY - 1 : 6;
+    
+	printf("depth: %d\n", depth);
+    // search position
+    search_position(depth);
+
+    search_listens = 0;
+}
+
+/**
+ * Parse UCI "setoption" command from a given input string.
+ * @param command The input string (e.g. "setoption name EvalCache value 64").
+ */
+void parse_setoption_command(char* command) {
+	char* name = strstr(command, "name ");
+	char* value = strstr(command, "value ");
+
+	// ignore malformed commands
+	if (name == NULL || value == NULL)
+		return;
+
+	// shift pointer to the option name
+	name += 5;
+
+	// shift pointer to the option value
+	value += 6;
+
+	// strip the trailing new line
+	value[strcspn(value, "\r\n")] = '\0';
+
+	// evaluation cache size in megabytes
+	if (strncmp(name, "EvalCache", 9) == 0)
+		init_eval_cache(atoi(value));
+
+	// network file (switches to the classic evaluation until UseNNUE is set again)
+	else if (strncmp(name, "EvalFile", 8) == 0) {
+		if (!load_nnue(value))
+			printf("info string could not load network %s\n", value);
+
+		init_eval_cache(eval_cache_megabytes);
+	}
+
+	// choose between the network and the classic evaluation
+	else if (strncmp(name, "UseNNUE", 7) == 0) {
+		use_nnue = nnue_loaded && strncmp(value, "true", 4) == 0;
+
+		if (!nnue_loaded && strncmp(value, "true", 4) == 0)
+			printf("info string no network loaded, using the classic evaluation\n");
+
+		// cached evaluations of the other evaluation must not be reused
+		init_eval_cache(eval_cache_megabytes);
+	}
+
+	// play book moves when available
+	else if (strncmp(name, "OwnBook", 7) == 0)
+		use_book = strncmp(value, "true", 4) == 0;
+
+	// opening book file
+	else if (strncmp(name, "BookFile", 8) == 0) {
+		if (!open_book(value) && *value && strcmp(value, "<empty>"))
+			printf("info string could not load book %s\n", value);
+	}
+
+	// directory of the endgame tablebases
+	else if (strncmp(name, "TablebasePath", 13) == 0)
+		printf("info string %d tablebases loaded\n", tb_load(value));
+}
+
+/**
+ * Print the engine identification and its options, in reply to the UCI "uci" command.
+ */
+void print_engine_info() {
+	printf("id name BBChess\n");
+	printf("id author DaniGMX\n");
+	printf("option name EvalCache type spin default %d min 0 max 4096\n", DEFAULT_EVAL_CACHE_MB);
+	printf("option name EvalFile type string default <empty>\n");
+	printf("option name UseNNUE type check default false\n");
+	printf("option name OwnBook type check default false\n");
+	printf("option name BookFile type string default <empty>\n");
+	printf("option name TablebasePath type string default <empty>\n");
+	printf("uciok\n");
+}
+
+/* 
+	GUI 	-> isready
+	Engine 	-> readyok
+	GUI		-> ucinewgame
+*/
+
+/**
+ * Main UCI loop
+ */
+void uci_loop() {
+	// reset stdin & stdout buffers
+	setbuf(stdin, NULL);
+	setbuf(stdout, NULL);
+
+	// define a user / GUI
+	char input[2000];
+
+	// print engine info
+	print_engine_info();
+
+	// main UCI loop
+	while (1) {
+		// reset GUI input
+		memset(input, 0, sizeof(input));
+
+		// make sure output reaches GUI
+		fflush(stdout);
+
+		// get user input, first a command sent during the last search (stop when the GUI closes the pipe)
+		if (pending_input[0]) {
+			strcpy(input, pending_input);
+			pending_input[0] = '\0';
+		}
+		else if (!fgets(input, sizeof(input), stdin))
+			break;
+
+		// make sure input is available
+		if (input[0] == '\n')
+			continue;
+
+		// parse UCI "isready" command
+		else if (strncmp(input, "isready", 7) == 0) {
+			printf("readyok\n");
+			continue;
+		}
+
+		// parse UCI "position" command
+		else if (strncmp(input, "position", 8) == 0)
+			parse_position_command(input);
+
+		// parse UCI "ucinewgame" command
+
+		else if (strncmp(input, "ucinewgame", 10) == 0)
+			parse_position_command("position startpos");
+
+		// parse UCI "go" command
+		else if (strncmp(input, "go", 2) == 0) {
+			parse_go_command(input);
+
+			// the GUI quit during the search
+			if (quit_requested)
+				break;
+		}
+
+		// generate self-play training data
+		else if (strncmp(input, "gensfen", 7) == 0)
+			parse_gensfen_command(input);
+
+		// search the benchmark positions
+		else if (strncmp(input, "bench", 5) == 0)
+			parse_bench_command(input);
+
+		// print the statistics of the last search
+		else if (strncmp(input, "stats", 5) == 0)
+			print_search_stats();
+
+		// check the perft results of an EPD file
+		else if (strncmp(input, "perftsuite", 10) == 0)
+			parse_perftsuite_command(input);
+
+		// replay the games of a PGN file
+		else if (strncmp(input, "pgn ", 4) == 0)
+			parse_pgn_command(input);
+
+		// parse the records of an EPD file
+		else if (strncmp(input, "epd ", 4) == 0)
+			parse_epd_command(input);
+
+		// list the book moves of the current position
+		else if (strncmp(input, "book", 4) == 0)
+			print_book_moves();
+
+		// build a book from a PGN or EPD file
+		else if (strncmp(input, "makebook", 8) == 0)
+			parse_makebook_command(input);
+
+		// generate endgame tablebases
+		else if (strncmp(input, "tbgen", 5) == 0)
+			parse_tbgen_command(input);
+
+		// parse UCI "quit" command
+		else if (strncmp(input, "quit", 4) == 0)
+			break;
+
+		// parse UCI "setoption" command
+		else if (strncmp(input, "setoption", 9) == 0)
+			parse_setoption_command(input);
+
+		// parse UCI "uci" command
+		else if (strncmp(input, "uci", 3) == 0) {
+			// print engine info
+			print_engine_info();
+		}
+	}
+}
+
+#pragma endregion
+
+#pragma region Library API
+
+/*
+ * The C API of bbchess.h. The engine state is thread local, so an instance keeps
+ * its own copy of the position and game history and loads it into the calling
+ * thread for every call. Build the library (no main function) with -DLIBRARY.
+ */
+
+/** An engine instance: a position with its game history. */
+struct bbchess_engine {
+	u64 bitboards[12];
+	u64 occupancies[3];
+	int side, enpassant, castlings, fifty, fullmove;
+	u64 hash_key, pawn_key, material_key;
+	int psqt_score, game_phase;
+	int repetition_index;
+	u64 repetition_table[MAX_GAME_PLY];
+};
+
+/** Makes sure the engine tables are built only once. */
+pthread_once_t engine_tables_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Initializes the engine tables shared by all instances, once.
+ */
+void bbchess_init() {
+	pthread_once(&engine_tables_once, init_all);
+}
+
+/**
+ * Loads the position of an instance into the calling thread.
+ * @param engine The instance.
+ */
+void load_engine(const bbchess_engine* engine) {
+	memcpy(bitboards, engine->bitboards, sizeof(bitboards));
+	memcpy(occupancies, engine->occupancies, sizeof(occupancies));
+	side = engine->side, open_enpassant = engine->enpassant, available_castlings = engine->castlings;
+	fifty = engine->fifty, fullmove = engine->fullmove;
+	hash_key = engine->hash_key, pawn_key = engine->pawn_key, material_key = engine->material_key;
+	psqt_score = engine->psqt_score, game_phase = engine->game_phase;
+	repetition_index = engine->repetition_index;
+	memcpy(repetition_table, engine->repetition_table, repetition_index * sizeof(u64));
+
+	// the NNUE accumulator is refreshed when a search starts
+	accumulator_index = -1;
+}
+
+/**
+ * Stores the position of the calling thread into an instance.
+ * @param engine The instance.
+ */
+void store_engine(bbchess_engine* engine) {
+	memcpy(engine->bitboards, bitboards, sizeof(bitboards));
+	memcpy(engine->occupancies, occupancies, sizeof(occupancies));
+	engine->side = side, engine->enpassant = open_enpassant, engine->castlings = available_castlings;
+	engine->fifty = fifty, engine->fullmove = fullmove;
+	engine->hash_key = hash_key, engine->pawn_key = pawn_key, engine->material_key = material_key;
+	engine->psqt_score = psqt_score, engine->game_phase = game_phase;
+	engine->repetition_index = repetition_index;
+	memcpy(engine->repetition_table, repetition_table, repetition_index * sizeof(u64));
+}
+
+/**
+ * Static evaluation of the current position as the search computes it, bypassing the
+ * evaluation cache (batches of unrelated positions would only thrash it).
+ * @return The evaluation from the side to move point of view.
+ */
+int static_evaluation() {
+	attack_map map;
+	int map_ready;
+
+	// the accumulator of a new position is computed from scratch
+	if (use_nnue)
+		nnue_refresh_accumulator();
+
+	return evaluate_position(&map, &map_ready);
+}
+
+bbchess_engine* bbchess_create(void) {
+	bbchess_init();
+
+	bbchess_engine* engine = calloc(1, sizeof(bbchess_engine));
+
+	if (engine)
+		bbchess_set_fen(engine, fen_starting_position);
+
+	return engine;
+}
+
+void bbchess_destroy(bbchess_engine* engine) {
+	free(engine);
+}
+
+int bbchess_set_fen(bbchess_engine* engine, const char* fen) {
+	if (!engine || !fen)
+		return -1;
+
+	// an invalid FEN leaves the instance unchanged
+	if (parse_fen(fen) != fen_ok)
+		return -1;
+
+	store_engine(engine);
+	return 0;
+}
+
+int bbchess_get_fen(const bbchess_engine* engine, char* buffer) {
+	board_position position;
+
+	memcpy(position.bitboards, engine->bitboards, sizeof(position.bitboards));
+	position.side = engine->side;
+	position.enpassant = engine->enpassant;
+	position.castlings = engine->castlings;
+	position.fifty = engine->fifty;
+	position.fullmove = engine->fullmove;
+
+	return write_fen(&position, buffer);
+}
+
+int bbchess_play_moves(bbchess_engine* engine, const char* moves) {
+	if (!engine || !moves)
+		return -1;
+
+	load_engine(engine);
+
+	int played = play_moves((char*)moves);
+
+	// keep the moves played before an illegal one
+	store_engine(engine);
+	return played;
+}
+
+/** Forwards the iterations of a library search to the user callback. */
+typedef struct {
+	bbchess_info_callback callback;
+	void* user_data;
+	int depth;		// depth of the last completed iteration
+} search_context;
+
+/**
+ * Records the depth of a completed iteration and reports it to the user callback.
+ * @param info The iteration.
+ * @param data The search context.
+ * @return Whether to stop the search.
+ */
+int report_iteration(const bbchess_search_info* info, void* data) {
+	search_context* context = data;
+
+	context->depth = info->depth;
+
+	return context->callback ? context->callback(info, context->user_data) : 0;
+}
+
+int bbchess_search(bbchess_engine* engine, const bbchess_limits* limits,
+		bbchess_info_callback callback, void* user_data, bbchess_search_result* result) {
+	int pv[MAX_PLY], score;
+	search_context context = { callback, user_data, 0 };
+
+	load_engine(engine);
+	clear_search();
+
+	// apply the limits, searches limited by nodes or time deepen as far as they can
+	int depth = (limits && limits->depth > 0) ? limits->depth : 0;
+	node_limit = limits ? limits->nodes : 0;
+
+	if (limits && limits->movetime > 0)
+		stop_time = get_time_millis() + limits->movetime;
+
+	if (depth <= 0)
+		depth = (node_limit || stop_time) ? MAX_PLY - 1 : 6;
+
+	depth = (depth > MAX_PLY - 1) ? MAX_PLY - 1 : depth;
+
+	int start = get_time_millis();
+
+	search_info_callback = report_iteration;
+	search_info_data = &context;
+
+	int pv_length = iterative_deepening(depth, 0, pv, &score);
+
+	// the callback and limits only apply to this search
+	search_info_callback = NULL;
+	search_info_data = NULL;
+	node_limit = 0;
+	stop_time = 0;
+
+	if (result) {
+		result->best_move = pv_length ? pv[0] : 0;
+		result->score = score;
+		result->depth = context.depth;
+		result->nodes = nodes;
+		result->time = get_time_millis() - start;
+	}
+
+	return pv_length ? 0 : -1;
+}
+
+long long bbchess_perft(bbchess_engine* engine, int depth) {
+	load_engine(engine);
+
+	nodes = 0;
+	perft_driver((depth > 0) ? depth : 0);
+
+	return nodes;
+}
+
+int bbchess_evaluate_fens(bbchess_engine* engine, const char* const* fens, int count, int* scores) {
+	int evaluated = 0;
+
+	for (int index = 0; index < count; index++) {
+		scores[index] = 0;
+
+		// invalid positions score 0
+		if (parse_fen(fens[index]) != fen_ok)
+			continue;
+
+		scores[index] = static_evaluation();
+		evaluated++;
+	}
+
+	// the position of the instance is not changed
+	load_engine(engine);
+
+	return evaluated;
+}
+
+/** Contiguous range of a batch analysed by one thread. */
+typedef struct {
+	bbchess_batch* batch;
+	int first;		// first position of the range
+	int last;		// one past the last position of the range
+	int valid;		// valid positions found in the range
+} batch_job;
+
+/**
+ * Analyses the positions of one range of a batch.
+ * @param arg The batch job.
+ */
+void* batch_worker(void* arg) {
+	batch_job* job = arg;
+	bbchess_batch* batch = job->batch;
+
+	job->valid = 0;
+
+	for (int index = job->first; index < job->last; index++) {
+		// invalid positions are marked and skipped
+		if (parse_fen(batch->fens[index]) != fen_ok) {
+			if (batch->scores)
+				batch->scores[index] = 0;
+
+			if (batch->move_counts)
+				batch->move_counts[index] = -1;
+
+			continue;
+		}
+
+		job->valid++;
+
+		if (batch->scores)
+			batch->scores[index] = static_evaluation();
+
+		if (!batch->move_counts && !batch->moves)
+			continue;
+
+		// keep the legal moves of the pseudo legal ones
+		move_list _move_list[1];
+		int* moves = batch->moves ? batch->moves + (long)index * batch->max_moves : NULL;
+		int count = 0;
+
+		generate_moves(_move_list);
+
+		for (int i = 0; i < _move_list->last; i++) {
+			save_board();
+
+			if (!make_move(_move_list->arr[i], all_moves))
+				continue;
+
+			restore_board();
+
+			if (moves && count < batch->max_moves)
+				moves[count] = _move_list->arr[i];
+
+			count++;
+		}
+
+		if (batch->move_counts)
+			batch->move_counts[index] = count;
+	}
+
+	return NULL;
+}
+
+int bbchess_analyse_batch(bbchess_batch* batch, int threads) {
+	batch_job jobs[MAX_THREADS];
+
+	bbchess_init();
+
+	if (!batch || !batch->fens || batch->count <= 0)
+		return 0;
+
+	// at least a few hundred positions per thread, or starting the threads costs more than it saves
+	if (threads <= 0)
+		threads = get_cpu_count();
+
+	threads = (threads > (batch->count + 255) / 256) ? (batch->count + 255) / 256 : threads;
+	threads = (threads > MAX_THREADS) ? MAX_THREADS : threads;
+
+	for (int thread = 0; thread < threads; thread++)
+		jobs[thread] = (batch_job){
+			.batch = batch,
+			.first = (int)((long)batch->count * thread / threads),
+			.last = (int)((long)batch->count * (thread + 1) / threads)
+		};
+
+	// a single range runs on the calling thread
+	if (threads == 1)
+		batch_worker(&jobs[0]);
+	else
+		run_threads(threads, batch_worker, jobs, sizeof(batch_job));
+
+	int valid = 0;
+
+	for (int thread = 0; thread < threads; thread++)
+		valid += jobs[thread].valid;
+
+	return valid;
+}
+
+char* bbchess_format_move(int move, char* buffer) {
+	return format_move(move, buffer);
+}
+
+int bbchess_uci(int argc, char* argv[]) {
+	bbchess_init();
+
+	// run a command given on the command line instead of the UCI loop
+	if (argc > 1) {
+		char command[2000] = "";
+
+		for (int i = 1; i < argc; i++) {
+			strncat(command, argv[i], sizeof(command) - strlen(command) - 2);
+			strcat(command, " ");
+		}
+
+		if (strncmp(command, "gensfen", 7) == 0)
+			parse_gensfen_command(command);
+		else if (strncmp(command, "bench", 5) == 0)
+			parse_bench_command(command);
+		else if (strncmp(command, "perftsuite", 10) == 0)
+			parse_perftsuite_command(command);
+		else if (strncmp(command, "pgn ", 4) == 0)
+			parse_pgn_command(command);
+		else if (strncmp(command, "epd ", 4) == 0)
+			parse_epd_command(command);
+		else if (strncmp(command, "makebook", 8) == 0)
+			parse_makebook_command(command);
+		else if (strncmp(command, "tbgen", 5) == 0)
+			parse_tbgen_command(command);
+		else {
+			printf("unknown command: %s\n", command);
+			return 1;
+		}
+
+		return 0;
+	}
+
+	// conmnect with GUI
+	uci_loop();
+
+	return 0;
+}
+
+#pragma endregion
+
+#ifdef TUNER
+
+#pragma region Texel Tuning
+
+/*
+	Texel tuning of the material and piece-square tables
+
+	1. 	Labelled positions (a FEN followed by a game result: 1-0, 0-1, 1/2-1/2,
+		[1.0], [0.5] or [0.0]) are read in batches and resolved in parallel to the
+		quiet leaf of their quiescence search, each worker thread on its own board.
+	2. 	Every leaf is stored as a 32 byte tuning entry: its pieces, game phase,
+		result and the untuned evaluation terms (pawn structure, mobility, king safety).
+	3. 	The scaling constant K of the win probability sigmoid(K * eval) is fitted,
+		then Adam descends the mean squared error between results and win
+		probabilities, evaluating the entries in parallel every epoch.
+	4. 	The tuned tables are written out as eval_tables.h, compiled into the engine.
+
+	Move ordering tables (mvv_lva) do not change the static evaluation, so they
+	are left alone.
+*/
+
+/** Compact quiet position used by the tuner. */
+typedef struct {
+	u64 occupancy;				// occupied squares
+	unsigned char pieces[16];	// pieces in occupancy order (a8 first), two per byte
+	short fixed_mg, fixed_eg;	// untuned evaluation terms (white point of view)
+	unsigned char phase;		// game phase, clamped to MAX_PHASE
+	unsigned char result;		// game result for white: 0 loss, 1 draw, 2 win
+	unsigned char padding[2];
+} tuning_entry;
+
+// tuned parameters: material, then the piece-square tables
+#define TUNING_PARAMS (10 + 7 * 64)
+
+enum {
+	mg_material_param = 0, eg_material_param = 5,
+	pawn_mg_param = 10, pawn_eg_param = 74, knight_param = 138, bishop_param = 202,
+	rook_param = 266, king_mg_param = 330, king_eg_param = 394
+};
+
+/** Parameters of every (piece type, white-oriented square) [type][square][mg/eg][material/table], -1 for none. */
+int tuning_indices[6][64][2][2];
+
+/** Lines read and resolved per batch. */
+#define TUNING_BATCH 65536
+
+/** Maximum length of an input line. */
+#define TUNING_LINE_SIZE 256
+
+/**
+ * Initializes the parameter indices of every piece on every square.
+ */
+void init_tuning_indices() {
+	for (int square = 0; square < 64; square++) {
+		int table_params[6][2] = {
+			{ pawn_mg_param, pawn_eg_param }, { knight_param, knight_param }, { bishop_param, bishop_param },
+			{ rook_param, rook_param }, { -1, -1 }, { king_mg_param, king_eg_param }
+		};
+
+		for (int type = P; type <= K; type++) {
+			// kings have no tuned material value, queens no table
+			tuning_indices[type][square][0][0] = (type == K) ? -1 : mg_material_param + type;
+			tuning_indices[type][square][1][0] = (type == K) ? -1 : eg_material_param + type;
+			tuning_indices[type][square][0][1] = (table_params[type][0] < 0) ? -1 : table_params[type][0] + square;
+			tuning_indices[type][square][1][1] = (table_params[type][1] < 0) ? -1 : table_params[type][1] + square;
+		}
+	}
+}
+
+/**
+ * Loads the compiled in tables into a parameter vector.
+ * @param params The parameters to fill.
+ */
+void load_tuning_params(double* params) {
+	for (int type = P; type <= Q; type++) {
+		params[mg_material_param + type] = material_score[type];
+		params[eg_material_param + type] = endgame_material_score[type];
+	}
+
+	for (int square = 0; square < 64; square++) {
+		params[pawn_mg_param + square] = pawn_scores[square];
+		params[pawn_eg_param + square] = pawn_endgame_scores[square];
+		params[knight_param + square] = knight_scores[square];
+		params[bishop_param + square] = bishop_scores[square];
+		params[rook_param + square] = rook_scores[square];
+		params[king_mg_param + square] = king_scores[square];
+		params[king_eg_param + square] = king_endgame_scores[square];
+	}
+}
+
+/**
+ * Parses the game result of a labelled position.
+ * @param line The input line.
+ * @return The result for white (0 loss, 1 draw, 2 win), or -1 if there is none.
+ */
+int parse_result(const char* line) {
+	if (strstr(line, "1/2-1/2") || strstr(line, "[0.5]"))
+		return 1;
+
+	if (strstr(line, "1-0") || strstr(line, "[1.0]"))
+		return 2;
+
+	if (strstr(line, "0-1") || strstr(line, "[0.0]"))
+		return 0;
+
+	return -1;
+}
+
+/**
+ * Packs the current position into a tuning entry.
+ * @param entry The entry to fill (the result is left alone).
+ * @param map The attack map of the current position.
+ */
+void pack_tuning_entry(tuning_entry* entry, const attack_map* map) {
+	// evaluation terms that are not tuned
+	int fixed = evaluate_pawns() + map->mobility + evaluate_king_attack(map, white) - evaluate_king_attack(map, black);
+
+	entry->occupancy = occupancies[both];
+	entry->fixed_mg = mg_score(fixed);
+	entry->fixed_eg = eg_score(fixed);
+	entry->phase = (game_phase < MAX_PHASE) ? game_phase : MAX_PHASE;
+	pack_pieces(entry->pieces);
+}
+
+/**
+ * Quiescence search that also returns its principal leaf, the quiet position
+ * whose evaluation the score comes from. Mirrors quiescence.
+ * @param alpha The lower bound.
+ * @param beta The upper bound.
+ * @param leaf The principal leaf, set when the score lies within the bounds.
+ * @return The quiescence score.
+ */
+int resolve_quiescence(int alpha, int beta, tuning_entry* leaf) {
+	search_frame* ss = frame_at(ply);
+
+	generate_attack_map(&ss->map);
+	int evaluation = evaluate(&ss->map);
+
+	if (ply >= MAX_PLY - 1 || evaluation >= beta) {
+		pack_tuning_entry(leaf, &ss->map);
+		return (evaluation >= beta) ? beta : evaluation;
+	}
+
+	// standing pat is the principal line so far
+	if (evaluation > alpha) {
+		alpha = evaluation;
+		pack_tuning_entry(leaf, &ss->map);
+	}
+
+	move_list _move_list[1];
+	generate_moves(_move_list);
+	sort_moves(_move_list);
+
+	for (int count = 0; count < _move_list->last; count++) {
+		// skip captures that are likely to lose material
+		if (decode_move_capture(_move_list->arr[count]) && is_losing_capture(_move_list->arr[count], &ss->map))
+			continue;
+
+		save_board();
+		ply++;
+
+		if (make_move(_move_list->arr[count], only_captures) == 0) {
+			ply--;
+			continue;
+		}
+
+		tuning_entry child;
+		int score = -resolve_quiescence(-beta, -alpha, &child);
+
+		ply--;
+		restore_board();
+
+		if (score >= beta)
+			return beta;
+
+		// the capture line is the principal line now
+		if (score > alpha) {
+			alpha = score;
+			*leaf = child;
+		}
+	}
+
+	return alpha;
+}
+
+/** Work of one thread resolving a batch of input lines. */
+typedef struct {
+	char (*lines)[TUNING_LINE_SIZE];	// input lines
+	tuning_entry* entries;				// resolved entries, one per line (result 255 when invalid)
+	int first, last;					// range of lines of this thread
+} resolve_job;
+
+/**
+ * Resolves a range of input lines into tuning entries.
+ * @param arg The resolve job.
+ */
+void* resolve_worker(void* arg) {
+	resolve_job* job = arg;
+
+	for (int line = job->first; line < job->last; line++) {
+		tuning_entry* entry = &job->entries[line];
+		int result = parse_result(job->lines[line]);
+
+		entry->result = 255;
+
+		// skip lines without a result or a king of each side
+		if (result < 0 || !strchr(job->lines[line], 'K') || !strchr(job->lines[line], 'k'))
+			continue;
+
+		parse_fen(job->lines[line]);
+		ply = 0;
+
+		resolve_quiescence(-50000, 50000, entry);
+		entry->result = result;
+	}
+
+	return NULL;
+}
+
+/** Work of one thread evaluating a range of tuning entries. */
+typedef struct {
+	const tuning_entry* entries;		// all entries
+	long first, last;					// range of entries of this thread
+	const double* params;				// current parameters
+	double k;							// sigmoid scaling constant
+	int compute_gradient;				// whether to accumulate the gradient
+	double error;						// sum of squared errors
+	double gradient[TUNING_PARAMS];		// error gradient, without constant factors
+} tuning_job;
+
+/**
+ * Evaluates a tuning entry with the given parameters.
+ * @param entry The entry.
+ * @param params The parameters.
+ * @return The evaluation, white point of view.
+ */
+static inline double tuning_evaluate(const tuning_entry* entry, const double* params) {
+	double mg = entry->fixed_mg, eg = entry->fixed_eg;
+	u64 occupancy = entry->occupancy;
+
+	for (int count = 0; occupancy; count++) {
+		int square = lsb_index(occupancy);
+		int piece = (entry->pieces[count / 2] >> ((count & 1) * 4)) & 15;
+		int type = (piece < p) ? piece : piece - p;
+		int oriented = (piece < p) ? square : mirror_square[square];
+		double sign = (piece < p) ? 1.0 : -1.0;
+		int* indices = &tuning_indices[type][oriented][0][0];
+
+		for (int term = 0; term < 2; term++) {
+			if (indices[term] >= 0)
+				mg += sign * params[indices[term]];
+
+			if (indices[2 + term] >= 0)
+				eg += sign * params[indices[2 + term]];
+		}
+
+		pop_bit(occupancy, square);
+	}
+
+	return (mg * entry->phase + eg * (MAX_PHASE - entry->phase)) / MAX_PHASE;
+}
+
+/**
+ * Computes the squared error (and its gradient) of a range of tuning entries.
+ * @param arg The tuning job.
+ */
+void* tuning_worker(void* arg) {
+	tuning_job* job = arg;
+
+	job->error = 0;
+	memset(job->gradient, 0, sizeof(job->gradient));
+
+	for (long index = job->first; index < job->last; index++) {
+		const tuning_entry* entry = &job->entries[index];
+		double result = entry->result / 2.0;
+		double probability = 1.0 / (1.0 + exp(-job->k * tuning_evaluate(entry, job->params) * M_LN10 / 400.0));
+		double difference = result - probability;
+
+		job->error += difference * difference;
+
+		if (!job->compute_gradient)
+			continue;
+
+		// derivative of the error with respect to the evaluation (constant factors applied later)
+		double slope = difference * probability * (1.0 - probability);
+		double mg_weight = slope * entry->phase / MAX_PHASE;
+		double eg_weight = slope * (MAX_PHASE - entry->phase) / MAX_PHASE;
+		u64 occupancy = entry->occupancy;
+
+		for (int count = 0; occupancy; count++) {
+			int square = lsb_index(occupancy);
+			int piece = (entry->pieces[count / 2] >> ((count & 1) * 4)) & 15;
+			int type = (piece < p) ? piece : piece - p;
+			int oriented = (piece < p) ? square : mirror_square[square];
+			double sign = (piece < p) ? 1.0 : -1.0;
+			int* indices = &tuning_indices[type][oriented][0][0];
+
+			for (int term = 0; term < 2; term++) {
+				if (indices[term] >= 0)
+					job->gradient[indices[term]] += sign * mg_weight;
+
+				if (indices[2 + term] >= 0)
+					job->gradient[indices[2 + term]] += sign * eg_weight;
+			}
+
+			pop_bit(occupancy, square);
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Computes the mean squared error of all entries, and optionally its gradient, in parallel.
+ * @param jobs The per-thread jobs (entries and ranges already set).
+ * @param threads The number of threads.
+ * @param count The number of entries.
+ * @param params The parameters.
+ * @param k The sigmoid scaling constant.
+ * @param gradient The gradient to fill, or NULL.
+ * @return The mean squared error.
+ */
+double tuning_error(tuning_job* jobs, int threads, long count, const double* params, double k, double* gradient) {
+	for (int thread = 0; thread < threads; thread++) {
+		jobs[thread].params = params;
+		jobs[thread].k = k;
+		jobs[thread].compute_gradient = (gradient != NULL);
+	}
+
+	run_threads(threads, tuning_worker, jobs, sizeof(tuning_job));
+
+	double error = 0;
+
+	for (int thread = 0; thread < threads; thread++)
+		error += jobs[thread].error;
+
+	if (gradient) {
+		// d/dp (r - s)^2 = -2 (r - s) s (1 - s) ln(10) k / 400 d eval / dp
+		double factor = -2.0 * log(10.0) * k / 400.0 / count;
+
+		for (int param = 0; param < TUNING_PARAMS; param++) {
+			gradient[param] = 0;
+
+			for (int thread = 0; thread < threads; thread++)
+				gradient[param] += jobs[thread].gradient[param] * factor;
+		}
+	}
+
+	return error / count;
+}
+
+/**
+ * Writes a 64 entry table of the tuned parameters.
+ * @param file The output file.
+ * @param comment The comment line above the table, or NULL.
+ * @param name The table name.
+ * @param params The parameters.
+ * @param first The index of the first entry of the table.
+ */
+void write_tuned_table(FILE* file, const char* comment, const char* name, const double* params, int first) {
+	if (comment)
+		fprintf(file, "// %s\n", comment);
+
+	fprintf(file, "const int %s[64] = {\n", name);
+
+	for (int rank = 0; rank < 8; rank++) {
+		fprintf(file, "\t");
+
+		for (int file_index = 0; file_index < 8; file_index++)
+			fprintf(file, "%4d%s", (int)lround(params[first + rank * 8 + file_index]), (rank == 7 && file_index == 7) ? "" : ",");
+
+		fprintf(file, "\n");
+	}
+
+	fprintf(file, "};\n\n");
+}
+
+/**
+ * Writes the tuned parameters in the format of eval_tables.h.
+ * @param path The output path.
+ * @param params The parameters.
+ * @return Whether the file was written.
+ */
+int write_tuned_tables(const char* path, const double* params) {
+	FILE* file = fopen(path, "w");
+
+	if (!file)
+		return 0;
+
+	const char* names[6] = { "pawn", "knight", "bishop", "rook", "queen", "king" };
+
+	fprintf(file, "/*\n"
+		"\tMaterial and piece-square tables of the classic evaluation (white point of view,\n"
+		"\ta8 first), compiled into bbchess.c. This file is regenerated by the Texel tuner\n"
+		"\t(make tuner), so edits may be overwritten by the next tuning run.\n"
+		"*/\n\n");
+
+	// material, both colors
+	for (int phase = 0; phase < 2; phase++) {
+		fprintf(file, "// %s material scores\n", phase ? "endgame" : "middlegame");
+		fprintf(file, "int %s[12] = {\n", phase ? "endgame_material_score" : "material_score");
+
+		for (int piece = P; piece <= k; piece++) {
+			int type = (piece < p) ? piece : piece - p;
+			int value = (type == K) ? 10000 : (int)lround(params[(phase ? eg_material_param : mg_material_param) + type]);
+
+			fprintf(file, "\t%6d,\t// %s %s\n", (piece < p) ? value : -value, (piece < p) ? "white" : "black", names[type]);
+		}
+
+		fprintf(file, "};\n\n");
+
+		// the middlegame tables follow the middlegame material
+		if (phase == 0) {
+			write_tuned_table(file, NULL, "pawn_scores", params, pawn_mg_param);
+			write_tuned_table(file, NULL, "knight_scores", params, knight_param);
+			write_tuned_table(file, NULL, "bishop_scores", params, bishop_param);
+			write_tuned_table(file, NULL, "rook_scores", params, rook_param);
+			write_tuned_table(file, NULL, "king_scores", params, king_mg_param);
+		}
+	}
+
+	write_tuned_table(file, "endgame pawn scores (every pawn gets more valuable as it advances, passed pawns score on top)", "pawn_endgame_scores", params, pawn_eg_param);
+	write_tuned_table(file, "endgame king scores (the king becomes an active piece and heads for the center)", "king_endgame_scores", params, king_eg_param);
+
+	fclose(file);
+	return 1;
+}
+
+/**
+ * Runs the Texel tuner.
+ * Usage: bbchess_tuner <positions file> [output file] [epochs] [threads]
+ * @param argc The number of arguments.
+ * @param argv The arguments.
+ * @return The process exit code.
+ */
+int run_tuner(int argc, char* argv[]) {
+	if (argc < 2) {
+		printf("usage: %s <positions file> [output file] [epochs] [threads]\n", argv[0]);
+		return 1;
+	}
+
+	const char* output_path = (argc > 2) ? argv[2] : "eval_tables.h";
+	int epochs = (argc > 3) ? atoi(argv[3]) : 1000;
+	int threads = (argc > 4) ? atoi(argv[4]) : get_cpu_count();
+
+	if (threads < 1 || threads > MAX_THREADS)
+		threads = (threads < 1) ? 1 : MAX_THREADS;
+
+	FILE* input = fopen(argv[1], "r");
+
+	if (!input) {
+		printf("could not open %s\n", argv[1]);
+		return 1;
+	}
+
+	init_tuning_indices();
+
+	// load and resolve the positions batch by batch
+	char (*lines)[TUNING_LINE_SIZE] = malloc(TUNING_BATCH * TUNING_LINE_SIZE);
+	tuning_entry* batch = malloc(TUNING_BATCH * sizeof(tuning_entry));
+	resolve_job resolve_jobs[MAX_THREADS];
+
+	tuning_entry* entries = NULL;
+	long count = 0, capacity = 0, lines_read = 0;
+	int start = get_time_millis();
+
+	for (;;) {
+		int batch_size = 0;
+
+		while (batch_size < TUNING_BATCH && fgets(lines[batch_size], TUNING_LINE_SIZE, input))
+			batch_size++;
+
+		if (batch_size == 0)
+			break;
+
+		lines_read += batch_size;
+
+		// resolve the batch in parallel
+		for (int thread = 0; thread < threads; thread++) {
+			resolve_jobs[thread].lines = lines;
+			resolve_jobs[thread].entries = batch;
+			resolve_jobs[thread].first = (int)((long)batch_size * thread / threads);
+			resolve_jobs[thread].last = (int)((long)batch_size * (thread + 1) / threads);
+		}
+
+		run_threads(threads, resolve_worker, resolve_jobs, sizeof(resolve_job));
+
+		// keep the valid entries
+		if (count + batch_size > capacity) {
+			capacity = (capacity + batch_size) * 2;
+			entries = realloc(entries, capacity * sizeof(tuning_entry));
+		}
+
+		for (int line = 0; line < batch_size; line++)
+			if (batch[line].result != 255)
+				entries[count++] = batch[line];
+
+		printf("\rloaded %ld positions", count);
+		fflush(stdout);
+	}
+
+	fclose(input);
+	free(lines);
+	free(batch);
+
+	double seconds = (get_time_millis() - start + 1) / 1000.0;
+
+	printf("\nresolved %ld of %ld lines in %.1f s (%.0f positions/s/core, %ld MB)\n",
+		count, lines_read, seconds, lines_read / seconds / threads, count * (long)sizeof(tuning_entry) >> 20);
+
+	if (count == 0) {
+		free(entries);
+		return 1;
+	}
+
+	// split the entries between the threads
+	tuning_job* jobs = malloc(threads * sizeof(tuning_job));
+
+	for (int thread = 0; thread < threads; thread++) {
+		jobs[thread].entries = entries;
+		jobs[thread].first = count * thread / threads;
+		jobs[thread].last = count * (thread + 1) / threads;
+	}
+
+	double params[TUNING_PARAMS];
+	load_tuning_params(params);
+
+	// fit the sigmoid scaling constant: coarse scan, then refine around the best value
+	double best_k = 1.0, best_error = tuning_error(jobs, threads, count, params, best_k, NULL);
+
+	for (double step = 0.1; step >= 0.001; step /= 10) {
+		double center = best_k;
+
+		for (int offset = -10; offset <= 10; offset++) {
+			double k = center + offset * step;
+
+			if (k <= 0)
+				continue;
+
+			double error = tuning_error(jobs, threads, count, params, k, NULL);
+
+			if (error < best_error) {
+				best_error = error;
+				best_k = k;
+			}
+		}
+	}
+
+	printf("K = %.3f, initial error %.6f\n", best_k, best_error);
+
+	// Adam
+	double gradient[TUNING_PARAMS], momentum[TUNING_PARAMS] = { 0 }, velocity[TUNING_PARAMS] = { 0 };
+	const double learning_rate = 1.0, beta1 = 0.9, beta2 = 0.999, epsilon = 1e-8;
+
+	for (int epoch = 1; epoch <= epochs; epoch++) {
+		int epoch_start = get_time_millis();
+		double error = tuning_error(jobs, threads, count, params, best_k, gradient);
+		double epoch_seconds = (get_time_millis() - epoch_start + 1) / 1000.0;
+
+		for (int param = 0; param < TUNING_PARAMS; param++) {
+			momentum[param] = beta1 * momentum[param] + (1 - beta1) * gradient[param];
+			velocity[param] = beta2 * velocity[param] + (1 - beta2) * gradient[param] * gradient[param];
+
+			double corrected_momentum = momentum[param] / (1 - pow(beta1, epoch));
+			double corrected_velocity = velocity[param] / (1 - pow(beta2, epoch));
+
+			params[param] -= learning_rate * corrected_momentum / (sqrt(corrected_velocity) + epsilon);
+		}
+
+		if (epoch % 10 == 0 || epoch == epochs)
+			printf("epoch %d error %.6f (%.0f positions/s/core)\n", epoch, error, count / epoch_seconds / threads);
+
+		// save the progress every now and then
+		if (epoch % 100 == 0 || epoch == epochs)
+			write_tuned_tables(output_path, params);
+	}
+
+	printf("tuned tables written to %s\n", output_path);
+
+	free(jobs);
+	free(entries);
+
+	return 0;
+}
+
+#pragma endregion
+
+#endif
+
+#ifdef MATCH
+
+#pragma region Match Runner
+
+/*
+	Match runner: plays games between two engine builds over UCI pipes
+
+	Every concurrent game slot is a thread with its own pair of engine processes
+	and its own board, which referees the game (legality, mate, stalemate,
+	repetition, fifty-move rule, insufficient material, time forfeits). Openings
+	come from a FEN/EPD file and are played twice with colours swapped.
+
+	bbchess_match engine1 <path> engine2 <path> [openings <file>] [games <n>]
+		[concurrency <n>] [tc <seconds>+<increment>] [movetime <ms>] [nodes <n>]
+		[depth <n>] [maxplies <n>] [sprt <elo0> <elo1>] [alpha <a>] [beta <b>]
+
+	The result is reported as logistic Elo with a 95% confidence interval, the
+	likelihood of superiority and, if requested, the sequential probability ratio
+	test (trinomial approximation), which also stops the match once decided.
+*/
+
+/** Tolerance on the clock before a time forfeit, in milliseconds. */
+#define MATCH_TIME_MARGIN 20
+
+/** How long a search without a clock may take before the engine is considered hung. */
+#define MATCH_MOVE_TIMEOUT 300000
+
+/** A running engine process and its UCI pipes. */
+typedef struct {
+#ifdef WIN64
+	HANDLE process;
+	HANDLE input;			// commands to the engine
+	HANDLE output;			// engine output
+#else
+	pid_t pid;
+	int input;				// commands to the engine
+	int output;				// engine output
+#endif
+	char buffer[8192];		// engine output not consumed yet
+	int buffered;
+	int alive;
+} engine_process;
+
+/** Settings and shared results of a match. */
+typedef struct {
+	const char* paths[2];
+	const char* names[2];
+	char (*openings)[128];
+	int opening_count;
+	int games;
+	int concurrency;
+	int time, increment;		// clock and increment in milliseconds (0 for none)
+	int move_time;
+	long nodes;
+	int depth;
+	int max_plies;
+	int sprt;
+	double elo0, elo1, alpha, beta;
+
+	pthread_mutex_t lock;		// guards everything below
+	int next_game;
+	int stop;
+	int wins, losses, draws;	// from the first engine's point of view
+} match_state;
+
+/** Serializes process creation, so no engine inherits the pipes of another one. */
+pthread_mutex_t spawn_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Starts an engine process with its standard input and output connected to pipes.
+ * @param engine The engine to start.
+ * @param path The path of the engine executable.
+ * @return Whether the engine started.
+ */
+int start_engine(engine_process* engine, const char* path) {
+	engine->buffered = 0;
+	engine->alive = 0;
+
+	pthread_mutex_lock(&spawn_lock);
+
+#ifdef WIN64
+	SECURITY_ATTRIBUTES attributes = { sizeof(SECURITY_ATTRIBUTES), NULL, TRUE };
+	HANDLE child_input, child_output;
+
+	if (!CreatePipe(&child_input, &engine->input, &attributes, 0)) {
+		pthread_mutex_unlock(&spawn_lock);
+		return 0;
+	}
+
+	if (!CreatePipe(&engine->output, &child_output, &attributes, 0)) {
+		CloseHandle(child_input);
+		CloseHandle(engine->input);
+		pthread_mutex_unlock(&spawn_lock);
+		return 0;
+	}
+
+	// only the child ends are inherited
+	SetHandleInformation(engine->input, HANDLE_FLAG_INHERIT, 0);
+	SetHandleInformation(engine->output, HANDLE_FLAG_INHERIT, 0);
+
+	STARTUPINFOA startup = { sizeof(STARTUPINFOA) };
+	PROCESS_INFORMATION process;
+	char command_line[1024];
+
+	startup.dwFlags = STARTF_USESTDHANDLES;
+	startup.hStdInput = child_input;
+	startup.hStdOutput = child_output;
+	startup.hStdError = GetStdHandle(STD_ERROR_HANDLE);
+	snprintf(command_line, sizeof(command_line), "\"%s\"", path);
+
+	int started = CreateProcessA(NULL, command_line, NULL, NULL, TRUE, 0, NULL, NULL, &startup, &process);
+
+	CloseHandle(child_input);
+	CloseHandle(child_output);
+	pthread_mutex_unlock(&spawn_lock);
+
+	if (!started) {
+		CloseHandle(engine->input);
+		CloseHandle(engine->output);
+		return 0;
+	}
+
+	CloseHandle(process.hThread);
+	engine->process = process.hProcess;
+#else
+	int to_engine[2], from_engine[2];
+
+	if (pipe(to_engine) < 0) {
+		pthread_mutex_unlock(&spawn_lock);
+		return 0;
+	}
+
+	if (pipe(from_engine) < 0) {
+		close(to_engine[0]);
+		close(to_engine[1]);
+		pthread_mutex_unlock(&spawn_lock);
+		return 0;
+	}
+
+	// engines started later must not inherit the runner's ends of the pipes
+	fcntl(to_engine[1], F_SETFD, FD_CLOEXEC);
+	fcntl(from_engine[0], F_SETFD, FD_CLOEXEC);
+
+	engine->pid = fork();
+
+	if (engine->pid == 0) {
+		dup2(to_engine[0], STDIN_FILENO);
+		dup2(from_engine[1], STDOUT_FILENO);
+		close(to_engine[0]);
+		close(from_engine[1]);
+		execl(path, path, (char*)NULL);
+		_exit(127);
+	}
+
+	close(to_engine[0]);
+	close(from_engine[1]);
+	pthread_mutex_unlock(&spawn_lock);
+
+	if (engine->pid < 0) {
+		close(to_engine[1]);
+		close(from_engine[0]);
+		return 0;
+	}
+
+	engine->input = to_engine[1];
+	engine->output = from_engine[0];
+#endif
+
+	engine->alive = 1;
+	return 1;
+}
+
+/**
+ * Sends a command line to an engine.
+ * @param engine The engine.
+ * @param command The command, including the trailing new line.
+ */
+void send_engine(engine_process* engine, const char* command) {
+	size_t length = strlen(command);
+
+	if (!engine->alive)
+		return;
+
+#ifdef WIN64
+	DWORD written;
+
+	if (!WriteFile(engine->input, command, (DWORD)length, &written, NULL) || written != length)
+		engine->alive = 0;
+#else
+	while (length > 0) {
+		ssize_t written = write(engine->input, command, length);
+
+		if (written <= 0) {
+			engine->alive = 0;
+			return;
+		}
+
+		command += written;
+		length -= written;
+	}
+#endif
+}
+
+/**
+ * Reads a line of engine output.
+ * @param engine The engine.
+ * @param line The line read, without the new line.
+ * @param size The size of the line buffer.
+ * @param timeout The time to wait for the line, in milliseconds.
+ * @return Whether a line was read (the engine is marked dead on errors and timeouts).
+ */
+int read_engine_line(engine_process* engine, char* line, int size, int timeout) {
+	int deadline = get_time_millis() + timeout;
+
+	while (engine->alive) {
+		// a complete line is buffered already
+		char* end = memchr(engine->buffer, '\n', engine->buffered);
+
+		if (end) {
+			int length = (int)(end - engine->buffer);
+			int copied = (length < size - 1) ? length : size - 1;
+
+			memcpy(line, engine->buffer, copied);
+			line[copied] = '\0';
+
+			if (copied && line[copied - 1] == '\r')
+				line[copied - 1] = '\0';
+
+			engine->buffered -= length + 1;
+			memmove(engine->buffer, end + 1, engine->buffered);
+			return 1;
+		}
+
+		// drop overlong lines
+		if (engine->buffered == sizeof(engine->buffer))
+			engine->buffered = 0;
+
+		int remaining = deadline - get_time_millis();
+
+		if (remaining <= 0)
+			break;
+
+#ifdef WIN64
+		DWORD available = 0, received = 0;
+
+		if (!PeekNamedPipe(engine->output, NULL, 0, NULL, &available, NULL))
+			break;
+
+		if (available == 0) {
+			Sleep(1);
+			continue;
+		}
+
+		if (!ReadFile(engine->output, engine->buffer + engine->buffered, sizeof(engine->buffer) - engine->buffered, &received, NULL) || received == 0)
+			break;
+#else
+		struct pollfd descriptor = { engine->output, POLLIN, 0 };
+
+		if (poll(&descriptor, 1, remaining) <= 0)
+			continue;
+
+		ssize_t received = read(engine->output, engine->buffer + engine->buffered, sizeof(engine->buffer) - engine->buffered);
+
+		if (received <= 0)
+			break;
+#endif
+
+		engine->buffered += received;
+	}
+
+	engine->alive = 0;
+	return 0;
+}
+
+/**
+ * Waits for an engine output line starting with the given token.
+ * @param engine The engine.
+ * @param token The expected token.
+ * @param line The matching line.
+ * @param size The size of the line buffer.
+ * @param timeout The time to wait, in milliseconds.
+ * @return Whether the line arrived in time.
+ */
+int wait_engine(engine_process* engine, const char* token, char* line, int size, int timeout) {
+	int deadline = get_time_millis() + timeout;
+
+	while (read_engine_line(engine, line, size, deadline - get_time_millis()))
+		if (strncmp(line, token, strlen(token)) == 0)
+			return 1;
+
+	return 0;
+}
+
+/**
+ * Asks an engine to quit and releases its process.
+ * @param engine The engine.
+ */
+void stop_engine(engine_process* engine) {
+	send_engine(engine, "quit\n");
+
+#ifdef WIN64
+	CloseHandle(engine->input);
+
+	if (WaitForSingleObject(engine->process, 1000) != WAIT_OBJECT_0)
+		TerminateProcess(engine->process, 1);
+
+	CloseHandle(engine->output);
+	CloseHandle(engine->process);
+#else
+	close(engine->input);
+
+	// give the engine a second to leave on its own
+	int status, exited = 0;
+
+	for (int wait = 0; wait < 100 && !exited; wait++) {
+		exited = (waitpid(engine->pid, &status, WNOHANG) == engine->pid);
+
+		if (!exited)
+			usleep(10000);
+	}
+
+	if (!exited) {
+		kill(engine->pid, SIGKILL);
+		waitpid(engine->pid, &status, 0);
+	}
+
+	close(engine->output);
+#endif
+
+	engine->alive = 0;
+}
+
+/**
+ * Starts an engine and waits until it is ready for UCI.
+ * @param engine The engine.
+ * @param path The path of the engine executable.
+ * @return Whether the engine is ready.
+ */
+int open_engine(engine_process* engine, const char* path) {
+	char line[1024];
+
+	if (!start_engine(engine, path))
+		return 0;
+
+	send_engine(engine, "uci\n");
+
+	if (!wait_engine(engine, "uciok", line, sizeof(line), 10000)) {
+		stop_engine(engine);
+		return 0;
+	}
+
+	send_engine(engine, "isready\n");
+
+	if (!wait_engine(engine, "readyok", line, sizeof(line), 10000)) {
+		stop_engine(engine);
+		return 0;
+	}
+
+	return 1;
+}
+
+/**
+ * Determines whether neither side can possibly mate (bare kings or a single minor piece).
+ * @return Whether the material is insufficient.
+ */
+int is_insufficient_material() {
+	if (bitboards[P] | bitboards[p] | bitboards[R] | bitboards[r] | bitboards[Q] | bitboards[q])
+		return 0;
+
+	return count_bits(occupancies[both]) <= 3;
+}
+
+/**
+ * Plays one game of the match.
+ * @param match The match.
+ * @param engines The engines of this thread, the first engine's one first.
+ * @param opening The opening FEN.
+ * @param first_is_white Whether the first engine plays white.
+ * @param reason The reason the game ended.
+ * @return The result for the first engine: 2 win, 1 draw, 0 loss.
+ */
+int play_match_game(match_state* match, engine_process engines[2], const char* opening, int first_is_white, const char** reason) {
+	static thread_local char position[16384];
+	static thread_local u64 keys[MAX_GAME_PLY + 1];
+	char line[4096], fen[128], move_string[8];
+	int legal_moves[256], clocks[2] = { match->time, match->time };
+
+	strcpy(fen, opening);
+	parse_fen(fen);
+
+	int length = snprintf(position, sizeof(position), "position fen %s moves", opening);
+	int key_count = 0;
+
+	keys[key_count++] = hash_key;
+
+	for (int index = 0; index < 2; index++) {
+		send_engine(&engines[index], "ucinewgame\nisready\n");
+		wait_engine(&engines[index], "readyok", line, sizeof(line), 10000);
+	}
+
+	for (int plies = 0; plies < match->max_plies; plies++) {
+		// engine of the side to move (0 is the first engine)
+		int mover = (side == white) ? !first_is_white : first_is_white;
+		int mover_result = mover ? 2 : 0;
+		int in_check = is_square_attacked(lsb_index(bitboards[(side == white) ? K : k]), side ^ 1);
+		int legal_count = generate_legal_moves(legal_moves);
+
+		// checkmate (the side to move lost) or stalemate
+		if (legal_count == 0) {
+			*reason = in_check ? "checkmate" : "stalemate";
+			return in_check ? mover_result : 1;
+		}
+
+		// threefold repetition since the last irreversible move
+		int repetitions = 1;
+
+		for (int index = key_count - 3; index >= 0 && index >= key_count - 1 - fifty; index -= 2)
+			repetitions += (keys[index] == hash_key);
+
+		if (repetitions >= 3) {
+			*reason = "threefold repetition";
+			return 1;
+		}
+
+		if (fifty >= 100) {
+			*reason = "fifty-move rule";
+			return 1;
+		}
+
+		if (is_insufficient_material()) {
+			*reason = "insufficient material";
+			return 1;
+		}
+
+		engine_process* engine = &engines[mover];
+		char go[256];
+
+		// send the game so far and the search limits
+		send_engine(engine, position);
+		send_engine(engine, "\n");
+
+		if (match->time)
+			snprintf(go, sizeof(go), "go wtime %d btime %d winc %d binc %d\n",
+				clocks[!first_is_white], clocks[first_is_white], match->increment, match->increment);
+		else if (match->move_time)
+			snprintf(go, sizeof(go), "go movetime %d\n", match->move_time);
+		else if (match->nodes)
+			snprintf(go, sizeof(go), "go nodes %ld\n", match->nodes);
+		else
+			snprintf(go, sizeof(go), "go depth %d\n", match->depth);
+
+		int start = get_time_millis();
+		send_engine(engine, go);
+
+		int timeout = match->time ? clocks[mover] + 5000 : match->move_time ? match->move_time + 5000 : MATCH_MOVE_TIMEOUT;
+
+		if (!wait_engine(engine, "bestmove", line, sizeof(line), timeout)) {
+			*reason = engine->alive ? "no answer" : "engine disconnected";
+			engine->alive = 0;
+			return mover_result;
+		}
+
+		// update the clock
+		if (match->time) {
+			clocks[mover] -= get_time_millis() - start;
+
+			if (clocks[mover] < -MATCH_TIME_MARGIN) {
+				*reason = "time forfeit";
+				return mover_result;
+			}
+
+			clocks[mover] += match->increment;
+		}
+
+		// find the move among the legal ones
+		int move = 0;
+		sscanf(line + 8, "%7s", move_string);
+
+		for (int index = 0; index < legal_count && !move; index++) {
+			char legal_string[8];
+
+			if (strcmp(format_move(legal_moves[index], legal_string), move_string) == 0)
+				move = legal_moves[index];
+		}
+
+		if (!move) {
+			*reason = "illegal move";
+			return mover_result;
+		}
+
+		make_move(move, all_moves);
+		keys[key_count++] = hash_key;
+
+		if (length + 8 < (int)sizeof(position))
+			length += snprintf(position + length, sizeof(position) - length, " %s", move_string);
+	}
+
+	*reason = "maximum game length";
+	return 1;
+}
+
+/**
+ * Converts a score fraction into a logistic Elo difference.
+ * @param score The score fraction, strictly between 0 and 1.
+ * @return The Elo difference.
+ */
+double score_to_elo(double score) {
+	return -400.0 * log10(1.0 / score - 1.0);
+}
+
+/**
+ * Prints the standings of the match: score, Elo with its 95% confidence interval,
+ * likelihood of superiority and the SPRT log-likelihood ratio.
+ * @param match The match (its lock held).
+ * @return 1 if SPRT accepted H1, -1 if it accepted H0, 0 otherwise.
+ */
+int print_match_standings(match_state* match) {
+	int games = match->wins + match->losses + match->draws;
+	double score = (match->wins + 0.5 * match->draws) / games;
+
+	printf("Score of %s vs %s: %d - %d - %d [%.3f] %d\n",
+		match->names[0], match->names[1], match->wins, match->losses, match->draws, score, games);
+
+	// per game variance of the score
+	double variance = (match->wins * (1 - score) * (1 - score) + match->draws * (0.5 - score) * (0.5 - score) +
+		match->losses * score * score) / games;
+
+	if (score > 0 && score < 1) {
+		double margin = 1.959964 * sqrt(variance / games);
+		double low = (score - margin > 0) ? score_to_elo(score - margin) : -INFINITY;
+		double high = (score + margin < 1) ? score_to_elo(score + margin) : INFINITY;
+
+		printf("Elo difference: %.1f +/- %.1f, LOS: %.1f %%\n", score_to_elo(score), (high - low) / 2,
+			(match->wins + match->losses) ? 50.0 * (1 + erf((match->wins - match->losses) / sqrt(2.0 * (match->wins + match->losses)))) : 50.0);
+	}
+
+	if (!match->sprt || variance <= 0)
+		return 0;
+
+	// trinomial GSPRT approximation of the log-likelihood ratio
+	double score0 = 1.0 / (1.0 + pow(10.0, -match->elo0 / 400.0));
+	double score1 = 1.0 / (1.0 + pow(10.0, -match->elo1 / 400.0));
+	double llr = games * (score1 - score0) * (2 * score - score0 - score1) / (2 * variance);
+	double lower = log(match->beta / (1 - match->alpha));
+	double upper = log((1 - match->beta) / match->alpha);
+	int decision = (llr >= upper) ? 1 : (llr <= lower) ? -1 : 0;
+
+	printf("SPRT: llr %.2f (%.2f, %.2f) [%.1f, %.1f]%s\n", llr, lower, upper, match->elo0, match->elo1,
+		(decision > 0) ? " - H1 was accepted" : (decision < 0) ? " - H0 was accepted" : "");
+
+	return decision;
+}
+
+/**
+ * Plays match games on one thread, with its own pair of engines, until there are none left.
+ * @param arg Pointer to the match.
+ */
+void* match_worker(void* arg) {
+	match_state* match = *(match_state**)arg;
+	engine_process engines[2];
+
+	for (int index = 0; index < 2; index++)
+		if (!open_engine(&engines[index], match->paths[index])) {
+			printf("could not start %s\n", match->paths[index]);
+
+			if (index)
+				stop_engine(&engines[0]);
+
+			return NULL;
+		}
+
+	for (;;) {
+		// claim the next game
+		pthread_mutex_lock(&match->lock);
+		int game = match->next_game++;
+		int stop = match->stop || game >= match->games;
+		pthread_mutex_unlock(&match->lock);
+
+		if (stop)
+			break;
 
-	// socre quiet move
-	else {
-		// score first killer move
-		if (killer_moves[0][ply] == move)
-			return 9000;
+		// every opening is played twice, with colours swapped
+		const char* reason;
+		int first_is_white = (game % 2 == 0);
+		const char* opening = match->openings[(game / 2) % match->opening_count];
+		int result = play_match_game(match, engines, opening, first_is_white, &reason);
 
-		// score second killer move
-		else if (killer_moves[1][ply] == move)
-			return 8000;
+		pthread_mutex_lock(&match->lock);
 
-		// score history moves
-		else 
-			return history_moves[decode_move_piece(move)][decode_move_target_square(move)];
+		match->wins += (result == 2);
+		match->draws += (result == 1);
+		match->losses += (result == 0);
+
+		printf("Finished game %d (%s vs %s): %s {%s}\n", game + 1,
+			match->names[!first_is_white], match->names[first_is_white],
+			(result == 1) ? "1/2-1/2" : ((result == 2) == first_is_white) ? "1-0" : "0-1", reason);
+
+		if (print_match_standings(match))
+			match->stop = 1;
+
+		fflush(stdout);
+		pthread_mutex_unlock(&match->lock);
+
+		// replace engines that crashed or hung
+		for (int index = 0; index < 2; index++)
+			if (!engines[index].alive) {
+				stop_engine(&engines[index]);
+
+				if (!open_engine(&engines[index], match->paths[index])) {
+					printf("could not restart %s\n", match->paths[index]);
+					stop_engine(&engines[!index]);
+					return NULL;
+				}
+			}
 	}
 
-	return 0;
+	stop_engine(&engines[0]);
+	stop_engine(&engines[1]);
+
+	return NULL;
 }
 
-static inline void sort_moves(move_list *_move_list)
-{
-    // move scores
-    int move_scores[_move_list->last];
+/**
+ * Reads the opening positions of an FEN/EPD file, keeping the FEN fields of every line.
+ * @param path The path of the file.
+ * @param openings The openings read (allocated).
+ * @return The number of openings.
+ */
+int load_openings(const char* path, char (**openings)[128]) {
+	FILE* file = fopen(path, "r");
+	char line[1024];
+	int count = 0, capacity = 0;
 
-    // score all the moves within a move list
-    for (int count = 0; count < _move_list->last; count++)
-        // score move
-        move_scores[count] = score_move(_move_list->arr[count]);
+	*openings = NULL;
 
-    // loop over current move within a move list
-    for (int current_move = 0; current_move < _move_list->last; current_move++)
-    {
-        // loop over next move within a move list
-        for (int next_move = current_move + 1; next_move < _move_list->last; next_move++)
-        {
-            // compare current and next move scores
-            if (move_scores[current_move] < move_scores[next_move])
-            {
-                // swap scores
-                int temp_score = move_scores[current_move];
-                move_scores[current_move] = move_scores[next_move];
-                move_scores[next_move] = temp_score;
+	if (!file)
+		return 0;
 
-                // swap moves
-                int temp_move = _move_list->arr[current_move];
-                _move_list->arr[current_move] = _move_list->arr[next_move];
-                _move_list->arr[next_move] = temp_move;
-            }
-        }
-    }
-}
+	while (fgets(line, sizeof(line), file)) {
+		char fields[6][128];
+		int field_count = sscanf(line, "%127s %127s %127s %127s %127s %127s", fields[0], fields[1], fields[2], fields[3], fields[4], fields[5]);
 
-// print move (for UCI purposes)
-void print_move(int move)
-{
-    if (decode_move_promoted_piece(move))
-        printf("%s%s%c", square_to_coordinates[decode_move_source_square(move)],
-                           square_to_coordinates[decode_move_target_square(move)],
-                           promoted_pieces[decode_move_promoted_piece(move)]);
-    else
-        printf("%s%s", square_to_coordinates[decode_move_source_square(move)],
-                           square_to_coordinates[decode_move_target_square(move)]);
-}
+		if (field_count < 4)
+			continue;
 
-void print_move_scores(move_list *_move_list)
-{
-    printf("     Move scores:\n\n");
+		// EPD lines have operations instead of the move counters
+		int counters = (field_count == 6 && strspn(fields[4], "0123456789") == strlen(fields[4]) &&
+			strspn(fields[5], "0123456789") == strlen(fields[5]));
 
-    // loop over moves within a move list
-    for (int count = 0; count <= _move_list->last; count++)
-    {
-        printf("     move: ");
-        print_move(_move_list->arr[count]);
-        printf(" score: %d\n", score_move(_move_list->arr[count]));
-    }
+		if (count == capacity) {
+			capacity = capacity ? capacity * 2 : 1024;
+			*openings = realloc(*openings, capacity * sizeof(**openings));
+		}
+
+		snprintf((*openings)[count++], 128, "%s %s %s %s %s %s", fields[0], fields[1], fields[2], fields[3],
+			counters ? fields[4] : "0", counters ? fields[5] : "1");
+	}
+
+	fclose(file);
+	return count;
 }
 
-static inline int quiescence(int alpha, int beta) {
-	nodes++;
+/**
+ * Runs a match between two engines.
+ * @param argc The number of arguments.
+ * @param argv The arguments.
+ * @return The process exit code.
+ */
+int run_match(int argc, char* argv[]) {
+	match_state match = {
+		.games = 100, .concurrency = get_cpu_count(), .max_plies = 400,
+		.elo0 = 0, .elo1 = 5, .alpha = 0.05, .beta = 0.05
+	};
+	const char* openings_path = NULL;
+	double seconds = 0, increment = 0;
+
+	// parse options
+	for (int i = 1; i + 1 < argc; i++) {
+		if (strcmp(argv[i], "engine1") == 0)
+			match.paths[0] = argv[++i];
+		else if (strcmp(argv[i], "engine2") == 0)
+			match.paths[1] = argv[++i];
+		else if (strcmp(argv[i], "openings") == 0)
+			openings_path = argv[++i];
+		else if (strcmp(argv[i], "games") == 0)
+			match.games = atoi(argv[++i]);
+		else if (strcmp(argv[i], "concurrency") == 0)
+			match.concurrency = atoi(argv[++i]);
+		else if (strcmp(argv[i], "tc") == 0)
+			sscanf(argv[++i], "%lf+%lf", &seconds, &increment);
+		else if (strcmp(argv[i], "movetime") == 0)
+			match.move_time = atoi(argv[++i]);
+		else if (strcmp(argv[i], "nodes") == 0)
+			match.nodes = atol(argv[++i]);
+		else if (strcmp(argv[i], "depth") == 0)
+			match.depth = atoi(argv[++i]);
+		else if (strcmp(argv[i], "maxplies") == 0)
+			match.max_plies = atoi(argv[++i]);
+		else if (strcmp(argv[i], "alpha") == 0)
+			match.alpha = atof(argv[++i]);
+		else if (strcmp(argv[i], "beta") == 0)
+			match.beta = atof(argv[++i]);
+		else if (strcmp(argv[i], "sprt") == 0 && i + 2 < argc) {
+			match.sprt = 1;
+			match.elo0 = atof(argv[++i]);
+			match.elo1 = atof(argv[++i]);
+		}
+	}
+
+	if (!match.paths[0] || !match.paths[1]) {
+		printf("usage: %s engine1 <path> engine2 <path> [openings <file>] [games <n>] [concurrency <n>]\n"
+			"\t[tc <seconds>+<increment>] [movetime <ms>] [nodes <n>] [depth <n>] [maxplies <n>]\n"
+			"\t[sprt <elo0> <elo1>] [alpha <a>] [beta <b>]\n", argv[0]);
+		return 1;
+	}
 
-	// quiescence recursion escape conditions
-	int evaluation = evaluate();
+	// engine names are the file names of their paths
+	for (int index = 0; index < 2; index++) {
+		const char* name = strrchr(match.paths[index], '/');
+		const char* windows_name = strrchr(match.paths[index], '\\');
 
-	// fail-hard beta cutoff
-	if (evaluation >= beta)
-	{
-		// node (move) fails high
-		return beta;
+		name = (windows_name > name) ? windows_name : name;
+		match.names[index] = name ? name + 1 : match.paths[index];
 	}
-	
-	// found a better move
-	if (evaluation > alpha)
-	{
-		// PV node (move)
-		alpha = evaluation;
+
+	match.time = (int)(seconds * 1000);
+	match.increment = (int)(increment * 1000);
+
+	// a short time control unless another limit is given
+	if (!match.time && !match.move_time && !match.nodes && !match.depth) {
+		match.time = 10000;
+		match.increment = 100;
 	}
-	
-	// create move list instance
-    move_list _move_list[1];
-    
-    // generate moves
-	generate_moves(_move_list);
 
-	sort_moves(_move_list);
-    
-    // loop over moves within a movelist
-    for (int count = 0; count < _move_list->last; count++)
-    {
-        // preserve board state
-        save_board();
-        
-        // increment ply
-        ply++;
-        
-        // make sure to make only legal moves
-        if (make_move(_move_list->arr[count], only_captures) == 0)
-        {
-            // decrement ply
-            ply--;
-            
-            // skip to next move
-            continue;
-        }
+	// openings, or the starting position
+	match.opening_count = openings_path ? load_openings(openings_path, &match.openings) : 0;
 
-        // score current move
-        int score = -quiescence(-beta, -alpha);
-        
-        // decrement ply
-        ply--;
+	if (openings_path && !match.opening_count) {
+		printf("no openings read from %s\n", openings_path);
+		return 1;
+	}
 
-        // take move back
-        restore_board();
-        
-        // fail-hard beta cutoff
-        if (score >= beta)
-        {
-            // node (move) fails high
-            return beta;
-        }
-        
-        // found a better move
-        if (score > alpha)
-        {
-            // PV node (move)
-            alpha = score;
-        }
-    }
+	if (!match.opening_count) {
+		match.openings = malloc(sizeof(*match.openings));
+		strcpy(match.openings[0], "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+		match.opening_count = 1;
+	}
 
-	// return the node that fails low
-	return alpha;
+	match.concurrency = (match.concurrency < 1) ? 1 : (match.concurrency > MAX_THREADS) ? MAX_THREADS : match.concurrency;
+	match.max_plies = (match.max_plies < 1) ? 1 : (match.max_plies > MAX_GAME_PLY) ? MAX_GAME_PLY : match.max_plies;
+
+#ifndef WIN64
+	// a dying engine must not take the runner with it
+	signal(SIGPIPE, SIG_IGN);
+#endif
+
+	pthread_mutex_init(&match.lock, NULL);
+
+	// every game slot shares the match state
+	match_state* slots[MAX_THREADS];
+
+	for (int thread = 0; thread < match.concurrency; thread++)
+		slots[thread] = &match;
+
+	run_threads(match.concurrency, match_worker, slots, sizeof(match_state*));
+
+	if (match.wins + match.losses + match.draws) {
+		printf("\nFinal result\n");
+		print_match_standings(&match);
+	}
+
+	pthread_mutex_destroy(&match.lock);
+	free(match.openings);
+
+	return 0;
 }
 
+#pragma endregion
+
+#endif
+
+#ifdef MICROBENCH
+
+#pragma region Microbenchmarks
+
+/*
+	Microbenchmarks of the board primitives
+
+	Every primitive is timed in isolation on each benchmark position (the position
+	is set up outside the timed section). A run times all positions; after a few
+	warmup runs, the ns/op of every run is collected and the median and 99th
+	percentile are reported, with the median cycles/op from the time stamp counter.
+	The output is JSON, so runs on different commits can be diffed.
+
+	bbchess_microbench [runs <n>] [warmup <n>]
+*/
+
+/** Repetitions of a primitive per position and run, so every timed section lasts a few microseconds. */
+#define MICROBENCH_REPEATS 64
+
+/** Accumulates results so the compiler cannot drop the benchmarked work. */
+volatile u64 microbench_sink;
+
+// keeps the compiler from hoisting repeated calls on unchanged inputs out of a loop
+#ifdef __GNUC__
+	#define microbench_barrier() __asm__ volatile("" ::: "memory")
+#else
+	#define microbench_barrier()
+#endif
+
 /**
- * Negamax search with alpha-beta pruning. This is the main search function.
- * This searches the tree from the root to the leaf and return the best move.
- * @param alpha The lower bound of the search.
- * @param beta The upper bound of the search.
- * @param depth The depth of the search.
- * @return The best move.
+ * Gets a monotonic time stamp in nanoseconds.
+ * @return The time stamp.
  */
-static inline int negamax(int alpha, int beta, int depth)
-{
-    // recurrsion escape condition
-    if (depth == 0)
-        // ru quiescence search
-        return quiescence(alpha, beta);
-    
-    // increment nodes count
-    nodes++;
+static inline u64 get_time_nanos() {
+#ifdef WIN64
+	LARGE_INTEGER counter, frequency;
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+	return (u64)(counter.QuadPart * (1000000000.0 / frequency.QuadPart));
+#else
+	struct timespec time_spec;
+	clock_gettime(CLOCK_MONOTONIC, &time_spec);
+	return (u64)time_spec.tv_sec * 1000000000ULL + time_spec.tv_nsec;
+#endif
+}
 
-	// check if king is in check
-	int in_check = is_square_attacked(
-		(side == white) ? lsb_index(bitboards[K]) : lsb_index(bitboards[k]),
-		side ^ 1
-	);
+/**
+ * Times count_bits on every bitboard of the position.
+ * @return The number of operations.
+ */
+long microbench_count_bits() {
+	u64 sum = 0;
 
-	if (in_check)
-		depth++;
+	for (int repeat = 0; repeat < MICROBENCH_REPEATS; repeat++)
+		for (int piece = P; piece <= k; piece++)
+			sum += count_bits(bitboards[piece] ^ repeat);
 
-	// legal moves counter
-	int legal_moves = 0;
-    
-    // best move so far
-    int best_sofar;
-    
-    // old value of alpha
-    int old_alpha = alpha;
-    
-    // create move list instance
-    move_list _move_list[1];
-    
-    // generate moves
-	generate_moves(_move_list);
+	microbench_sink += sum;
+	return MICROBENCH_REPEATS * 12;
+}
 
-	sort_moves(_move_list);
-    
-    // loop over moves within a movelist
-    for (int count = 0; count < _move_list->last; count++)
-    {
-        // preserve board state
-        save_board();
-        
-        // increment ply
-        ply++;
-        
-        // make sure to make only legal moves
-        if (make_move(_move_list->arr[count], all_moves) == 0)
-        {
-            // decrement ply
-            ply--;
-            
-            // skip to next move
-            continue;
-        }
+/**
+ * Times lsb_index on every bitboard of the position.
+ * @return The number of operations.
+ */
+long microbench_lsb_index() {
+	u64 sum = 0;
 
-		// increment legal moves
-		legal_moves++;
-        
-        // score current move
-        int score = -negamax(-beta, -alpha, depth - 1);
-        
-        // decrement ply
-        ply--;
+	for (int repeat = 0; repeat < MICROBENCH_REPEATS; repeat++)
+		for (int piece = P; piece <= k; piece++)
+			sum += lsb_index(bitboards[piece] | (1ULL << 63 >> repeat));
 
-        // take move back
-        restore_board();
-        
-        // fail-hard beta cutoff
-        if (score >= beta)
-        {
-			killer_moves[1][ply] = killer_moves[0][ply];
-			killer_moves[0][ply] = _move_list->arr[count];
+	microbench_sink += sum;
+	return MICROBENCH_REPEATS * 12;
+}
+
+/**
+ * Times get_bishop_attacks on every square with the position's occupancy.
+ * @return The number of operations.
+ */
+long microbench_bishop_attacks() {
+	u64 sum = 0;
+
+	for (int repeat = 0; repeat < MICROBENCH_REPEATS / 4; repeat++)
+		for (int square = 0; square < 64; square++)
+			sum ^= get_bishop_attacks(square, occupancies[both] ^ repeat);
+
+	microbench_sink += sum;
+	return MICROBENCH_REPEATS / 4 * 64;
+}
+
+/**
+ * Times get_rook_attacks on every square with the position's occupancy.
+ * @return The number of operations.
+ */
+long microbench_rook_attacks() {
+	u64 sum = 0;
 
-            // node (move) fails high
-            return beta;
-        }
-        
-        // found a better move
-        if (score > alpha)
-        {
-			int piece = decode_move_piece(_move_list->arr[count]);
-			int target_square = decode_move_target_square(_move_list->arr[count]);
-			history_moves[piece][target_square] += depth;
+	for (int repeat = 0; repeat < MICROBENCH_REPEATS / 4; repeat++)
+		for (int square = 0; square < 64; square++)
+			sum ^= get_rook_attacks(square, occupancies[both] ^ repeat);
 
-            // PV node (move)
-            alpha = score;
-            
-            // if root move
-            if (ply == 0)
-                // associate best move with the best score
-                best_sofar = _move_list->arr[count];
-        }
-    }
+	microbench_sink += sum;
+	return MICROBENCH_REPEATS / 4 * 64;
+}
 
-	// there are no legal moves to make in this position
-	if (legal_moves == 0) {
-		// king is in check, return -infinity
-		if (in_check)
-			return -49000 + ply; // adding ply is necessary in order to avoid stalemate
+/**
+ * Times is_square_attacked on every square, by both sides.
+ * @return The number of operations.
+ */
+long microbench_is_square_attacked() {
+	u64 sum = 0;
 
-		// king is NOT in check, return stalemate score, this is a draw
-		else
-			return 0;
+	for (int repeat = 0; repeat < MICROBENCH_REPEATS / 4; repeat++) {
+		microbench_barrier();
+
+		for (int square = 0; square < 64; square++)
+			sum += is_square_attacked(square, white) + is_square_attacked(square, black);
 	}
-    
-    // found better move
-    if (old_alpha != alpha)
-        // init best move
-        best_move = best_sofar;
-    
-    // node (move) fails low
-    return alpha;
+
+	microbench_sink += sum;
+	return MICROBENCH_REPEATS / 4 * 128;
 }
 
 /**
- * Searches the best move for the current position.
- * @param depth Maximum depth of the search.
- * @return The best move for the current position.
+ * Times generate_moves.
+ * @return The number of operations.
  */
-int search_position(int depth) {
-	printf("Searching (depth = %d)...\n", depth);
-
-	// find best move for a given position
-	int score = negamax(-50000, 50000, depth);
+long microbench_generate_moves() {
+	move_list _move_list[1];
+	u64 sum = 0;
 
-	if (best_move) {
-		// best move placeholder
-		printf("info score cp %d depth %d nodes %ld\n\n", score, depth, nodes);
-		printf("bestmove ");
-		print_uci_move(best_move);
-		printf("\n");
-		return 1;
+	for (int repeat = 0; repeat < MICROBENCH_REPEATS; repeat++) {
+		microbench_barrier();
+		generate_moves(_move_list);
+		sum += _move_list->last;
 	}
+
+	microbench_sink += sum;
+	return MICROBENCH_REPEATS;
 }
 
-#pragma endregion
+/** Pseudo-legal moves of the current position, generated outside the timed sections. */
+move_list microbench_moves;
 
-#pragma region UCI
+/**
+ * Times make_move (with the copy-make board restore) on every pseudo-legal move.
+ * @return The number of operations.
+ */
+long microbench_make_move() {
+	u64 sum = 0;
+
+	for (int repeat = 0; repeat < MICROBENCH_REPEATS / 4; repeat++)
+		for (int index = 0; index < microbench_moves.last; index++) {
+			save_board();
+			sum += make_move(microbench_moves.arr[index], all_moves);
+			restore_board();
+		}
+
+	microbench_sink += sum;
+	return MICROBENCH_REPEATS / 4 * microbench_moves.last;
+}
 
 /**
- * Parses the given move from a string. (e.g. "e7e8q")
- * @param move_str The string containing the move.
- * @return Whether the move is legal or not
+ * Times score_move on every pseudo-legal move.
+ * @return The number of operations.
  */
-int parse_move(char* move_str) {
-	move_list _move_list[1];
+long microbench_score_move() {
+	u64 sum = 0;
 
-	// generate_moves_cmk(_move_list);
-	generate_moves(_move_list);
+	for (int repeat = 0; repeat < MICROBENCH_REPEATS; repeat++) {
+		microbench_barrier();
 
-	// parse source and target squares
-	int source_square = (move_str[0] - 'a') + ((8 - (move_str[1] - '0')) * 8);
-	int target_square = (move_str[2] - 'a') + ((8 - (move_str[3] - '0')) * 8);
+		for (int index = 0; index < microbench_moves.last; index++)
+			sum += score_move(microbench_moves.arr[index]);
+	}
 
-	// define parse promoted piece
-	int promoted_piece = 0;
+	microbench_sink += sum;
+	return MICROBENCH_REPEATS * microbench_moves.last;
+}
 
-	// loop over the moves within the move list
-	for (int i = 0; i < _move_list->arr[i]; i++) {
-		// init move
-		int move = _move_list->arr[i];
+/**
+ * Times sort_moves (scoring included) on the pseudo-legal moves.
+ * @return The number of operations.
+ */
+long microbench_sort_moves() {
+	move_list _move_list[1];
+	u64 sum = 0;
 
-		// make sure source and target squares are available within the generated move
-		if (decode_move_source_square(move) == source_square && decode_move_target_square(move) == target_square) {
-			// initialize promoted piece, if that's the case
-			promoted_piece = decode_move_promoted_piece(move);
+	for (int repeat = 0; repeat < MICROBENCH_REPEATS / 4; repeat++) {
+		*_move_list = microbench_moves;
+		sort_moves(_move_list);
+		sum += _move_list->arr[0];
+	}
 
-			// only check this if promoted piece is available
-			if (promoted_piece) {
-				// promotion to queen
-				if ((promoted_piece == Q || promoted_piece == q) && move_str[4] == 'q')
-					return move;
+	microbench_sink += sum;
+	return MICROBENCH_REPEATS / 4;
+}
 
-				// promotion to rook
-				if ((promoted_piece == R || promoted_piece == r) && move_str[4] == 'r')
-					return move;
+/**
+ * Times generate_attack_map.
+ * @return The number of operations.
+ */
+long microbench_attack_map() {
+	attack_map map;
+	u64 sum = 0;
+
+	for (int repeat = 0; repeat < MICROBENCH_REPEATS / 4; repeat++) {
+		microbench_barrier();
+		generate_attack_map(&map);
+		sum += map.mobility;
+	}
 
-				// promotion to bishop
-				if ((promoted_piece == B || promoted_piece == b) && move_str[4] == 'b')
-					return move;
+	microbench_sink += sum;
+	return MICROBENCH_REPEATS / 4;
+}
 
-				// promotion to knight
-				if ((promoted_piece == N || promoted_piece == n) && move_str[4] == 'n')
-					return move;
+/** Attack map of the current position, generated outside the timed sections. */
+attack_map microbench_map;
 
-				// continue in case of bad promotion input
-				continue;
-			}
+/**
+ * Times evaluate, given the attack map.
+ * @return The number of operations.
+ */
+long microbench_evaluate() {
+	u64 sum = 0;
 
-			// if the move is not a promotion, return it
-			return move;
-		}
+	for (int repeat = 0; repeat < MICROBENCH_REPEATS; repeat++) {
+		microbench_barrier();
+		sum += evaluate(&microbench_map);
 	}
 
-	// return illegal move by default
-	return 0;
+	microbench_sink += sum;
+	return MICROBENCH_REPEATS;
 }
 
+/** A benchmarked primitive. */
+typedef struct {
+	const char* name;
+	long (*run)();
+} microbenchmark;
+
+microbenchmark microbenchmarks[] = {
+	{ "count_bits", microbench_count_bits },
+	{ "lsb_index", microbench_lsb_index },
+	{ "get_bishop_attacks", microbench_bishop_attacks },
+	{ "get_rook_attacks", microbench_rook_attacks },
+	{ "is_square_attacked", microbench_is_square_attacked },
+	{ "generate_moves", microbench_generate_moves },
+	{ "make_move", microbench_make_move },
+	{ "score_move", microbench_score_move },
+	{ "sort_moves", microbench_sort_moves },
+	{ "generate_attack_map", microbench_attack_map },
+	{ "evaluate", microbench_evaluate },
+};
+
 /**
- * Parse UCI "position" command from a given input string.
- * @param input_str The input string.
+ * Compares two doubles, for qsort.
  */
-void parse_position_command(char* input_str) {
-	// shift pointer to the right where next token begins
-	input_str += 9;
+int compare_doubles(const void* a, const void* b) {
+	double difference = *(const double*)a - *(const double*)b;
 
-	// initialize the pointer to the current character in the command string
-	char* current_char = input_str;
+	return (difference > 0) - (difference < 0);
+}
 
-	// parse UCI "startpos" command
-	if (strncmp(input_str, "startpos", 8) == 0) {
-		// initialize the board with the starting position
-		parse_fen(fen_starting_position);
-	} else {
-		// make sure "fen" is available within command string
-		current_char = strstr(input_str, "fen");
+/**
+ * Runs one run of a primitive over all benchmark positions.
+ * @param benchmark The primitive.
+ * @param nanos The time per operation.
+ * @param cycles The time stamp counter cycles per operation.
+ */
+void run_microbenchmark(const microbenchmark* benchmark, double* nanos, double* cycles) {
+	u64 total_nanos = 0, total_cycles = 0;
+	long total_ops = 0;
 
-		// if no "fen" command is available, return
-		if (current_char == NULL)
-			parse_fen(fen_starting_position);
-		else {
-			// shift pointer to the right where next token begins
-			current_char += 4;
+	for (int position = 0; position < BENCH_POSITIONS; position++) {
+		// set up the position and its inputs, untimed
+		parse_fen(bench_positions[position]);
+		generate_moves(&microbench_moves);
+		generate_attack_map(&microbench_map);
 
-			// initialize board position from given fen string
-			parse_fen(current_char);
-		}
+		u64 start_nanos = get_time_nanos();
+		u64 start_cycles = read_cycle_counter();
 
-		printf("%s\n", current_char);
+		total_ops += benchmark->run();
+
+		total_cycles += read_cycle_counter() - start_cycles;
+		total_nanos += get_time_nanos() - start_nanos;
 	}
 
-	// parse moves for position
-	current_char = strstr(input_str, "moves");
+	*nanos = (double)total_nanos / total_ops;
+	*cycles = (double)total_cycles / total_ops;
+}
 
-	// if "moves" command is available
-	if (current_char != NULL) {
-		// shift pointer to the right where next token begins
-		current_char += 6;
+/**
+ * Runs all microbenchmarks and prints the results as JSON.
+ * @param argc The number of arguments.
+ * @param argv The arguments.
+ * @return The process exit code.
+ */
+int run_microbenchmarks(int argc, char* argv[]) {
+	int runs = 200, warmup = 10;
+
+	for (int i = 1; i + 1 < argc; i++) {
+		if (strcmp(argv[i], "runs") == 0)
+			runs = atoi(argv[++i]);
+		else if (strcmp(argv[i], "warmup") == 0)
+			warmup = atoi(argv[++i]);
+	}
 
-		// loop over all moves
-		while (*current_char) {
-			// parse move
-			int move = parse_move(current_char);
+	runs = (runs < 1) ? 1 : runs;
 
-			// if there are no moves left, break
-			if (move == 0)
-				break;
+	double* nanos = malloc(runs * sizeof(double));
+	double* cycles = malloc(runs * sizeof(double));
+	int count = (int)(sizeof(microbenchmarks) / sizeof(microbenchmarks[0]));
 
-			// make move
-			make_move(move, all_moves);
+	printf("{\n\t\"positions\": %d,\n\t\"runs\": %d,\n\t\"warmup\": %d,\n\t\"results\": [\n", BENCH_POSITIONS, runs, warmup);
 
-			// shift pointer to the right
-			while (*current_char && *current_char != ' ') {
-				current_char++;
-			}
+	for (int index = 0; index < count; index++) {
+		double ignored_nanos, ignored_cycles;
 
-			// go to the next move
-			current_char++;
-		}
+		for (int run = 0; run < warmup; run++)
+			run_microbenchmark(&microbenchmarks[index], &ignored_nanos, &ignored_cycles);
+
+		for (int run = 0; run < runs; run++)
+			run_microbenchmark(&microbenchmarks[index], &nanos[run], &cycles[run]);
+
+		qsort(nanos, runs, sizeof(double), compare_doubles);
+		qsort(cycles, runs, sizeof(double), compare_doubles);
+
+		// nearest-rank percentiles
+		int p99 = (int)ceil(0.99 * runs) - 1;
+
+		printf("\t\t{ \"name\": \"%s\", \"median_ns\": %.3f, \"p99_ns\": %.3f, \"median_cycles\": %.1f }%s\n",
+			microbenchmarks[index].name, nanos[runs / 2], nanos[p99], cycles[runs / 2], (index + 1 < count) ? "," : "");
 	}
 
-	// prinf board
-	print_board();
+	printf("\t]\n}\n");
+
+	free(nanos);
+	free(cycles);
+
+	return 0;
 }
 
+#pragma endregion
+
+#endif
+
+#ifdef LAUNCHER
+
+#pragma region Launcher
+
+/** Engine builds for the x86-64 microarchitecture levels, best first (make release). */
+const char* launcher_levels[] = { "x86-64-v4", "x86-64-v3", "x86-64-v2", "x86-64" };
+
+#define LAUNCHER_LEVELS (int)(sizeof(launcher_levels) / sizeof(launcher_levels[0]))
+
 /**
- * Parse UCI "go" command from a given input string.
- * @param input_str The input string.
+ * Checks whether the host CPU (and operating system) supports a microarchitecture level.
+ * @param level The level (e.g. "x86-64-v3").
+ * @return Whether the level is supported.
  */
-void parse_go_command(char *command)
-{
-    // init depth
-    int depth = -1;
-    
-    // init character pointer to the current depth argument
-    char *current_depth = NULL;
-    
-    // handle fixed depth search
-    if (current_depth = strstr(command, "depth"))
-        //convert string to integer and assign the result value to depth
-        depth = atoi(current_depth + 6);
-    
-    // different time controls placeholder
-    else
-        depth = 6;
-    
-	printf("depth: %d\n", depth);
-    // search position
-    search_position(depth);
-}
+int cpu_supports_level(const char* level) {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	__builtin_cpu_init();
 
-/* 
-	GUI 	-> isready
-	Engine 	-> readyok
-	GUI		-> ucinewgame
-*/
+	if (strcmp(level, "x86-64-v4") == 0)
+		return __builtin_cpu_supports("x86-64-v4");
+
+	if (strcmp(level, "x86-64-v3") == 0)
+		return __builtin_cpu_supports("x86-64-v3");
+
+	if (strcmp(level, "x86-64-v2") == 0)
+		return __builtin_cpu_supports("x86-64-v2");
+#endif
+
+	// the baseline runs everywhere
+	return strcmp(level, "x86-64") == 0;
+}
 
 /**
- * Main UCI loop
+ * Gets the directory of the running executable, to find the engine builds next to it.
+ * @param directory The directory, with a trailing separator (empty for the working directory).
+ * @param size The size of the directory buffer.
+ * @param argv0 The first command line argument, used when the executable path is unknown.
  */
-void uci_loop() {
-	// reset stdin & stdout buffers
-	setbuf(stdin, NULL);
-	setbuf(stdout, NULL);
+void get_executable_directory(char* directory, int size, const char* argv0) {
+	char path[4096] = "";
 
-	// define a user / GUI
-	char input[2000];
+#ifdef WIN64
+	GetModuleFileNameA(NULL, path, sizeof(path));
+#else
+	ssize_t length = readlink("/proc/self/exe", path, sizeof(path) - 1);
+	path[(length > 0) ? length : 0] = '\0';
+#endif
 
-	// print engine info
-	printf("id name BBChess\n");
-	printf("id author DaniGMX\n");
-	printf("uciok\n");
+	if (!path[0])
+		strncpy(path, argv0, sizeof(path) - 1);
 
-	// main UCI loop
-	while (1) {
-		// reset GUI input
-		memset(input, 0, sizeof(input));
+	// cut after the last separator
+	char* separator = strrchr(path, '/');
+	char* backslash = strrchr(path, '\\');
 
-		// make sure output reaches GUI
-		fflush(stdout);
+	if (backslash > separator)
+		separator = backslash;
 
-		// get user input
-		if (!fgets(input, sizeof(input), stdin))
-			continue;
+	if (separator)
+		separator[1] = '\0';
+	else
+		path[0] = '\0';
 
-		// make sure input is available
-		else if (input[0] == '\n')
-			continue;
+	snprintf(directory, size, "%s", path);
+}
 
-		// parse UCI "isready" command
-		else if (strncmp(input, "isready", 7) == 0) {
-			printf("readyok\n");
+/**
+ * Starts the fastest engine build the host CPU can run, passing the command line on.
+ * @param argc The number of command line arguments.
+ * @param argv The command line arguments.
+ * @return The exit code of the engine, 1 if no build could be started.
+ */
+int run_launcher(int argc, char* argv[]) {
+	char directory[4096], path[4200];
+	char* arguments[256];
+	int count = (argc < 255) ? argc : 255;
+
+	get_executable_directory(directory, sizeof(directory), (argc > 0) ? argv[0] : "");
+
+	// the engine gets the launcher's arguments after its own path
+	for (int index = 1; index < count; index++)
+		arguments[index] = argv[index];
+
+	arguments[0] = path;
+	arguments[(count > 1) ? count : 1] = NULL;
+
+	for (int level = 0; level < LAUNCHER_LEVELS; level++) {
+		if (!cpu_supports_level(launcher_levels[level]))
 			continue;
-		}
 
-		// parse UCI "position" command
-		else if (strncmp(input, "position", 8) == 0)
-			parse_position_command(input);
+#ifdef WIN64
+		snprintf(path, sizeof(path), "%sbbchess-%s.exe", directory, launcher_levels[level]);
 
-		// parse UCI "ucinewgame" command
+		if (GetFileAttributesA(path) == INVALID_FILE_ATTRIBUTES)
+			continue;
 
-		else if (strncmp(input, "ucinewgame", 10) == 0)
-			parse_position_command("position startpos");
+		// the engine shares the console and standard streams of the launcher
+		intptr_t code = _spawnv(_P_WAIT, path, (const char* const*)arguments);
 
-		// parse UCI "go" command
-		else if (strncmp(input, "go", 2) == 0)
-			parse_go_command(input);
+		if (code != -1)
+			return (int)code;
+#else
+		snprintf(path, sizeof(path), "%sbbchess-%s", directory, launcher_levels[level]);
 
-		// parse UCI "quit" command
-		else if (strncmp(input, "quit", 4) == 0)
-			break;
+		if (access(path, X_OK) != 0)
+			continue;
 
-		// parse UCI "uci" command
-		else if (strncmp(input, "uci", 3) == 0) {
-			// print engine info
-			printf("id name BBChess\n");
-			printf("id author DaniGMX\n");
-			printf("uciok\n");
-		}
+		// replace the launcher, the GUI talks to the engine directly
+		execv(path, arguments);
+#endif
 	}
+
+	fprintf(stderr, "no engine build found for this CPU in '%s' (run make release)\n", directory[0] ? directory : ".");
+	return 1;
 }
 
 #pragma endregion
 
+#endif
+
+#ifndef LIBRARY
+
 // main function
-int main() {
+int main(int argc, char* argv[]) {
+#ifdef LAUNCHER
+	// start the best engine build for this CPU instead of the engine
+	return run_launcher(argc, argv);
+#endif
+
 	// initialize all
-	init_all();
+	bbchess_init();
+
+#ifdef TUNER
+	// run the Texel tuner instead of the engine
+	return run_tuner(argc, argv);
+#endif
+
+#ifdef MATCH
+	// run a match between two engines instead of the engine
+	return run_match(argc, argv);
+#endif
+
+#ifdef MICROBENCH
+	// time the board primitives instead of running the engine
+	return run_microbenchmarks(argc, argv);
+#endif
 
 	// debug mode variable
 	int debug = 0;
@@ -2564,12 +11758,12 @@ int main() {
 		parse_fen(fen_starting_position);
 		print_board();
 		search_position(1);
-	}
-	else {
-		// conmnect with GUI
-		uci_loop();
+		getchar();
+		return 0;
 	}
 
-	getchar();
-	return 0;
-} 
\ No newline at end of file
+	// the engine binary is a front-end over the library: a command line tool or the UCI loop
+	return bbchess_uci(argc, argv);
+}
+
+#endif
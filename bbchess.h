@@ -0,0 +1,180 @@
+/**
+ * BBChess library API.
+ *
+ * Build the library with "make lib" (libbbchess.a and libbbchess.so) and link with
+ * -lbbchess -lpthread -lm. The engine tables are shared by all instances and built on
+ * the first bbchess_create call. An instance can be used from any thread, but not from
+ * two threads at the same time; different instances can search in parallel.
+ */
+#ifndef BBCHESS_H
+#define BBCHESS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Marks the functions the library exports, the library build hides every other symbol. */
+#if defined(BBCHESS_BUILD) && defined(_WIN32)
+	#define BBCHESS_API __declspec(dllexport)
+#elif defined(BBCHESS_BUILD) && defined(__GNUC__)
+	#define BBCHESS_API __attribute__((visibility("default")))
+#else
+	#define BBCHESS_API
+#endif
+
+/** An engine instance: a position with its game history. */
+typedef struct bbchess_engine bbchess_engine;
+
+/** Search limits, 0 means no limit. */
+typedef struct {
+	int depth;			// maximum depth in plies
+	long long nodes;	// node budget
+	int movetime;		// time budget in milliseconds
+} bbchess_limits;
+
+/** Progress of a search, reported after every completed iteration. */
+typedef struct {
+	int depth;			// depth of the iteration
+	int score;			// score in centipawns, from the side to move point of view
+	long long nodes;	// nodes searched so far
+	int time;			// milliseconds since the start of the search
+	int pv_length;		// number of moves of the principal variation
+	const int* pv;		// principal variation (see bbchess_format_move)
+} bbchess_search_info;
+
+/** Result of a search. */
+typedef struct {
+	int best_move;		// best move (see bbchess_format_move), 0 without legal moves
+	int score;			// score of the best move in centipawns, side to move point of view
+	int depth;			// depth of the last completed iteration, 0 if the limits stopped the first one
+	long long nodes;	// nodes searched
+	int time;			// milliseconds spent
+} bbchess_search_result;
+
+/**
+ * Called after every completed iteration of a search.
+ * @return Non-zero to stop the search.
+ */
+typedef int (*bbchess_info_callback)(const bbchess_search_info* info, void* user_data);
+
+/**
+ * A batch of positions and the buffers for their analysis, in structure-of-arrays layout.
+ * All buffers belong to the caller; a NULL output buffer skips that part of the analysis.
+ */
+typedef struct {
+	int count;					// number of positions
+	const char* const* fens;	// [count] positions as FEN strings
+	int* scores;				// [count] static evaluations in centipawns, side to move point of view
+	int* move_counts;			// [count] number of legal moves, -1 for an invalid position
+	int* moves;					// [count * max_moves] legal moves, those of position i start at i * max_moves
+	int max_moves;				// room for moves per position (BBCHESS_MAX_MOVES always suffices)
+} bbchess_batch;
+
+/** Maximum number of legal moves a position can have, rounded up. */
+#define BBCHESS_MAX_MOVES 256
+
+/** Room for any FEN string written by bbchess_get_fen, including the terminator. */
+#define BBCHESS_FEN_SIZE 128
+
+/** Standard starting position. */
+#define BBCHESS_STARTPOS "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"
+
+/**
+ * Creates an engine instance, set to the starting position.
+ * @return The instance, NULL if out of memory.
+ */
+BBCHESS_API bbchess_engine* bbchess_create(void);
+
+/**
+ * Destroys an engine instance.
+ * @param engine The instance (may be NULL).
+ */
+BBCHESS_API void bbchess_destroy(bbchess_engine* engine);
+
+/**
+ * Sets the position from a FEN string, clearing the game history.
+ * The FEN string is validated, an invalid one leaves the position unchanged.
+ * @param engine The instance.
+ * @param fen The FEN string (the move counters are optional).
+ * @return 0 on success, -1 if the FEN string is invalid.
+ */
+BBCHESS_API int bbchess_set_fen(bbchess_engine* engine, const char* fen);
+
+/**
+ * Writes the current position as a FEN string.
+ * @param engine The instance.
+ * @param buffer The output, at least BBCHESS_FEN_SIZE characters.
+ * @return The length of the FEN string.
+ */
+BBCHESS_API int bbchess_get_fen(const bbchess_engine* engine, char* buffer);
+
+/**
+ * Plays moves from the current position.
+ * @param engine The instance.
+ * @param moves Moves in UCI notation separated by spaces (e.g. "e2e4 e7e5 g1f3").
+ * @return The number of moves played, -1 if a move is illegal (the moves before it stay played).
+ */
+BBCHESS_API int bbchess_play_moves(bbchess_engine* engine, const char* moves);
+
+/**
+ * Searches the current position. A legal move is found even if the limits stop the
+ * search before its first iteration completes (the result then has depth 0).
+ * @param engine The instance.
+ * @param limits The limits (NULL for the default depth).
+ * @param callback Called after every completed iteration (may be NULL).
+ * @param user_data Passed to the callback.
+ * @param result The result.
+ * @return 0 on success, -1 if the position has no legal moves.
+ */
+BBCHESS_API int bbchess_search(bbchess_engine* engine, const bbchess_limits* limits,
+	bbchess_info_callback callback, void* user_data, bbchess_search_result* result);
+
+/**
+ * Counts the leaf nodes of the legal move tree of the current position.
+ * @param engine The instance.
+ * @param depth The depth.
+ * @return The number of leaf nodes.
+ */
+BBCHESS_API long long bbchess_perft(bbchess_engine* engine, int depth);
+
+/**
+ * Statically evaluates a batch of positions.
+ * @param engine The instance (its position is not changed).
+ * @param fens The FEN strings.
+ * @param count The number of positions.
+ * @param scores The evaluations in centipawns, from the side to move point of view (0 for invalid positions).
+ * @return The number of valid positions evaluated.
+ */
+BBCHESS_API int bbchess_evaluate_fens(bbchess_engine* engine, const char* const* fens, int count, int* scores);
+
+/**
+ * Evaluates and generates the legal moves of a batch of positions on several threads,
+ * without allocating or printing anything per position. Every thread takes a contiguous
+ * range of the batch. Moves beyond max_moves are not stored, but counted.
+ * @param batch The positions and the output buffers.
+ * @param threads The number of threads (0 for one per processor).
+ * @return The number of valid positions.
+ */
+BBCHESS_API int bbchess_analyse_batch(bbchess_batch* batch, int threads);
+
+/**
+ * Writes a move in UCI notation (e.g. "e7e8q").
+ * @param move The move.
+ * @param buffer The output, at least 6 characters.
+ * @return The output.
+ */
+BBCHESS_API char* bbchess_format_move(int move, char* buffer);
+
+/**
+ * Runs the UCI front-end: a command given on the command line (e.g. "bench") or the UCI loop.
+ * @param argc The number of command line arguments.
+ * @param argv The command line arguments.
+ * @return The exit code.
+ */
+BBCHESS_API int bbchess_uci(int argc, char* argv[]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,116 @@
+/*
+	Material and piece-square tables of the classic evaluation (white point of view,
+	a8 first), compiled into bbchess.c. This file is regenerated by the Texel tuner
+	(make tuner), so edits may be overwritten by the next tuning run.
+*/
+
+// middlegame material scores
+int material_score[12] = {
+	   100,	// white pawn
+	   300,	// white knight
+	   350,	// white bishop
+	   500,	// white rook
+	  1000,	// white queen
+	 10000, // white king
+	  -100, // black pawn
+	  -300,	// black knight
+	  -350,	// black bishop
+	  -500,	// black rook
+	 -1000,	// black queen
+	-10000,	// black king
+};
+
+const int pawn_scores[64] = {
+	90, 90, 90, 90, 90, 90, 90, 90,
+	30, 30, 30, 40, 40, 30, 30, 30,
+	20, 20, 20, 30, 30, 30, 20, 20,
+	10, 10, 10, 20, 20, 10, 10, 10,
+	 5,  5, 10, 20, 20,  5,  5,  5,
+	 0,  0,  0,  5,  5,  0,  0,  0,
+	 0,  0,  0,-10,-10,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0
+};
+
+const int knight_scores[64] = {
+	-5,  0,  0,  0,  0,  0,  0, -5,
+	-5,  0,  0, 10, 10,  0,  0, -5,
+	-5,  5, 20, 20, 20, 20,  5, -5,
+	-5, 10, 20, 30, 30, 20, 10, -5,
+	-5, 10, 20, 30, 30, 20, 10, -5,
+	-5,  5, 20, 10, 10, 20,  5, -5,
+	-5,  0,  0,  0,  0,  0,  0, -5,
+	-5,-10,  0,  0,  0,  0,-10, -5
+};
+
+const int bishop_scores[64] = {
+	 0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0, 10, 10,  0,  0,  0,
+	 0,  0, 10, 20, 20, 10,  0,  0,
+	 0,  0, 10, 20, 20, 10,  0,  0,
+	 0, 10,  0,  0,  0,  0, 10,  0,
+	 0, 30,  0,  0,  0,  0, 30,  0,
+	 0,  0,-10,  0,  0,-10,  0,  0,
+};
+
+const int rook_scores[64] = {
+	50, 50, 50, 50, 50, 50, 50, 50,
+	50, 50, 50, 50, 50, 50, 50, 50,
+	 0,  0, 10, 20, 20, 10,  0,  0,
+	 0,  0, 10, 20, 20, 10,  0,  0,
+	 0,  0, 10, 20, 20, 10,  0,  0,
+	 0,  0, 10, 20, 20, 10,  0,  0,
+	 0,  0, 10, 20, 20, 10,  0,  0,
+	 0,  0,  0, 20, 20,  0,  0,  0,
+};
+
+const int king_scores[64] = {
+	 0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  5,  5,  5,  5,  0,  0,
+	 0,  5,  5, 10, 10,  5,  5,  0,
+	 0,  5, 10, 20, 20, 10,  5,  0,
+	 0,  5, 10, 20, 20, 10,  5,  0,
+	 0,  0,  5, 10, 10,  5,  0,  0,
+	 0,  5,  5, -5, -5,  0,  5,  0,
+	 0,  0,  5,  0,-15,  0, 10,  0,
+};
+
+// endgame material scores
+int endgame_material_score[12] = {
+	   120,	// white pawn
+	   290,	// white knight
+	   330,	// white bishop
+	   520,	// white rook
+	   980,	// white queen
+	 10000, // white king
+	  -120, // black pawn
+	  -290,	// black knight
+	  -330,	// black bishop
+	  -520,	// black rook
+	  -980,	// black queen
+	-10000,	// black king
+};
+
+// endgame pawn scores (every pawn gets more valuable as it advances, passed pawns score on top)
+const int pawn_endgame_scores[64] = {
+	 0,  0,  0,  0,  0,  0,  0,  0,
+	90, 90, 90, 90, 90, 90, 90, 90,
+	60, 60, 60, 60, 60, 60, 60, 60,
+	35, 35, 35, 35, 35, 35, 35, 35,
+	20, 20, 20, 20, 20, 20, 20, 20,
+	10, 10, 10, 10, 10, 10, 10, 10,
+	 0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0
+};
+
+// endgame king scores (the king becomes an active piece and heads for the center)
+const int king_endgame_scores[64] = {
+	-50,-30,-30,-30,-30,-30,-30,-50,
+	-30,-10,  0,  0,  0,  0,-10,-30,
+	-30,  0, 20, 30, 30, 20,  0,-30,
+	-30,  0, 30, 40, 40, 30,  0,-30,
+	-30,  0, 30, 40, 40, 30,  0,-30,
+	-30,  0, 20, 30, 30, 20,  0,-30,
+	-30,-10,  0,  0,  0,  0,-10,-30,
+	-50,-30,-30,-30,-30,-30,-30,-50
+};